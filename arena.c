@@ -0,0 +1,146 @@
+#include "arena.h"
+#include "profiler.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @struct ArenaBlock
+ * @brief Header of a block; the block's memory follows it.
+ */
+struct ArenaBlock {
+    ArenaBlock *next;   /**< Next block of the chain. */
+    size_t capacity;    /**< Usable bytes after the header. */
+    size_t used;        /**< Bytes handed out from this block. */
+};
+
+// Size of the block header, rounded so that the data starts aligned
+#define ARENA_HEADER_SIZE ((sizeof(ArenaBlock) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+// Returns the start of the memory of a block.
+static inline char *blockData(ArenaBlock *block) {
+    return (char *)block + ARENA_HEADER_SIZE;
+}
+
+// Initializes an empty arena.
+void arenaInit(Arena *arena, size_t blockSize, int phase) {
+    arena->first = NULL;
+    arena->current = NULL;
+    arena->blockSize = blockSize > 0 ? blockSize : ARENA_DEFAULT_BLOCK_SIZE;
+    arena->phase = phase;
+}
+
+// Allocates from the current block, moving on to the kept blocks or a new one when it is full.
+void *arenaAlloc(Arena *arena, size_t size) {
+    size = size > 0 ? (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1) : ARENA_ALIGNMENT;
+    profileCount(arena->phase, PROFILE_ARENA_BYTES, size);
+
+    ArenaBlock *block = arena->current;
+    if (!block || block->used + size > block->capacity) {
+        // Blocks after the current one hold nothing live since the last reset
+        ArenaBlock *last = block;
+        block = block ? block->next : arena->first;
+        while (block) {
+            block->used = 0;
+            if (size <= block->capacity) {
+                break;
+            }
+            last = block;
+            block = block->next;
+        }
+
+        if (!block) {
+            while (last && last->next) {
+                last = last->next;
+            }
+            size_t capacity = size > arena->blockSize ? size : arena->blockSize;
+            block = malloc(ARENA_HEADER_SIZE + capacity);
+            if (!block) {
+                return NULL;
+            }
+            profileCount(arena->phase, PROFILE_ALLOCATIONS, 1);
+            block->next = NULL;
+            block->capacity = capacity;
+            block->used = 0;
+            if (last) {
+                last->next = block;
+            } else {
+                arena->first = block;
+            }
+        }
+        arena->current = block;
+    }
+
+    void *memory = blockData(block) + block->used;
+    block->used += size;
+    return memory;
+}
+
+// Allocates zeroed memory from an arena.
+void *arenaCalloc(Arena *arena, size_t count, size_t size) {
+    void *memory = arenaAlloc(arena, count * size);
+    if (memory) {
+        memset(memory, 0, count * size);
+    }
+    return memory;
+}
+
+// Returns the current position of an arena.
+ArenaMark arenaMark(const Arena *arena) {
+    ArenaMark mark = {arena->current, arena->current ? arena->current->used : 0};
+    return mark;
+}
+
+// Releases every allocation made since a mark.
+void arenaReset(Arena *arena, ArenaMark mark) {
+    arena->current = mark.block;
+    if (mark.block) {
+        mark.block->used = mark.used;
+    }
+}
+
+// Releases every allocation of an arena.
+void arenaClear(Arena *arena) {
+    arena->current = NULL;
+}
+
+// Frees the blocks of an arena.
+void arenaFree(Arena *arena) {
+    ArenaBlock *block = arena->first;
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->first = NULL;
+    arena->current = NULL;
+}
+
+// Key whose destructor frees the scratch arena of an exiting thread
+static pthread_key_t scratchKey;
+static pthread_once_t scratchOnce = PTHREAD_ONCE_INIT;
+static __thread Arena scratch;
+static __thread int scratchReady = 0;
+
+// Frees the scratch arena of an exiting thread.
+static void freeScratchArena(void *arena) {
+    arenaFree(arena);
+}
+
+// Creates the key of the scratch arenas.
+static void createScratchKey(void) {
+    pthread_key_create(&scratchKey, freeScratchArena);
+}
+
+// Returns the scratch arena of the calling thread, creating it on first use.
+Arena *scratchArena(int phase) {
+    if (!scratchReady) {
+        pthread_once(&scratchOnce, createScratchKey);
+        arenaInit(&scratch, 0, phase);
+        pthread_setspecific(scratchKey, &scratch);
+        scratchReady = 1;
+    }
+    scratch.phase = phase;
+    return &scratch;
+}
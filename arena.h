@@ -0,0 +1,116 @@
+/**
+ * @file arena.h
+ * @brief Header file for the arena (bump) allocator and the per-thread scratch arenas.
+ *
+ * An arena hands out memory by advancing an offset inside large blocks. Nothing is
+ * freed individually: a mark taken before a group of allocations is passed to
+ * arenaReset to release them all at once. Blocks are kept when the arena is reset,
+ * so a loop that resets its arena every iteration stops calling malloc once the
+ * first iteration has grown the arena to its working size.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Size of a new block when the request fits in it
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+// Alignment of every allocation, enough for doubles and vector loads
+#define ARENA_ALIGNMENT 16
+
+/** Block of memory owned by an arena; the data follows the header. */
+typedef struct ArenaBlock ArenaBlock;
+
+/**
+ * @struct Arena
+ * @brief Bump allocator made of a chain of blocks.
+ */
+typedef struct {
+    ArenaBlock *first;     /**< First block of the chain, NULL before the first allocation. */
+    ArenaBlock *current;   /**< Block allocations are currently taken from. */
+    size_t blockSize;      /**< Minimum size of a new block. */
+    int phase;             /**< PROFILE_* phase new blocks and allocated bytes are counted in. */
+} Arena;
+
+/**
+ * @struct ArenaMark
+ * @brief Position of an arena, returned by arenaMark and restored by arenaReset.
+ */
+typedef struct {
+    ArenaBlock *block;   /**< Current block when the mark was taken. */
+    size_t used;         /**< Bytes used in that block. */
+} ArenaMark;
+
+/**
+ * @brief Initializes an empty arena; no memory is allocated until the first request.
+ *
+ * @param arena Arena to initialize.
+ * @param blockSize Minimum size of a block, 0 for ARENA_DEFAULT_BLOCK_SIZE.
+ * @param phase PROFILE_* phase the arena's allocations are counted in.
+ */
+void arenaInit(Arena *arena, size_t blockSize, int phase);
+
+/**
+ * @brief Allocates memory from an arena.
+ *
+ * @param arena Arena to allocate from.
+ * @param size Number of bytes.
+ * @return Memory aligned to ARENA_ALIGNMENT, or NULL if a new block cannot be allocated.
+ */
+void *arenaAlloc(Arena *arena, size_t size);
+
+/**
+ * @brief Allocates zeroed memory from an arena.
+ *
+ * @param arena Arena to allocate from.
+ * @param count Number of elements.
+ * @param size Size of one element.
+ * @return Zeroed memory, or NULL if a new block cannot be allocated.
+ */
+void *arenaCalloc(Arena *arena, size_t count, size_t size);
+
+/**
+ * @brief Returns the current position of an arena.
+ *
+ * @param arena Arena to mark.
+ * @return Mark to pass to arenaReset.
+ */
+ArenaMark arenaMark(const Arena *arena);
+
+/**
+ * @brief Releases every allocation made since a mark; the blocks are kept for reuse.
+ *
+ * @param arena Arena to reset.
+ * @param mark Mark returned by arenaMark on the same arena.
+ */
+void arenaReset(Arena *arena, ArenaMark mark);
+
+/**
+ * @brief Releases every allocation of an arena; the blocks are kept for reuse.
+ *
+ * @param arena Arena to clear.
+ */
+void arenaClear(Arena *arena);
+
+/**
+ * @brief Frees the blocks of an arena.
+ *
+ * @param arena Arena to free; it may be reused after arenaInit.
+ */
+void arenaFree(Arena *arena);
+
+/**
+ * @brief Returns the scratch arena of the calling thread.
+ *
+ * Scratch memory is for temporaries that do not outlive the function using them: take
+ * a mark, allocate, and reset to the mark before returning. The arena is freed when
+ * the thread exits.
+ *
+ * @param phase PROFILE_* phase the following allocations are counted in.
+ * @return The calling thread's scratch arena.
+ */
+Arena *scratchArena(int phase);
+
+#endif // ARENA_H
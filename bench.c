@@ -0,0 +1,597 @@
+/**
+ * @file bench.c
+ * @brief Micro and macro benchmark suite.
+ *
+ * Micro-benchmarks time the hot library functions (distances, k-NN voting, one k-Means
+ * iteration, silhouette, file reading and normalization); macro-benchmarks time the
+ * end-to-end k-NN and k-Means pipelines on every descriptor set. Each benchmark is run
+ * for a number of warmup rounds followed by timed repetitions, and the median, p95,
+ * minimum and mean are written as JSON so that runs can be compared over time.
+ * The PCA curve times k-NN on the projected features for several component counts and
+ * records the accuracy next to the timings, so the speed/accuracy trade-off is visible.
+ * The reference store churn removes three quarters of an updatable reference set and
+ * inserts them again, timing the tombstones, the compactions and the refit.
+ */
+
+#include "data_reader.h"
+#include "normalization.h"
+#include "preprocessing.h"
+#include "pca.h"
+#include "data_split.h"
+#include "knn.h"
+#include "knn_batch.h"
+#include "kmeans.h"
+#include "kmeans_evaluation.h"
+#include "confusion_matrix.h"
+#include "reference_store.h"
+
+#include <omp.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_WARMUP 3
+#define BENCH_DEFAULT_REPETITIONS 21
+#define BENCH_DISTANCE_CALLS 10000
+#define BENCH_MAX_ITERATIONS 100
+
+/**
+ * @struct BenchOptions
+ * @brief Stores command line options of the benchmark suite.
+ */
+typedef struct {
+    const char *assets;   /**< Directory containing the descriptor sets. */
+    const char *output;   /**< Path of the JSON report, NULL for the standard output. */
+    const char *filter;   /**< Only run benchmarks whose name contains this string, NULL for all. */
+    int warmup;           /**< Untimed rounds before the repetitions. */
+    int repetitions;      /**< Timed rounds. */
+} BenchOptions;
+
+/**
+ * @struct BenchDescriptor
+ * @brief Location of one descriptor set below the assets directory.
+ */
+typedef struct {
+    const char *name;        /**< Name reported in the benchmark names. */
+    const char *directory;   /**< Directory relative to the assets directory. */
+    const char *extension;   /**< Extension of the data files. */
+} BenchDescriptor;
+
+static const BenchDescriptor descriptors[] = {
+    {"E34", "E34/E34", ".E34"},
+    {"F0", "F0", ".F0"},
+    {"GFD", "GFD", ".GFD"},
+    {"SA", "SA", ".SA"},
+};
+static const int descriptorCount = sizeof(descriptors) / sizeof(descriptors[0]);
+
+/**
+ * @struct BenchResult
+ * @brief Timing statistics of one benchmark, in microseconds per repetition.
+ */
+typedef struct {
+    char name[64];
+    const char *group;   /**< "micro" or "macro". */
+    long operations;     /**< Operations performed by one repetition. */
+    double median;
+    double p95;
+    double min;
+    double mean;
+    double accuracy;     /**< Test accuracy of the last repetition, negative when not measured. */
+} BenchResult;
+
+/**
+ * Function timed by the harness.
+ * @param arg Benchmark state prepared by the caller.
+ */
+typedef void (*BenchFunction)(void *arg);
+
+// State shared by the benchmarks of one descriptor set.
+typedef struct {
+    const char *directory;
+    const char *extension;
+    ShapeData *shapes;
+    int count;
+    int featureCount;
+    SplitData split;
+    double **distances;
+    Cluster *clusters;
+    int p;
+    int k;
+    KnnBatchClassifier classifier;   /**< Batch classifier over the training split. */
+    double *queryMatrix;             /**< Test split as a row-major matrix. */
+    int *predictions;
+} BenchContext;
+
+// State of the Minkowski distance benchmark.
+typedef struct {
+    ShapeData a;
+    ShapeData b;
+    int featureCount;
+    int p;
+    double sink;   /**< Keeps the compiler from dropping the calls. */
+} DistanceContext;
+
+// State of one point of the PCA speed/accuracy curve.
+typedef struct {
+    ShapeData *trainingSet;   /**< Projected copy of the training split. */
+    int trainingSize;
+    ShapeData *testSet;       /**< Projected copy of the test split. */
+    int testSize;
+    int featureCount;         /**< Number of kept components. */
+    int classCount;
+    int p;
+    int k;
+    double accuracy;          /**< Accuracy of the last run. */
+} PcaContext;
+
+static BenchResult *results = NULL;
+static int resultCount = 0;
+static int resultCapacity = 0;
+
+// Returns the current monotonic time in microseconds.
+static double nowMicros(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e6 + time.tv_nsec / 1e3;
+}
+
+// Comparator for sorting timings in ascending order.
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Frees clusters returned by kmeans().
+static void freeClusters(Cluster *clusters, int k) {
+    if (!clusters) return;
+    for (int i = 0; i < k; i++) {
+        if (clusters[i].centroid) {
+            free(clusters[i].centroid->features);
+            free(clusters[i].centroid);
+        }
+        free(clusters[i].points);
+    }
+    free(clusters);
+}
+
+// Runs one benchmark and records its statistics; returns NULL when it is filtered out.
+static BenchResult *runBenchmark(const BenchOptions *options, const char *group, const char *name, long operations,
+                         BenchFunction function, void *arg) {
+    if (options->filter && !strstr(name, options->filter)) {
+        return NULL;
+    }
+    if (resultCount == resultCapacity) {
+        resultCapacity = resultCapacity ? 2 * resultCapacity : 32;
+        results = realloc(results, resultCapacity * sizeof(BenchResult));
+        if (!results) {
+            fprintf(stderr, "Memory allocation failed for benchmark results\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    double *samples = malloc(options->repetitions * sizeof(double));
+    if (!samples) {
+        fprintf(stderr, "Memory allocation failed for benchmark samples\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < options->warmup; i++) {
+        function(arg);
+    }
+    double total = 0;
+    for (int i = 0; i < options->repetitions; i++) {
+        double start = nowMicros();
+        function(arg);
+        samples[i] = nowMicros() - start;
+        total += samples[i];
+    }
+    qsort(samples, options->repetitions, sizeof(double), compareDoubles);
+
+    // p95 uses the nearest-rank definition
+    int p95Rank = (int)(0.95 * options->repetitions + 0.999999) - 1;
+    BenchResult *result = &results[resultCount++];
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->group = group;
+    result->operations = operations;
+    result->median = samples[options->repetitions / 2];
+    result->p95 = samples[p95Rank < 0 ? 0 : p95Rank];
+    result->min = samples[0];
+    result->mean = total / options->repetitions;
+    result->accuracy = -1;
+    free(samples);
+
+    fprintf(stderr, "%-40s median %12.2f us  p95 %12.2f us  (%.1f ns/op)\n", result->name, result->median,
+            result->p95, result->median * 1e3 / operations);
+    return result;
+}
+
+// Copies samples with their own feature arrays, so that they can be transformed in place.
+static ShapeData *copySamples(const ShapeData *samples, int count) {
+    ShapeData *copy = malloc(count * sizeof(ShapeData));
+    if (!copy) return NULL;
+    for (int i = 0; i < count; i++) {
+        copy[i] = samples[i];
+        copy[i].features = malloc(samples[i].featureCount * sizeof(double));
+        if (!copy[i].features) {
+            freeShapeData(copy, i);
+            return NULL;
+        }
+        memcpy(copy[i].features, samples[i].features, samples[i].featureCount * sizeof(double));
+    }
+    return copy;
+}
+
+// Benchmark: repeated Minkowski distances between two vectors.
+static void benchMinkowski(void *arg) {
+    DistanceContext *context = arg;
+    double sum = 0;
+    for (int i = 0; i < BENCH_DISTANCE_CALLS; i++) {
+        sum += minkowskiDistance(context->a, context->b, context->featureCount, context->p);
+    }
+    context->sink += sum;
+}
+
+// Benchmark: distances between the test and the training split.
+static void benchPrecomputeDistances(void *arg) {
+    BenchContext *context = arg;
+    double **distances = precomputeDistances(context->split.trainingSet, context->split.trainingSize,
+                                             context->split.testSet, context->split.testSize,
+                                             context->featureCount, context->p);
+    for (int i = 0; distances && i < context->split.testSize; i++) {
+        free(distances[i]);
+    }
+    free(distances);
+}
+
+// Benchmark: k-NN vote of every test sample from precomputed distances.
+static void benchKnnClassify(void *arg) {
+    BenchContext *context = arg;
+    for (int i = 0; i < context->split.testSize; i++) {
+        knnClassify(context->distances, i, context->split.trainingSet, context->split.trainingSize, context->k);
+    }
+}
+
+// Benchmark: the batch API classifying the test split on its worker pool.
+static void benchKnnBatch(void *arg) {
+    BenchContext *context = arg;
+    knnBatchClassify(&context->classifier, context->queryMatrix, context->split.testSize, context->featureCount,
+                     context->k, KNN_SEARCH_BRUTE_FORCE, context->predictions, NULL, NULL);
+}
+
+// Benchmark: fills a reference store, removes three quarters of it, inserts them again and refits.
+static void benchReferenceChurn(void *arg) {
+    BenchContext *context = arg;
+    const ShapeData *training = context->split.trainingSet;
+    int size = context->split.trainingSize, initialSize = size / 2, churn = size * 3 / 4;
+    ReferenceStore store;
+    int *ids = malloc(size * sizeof(int));
+    if (!ids || createReferenceStore(&store, training, initialSize, context->featureCount, context->p,
+                                     PREPROCESS_STANDARDIZE, 0) != REFERENCE_SUCCESS) {
+        fprintf(stderr, "Failed to create the reference store\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < size; i++) {
+        ids[i] = i < initialSize ? i : referenceStoreInsert(&store, training[i].features, training[i].class);
+    }
+    for (int i = 0; i < churn; i++) {
+        referenceStoreRemove(&store, ids[i]);
+    }
+    for (int i = 0; i < churn; i++) {
+        referenceStoreInsert(&store, training[i].features, training[i].class);
+    }
+    referenceStoreRefit(&store);
+    freeReferenceStore(&store);
+    free(ids);
+}
+
+// Benchmark: a single k-Means iteration.
+static void benchKmeansIteration(void *arg) {
+    BenchContext *context = arg;
+    freeClusters(kmeans(context->shapes, context->count, context->k, context->p, context->featureCount, 1),
+                 context->k);
+}
+
+// Benchmark: silhouette score of a clustering.
+static void benchSilhouette(void *arg) {
+    BenchContext *context = arg;
+    silhouetteScore(context->clusters, context->k, context->featureCount);
+}
+
+// Benchmark: reading every file of a descriptor set.
+static void benchReadAllFiles(void *arg) {
+    BenchContext *context = arg;
+    int count;
+    ShapeData *shapes = readAllFiles(context->directory, context->extension, &count);
+    if (shapes) {
+        freeShapeData(shapes, count);
+    }
+}
+
+// Benchmark: min-max normalization (repeated normalization does the same work).
+static void benchNormalization(void *arg) {
+    BenchContext *context = arg;
+    normalizeData(context->shapes, context->count, context->featureCount);
+}
+
+// Benchmark: read, split, standardize, classify and score with k-NN.
+static void benchKnnPipeline(void *arg) {
+    BenchContext *context = arg;
+    int count;
+    ShapeData *shapes = readAllFiles(context->directory, context->extension, &count);
+    if (!shapes) return;
+    SplitData split = splitData(shapes, count, 0.8f, false, SPLIT_DEFAULT_SEED);
+    PreprocessingParams preprocessing = fitPreprocessing(split.trainingSet, split.trainingSize, shapes->featureCount,
+                                                         PREPROCESS_STANDARDIZE);
+    applyPreprocessing(&preprocessing, split.trainingSet, split.trainingSize);
+    applyPreprocessing(&preprocessing, split.testSet, split.testSize);
+
+    double **distances = precomputeDistances(split.trainingSet, split.trainingSize, split.testSet, split.testSize,
+                                             shapes->featureCount, context->p);
+    ConfusionMatrix cm = createConfusionMatrix(countClasses(shapes, count));
+    for (int i = 0; distances && i < split.testSize; i++) {
+        updateConfusionMatrix(&cm, split.testSet[i].class,
+                              knnClassify(distances, i, split.trainingSet, split.trainingSize, context->k));
+        free(distances[i]);
+    }
+    ConfusionMatrixMetrics metrics = calculateStatistics(&cm);
+
+    freeConfusionMatrixMetrics(&metrics);
+    freeConfusionMatrix(&cm);
+    free(distances);
+    freePreprocessingParams(&preprocessing);
+    freeSplitData(&split);
+    freeShapeData(shapes, count);
+}
+
+// Benchmark: read, standardize, cluster and score with k-Means.
+static void benchKmeansPipeline(void *arg) {
+    BenchContext *context = arg;
+    int count;
+    ShapeData *shapes = readAllFiles(context->directory, context->extension, &count);
+    if (!shapes) return;
+    PreprocessingParams preprocessing = fitPreprocessing(shapes, count, shapes->featureCount, PREPROCESS_STANDARDIZE);
+    applyPreprocessing(&preprocessing, shapes, count);
+
+    Cluster *clusters = kmeans(shapes, count, context->k, context->p, shapes->featureCount, BENCH_MAX_ITERATIONS);
+    if (clusters) {
+        silhouetteScore(clusters, context->k, shapes->featureCount);
+    }
+
+    freeClusters(clusters, context->k);
+    freePreprocessingParams(&preprocessing);
+    freeShapeData(shapes, count);
+}
+
+// Benchmark: k-NN distances and votes on PCA-projected features.
+static void benchPcaKnn(void *arg) {
+    PcaContext *context = arg;
+    double **distances = precomputeDistances(context->trainingSet, context->trainingSize, context->testSet,
+                                             context->testSize, context->featureCount, context->p);
+    int *predictions = malloc(context->testSize * sizeof(int));
+    if (!distances || !predictions) {
+        fprintf(stderr, "Memory allocation failed for the PCA benchmark\n");
+        exit(EXIT_FAILURE);
+    }
+    ConfusionMatrix cm = createConfusionMatrix(context->classCount);
+    knnClassifyBatch(distances, context->trainingSet, context->trainingSize, context->testSet, context->testSize,
+                     context->k, &cm, predictions);
+    int correct = 0;
+    for (int i = 0; i < context->testSize; i++) {
+        correct += predictions[i] == context->testSet[i].class;
+    }
+    context->accuracy = context->testSize > 0 ? (double)correct / context->testSize : 0;
+
+    freeConfusionMatrix(&cm);
+    free(predictions);
+    for (int i = 0; i < context->testSize; i++) {
+        free(distances[i]);
+    }
+    free(distances);
+}
+
+// Runs the PCA speed/accuracy curve of one descriptor set, from 4 components up to all of them.
+static void runPcaBenchmarks(const BenchOptions *options, const BenchDescriptor *descriptor,
+                             const BenchContext *base) {
+    static const int components[] = {4, 8, 16, 32, 0};
+    for (int c = 0; c < (int)(sizeof(components) / sizeof(components[0])); c++) {
+        int r = components[c] > 0 ? components[c] : base->featureCount;
+        if (components[c] > 0 && r >= base->featureCount) continue;
+
+        char name[64];
+        snprintf(name, sizeof(name), "pca_knn_%s_r%d", descriptor->name, r);
+        if (options->filter && !strstr(name, options->filter)) continue;
+
+        // The projection is fitted outside the timed function, which only sees the reduced features
+        PcaContext context = {copySamples(base->split.trainingSet, base->split.trainingSize),
+                              base->split.trainingSize, copySamples(base->split.testSet, base->split.testSize),
+                              base->split.testSize, r, countClasses(base->shapes, base->count), base->p, base->k, 0};
+        if (!context.trainingSet || !context.testSet) {
+            fprintf(stderr, "Memory allocation failed for the PCA benchmark\n");
+            exit(EXIT_FAILURE);
+        }
+        PreprocessingParams preprocessing = fitPreprocessing(context.trainingSet, context.trainingSize,
+                                                             base->featureCount, PREPROCESS_STANDARDIZE);
+        if (fitPca(&preprocessing, context.trainingSet, context.trainingSize, r, 0) != PCA_SUCCESS) {
+            fprintf(stderr, "Failed to fit PCA for %s\n", name);
+            exit(EXIT_FAILURE);
+        }
+        applyPreprocessing(&preprocessing, context.trainingSet, context.trainingSize);
+        applyPreprocessing(&preprocessing, context.testSet, context.testSize);
+
+        BenchResult *result = runBenchmark(options, "macro", name, context.testSize, benchPcaKnn, &context);
+        result->accuracy = context.accuracy;
+        fprintf(stderr, "%-40s accuracy %.4f, %.2f%% of the variance\n", name, context.accuracy,
+                preprocessing.explainedVariance * 100);
+
+        freePreprocessingParams(&preprocessing);
+        freeShapeData(context.trainingSet, context.trainingSize);
+        freeShapeData(context.testSet, context.testSize);
+    }
+}
+
+// Runs the Minkowski distance benchmarks for every p and descriptor dimension.
+static void runDistanceBenchmarks(const BenchOptions *options) {
+    static const int dimensions[] = {16, 90, 100, 128};
+    double a[128], b[128];
+    for (int i = 0; i < 128; i++) {
+        a[i] = (double)rand() / RAND_MAX;
+        b[i] = (double)rand() / RAND_MAX;
+    }
+
+    for (int p = 1; p <= 3; p++) {
+        for (int d = 0; d < 4; d++) {
+            DistanceContext context = {{0, 0, a, dimensions[d]}, {0, 0, b, dimensions[d]}, dimensions[d], p, 0};
+            char name[64];
+            snprintf(name, sizeof(name), "minkowski_p%d_d%d", p, dimensions[d]);
+            runBenchmark(options, "micro", name, BENCH_DISTANCE_CALLS, benchMinkowski, &context);
+        }
+    }
+}
+
+// Runs the micro and macro benchmarks of one descriptor set.
+static void runDescriptorBenchmarks(const BenchOptions *options, const BenchDescriptor *descriptor) {
+    char directory[1024];
+    snprintf(directory, sizeof(directory), "%s/%s", options->assets, descriptor->directory);
+
+    BenchContext context = {directory, descriptor->extension, NULL, 0, 0, {0}, NULL, NULL, 2, 9, {0}, NULL, NULL};
+    context.shapes = readAllFiles(directory, descriptor->extension, &context.count);
+    if (!context.shapes) {
+        fprintf(stderr, "Skipping %s: failed to read %s\n", descriptor->name, directory);
+        return;
+    }
+    context.featureCount = context.shapes->featureCount;
+    context.split = splitData(context.shapes, context.count, 0.8f, false, SPLIT_DEFAULT_SEED);
+    context.distances = precomputeDistances(context.split.trainingSet, context.split.trainingSize,
+                                            context.split.testSet, context.split.testSize,
+                                            context.featureCount, context.p);
+    context.clusters = kmeans(context.shapes, context.count, context.k, context.p, context.featureCount,
+                              BENCH_MAX_ITERATIONS);
+    context.queryMatrix = malloc((size_t)context.split.testSize * context.featureCount * sizeof(double));
+    context.predictions = malloc(context.split.testSize * sizeof(int));
+    if (!context.distances || !context.clusters || !context.queryMatrix || !context.predictions ||
+        createKnnBatchClassifier(&context.classifier, context.split.trainingSet, context.split.trainingSize,
+                                 context.featureCount, context.p, 0) != KNN_BATCH_SUCCESS) {
+        fprintf(stderr, "Failed to prepare the %s benchmarks\n", descriptor->name);
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < context.split.testSize; i++) {
+        memcpy(context.queryMatrix + (size_t)i * context.featureCount, context.split.testSet[i].features,
+               context.featureCount * sizeof(double));
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "read_all_files_%s", descriptor->name);
+    runBenchmark(options, "micro", name, context.count, benchReadAllFiles, &context);
+    snprintf(name, sizeof(name), "precompute_distances_%s", descriptor->name);
+    runBenchmark(options, "micro", name, (long)context.split.trainingSize * context.split.testSize,
+                 benchPrecomputeDistances, &context);
+    snprintf(name, sizeof(name), "knn_classify_%s", descriptor->name);
+    runBenchmark(options, "micro", name, context.split.testSize, benchKnnClassify, &context);
+    snprintf(name, sizeof(name), "knn_batch_%s", descriptor->name);
+    runBenchmark(options, "micro", name, context.split.testSize, benchKnnBatch, &context);
+    snprintf(name, sizeof(name), "reference_churn_%s", descriptor->name);
+    runBenchmark(options, "micro", name, 2 * context.split.trainingSize, benchReferenceChurn, &context);
+    snprintf(name, sizeof(name), "kmeans_iteration_%s", descriptor->name);
+    runBenchmark(options, "micro", name, context.count, benchKmeansIteration, &context);
+    snprintf(name, sizeof(name), "silhouette_%s", descriptor->name);
+    runBenchmark(options, "micro", name, context.count, benchSilhouette, &context);
+    snprintf(name, sizeof(name), "normalization_%s", descriptor->name);
+    runBenchmark(options, "micro", name, context.count, benchNormalization, &context);
+    snprintf(name, sizeof(name), "knn_end_to_end_%s", descriptor->name);
+    runBenchmark(options, "macro", name, context.split.testSize, benchKnnPipeline, &context);
+    snprintf(name, sizeof(name), "kmeans_end_to_end_%s", descriptor->name);
+    runBenchmark(options, "macro", name, context.count, benchKmeansPipeline, &context);
+    runPcaBenchmarks(options, descriptor, &context);
+
+    freeKnnBatchClassifier(&context.classifier);
+    free(context.queryMatrix);
+    free(context.predictions);
+    freeClusters(context.clusters, context.k);
+    for (int i = 0; i < context.split.testSize; i++) {
+        free(context.distances[i]);
+    }
+    free(context.distances);
+    freeSplitData(&context.split);
+    freeShapeData(context.shapes, context.count);
+}
+
+// Writes the recorded results as JSON.
+static int writeReport(const BenchOptions *options, FILE *output) {
+    time_t now = time(NULL);
+    char timestamp[32];
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fprintf(output, "{\n");
+    fprintf(output, "  \"timestamp\": \"%s\",\n", timestamp);
+    fprintf(output, "  \"warmup\": %d,\n", options->warmup);
+    fprintf(output, "  \"repetitions\": %d,\n", options->repetitions);
+    fprintf(output, "  \"threads\": %d,\n", omp_get_max_threads());
+    fprintf(output, "  \"unit\": \"us\",\n");
+    fprintf(output, "  \"results\": [\n");
+    for (int i = 0; i < resultCount; i++) {
+        const BenchResult *r = &results[i];
+        fprintf(output, "    {\"name\": \"%s\", \"group\": \"%s\", \"operations\": %ld, \"median\": %.3f, "
+                        "\"p95\": %.3f, \"min\": %.3f, \"mean\": %.3f, \"median_ns_per_op\": %.3f",
+                r->name, r->group, r->operations, r->median, r->p95, r->min, r->mean,
+                r->median * 1e3 / r->operations);
+        if (r->accuracy >= 0) {
+            fprintf(output, ", \"accuracy\": %.4f", r->accuracy);
+        }
+        fprintf(output, "}%s\n", i + 1 < resultCount ? "," : "");
+    }
+    fprintf(output, "  ]\n}\n");
+    return fflush(output) == 0 && !ferror(output) ? 0 : -1;
+}
+
+// Prints the usage message of the benchmark suite.
+static void printBenchUsage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [-a <assets_directory>] [-w <warmup>] [-n <repetitions>] [-f <name_filter>] [-o <json_output>]\n",
+            program_name);
+}
+
+int main(int argc, char *argv[]) {
+    BenchOptions options = {"assets", NULL, NULL, BENCH_DEFAULT_WARMUP, BENCH_DEFAULT_REPETITIONS};
+    int opt;
+    while ((opt = getopt(argc, argv, "a:w:n:f:o:")) != -1) {
+        switch (opt) {
+            case 'a':
+                options.assets = optarg;
+                break;
+            case 'w':
+                options.warmup = atoi(optarg);
+                break;
+            case 'n':
+                options.repetitions = atoi(optarg);
+                break;
+            case 'f':
+                options.filter = optarg;
+                break;
+            case 'o':
+                options.output = optarg;
+                break;
+            default:
+                printBenchUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (options.warmup < 0 || options.repetitions <= 0) {
+        printBenchUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    runDistanceBenchmarks(&options);
+    for (int i = 0; i < descriptorCount; i++) {
+        runDescriptorBenchmarks(&options, &descriptors[i]);
+    }
+
+    FILE *output = options.output ? fopen(options.output, "w") : stdout;
+    if (!output) {
+        perror("Failed to open the benchmark report");
+        return EXIT_FAILURE;
+    }
+    int status = writeReport(&options, output);
+    if (options.output) {
+        fclose(output);
+    }
+    free(results);
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
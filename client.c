@@ -0,0 +1,202 @@
+/**
+ * @file client.c
+ * @brief Local client for the classification server.
+ *
+ * Reads descriptor files from a directory, sends them to a running server over its
+ * Unix domain socket from several threads and prints the resulting confusion matrix,
+ * the throughput and the latency counters reported by the server.
+ */
+
+#include "server.h"
+#include "data_reader.h"
+#include "confusion_matrix.h"
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @struct ClientOptions
+ * @brief Stores command line options of the client.
+ */
+typedef struct {
+    char *socketPath;   /**< Path of the server socket. */
+    char *directory;    /**< Directory containing the query files. */
+    char *extension;    /**< Extension of the query files. */
+    int k;              /**< Neighbors requested from a k-NN model, 0 for the model default. */
+    int threads;        /**< Number of concurrent connections. */
+    int statsOnly;      /**< Only print the server counters. */
+    int shutdown;       /**< Ask the server to stop once done. */
+} ClientOptions;
+
+/**
+ * @struct ClientWorker
+ * @brief Work assigned to one client thread.
+ */
+typedef struct {
+    const ClientOptions *options;
+    ShapeData *queries;     /**< All query samples. */
+    int first;              /**< First query handled by this worker. */
+    int step;               /**< Stride between the queries of this worker. */
+    int count;              /**< Total number of queries. */
+    int *predictions;       /**< Shared array of predicted classes. */
+    int failures;           /**< Requests that did not get an answer. */
+} ClientWorker;
+
+// Connects to the server socket.
+static int connectToServer(const char *path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Sends one request frame with an optional feature payload and reads the response.
+static int sendRequest(int fd, uint32_t type, const double *features, int featureCount, int k, ServerResponse *response) {
+    ServerRequest request = {SERVER_MAGIC, type, (uint32_t)featureCount, k};
+    if (writeFully(fd, &request, sizeof(request)) != SERVER_SUCCESS ||
+        (featureCount > 0 && writeFully(fd, features, featureCount * sizeof(double)) != SERVER_SUCCESS) ||
+        readFully(fd, response, sizeof(*response)) != SERVER_SUCCESS || response->magic != SERVER_MAGIC) {
+        return SERVER_ERR_SOCKET;
+    }
+    return response->status;
+}
+
+// Worker thread: classifies every step-th query over its own connection.
+static void *clientThread(void *args) {
+    ClientWorker *worker = args;
+    int fd = connectToServer(worker->options->socketPath);
+    for (int i = worker->first; i < worker->count; i += worker->step) {
+        ServerResponse response;
+        if (fd < 0 || sendRequest(fd, SERVER_REQUEST_CLASSIFY, worker->queries[i].features,
+                                  worker->queries[i].featureCount, worker->options->k, &response) != SERVER_SUCCESS) {
+            worker->predictions[i] = -1;
+            worker->failures++;
+            continue;
+        }
+        worker->predictions[i] = response.predictedClass;
+    }
+    if (fd >= 0) close(fd);
+    return NULL;
+}
+
+// Prints the counters reported by the server.
+static void printServerStats(const ServerStats *stats) {
+    printf("Server Requests: %llu, Batches: %llu, Mean Batch Size: %.2f\n",
+           (unsigned long long)stats->requestCount, (unsigned long long)stats->batchCount, stats->meanBatchSize);
+    printf("Server Latency p50: %.1f us, p99: %.1f us, max: %.1f us\n", stats->p50Micros, stats->p99Micros, stats->maxMicros);
+}
+
+// Sends a stats or shutdown request on a fresh connection.
+static int sendControl(const char *socketPath, uint32_t type) {
+    int fd = connectToServer(socketPath);
+    ServerResponse response;
+    if (fd < 0 || sendRequest(fd, type, NULL, 0, 0, &response) != SERVER_SUCCESS) {
+        fprintf(stderr, "Unable to reach server on %s\n", socketPath);
+        if (fd >= 0) close(fd);
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    printServerStats(&response.stats);
+    return EXIT_SUCCESS;
+}
+
+// Classifies all query files through the server.
+static int classifyDirectory(const ClientOptions *options) {
+    int count;
+    ShapeData *queries = readAllFiles(options->directory, options->extension, &count);
+    int *predictions = malloc(count * sizeof(int));
+    ClientWorker *workers = calloc(options->threads, sizeof(ClientWorker));
+    pthread_t *threads = malloc(options->threads * sizeof(pthread_t));
+    if (!predictions || !workers || !threads) {
+        fprintf(stderr, "Memory allocation failed for client workers\n");
+        exit(ERR_MEMORY_ALLOCATION_FAILED);
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int t = 0; t < options->threads; t++) {
+        workers[t] = (ClientWorker){options, queries, t, options->threads, count, predictions, 0};
+        pthread_create(&threads[t], NULL, clientThread, &workers[t]);
+    }
+    int failures = 0;
+    for (int t = 0; t < options->threads; t++) {
+        pthread_join(threads[t], NULL);
+        failures += workers[t].failures;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    int classCount = countClasses(queries, count);
+    for (int i = 0; i < count; i++) {
+        if (predictions[i] > classCount) {
+            classCount = predictions[i];
+        }
+    }
+    ConfusionMatrix cm = createConfusionMatrix(classCount);
+    for (int i = 0; i < count; i++) {
+        updateConfusionMatrix(&cm, queries[i].class, predictions[i]);
+    }
+    printDetailedConfusionMatrix(cm);
+    printf("\nClassified %d samples (%d failed) in %.3f s, %.0f requests/s\n", count, failures, seconds, count / seconds);
+
+    freeConfusionMatrix(&cm);
+    free(threads);
+    free(workers);
+    free(predictions);
+    freeShapeData(queries, count);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Prints the usage message for the client.
+static void printUsage(const char *program_name) {
+    fprintf(stderr, "Usage: %s -s <socket> -d <directory> -e <file_extension> [-k <k-value>] [-c <connections>] [-q]\n", program_name);
+    fprintf(stderr, "       %s -s <socket> -t   (print server statistics)\n", program_name);
+    fprintf(stderr, "       %s -s <socket> -q   (shut the server down)\n", program_name);
+}
+
+int main(int argc, char *argv[]) {
+    ClientOptions options = {NULL, NULL, NULL, 0, 4, 0, 0};
+    int opt;
+    while ((opt = getopt(argc, argv, "s:d:e:k:c:tq")) != -1) {
+        switch (opt) {
+            case 's': options.socketPath = optarg; break;
+            case 'd': options.directory = optarg; break;
+            case 'e': options.extension = optarg; break;
+            case 'k': options.k = atoi(optarg); break;
+            case 'c': options.threads = atoi(optarg); break;
+            case 't': options.statsOnly = 1; break;
+            case 'q': options.shutdown = 1; break;
+            default:
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    int classify = options.directory && options.extension;
+    if (!options.socketPath || options.threads <= 0 || (!classify && !options.statsOnly && !options.shutdown)) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+    if (classify) {
+        status = classifyDirectory(&options);
+    }
+    if (options.statsOnly || classify) {
+        status |= sendControl(options.socketPath, SERVER_REQUEST_STATS);
+    }
+    if (options.shutdown) {
+        status |= sendControl(options.socketPath, SERVER_REQUEST_SHUTDOWN);
+    }
+    return status;
+}
@@ -0,0 +1,400 @@
+#include "compressed_search.h"
+#include "kmeans.h"
+#include "profiler.h"
+#include "arena.h"
+#include "random.h"
+
+#include <float.h>
+
+// Converts a compression method name to its constant.
+int parseCompressionMethod(const char *name) {
+    if (strcmp(name, "rp") == 0) {
+        return COMPRESS_RANDOM_PROJECTION;
+    } else if (strcmp(name, "pq") == 0) {
+        return COMPRESS_PRODUCT_QUANTIZATION;
+    }
+    return COMPRESSED_ERR_INVALID_INPUT;
+}
+
+// Draws a standard normal value with the Box-Muller transform.
+static double nextGaussian(uint64_t *state) {
+    // The uniform values lie in (0, 1], so the logarithm is finite
+    double u1 = ((nextRandom(state) >> 11) + 1) * 0x1.0p-53;
+    double u2 = ((nextRandom(state) >> 11) + 1) * 0x1.0p-53;
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+// Draws the projection matrix and projects every training sample.
+static int buildRandomProjection(CompressedIndex *index, uint64_t seed) {
+    int d = index->featureCount, r = index->codeSize;
+    index->projection = malloc((size_t)r * d * sizeof(double));
+    index->projected = malloc((size_t)index->trainingSize * r * sizeof(float));
+    if (!index->projection || !index->projected) {
+        return COMPRESSED_ERR_MEMORY;
+    }
+    profileCount(PROFILE_PREPROCESS, PROFILE_ALLOCATIONS, 2);
+
+    // Entries of variance 1 / r keep the expected squared norm of a projected vector
+    uint64_t state = seed;
+    double scale = 1.0 / sqrt(r);
+    for (size_t i = 0; i < (size_t)r * d; i++) {
+        index->projection[i] = nextGaussian(&state) * scale;
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < index->trainingSize; i++) {
+        compressedEncode(index, index->trainingSet[i].features, index->projected + (size_t)i * r);
+    }
+    return COMPRESSED_SUCCESS;
+}
+
+// Frees clusters returned by kmeans().
+static void freeClusters(Cluster *clusters, int k) {
+    for (int i = 0; i < k; i++) {
+        free(clusters[i].centroid->features);
+        free(clusters[i].centroid);
+        free(clusters[i].points);
+    }
+    free(clusters);
+}
+
+// Trains the codebook of one subspace with k-Means on the training sub-vectors.
+static int trainCodebook(CompressedIndex *index, int subspace, Arena *scratch) {
+    int n = index->trainingSize, first = index->subspaceOffsets[subspace];
+    int subDim = index->subspaceOffsets[subspace + 1] - first;
+    int ks = index->centroidCount;
+
+    ArenaMark mark = arenaMark(scratch);
+    ShapeData *subVectors = arenaAlloc(scratch, n * sizeof(ShapeData));
+    double *features = arenaAlloc(scratch, (size_t)n * subDim * sizeof(double));
+    int *clusterClasses = arenaAlloc(scratch, ks * sizeof(int));
+    if (!subVectors || !features || !clusterClasses) {
+        arenaReset(scratch, mark);
+        return COMPRESSED_ERR_MEMORY;
+    }
+    for (int i = 0; i < n; i++) {
+        subVectors[i] = index->trainingSet[i];
+        subVectors[i].features = features + (size_t)i * subDim;
+        subVectors[i].featureCount = subDim;
+        memcpy(subVectors[i].features, index->trainingSet[i].features + first, subDim * sizeof(double));
+    }
+
+    Cluster *clusters = kmeans(subVectors, n, ks, index->p, subDim, PQ_MAX_ITERATIONS);
+    if (!clusters) {
+        arenaReset(scratch, mark);
+        return COMPRESSED_ERR_KMEANS;
+    }
+    extractCentroids(clusters, ks, subDim, index->codebooks + (size_t)ks * first, clusterClasses);
+    freeClusters(clusters, ks);
+    arenaReset(scratch, mark);
+    return COMPRESSED_SUCCESS;
+}
+
+// Trains the codebooks of every subspace and encodes the training samples.
+static int buildProductQuantizer(CompressedIndex *index) {
+    int d = index->featureCount, m = index->codeSize, ks = index->centroidCount;
+    index->subspaceOffsets = malloc((m + 1) * sizeof(int));
+    index->codebooks = malloc((size_t)ks * d * sizeof(double));
+    index->codes = malloc((size_t)index->trainingSize * m);
+    if (!index->subspaceOffsets || !index->codebooks || !index->codes) {
+        return COMPRESSED_ERR_MEMORY;
+    }
+    profileCount(PROFILE_PREPROCESS, PROFILE_ALLOCATIONS, 3);
+
+    // Contiguous subspaces whose sizes differ by at most one feature
+    for (int s = 0; s <= m; s++) {
+        index->subspaceOffsets[s] = (int)((long)s * d / m);
+    }
+
+    Arena *scratch = scratchArena(PROFILE_PREPROCESS);
+    for (int s = 0; s < m; s++) {
+        int status = trainCodebook(index, s, scratch);
+        if (status != COMPRESSED_SUCCESS) {
+            return status;
+        }
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < index->trainingSize; i++) {
+        compressedEncode(index, index->trainingSet[i].features, index->codes + (size_t)i * m);
+    }
+    return COMPRESSED_SUCCESS;
+}
+
+// Builds a compressed index of a training set.
+int buildCompressedIndex(CompressedIndex *index, const ShapeData *trainingSet, int trainingSize, int featureCount,
+                         int p, int method, int codeSize, int centroidCount, uint64_t seed) {
+    memset(index, 0, sizeof(CompressedIndex));
+    if (!trainingSet || trainingSize <= 0 || featureCount <= 0 || p <= 0 || codeSize <= 0 ||
+        (method != COMPRESS_RANDOM_PROJECTION && method != COMPRESS_PRODUCT_QUANTIZATION) ||
+        (method == COMPRESS_PRODUCT_QUANTIZATION && (codeSize > featureCount || centroidCount <= 0))) {
+        fprintf(stderr, "Invalid parameters for the compressed index\n");
+        return COMPRESSED_ERR_INVALID_INPUT;
+    }
+    ProfileScope scope = profileBegin(PROFILE_PREPROCESS);
+
+    index->method = method;
+    index->featureCount = featureCount;
+    index->codeSize = codeSize;
+    index->p = p;
+    index->trainingSet = trainingSet;
+    index->trainingSize = trainingSize;
+
+    int status;
+    if (method == COMPRESS_RANDOM_PROJECTION) {
+        status = buildRandomProjection(index, seed);
+    } else {
+        // A codebook cannot have more centroids than samples, nor more than a byte can index
+        index->centroidCount = centroidCount < trainingSize ? centroidCount : trainingSize;
+        if (index->centroidCount > PQ_MAX_CENTROIDS) {
+            index->centroidCount = PQ_MAX_CENTROIDS;
+        }
+        status = buildProductQuantizer(index);
+    }
+    if (status != COMPRESSED_SUCCESS) {
+        freeCompressedIndex(index);
+    }
+    profileEnd(&scope);
+    return status;
+}
+
+// Returns the bytes of compressed data stored per training sample.
+size_t compressedBytesPerSample(const CompressedIndex *index) {
+    if (index->method == COMPRESS_RANDOM_PROJECTION) {
+        return index->codeSize * sizeof(float);
+    }
+    return index->codeSize * sizeof(uint8_t);
+}
+
+// Writes the code of a sample: its projection, or its nearest centroid in every subspace.
+void compressedEncode(const CompressedIndex *index, const double *features, void *code) {
+    if (index->method == COMPRESS_RANDOM_PROJECTION) {
+        float *projected = code;
+        for (int r = 0; r < index->codeSize; r++) {
+            const double *row = index->projection + (size_t)r * index->featureCount;
+            double value = 0;
+            for (int j = 0; j < index->featureCount; j++) {
+                value += row[j] * features[j];
+            }
+            projected[r] = (float)value;
+        }
+        return;
+    }
+
+    uint8_t *codes = code;
+    int ks = index->centroidCount;
+    for (int s = 0; s < index->codeSize; s++) {
+        int first = index->subspaceOffsets[s], subDim = index->subspaceOffsets[s + 1] - first;
+        const double *codebook = index->codebooks + (size_t)ks * first;
+        double best = DBL_MAX;
+        int bestCode = 0;
+        for (int c = 0; c < ks; c++) {
+            double distance = minkowskiPowerSum(features + first, codebook + (size_t)c * subDim, subDim, index->p);
+            if (distance < best) {
+                best = distance;
+                bestCode = c;
+            }
+        }
+        codes[s] = (uint8_t)bestCode;
+    }
+}
+
+// Returns the number of doubles compressedPrepareQuery writes.
+size_t compressedQueryStateSize(const CompressedIndex *index) {
+    if (index->method == COMPRESS_RANDOM_PROJECTION) {
+        return index->codeSize;
+    }
+    return (size_t)index->codeSize * index->centroidCount;
+}
+
+// Projects a query, or tabulates its distances to every centroid of every subspace.
+void compressedPrepareQuery(const CompressedIndex *index, const double *features, double *state) {
+    int m = index->codeSize;
+    if (index->method == COMPRESS_RANDOM_PROJECTION) {
+        for (int r = 0; r < m; r++) {
+            const double *row = index->projection + (size_t)r * index->featureCount;
+            double value = 0;
+            for (int j = 0; j < index->featureCount; j++) {
+                value += row[j] * features[j];
+            }
+            state[r] = value;
+        }
+        return;
+    }
+
+    int ks = index->centroidCount;
+    for (int s = 0; s < m; s++) {
+        int first = index->subspaceOffsets[s], subDim = index->subspaceOffsets[s + 1] - first;
+        const double *codebook = index->codebooks + (size_t)ks * first;
+        for (int c = 0; c < ks; c++) {
+            state[(size_t)s * ks + c] = minkowskiPowerSum(features + first, codebook + (size_t)c * subDim, subDim,
+                                                          index->p);
+        }
+    }
+}
+
+// Returns the approximate distance of a prepared query to a code.
+double compressedCodeDistance(const CompressedIndex *index, const double *state, const void *code) {
+    int m = index->codeSize;
+    double sum = 0;
+    if (index->method == COMPRESS_RANDOM_PROJECTION) {
+        const float *projected = code;
+        for (int c = 0; c < m; c++) {
+            double diff = state[c] - projected[c];
+            sum += diff * diff;
+        }
+        return sum;
+    }
+
+    const uint8_t *codes = code;
+    int ks = index->centroidCount;
+    for (int s = 0; s < m; s++) {
+        sum += state[(size_t)s * ks + codes[s]];
+    }
+    return sum;
+}
+
+// Fills the approximate distances of a query to every training sample.
+static int approximateDistances(const CompressedIndex *index, const ShapeData *query, DistanceLabel *candidates,
+                                Arena *scratch) {
+    double *state = arenaAlloc(scratch, compressedQueryStateSize(index) * sizeof(double));
+    if (!state) {
+        return COMPRESSED_ERR_MEMORY;
+    }
+    compressedPrepareQuery(index, query->features, state);
+
+    const uint8_t *codes = index->method == COMPRESS_RANDOM_PROJECTION ? (const uint8_t *)index->projected
+                                                                        : index->codes;
+    size_t codeBytes = compressedBytesPerSample(index);
+    for (int i = 0; i < index->trainingSize; i++) {
+        candidates[i].distance = compressedCodeDistance(index, state, codes + i * codeBytes);
+        candidates[i].label = i;
+    }
+    return COMPRESSED_SUCCESS;
+}
+
+// Shortlists candidates by their compressed distance and re-ranks them exactly.
+int compressedSearch(const CompressedIndex *index, const ShapeData *query, int k, int shortlist,
+                     DistanceLabel *neighbors) {
+    if (!index || !query || !neighbors || k <= 0 || k > index->trainingSize) {
+        fprintf(stderr, "Invalid parameters for the compressed search\n");
+        return COMPRESSED_ERR_INVALID_INPUT;
+    }
+    int n = index->trainingSize;
+    shortlist = shortlist < k ? k : shortlist > n ? n : shortlist;
+
+    Arena *scratch = scratchArena(PROFILE_DISTANCE);
+    ArenaMark mark = arenaMark(scratch);
+    DistanceLabel *candidates = arenaAlloc(scratch, n * sizeof(DistanceLabel));
+    if (!candidates || approximateDistances(index, query, candidates, scratch) != COMPRESSED_SUCCESS) {
+        arenaReset(scratch, mark);
+        return COMPRESSED_ERR_MEMORY;
+    }
+
+    knnSelectNearest(candidates, n, shortlist);
+    for (int j = 0; j < shortlist; j++) {
+        candidates[j].distance = minkowskiDistance(*query, index->trainingSet[candidates[j].label],
+                                                   index->featureCount, index->p);
+    }
+    knnSelectNearest(candidates, shortlist, k);
+    memcpy(neighbors, candidates, k * sizeof(DistanceLabel));
+    profileCount(PROFILE_DISTANCE, PROFILE_DISTANCE_EVALUATIONS, shortlist);
+
+    arenaReset(scratch, mark);
+    return COMPRESSED_SUCCESS;
+}
+
+/**
+ * @struct ShortlistSearch
+ * @brief Compressed index searched by classifyWithSearch with a fixed shortlist.
+ */
+typedef struct {
+    const CompressedIndex *index;
+    int shortlist;
+} ShortlistSearch;
+
+// Search of a ShortlistSearch.
+static int shortlistSearch(const void *arg, const ShapeData *query, int k, DistanceLabel *neighbors) {
+    const ShortlistSearch *search = arg;
+    return compressedSearch(search->index, query, k, search->shortlist, neighbors);
+}
+
+// Classifies every test sample with the compressed search into thread-local confusion matrices.
+int compressedClassifyBatch(const CompressedIndex *index, const ShapeData *testSet, int testSize, int k,
+                            int shortlist, ConfusionMatrix *cm, int *predictions) {
+    if (!index || !testSet || !cm || !predictions || k <= 0 || k > index->trainingSize) {
+        fprintf(stderr, "Invalid parameters for compressed classification\n");
+        return COMPRESSED_ERR_INVALID_INPUT;
+    }
+    ProfileScope scope = profileBegin(PROFILE_DISTANCE);
+    ShortlistSearch search = {index, shortlist};
+    int status = classifyWithSearch(&search, shortlistSearch, index->trainingSet, testSet, testSize, k, cm,
+                                    predictions);
+    profileEnd(&scope);
+    return status == KNN_ERR_MEMORY_ALLOCATION ? COMPRESSED_ERR_MEMORY : status;
+}
+
+// Compares the neighbors of the compressed search with those of a brute-force search.
+double compressedRecallAtK(const CompressedIndex *index, const ShapeData *testSet, int testSize, int k,
+                           int shortlist) {
+    if (!index || !testSet || testSize <= 0 || k <= 0 || k > index->trainingSize) {
+        fprintf(stderr, "Invalid parameters for the recall measurement\n");
+        return COMPRESSED_ERR_INVALID_INPUT;
+    }
+    int n = index->trainingSize;
+    long found = 0;
+    int failed = 0;
+    #pragma omp parallel reduction(+:found) reduction(|:failed)
+    {
+        Arena *scratch = scratchArena(PROFILE_DISTANCE);
+        ArenaMark mark = arenaMark(scratch);
+        DistanceLabel *approximate = arenaAlloc(scratch, k * sizeof(DistanceLabel));
+        DistanceLabel *exact = arenaAlloc(scratch, n * sizeof(DistanceLabel));
+        failed = !approximate || !exact;
+
+        #pragma omp for schedule(static)
+        for (int i = 0; i < testSize; i++) {
+            if (!approximate || !exact || compressedSearch(index, &testSet[i], k, shortlist, approximate) !=
+                                              COMPRESSED_SUCCESS) {
+                failed = 1;
+                continue;
+            }
+            for (int j = 0; j < n; j++) {
+                exact[j].distance = minkowskiDistance(testSet[i], index->trainingSet[j], index->featureCount,
+                                                      index->p);
+                exact[j].label = j;
+            }
+            knnSelectNearest(exact, n, k);
+            for (int a = 0; a < k; a++) {
+                for (int b = 0; b < k; b++) {
+                    if (approximate[a].label == exact[b].label) {
+                        found++;
+                        break;
+                    }
+                }
+            }
+        }
+        arenaReset(scratch, mark);
+    }
+    if (failed) {
+        return COMPRESSED_ERR_MEMORY;
+    }
+    profileCount(PROFILE_DISTANCE, PROFILE_DISTANCE_EVALUATIONS, (uint64_t)testSize * n);
+    return (double)found / ((double)testSize * k);
+}
+
+// Frees the memory held by a compressed index.
+void freeCompressedIndex(CompressedIndex *index) {
+    if (index) {
+        free(index->projection);
+        free(index->projected);
+        free(index->subspaceOffsets);
+        free(index->codebooks);
+        free(index->codes);
+        index->projection = NULL;
+        index->projected = NULL;
+        index->subspaceOffsets = NULL;
+        index->codebooks = NULL;
+        index->codes = NULL;
+    }
+}
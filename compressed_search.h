@@ -0,0 +1,195 @@
+/**
+ * @file compressed_search.h
+ * @brief Header file for k-NN search over compressed training samples.
+ *
+ * The training samples are replaced by short codes that are scanned to build a
+ * shortlist of candidates, and only the shortlist is re-ranked with the exact
+ * Minkowski distance. Two codes are available:
+ *
+ * - A Gaussian random projection to a few dimensions stored as floats. Distances
+ *   in the projection approximate the Euclidean distance whatever the p of the run,
+ *   which is enough to shortlist candidates for the exact re-ranking.
+ * - Product quantization: the features are cut into contiguous sub-vectors, each
+ *   sub-vector is replaced by the index of its nearest centroid in a codebook trained
+ *   with kmeans(), and a query's distances to all the centroids of a subspace are
+ *   tabulated once, so the approximate distance to a training sample is one table
+ *   lookup per subspace. The p-th power of the Minkowski distance is a sum over
+ *   features, so the tables work for every p.
+ */
+
+#ifndef COMPRESSED_SEARCH_H
+#define COMPRESSED_SEARCH_H
+
+#include "knn.h"
+
+#include <stdint.h>
+
+// Error codes
+#define COMPRESSED_SUCCESS 0
+#define COMPRESSED_ERR_INVALID_INPUT -1
+#define COMPRESSED_ERR_MEMORY -2
+#define COMPRESSED_ERR_KMEANS -3
+
+// Compression methods
+#define COMPRESS_NONE 0
+#define COMPRESS_RANDOM_PROJECTION 1
+#define COMPRESS_PRODUCT_QUANTIZATION 2
+
+// Largest codebook of a subspace, so that a code fits in one byte
+#define PQ_MAX_CENTROIDS 256
+
+// Iterations of k-Means when training a codebook
+#define PQ_MAX_ITERATIONS 25
+
+// Candidates re-ranked exactly when no shortlist size is given
+#define COMPRESSED_DEFAULT_SHORTLIST 32
+
+// Seed of the random projection when the caller has no preference
+#define RP_DEFAULT_SEED 42
+
+/**
+ * @struct CompressedIndex
+ * @brief Compressed copy of a training set, searched by compressedSearch.
+ */
+typedef struct {
+    int method;              /**< COMPRESS_RANDOM_PROJECTION or COMPRESS_PRODUCT_QUANTIZATION. */
+    int featureCount;        /**< Number of features of the original samples. */
+    int codeSize;            /**< Projected dimensions, or number of subspaces for product quantization. */
+    int centroidCount;       /**< Centroids per subspace, 0 for a random projection. */
+    int p;                   /**< Minkowski exponent of the exact re-ranking. */
+    const ShapeData *trainingSet; /**< Original samples used for re-ranking; not owned. */
+    int trainingSize;        /**< Number of training samples. */
+    double *projection;      /**< Row-major codeSize x featureCount projection matrix. */
+    float *projected;        /**< Row-major trainingSize x codeSize projected samples. */
+    int *subspaceOffsets;    /**< First feature of every subspace, codeSize + 1 entries. */
+    double *codebooks;       /**< Centroids of every subspace; subspace s starts at centroidCount * subspaceOffsets[s]. */
+    uint8_t *codes;          /**< Row-major trainingSize x codeSize centroid indices. */
+} CompressedIndex;
+
+/**
+ * @brief Parses a compression method name.
+ *
+ * @param name "rp" or "pq".
+ * @return COMPRESS_* constant, or COMPRESSED_ERR_INVALID_INPUT for an unknown name.
+ */
+int parseCompressionMethod(const char *name);
+
+/**
+ * @brief Builds a compressed index of a training set.
+ *
+ * @param index Index to fill; freeCompressedIndex releases it.
+ * @param trainingSet Training samples, kept by reference for the re-ranking.
+ * @param trainingSize Number of training samples.
+ * @param featureCount Number of features in each sample.
+ * @param p Minkowski exponent.
+ * @param method COMPRESS_RANDOM_PROJECTION or COMPRESS_PRODUCT_QUANTIZATION.
+ * @param codeSize Projected dimensions, or number of subspaces (at most featureCount).
+ * @param centroidCount Centroids per subspace for product quantization, clamped to the training size.
+ * @param seed Seed of the projection matrix; product quantization uses the k-Means initialization.
+ * @return COMPRESSED_SUCCESS or a COMPRESSED_ERR_* code.
+ */
+int buildCompressedIndex(CompressedIndex *index, const ShapeData *trainingSet, int trainingSize, int featureCount,
+                         int p, int method, int codeSize, int centroidCount, uint64_t seed);
+
+/**
+ * @brief Returns the bytes of compressed data stored per training sample.
+ *
+ * @param index Built index.
+ * @return Bytes per sample, without the shared projection matrix or codebooks.
+ */
+size_t compressedBytesPerSample(const CompressedIndex *index);
+
+/**
+ * @brief Writes the code of one sample.
+ *
+ * Samples added after the index was built are encoded with the same projection or
+ * codebooks, so a growing reference set can keep its codes up to date.
+ *
+ * @param index Built index.
+ * @param features featureCount features, preprocessed like the training set.
+ * @param code Output of compressedBytesPerSample bytes: codeSize floats or codeSize centroid indices.
+ */
+void compressedEncode(const CompressedIndex *index, const double *features, void *code);
+
+/**
+ * @brief Returns the number of doubles of a prepared query.
+ *
+ * @param index Built index.
+ * @return codeSize for a random projection, codeSize x centroidCount for product quantization.
+ */
+size_t compressedQueryStateSize(const CompressedIndex *index);
+
+/**
+ * @brief Prepares a query for compressedCodeDistance: its projection, or its distance tables.
+ *
+ * @param index Built index.
+ * @param features featureCount features of the query.
+ * @param state Output of compressedQueryStateSize doubles.
+ */
+void compressedPrepareQuery(const CompressedIndex *index, const double *features, double *state);
+
+/**
+ * @brief Returns the approximate distance between a prepared query and a code.
+ *
+ * The value orders candidates like the true distance; it is a squared Euclidean
+ * distance for a random projection and a p-th power sum for product quantization.
+ *
+ * @param index Built index.
+ * @param state Query prepared by compressedPrepareQuery.
+ * @param code Code written by compressedEncode.
+ * @return Approximate distance.
+ */
+double compressedCodeDistance(const CompressedIndex *index, const double *state, const void *code);
+
+/**
+ * @brief Finds the k nearest training samples of a query.
+ *
+ * The shortlist closest candidates by the compressed distance are re-ranked with
+ * minkowskiDistance and the k nearest of them are returned.
+ *
+ * @param index Built index.
+ * @param query Sample to search for.
+ * @param k Number of neighbors.
+ * @param shortlist Number of candidates to re-rank, at least k; clamped to the training size.
+ * @param neighbors Output array of k pairs, nearest first, whose labels are training indices.
+ * @return COMPRESSED_SUCCESS or a COMPRESSED_ERR_* code.
+ */
+int compressedSearch(const CompressedIndex *index, const ShapeData *query, int k, int shortlist,
+                     DistanceLabel *neighbors);
+
+/**
+ * @brief Classifies every test sample with the compressed search and tallies the results.
+ *
+ * @param index Built index.
+ * @param testSet Samples to classify, whose classes are the actual classes.
+ * @param testSize Number of samples.
+ * @param k Number of neighbors voting.
+ * @param shortlist Number of candidates re-ranked per query.
+ * @param cm Confusion matrix receiving the results.
+ * @param predictions Output array of testSize predicted classes.
+ * @return COMPRESSED_SUCCESS or a COMPRESSED_ERR_* code.
+ */
+int compressedClassifyBatch(const CompressedIndex *index, const ShapeData *testSet, int testSize, int k,
+                            int shortlist, ConfusionMatrix *cm, int *predictions);
+
+/**
+ * @brief Measures the recall@k of the compressed search against a brute-force search.
+ *
+ * @param index Built index.
+ * @param testSet Queries.
+ * @param testSize Number of queries.
+ * @param k Number of neighbors compared.
+ * @param shortlist Number of candidates re-ranked per query.
+ * @return Mean fraction of the exact k nearest neighbors found, or a negative COMPRESSED_ERR_* code.
+ */
+double compressedRecallAtK(const CompressedIndex *index, const ShapeData *testSet, int testSize, int k,
+                           int shortlist);
+
+/**
+ * @brief Frees the memory held by a compressed index.
+ *
+ * @param index Index to free.
+ */
+void freeCompressedIndex(CompressedIndex *index);
+
+#endif // COMPRESSED_SEARCH_H
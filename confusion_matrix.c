@@ -1,157 +1,137 @@
 #include "confusion_matrix.h"
+#include "profiler.h"
 
 ConfusionMatrix createConfusionMatrix(int classCount) {
-    ConfusionMatrix cm;
-    cm.classCount = classCount;
-    cm.matrix = malloc(classCount * sizeof(int *));
-    for (int i = 0; i < classCount; i++) {
-        cm.matrix[i] = calloc(classCount, sizeof(int));
+    ConfusionMatrix cm = {NULL, NULL, NULL, 0, classCount};
+    // Counts, row sums and column sums share one zeroed block
+    cm.matrix = calloc((size_t)classCount * classCount + 2 * (size_t)classCount, sizeof(int));
+    if (!cm.matrix) {
+        fprintf(stderr, "Memory allocation failed for the confusion matrix\n");
+        exit(EXIT_FAILURE);
     }
+    cm.rowSums = cm.matrix + (size_t)classCount * classCount;
+    cm.columnSums = cm.rowSums + classCount;
     return cm;
 }
 
 void updateConfusionMatrix(ConfusionMatrix *cm, int actualClass, int predictedClass) {
     // Adjust for 0-based indexing
-    int matrixRow = actualClass - 1; // Adjusting for 0-based indexing
-    int matrixColumn = predictedClass - 1; // Adjusting for 0-based indexing
+    int matrixRow = actualClass - 1;
+    int matrixColumn = predictedClass - 1;
 
     // Ensure the adjusted indices are within the matrix bounds
     if (matrixRow >= 0 && matrixRow < cm->classCount && 
         matrixColumn >= 0 && matrixColumn < cm->classCount) {
-        cm->matrix[matrixRow][matrixColumn]++;
+        cm->matrix[(size_t)matrixRow * cm->classCount + matrixColumn]++;
+        cm->rowSums[matrixRow]++;
+        cm->columnSums[matrixColumn]++;
+        cm->total++;
     }
 }
 
+// Returns the one-vs-rest counts of a class from the kept sums.
+ClassCounts confusionClassCounts(const ConfusionMatrix *cm, int classIndex) {
+    ClassCounts counts;
+    counts.truePositives = confusionCell(cm, classIndex, classIndex);
+    counts.falseNegatives = cm->rowSums[classIndex] - counts.truePositives;
+    counts.falsePositives = cm->columnSums[classIndex] - counts.truePositives;
+    counts.trueNegatives = cm->total - counts.truePositives - counts.falseNegatives - counts.falsePositives;
+    return counts;
+}
+
+// Adds the counts of one confusion matrix to another.
+int mergeConfusionMatrix(ConfusionMatrix *target, const ConfusionMatrix *source) {
+    if (target->classCount != source->classCount) {
+        return CONFUSION_ERR_SIZE_MISMATCH;
+    }
+    // The sums follow the counts in the same block, so one pass merges everything
+    size_t cells = (size_t)source->classCount * source->classCount + 2 * (size_t)source->classCount;
+    for (size_t i = 0; i < cells; i++) {
+        target->matrix[i] += source->matrix[i];
+    }
+    target->total += source->total;
+    return CONFUSION_SUCCESS;
+}
 
 void freeConfusionMatrix(ConfusionMatrix *cm) {
-    if (cm && cm->matrix) {
-        for (int i = 0; i < cm->classCount; i++) {
-            free(cm->matrix[i]);
-        }
+    if (cm) {
         free(cm->matrix);
+        cm->matrix = cm->rowSums = cm->columnSums = NULL;
     }
 }
 
-void printMatrix(const ConfusionMatrix cm) {
-    printf("\nConfusion Matrix:\n");
+// Writes the matrix with class labels.
+static void writeMatrix(const ConfusionMatrix *cm, FILE *file) {
+    fprintf(file, "\nConfusion Matrix:\n");
 
     // Print column headers with appropriate spacing
-    printf("          "); // Space for row label
-    for (int i = 0; i < cm.classCount; i++) {
-        printf("Class%-2d", i + 1);
+    fprintf(file, "          "); // Space for row label
+    for (int i = 0; i < cm->classCount; i++) {
+        fprintf(file, "Class%-2d", i + 1);
     }
-    printf("\n");
+    fprintf(file, "\n");
 
     // Print matrix rows
-    for (int i = 0; i < cm.classCount; i++) {
-        printf("Class%-4d", i + 1); // Print row label
-        for (int j = 0; j < cm.classCount; j++) {
-            printf("%7d", cm.matrix[i][j]); // Ensure each matrix cell is aligned
+    for (int i = 0; i < cm->classCount; i++) {
+        fprintf(file, "Class%-4d", i + 1); // Print row label
+        for (int j = 0; j < cm->classCount; j++) {
+            fprintf(file, "%7d", confusionCell(cm, i, j)); // Ensure each matrix cell is aligned
         }
-        printf("\n");
+        fprintf(file, "\n");
     }
 }
 
+// Writes one line of overall metrics.
+static void writeOverallMetrics(const char *name, const ClassMetrics *m, FILE *file) {
+    fprintf(file, "%s: Precision = %.2f, Recall = %.2f, Specificity = %.2f, F1 Score = %.2f, FPR = %.2f, Accuracy = %.2f%%\n",
+            name, m->precision, m->recall, m->specificity, m->f1Score, m->fpr, m->accuracy * 100);
+}
 
-void printStatistics(const ConfusionMatrix cm) {
-    printf("\nStatistics by Class:\n");
-
-    int totalTP = 0, totalFP = 0, totalFN = 0, totalTN = 0;
-
-    for (int i = 0; i < cm.classCount; i++) {
-        int TP = cm.matrix[i][i];
-        int FP = 0, FN = 0, TN = 0;
+// Writes the per-class counts and metrics followed by the macro and micro metrics.
+static void writeStatistics(const ConfusionMatrix *cm, FILE *file) {
+    Arena *scratch = scratchArena(PROFILE_METRICS);
+    ArenaMark mark = arenaMark(scratch);
+    ConfusionMatrixMetrics metrics = calculateStatisticsInArena(cm, scratch);
+    fprintf(file, "\nStatistics by Class:\n");
+    for (int i = 0; i < cm->classCount; i++) {
+        ClassCounts c = confusionClassCounts(cm, i);
+        const ClassMetrics *m = &metrics.classMetrics[i];
+        fprintf(file, "Class %d: TP = %d, TN = %d, FP = %d, FN = %d, Precision = %.2f, Recall = %.2f, Specificity = %.2f, F1 Score = %.2f, FPR = %.2f, Accuracy = %.2f%%\n",
+                i + 1, c.truePositives, c.trueNegatives, c.falsePositives, c.falseNegatives, m->precision, m->recall,
+                m->specificity, m->f1Score, m->fpr, m->accuracy * 100);
+    }
 
-        for (int j = 0; j < cm.classCount; j++) {
-            if (i != j) {
-                FN += cm.matrix[j][i]; // Predicted as i, actual is j
-                FP += cm.matrix[i][j]; // Predicted as j, actual is i
-            }
-        }
-        for (int x = 0; x < cm.classCount; x++) {
-            for (int y = 0; y < cm.classCount; y++) {
-                if (x != i && y != i) {
-                    TN += cm.matrix[x][y]; // True negatives
-                }
-            }
-        }
+    fprintf(file, "\nOverall Metrics:\n");
+    writeOverallMetrics("Macro", &metrics.overallMetrics, file);
+    writeOverallMetrics("Micro", &metrics.microMetrics, file);
+    arenaReset(scratch, mark);
+}
 
-        totalTP += TP;
-        totalFP += FP;
-        totalFN += FN;
-        totalTN += TN;
+void printMatrix(const ConfusionMatrix cm) {
+    writeMatrix(&cm, stdout);
+}
 
-        double precision = (TP + FP) != 0 ? (double)TP / (TP + FP) : 0;
-        double recall = (TP + FN) != 0 ? (double)TP / (TP + FN) : 0;
-        double specificity = (TN + FP) != 0 ? (double)TN / (TN + FP) : 0;
-        double f1Score = (precision + recall) != 0 ? 2 * (precision * recall) / (precision + recall) : 0;
-        double fpr = (FP + TN) != 0 ? (double)FP / (FP + TN) : 0;
-        double accuracy = (TP + FP + FN + TN) != 0 ? (double)(TP + TN) / (TP + FP + FN + TN) : 0;
+void printStatistics(const ConfusionMatrix cm) {
+    writeStatistics(&cm, stdout);
+}
 
-        printf("Class %d: TP = %d, TN = %d, FP = %d, FN = %d, Precision = %.2f, Recall = %.2f, Specificity = %.2f, F1 Score = %.2f, FPR = %.2f, Accuracy = %.2f%%\n",
-               i + 1, TP, TN, FP, FN, precision, recall, specificity, f1Score, fpr, accuracy * 100);
+void printStatistics2(const ConfusionMatrixMetrics *metrics) {
+    printf("\nStatistics by Class:\n");
+    for (int i = 0; i < metrics->classCount; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "Class %d", i + 1);
+        writeOverallMetrics(name, &metrics->classMetrics[i], stdout);
     }
-
-    // Overall metrics
-    double overallPrecision = (totalTP + totalFP) != 0 ? (double)totalTP / (totalTP + totalFP) : 0;
-    double overallRecall = (totalTP + totalFN) != 0 ? (double)totalTP / (totalTP + totalFN) : 0;
-    double overallSpecificity = (totalTN + totalFP) != 0 ? (double)totalTN / (totalTN + totalFP) : 0;
-    double overallF1Score = (overallPrecision + overallRecall) != 0 ? 2 * (overallPrecision * overallRecall) / (overallPrecision + overallRecall) : 0;
-    double overallFPR = (totalFP + totalTN) != 0 ? (double)totalFP / (totalFP + totalTN) : 0;
-    double overallAccuracy = (totalTP + totalFP + totalFN + totalTN) != 0 ? (double)(totalTP + totalTN) / (totalTP + totalFP + totalFN + totalTN) : 0;
-
     printf("\nOverall Metrics:\n");
-    printf("Overall Precision = %.2f%%\n", overallPrecision);
-    printf("Overall Recall = %.2f\n", overallRecall);
-    printf("Overall Specificity = %.2f\n", overallSpecificity);
-    printf("Overall F1 Score = %.2f\n", overallF1Score);
-    printf("Overall FPR = %.2f\n", overallFPR);
-    printf("Overall Accuracy = %.2f%%\n", overallAccuracy * 100);
+    writeOverallMetrics("Macro", &metrics->overallMetrics, stdout);
+    writeOverallMetrics("Micro", &metrics->microMetrics, stdout);
 }
 
-
 void printDetailedConfusionMatrix(const ConfusionMatrix cm) {
     printMatrix(cm);
     printStatistics(cm);
 }
 
-void writeMatrixToFile(const ConfusionMatrix cm, FILE *file) {
-    fprintf(file, "\nConfusion Matrix:\n");
-    for (int i = 0; i < cm.classCount; i++) {
-        for (int j = 0; j < cm.classCount; j++) {
-            fprintf(file, "%7d ", cm.matrix[i][j]);
-        }
-        fprintf(file, "\n");
-    }
-}
-
-void writeStatisticsToFile(const ConfusionMatrix cm, FILE *file) {
-    fprintf(file, "\nStatistics by Class:\n");
-    for (int i = 0; i < cm.classCount; i++) {
-        // Similar calculations as in printStatistics
-        int TP = cm.matrix[i][i];
-        int FN = 0, FP = 0, TN = 0;
-        for (int j = 0; j < cm.classCount; j++) {
-            if (i != j) {
-                FN += cm.matrix[i][j];
-                FP += cm.matrix[j][i];
-            }
-            for (int k = 0; k < cm.classCount; k++) {
-                if (j != i && k != i) {
-                    TN += cm.matrix[j][k];
-                }
-            }
-        }
-
-        double precision = TP + FP == 0 ? 0 : (double)TP / (TP + FP);
-        double recall = TP + FN == 0 ? 0 : (double)TP / (TP + FN);
-        double f1Score = precision + recall == 0 ? 0 : 2 * (precision * recall) / (precision + recall);
-
-        fprintf(file, "Class %d: TP = %d, TN = %d, FP = %d, FN = %d, Precision = %.2f, Recall = %.2f, F1 Score = %.2f\n",
-                i, TP, TN, FP, FN, precision, recall, f1Score);
-    }
-}
-
 void saveDetailedConfusionMatrixToFile(const ConfusionMatrix cm, const char *filename, const char *title) {
     FILE *file = fopen(filename, "w");
     if (!file) {
@@ -165,8 +145,88 @@ void saveDetailedConfusionMatrixToFile(const ConfusionMatrix cm, const char *fil
 
     fprintf(file, "Experiment: %s\n", title);
     fprintf(file, "Date: %s\n", date);
-    writeMatrixToFile(cm, file);
-    writeStatisticsToFile(cm, file);
+    writeMatrix(&cm, file);
+    writeStatistics(&cm, file);
 
     fclose(file);
 }
+
+// Fills the metrics of a set of one-vs-rest counts.
+static void countsToMetrics(double TP, double FP, double FN, double TN, ClassMetrics *m) {
+    double total = TP + FP + FN + TN;
+    m->precision = (TP + FP) != 0 ? TP / (TP + FP) : 0;
+    m->recall = (TP + FN) != 0 ? TP / (TP + FN) : 0;
+    m->f1Score = (m->precision + m->recall) != 0 ? 2 * m->precision * m->recall / (m->precision + m->recall) : 0;
+    m->accuracy = total != 0 ? (TP + TN) / total : 0;
+    m->specificity = (TN + FP) != 0 ? TN / (TN + FP) : 0;
+    m->fpr = (TN + FP) != 0 ? FP / (TN + FP) : 0;
+}
+
+// Fills the metrics of a confusion matrix into the given per-class array.
+static ConfusionMatrixMetrics computeStatistics(const ConfusionMatrix *cm, ClassMetrics *classMetrics) {
+    ProfileScope scope = profileBegin(PROFILE_METRICS);
+    ConfusionMatrixMetrics metrics = {classMetrics, {0, 0, 0, 0, 0, 0}, {0, 0, 0, 0, 0, 0}, cm->classCount};
+
+    // With the row and column sums kept, every class costs O(1) and the metrics O(C)
+    double sumTP = 0, sumFP = 0, sumFN = 0, sumTN = 0;
+    int presentClasses = 0;
+    for (int i = 0; i < cm->classCount; i++) {
+        ClassCounts c = confusionClassCounts(cm, i);
+        ClassMetrics *m = &metrics.classMetrics[i];
+        countsToMetrics(c.truePositives, c.falsePositives, c.falseNegatives, c.trueNegatives, m);
+        sumTP += c.truePositives;
+        sumFP += c.falsePositives;
+        sumFN += c.falseNegatives;
+        sumTN += c.trueNegatives;
+
+        // Classes that never occur, as actual or predicted, do not enter the macro averages
+        if (c.truePositives + c.falseNegatives + c.falsePositives > 0) {
+            metrics.overallMetrics.precision += m->precision;
+            metrics.overallMetrics.recall += m->recall;
+            metrics.overallMetrics.f1Score += m->f1Score;
+            metrics.overallMetrics.specificity += m->specificity;
+            metrics.overallMetrics.fpr += m->fpr;
+            presentClasses++;
+        }
+    }
+    if (presentClasses > 0) {
+        metrics.overallMetrics.precision /= presentClasses;
+        metrics.overallMetrics.recall /= presentClasses;
+        metrics.overallMetrics.f1Score /= presentClasses;
+        metrics.overallMetrics.specificity /= presentClasses;
+        metrics.overallMetrics.fpr /= presentClasses;
+    }
+    metrics.overallMetrics.accuracy = cm->total != 0 ? (double)sumTP / cm->total : 0;
+
+    countsToMetrics(sumTP, sumFP, sumFN, sumTN, &metrics.microMetrics);
+    // Micro accuracy is the fraction of correct samples, not the pooled one-vs-rest accuracy
+    metrics.microMetrics.accuracy = metrics.overallMetrics.accuracy;
+    profileEnd(&scope);
+    return metrics;
+}
+
+ConfusionMatrixMetrics calculateStatistics(const ConfusionMatrix *cm) {
+    ClassMetrics *classMetrics = malloc(cm->classCount * sizeof(ClassMetrics));
+    if (!classMetrics) {
+        fprintf(stderr, "Memory allocation failed for confusion matrix metrics\n");
+        exit(EXIT_FAILURE);
+    }
+    profileCount(PROFILE_METRICS, PROFILE_ALLOCATIONS, 1);
+    return computeStatistics(cm, classMetrics);
+}
+
+ConfusionMatrixMetrics calculateStatisticsInArena(const ConfusionMatrix *cm, Arena *arena) {
+    ClassMetrics *classMetrics = arenaAlloc(arena, cm->classCount * sizeof(ClassMetrics));
+    if (!classMetrics) {
+        fprintf(stderr, "Memory allocation failed for confusion matrix metrics\n");
+        exit(EXIT_FAILURE);
+    }
+    return computeStatistics(cm, classMetrics);
+}
+
+void freeConfusionMatrixMetrics(ConfusionMatrixMetrics *metrics) {
+    if (metrics) {
+        free(metrics->classMetrics);
+        metrics->classMetrics = NULL;
+    }
+}
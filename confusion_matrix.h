@@ -7,18 +7,41 @@
 #define CONFUSION_MATRIX_H
 
 #include "data_reader.h" // Include for ShapeData structure definition.
+#include "arena.h"
 #include <time.h>
 
 
+// Error codes
+#define CONFUSION_SUCCESS 0
+#define CONFUSION_ERR_SIZE_MISMATCH -1
+
 /**
  * @struct ConfusionMatrix
  * @brief Represents a confusion matrix for classification results.
+ *
+ * The counts are stored in one contiguous row-major block whose rows are actual
+ * classes and columns predicted classes. Row sums, column sums and the total are
+ * kept up to date, so every per-class count is available in constant time.
  */
 typedef struct {
-    int **matrix;     /**< 2D array representing the confusion matrix. */
+    int *matrix;      /**< classCount x classCount counts, row-major. */
+    int *rowSums;     /**< Samples per actual class. */
+    int *columnSums;  /**< Samples per predicted class. */
+    int total;        /**< Number of recorded samples. */
     int classCount;   /**< Number of classes. */
 } ConfusionMatrix;
 
+/**
+ * @struct ClassCounts
+ * @brief One-vs-rest counts of a single class.
+ */
+typedef struct {
+    int truePositives;    /**< Samples of the class predicted as the class. */
+    int falsePositives;   /**< Samples of other classes predicted as the class. */
+    int falseNegatives;   /**< Samples of the class predicted as another class. */
+    int trueNegatives;    /**< Samples neither of nor predicted as the class. */
+} ClassCounts;
+
 /**
  * @struct ClassMetrics
  * @brief Metrics for evaluating classification performance for a single class.
@@ -28,6 +51,8 @@ typedef struct {
     double recall;          /**< Recall of the class. */
     double f1Score;         /**< F1 Score of the class. */
     double accuracy;        /**< Accuracy of the class. */
+    double specificity;     /**< Specificity (true negative rate) of the class. */
+    double fpr;             /**< False positive rate of the class. */
 } ClassMetrics;
 
 
@@ -37,7 +62,8 @@ typedef struct {
  */
 typedef struct {
     ClassMetrics *classMetrics;  /**< Array of metrics for each class. */
-    ClassMetrics overallMetrics; /**< Overall metrics computed from the entire confusion matrix. */
+    ClassMetrics overallMetrics; /**< Macro averages over the classes present; accuracy over all samples. */
+    ClassMetrics microMetrics;   /**< Metrics of the summed one-vs-rest counts of all classes. */
     int classCount;              /**< Number of classes. */
 } ConfusionMatrixMetrics;
 
@@ -59,6 +85,36 @@ ConfusionMatrix createConfusionMatrix(int classCount);
  */
 void updateConfusionMatrix(ConfusionMatrix *cm, int actual, int predicted);
 
+/**
+ * @brief Returns one cell of the confusion matrix.
+ *
+ * @param cm Pointer to the confusion matrix.
+ * @param actualIndex 0-based actual class.
+ * @param predictedIndex 0-based predicted class.
+ * @return Number of samples of the actual class predicted as the predicted class.
+ */
+static inline int confusionCell(const ConfusionMatrix *cm, int actualIndex, int predictedIndex) {
+    return cm->matrix[(size_t)actualIndex * cm->classCount + predictedIndex];
+}
+
+/**
+ * @brief Returns the one-vs-rest counts of a class.
+ *
+ * @param cm Pointer to the confusion matrix.
+ * @param classIndex 0-based class.
+ * @return The TP, FP, FN and TN counts of the class.
+ */
+ClassCounts confusionClassCounts(const ConfusionMatrix *cm, int classIndex);
+
+/**
+ * @brief Adds the counts of one confusion matrix to another, for example a thread-local one.
+ *
+ * @param target Matrix receiving the counts.
+ * @param source Matrix whose counts are added.
+ * @return CONFUSION_SUCCESS, or CONFUSION_ERR_SIZE_MISMATCH when the class counts differ.
+ */
+int mergeConfusionMatrix(ConfusionMatrix *target, const ConfusionMatrix *source);
+
 /**
  * @brief Frees the memory allocated for the confusion matrix.
  * 
@@ -74,7 +130,44 @@ void freeConfusionMatrix(ConfusionMatrix *cm);
 void printDetailedConfusionMatrix(const ConfusionMatrix cm);
 
 void saveDetailedConfusionMatrixToFile(const ConfusionMatrix cm, const char *filename, const char *title);
+
+/**
+ * @brief Calculates per-class and overall metrics from a confusion matrix.
+ *
+ * Rows are actual classes and columns predicted classes. The overall precision,
+ * recall, specificity and F1 score are macro averages over the classes that occur as
+ * actual or predicted class; the overall accuracy is the fraction of correctly
+ * classified samples. The micro metrics pool the one-vs-rest counts of all classes.
+ * Runs in O(C^2) for C classes.
+ *
+ * @param cm Pointer to the confusion matrix.
+ * @return ConfusionMatrixMetrics to be released with freeConfusionMatrixMetrics.
+ */
 ConfusionMatrixMetrics calculateStatistics(const ConfusionMatrix *cm);
+
+/**
+ * @brief Calculates the metrics of calculateStatistics with the per-class array taken from an arena.
+ *
+ * The metrics are released by resetting the arena, not with freeConfusionMatrixMetrics.
+ *
+ * @param cm Pointer to the confusion matrix.
+ * @param arena Arena providing the per-class metrics.
+ * @return ConfusionMatrixMetrics valid until the arena is reset.
+ */
+ConfusionMatrixMetrics calculateStatisticsInArena(const ConfusionMatrix *cm, Arena *arena);
+
+/**
+ * @brief Frees the memory held by confusion matrix metrics.
+ *
+ * @param metrics Pointer to the metrics to be freed.
+ */
+void freeConfusionMatrixMetrics(ConfusionMatrixMetrics *metrics);
+
+/**
+ * @brief Prints per-class, macro and micro metrics to standard output.
+ *
+ * @param metrics Pointer to the metrics returned by calculateStatistics.
+ */
 void printStatistics2(const ConfusionMatrixMetrics *metrics);
 
 #endif // CONFUSION_MATRIX_H
@@ -1,39 +1,302 @@
 #include "cross_validation.h"
+#include "knn.h"
+#include "thread_pool.h"
+#include "profiler.h"
 
-// Perform k-fold cross-validation on a dataset using a specified model.
-void crossValidation(ShapeData *data, int dataSize, int kFolds, ModelFunction modelFunc) {
-    // Calculate the size of each fold
-    int foldSize = dataSize / kFolds;
-
-    // Iterate through each fold
-    for (int i = 0; i < kFolds; i++) {
-        // Calculate the start and end indices for the test set in this fold
-        int testStart = i * foldSize;
-        int testEnd = testStart + foldSize;
-
-        // Create a structure to hold the training and test sets
-        SplitData split;
-        split.trainingSet = malloc((dataSize - foldSize) * sizeof(ShapeData));
-        split.testSet = malloc(foldSize * sizeof(ShapeData));
-        split.trainingSize = 0;
-        split.testSize = 0;
-
-        // Populate training and test sets
-        for (int j = 0; j < dataSize; j++) {
-            if (j >= testStart && j < testEnd) {
-                // Add the data point to the test set
-                split.testSet[split.testSize++] = data[j];
-            } else {
-                // Add the data point to the training set
-                split.trainingSet[split.trainingSize++] = data[j];
+#include <math.h>
+
+/**
+ * @struct FoldTask
+ * @brief Work item evaluating one fold on the thread pool.
+ */
+typedef struct {
+    CrossValidationFold fold;
+    ModelFunction modelFunc;
+    void *modelArgs;
+    ConfusionMatrix cm;
+    int status;     /**< Result of the model function. */
+} FoldTask;
+
+// Sort key used to group shuffled samples by class.
+typedef struct {
+    int class;
+    int position;  /**< Position after shuffling, keeps the shuffled order within a class. */
+    int index;
+} StratifiedEntry;
+
+// Comparator ordering entries by class, then by shuffled position.
+static int compareStratifiedEntries(const void *a, const void *b) {
+    const StratifiedEntry *x = a, *y = b;
+    if (x->class != y->class) {
+        return (x->class > y->class) - (x->class < y->class);
+    }
+    return (x->position > y->position) - (x->position < y->position);
+}
+
+// Assigns every sample to a fold, stratified by class.
+int *assignStratifiedFolds(const ShapeData *data, int dataSize, int kFolds, uint64_t seed) {
+    if (!data || kFolds < 2 || kFolds > dataSize) {
+        fprintf(stderr, "Invalid parameters for stratified folds\n");
+        return NULL;
+    }
+
+    int *order = malloc(dataSize * sizeof(int));
+    StratifiedEntry *entries = malloc(dataSize * sizeof(StratifiedEntry));
+    int *folds = malloc(dataSize * sizeof(int));
+    if (!order || !entries || !folds) {
+        free(order);
+        free(entries);
+        free(folds);
+        return NULL;
+    }
+
+    for (int i = 0; i < dataSize; i++) {
+        order[i] = i;
+    }
+    shuffleIndices(order, dataSize, seed);
+    for (int position = 0; position < dataSize; position++) {
+        entries[position].class = data[order[position]].class;
+        entries[position].position = position;
+        entries[position].index = order[position];
+    }
+    qsort(entries, dataSize, sizeof(StratifiedEntry), compareStratifiedEntries);
+
+    // Deal the grouped samples round-robin; continuing across classes balances the fold sizes
+    for (int i = 0; i < dataSize; i++) {
+        folds[entries[i].index] = i % kFolds;
+    }
+
+    free(order);
+    free(entries);
+    return folds;
+}
+
+// Thread pool task evaluating one fold.
+static void runFoldTask(void *arg) {
+    FoldTask *task = arg;
+    task->status = task->modelFunc(&task->fold, task->modelArgs, &task->cm);
+}
+
+// Computes the mean and standard deviation of the fold metrics.
+static void aggregateFoldMetrics(CrossValidationMetrics *metrics) {
+    int n = metrics->foldsProcessed;
+    ClassMetrics sum = {0, 0, 0, 0, 0, 0}, sumSquares = {0, 0, 0, 0, 0, 0};
+    for (int i = 0; i < n; i++) {
+        const ClassMetrics *m = &metrics->foldMetrics[i];
+        sum.precision += m->precision;
+        sum.recall += m->recall;
+        sum.f1Score += m->f1Score;
+        sum.accuracy += m->accuracy;
+        sum.specificity += m->specificity;
+        sum.fpr += m->fpr;
+        sumSquares.precision += m->precision * m->precision;
+        sumSquares.recall += m->recall * m->recall;
+        sumSquares.f1Score += m->f1Score * m->f1Score;
+        sumSquares.accuracy += m->accuracy * m->accuracy;
+        sumSquares.specificity += m->specificity * m->specificity;
+        sumSquares.fpr += m->fpr * m->fpr;
+    }
+
+    metrics->mean.precision = sum.precision / n;
+    metrics->mean.recall = sum.recall / n;
+    metrics->mean.f1Score = sum.f1Score / n;
+    metrics->mean.accuracy = sum.accuracy / n;
+    metrics->mean.specificity = sum.specificity / n;
+    metrics->mean.fpr = sum.fpr / n;
+    metrics->stdDev.precision = sqrt(fmax(0, sumSquares.precision / n - metrics->mean.precision * metrics->mean.precision));
+    metrics->stdDev.recall = sqrt(fmax(0, sumSquares.recall / n - metrics->mean.recall * metrics->mean.recall));
+    metrics->stdDev.f1Score = sqrt(fmax(0, sumSquares.f1Score / n - metrics->mean.f1Score * metrics->mean.f1Score));
+    metrics->stdDev.accuracy = sqrt(fmax(0, sumSquares.accuracy / n - metrics->mean.accuracy * metrics->mean.accuracy));
+    metrics->stdDev.specificity = sqrt(fmax(0, sumSquares.specificity / n - metrics->mean.specificity * metrics->mean.specificity));
+    metrics->stdDev.fpr = sqrt(fmax(0, sumSquares.fpr / n - metrics->mean.fpr * metrics->mean.fpr));
+}
+
+// Evaluates every task on a thread pool and aggregates the metrics of their confusion matrices.
+static int evaluateFoldTasks(FoldTask *tasks, int taskCount, int threadCount, CrossValidationMetrics *metrics) {
+    metrics->foldMetrics = calloc(taskCount, sizeof(ClassMetrics));
+    ThreadPool *pool = createThreadPool(threadCount < taskCount ? threadCount : taskCount);
+    if (!metrics->foldMetrics || !pool) {
+        for (int f = 0; f < taskCount; f++) {
+            freeConfusionMatrix(&tasks[f].cm);
+        }
+        freeCrossValidationMetrics(metrics);
+        destroyThreadPool(pool);
+        return CV_ERR_MEMORY_FAILURE;
+    }
+    for (int f = 0; f < taskCount; f++) {
+        submitTask(pool, runFoldTask, &tasks[f]);
+    }
+    waitThreadPool(pool);
+    destroyThreadPool(pool);
+
+    // A fold that could not be scored would leave samples out of the metrics
+    for (int f = 0; f < taskCount; f++) {
+        if (tasks[f].status != CV_SUCCESS) {
+            int status = tasks[f].status;
+            for (int g = 0; g < taskCount; g++) {
+                freeConfusionMatrix(&tasks[g].cm);
             }
+            freeCrossValidationMetrics(metrics);
+            return status;
+        }
+    }
+
+    Arena *scratch = scratchArena(PROFILE_METRICS);
+    ArenaMark mark = arenaMark(scratch);
+    for (int f = 0; f < taskCount; f++) {
+        ConfusionMatrixMetrics foldStatistics = calculateStatisticsInArena(&tasks[f].cm, scratch);
+        metrics->foldMetrics[f] = foldStatistics.overallMetrics;
+        arenaReset(scratch, mark);
+        freeConfusionMatrix(&tasks[f].cm);
+    }
+    metrics->foldsProcessed = taskCount;
+    aggregateFoldMetrics(metrics);
+    return CV_SUCCESS;
+}
+
+// Returns the training size of the smallest fold of a stratified k-fold cross-validation.
+int smallestFoldTrainingSize(int dataSize, int kFolds) {
+    return dataSize - (dataSize + kFolds - 1) / kFolds;
+}
+
+// Perform stratified k-fold cross-validation on a dataset using a specified model.
+int crossValidation(ShapeData *data, int dataSize, int kFolds, int classCount, ModelFunction modelFunc,
+                    void *modelArgs, int threadCount, uint64_t seed, CrossValidationMetrics *metrics) {
+    memset(metrics, 0, sizeof(*metrics));
+    int *folds = assignStratifiedFolds(data, dataSize, kFolds, seed);
+    if (!folds || !modelFunc) {
+        free(folds);
+        return CV_ERR_INVALID_INPUT;
+    }
+
+    // Every fold gets one contiguous block: its test indices followed by its training indices
+    int *indices = malloc((size_t)kFolds * dataSize * sizeof(int));
+    FoldTask *tasks = calloc(kFolds, sizeof(FoldTask));
+    if (!indices || !tasks) {
+        free(folds);
+        free(indices);
+        free(tasks);
+        return CV_ERR_MEMORY_FAILURE;
+    }
+
+    for (int f = 0; f < kFolds; f++) {
+        int *block = indices + (size_t)f * dataSize;
+        int testSize = 0;
+        for (int i = 0; i < dataSize; i++) {
+            if (folds[i] == f) block[testSize++] = i;
+        }
+        int trainingSize = 0;
+        for (int i = 0; i < dataSize; i++) {
+            if (folds[i] != f) block[testSize + trainingSize++] = i;
         }
 
-        // Call the model function to evaluate the model on the current fold
-        modelFunc(split);
+        tasks[f].fold = (CrossValidationFold){data, block + testSize, trainingSize, block, testSize, f};
+        tasks[f].modelFunc = modelFunc;
+        tasks[f].modelArgs = modelArgs;
+        tasks[f].cm = createConfusionMatrix(classCount);
+    }
+    int status = evaluateFoldTasks(tasks, kFolds, threadCount, metrics);
+
+    free(tasks);
+    free(indices);
+    free(folds);
+    return status;
+}
+
+// Evaluates a model on repeated random splits of a dataset.
+int repeatedSubsampling(const ShapeData *data, int dataSize, int repetitions, float trainingFraction, bool stratified,
+                        int classCount, ModelFunction modelFunc, void *modelArgs, int threadCount, uint64_t seed,
+                        CrossValidationMetrics *metrics) {
+    memset(metrics, 0, sizeof(*metrics));
+    if (!data || dataSize <= 0 || repetitions <= 0 || !modelFunc) {
+        fprintf(stderr, "Invalid parameters for repeated random subsampling\n");
+        return CV_ERR_INVALID_INPUT;
+    }
+    IndexSplit *splits = calloc(repetitions, sizeof(IndexSplit));
+    FoldTask *tasks = calloc(repetitions, sizeof(FoldTask));
+    if (!splits || !tasks) {
+        free(splits);
+        free(tasks);
+        return CV_ERR_MEMORY_FAILURE;
+    }
+    int status = repeatedSplits(splits, repetitions, data, dataSize, trainingFraction, stratified, seed);
+    if (status != SPLIT_SUCCESS) {
+        free(splits);
+        free(tasks);
+        return status == SPLIT_ERR_MEMORY_FAILURE ? CV_ERR_MEMORY_FAILURE : CV_ERR_INVALID_INPUT;
+    }
+
+    for (int r = 0; r < repetitions; r++) {
+        const IndexSplit *split = &splits[r];
+        tasks[r].fold = (CrossValidationFold){data, split->trainingIndices, split->trainingSize, split->testIndices,
+                                              split->testSize, r};
+        tasks[r].modelFunc = modelFunc;
+        tasks[r].modelArgs = modelArgs;
+        tasks[r].cm = createConfusionMatrix(classCount);
+    }
+    status = evaluateFoldTasks(tasks, repetitions, threadCount, metrics);
+
+    for (int r = 0; r < repetitions; r++) {
+        freeIndexSplit(&splits[r]);
+    }
+    free(splits);
+    free(tasks);
+    return status;
+}
+
+// Model function for k-Nearest Neighbors (knn) algorithm.
+int knnModelFunction(const CrossValidationFold *fold, void *modelArgs, ConfusionMatrix *cm) {
+    const KnnModelArgs *args = modelArgs;
+    if (args->k <= 0 || args->k > fold->trainingSize) {
+        fprintf(stderr, "k = %d exceeds the %d training samples of fold %d\n", args->k, fold->trainingSize,
+                fold->foldIndex + 1);
+        return CV_ERR_INVALID_K;
+    }
+    Arena *scratch = scratchArena(PROFILE_VOTE);
+    ArenaMark mark = arenaMark(scratch);
+    DistanceLabel *distanceLabels = arenaAlloc(scratch, fold->trainingSize * sizeof(DistanceLabel));
+    if (!distanceLabels) {
+        fprintf(stderr, "Memory allocation failed for fold %d\n", fold->foldIndex);
+        return CV_ERR_MEMORY_FAILURE;
+    }
+
+    for (int t = 0; t < fold->testSize; t++) {
+        int testIndex = fold->testIndices[t];
+        // Slice the row of the test sample down to the training samples of the fold
+        for (int i = 0; i < fold->trainingSize; i++) {
+            int trainingIndex = fold->trainingIndices[i];
+            distanceLabels[i].distance = getDistance(args->distances, testIndex, trainingIndex);
+            distanceLabels[i].label = fold->data[trainingIndex].class;
+        }
+        int predictedClass = knnVote(distanceLabels, fold->trainingSize, args->k);
+        updateConfusionMatrix(cm, fold->data[testIndex].class, predictedClass);
+    }
+
+    arenaReset(scratch, mark);
+    return CV_SUCCESS;
+}
+
+// Prints the metrics of each fold and their mean and standard deviation.
+void printCrossValidationMetrics(const CrossValidationMetrics *metrics) {
+    printf("\nCross-Validation Metrics by Fold:\n");
+    for (int f = 0; f < metrics->foldsProcessed; f++) {
+        const ClassMetrics *m = &metrics->foldMetrics[f];
+        printf("Fold %d: Precision = %.4f, Recall = %.4f, F1 Score = %.4f, Accuracy = %.2f%%\n",
+               f + 1, m->precision, m->recall, m->f1Score, m->accuracy * 100);
+    }
+
+    printf("\nCross-Validation Metrics (%d folds, mean +/- std):\n", metrics->foldsProcessed);
+    printf("Mean Precision = %.4f +/- %.4f\n", metrics->mean.precision, metrics->stdDev.precision);
+    printf("Mean Recall = %.4f +/- %.4f\n", metrics->mean.recall, metrics->stdDev.recall);
+    printf("Mean F1 Score = %.4f +/- %.4f\n", metrics->mean.f1Score, metrics->stdDev.f1Score);
+    printf("Mean Accuracy = %.2f%% +/- %.2f%%\n", metrics->mean.accuracy * 100, metrics->stdDev.accuracy * 100);
+}
 
-        // Free memory allocated for the training and test sets
-        free(split.trainingSet);
-        free(split.testSet);
+// Frees the memory held by cross-validation metrics.
+void freeCrossValidationMetrics(CrossValidationMetrics *metrics) {
+    if (metrics) {
+        free(metrics->foldMetrics);
+        metrics->foldMetrics = NULL;
+        metrics->foldsProcessed = 0;
     }
-}
\ No newline at end of file
+}
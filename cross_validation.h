@@ -1,7 +1,6 @@
-
 /**
  * @file cross_validation.h
- * @brief Header file for implementing k-fold cross-validation with model evaluation metrics.
+ * @brief Header file for stratified k-fold cross-validation and repeated random subsampling with model evaluation metrics.
  */
 
 #ifndef CROSS_VALIDATION_H
@@ -9,46 +8,154 @@
 
 #include "data_split.h"  // Includes ShapeData structure definition
 #include "confusion_matrix.h" // Includes ConfusionMatrix definition
+#include "distance_matrix.h" // Includes DistanceMatrix definition
+
+// Error codes
+#define CV_SUCCESS 0
+#define CV_ERR_INVALID_INPUT -1
+#define CV_ERR_MEMORY_FAILURE -2
+#define CV_ERR_INVALID_K -3
+
+/**
+ * @struct CrossValidationFold
+ * @brief One fold of a cross-validation or one random split, given as indices into the whole dataset.
+ */
+typedef struct {
+    const ShapeData *data;        /**< The whole dataset. */
+    const int *trainingIndices;   /**< Indices of the training samples of this fold. */
+    int trainingSize;             /**< Number of training samples. */
+    const int *testIndices;       /**< Indices of the test samples of this fold. */
+    int testSize;                 /**< Number of test samples. */
+    int foldIndex;                /**< Index of the fold, from 0 to kFolds - 1. */
+} CrossValidationFold;
 
 /**
  * @typedef ModelFunction
- * @brief Typedef for a function pointer representing a model's evaluation function.
- * @param split The data split containing training and test sets.
- * @return ConfusionMatrix representing the model's performance.
+ * @brief Typedef for a function pointer that trains a model on a fold and scores its test samples.
+ * Called concurrently for different folds, so it must only write to its own confusion matrix.
+ * @param fold The fold containing training and test indices.
+ * @param modelArgs Model specific arguments shared by all folds.
+ * @param cm Confusion matrix receiving the results of the test samples.
+ * @return CV_SUCCESS, or a CV_ERR_* code that fails the whole evaluation.
  */
-typedef ConfusionMatrix (*ModelFunction)(SplitData split);
+typedef int (*ModelFunction)(const CrossValidationFold *fold, void *modelArgs, ConfusionMatrix *cm);
 
 /**
  * @struct CrossValidationMetrics
  * @brief Structure to hold aggregated metrics from k-fold cross-validation.
+ *
+ * Precision, recall and F1 score are macro averages over the classes of each fold.
  */
 typedef struct {
-    double totalAccuracy;  /**< Total accuracy across all folds. */
-    double totalPrecision; /**< Total precision across all folds. */
-    double totalRecall;    /**< Total recall across all folds. */
-    double totalF1Score;   /**< Total F1 score across all folds. */
-    int foldsProcessed;    /**< Number of folds processed. */
+    ClassMetrics *foldMetrics;  /**< Overall metrics of each fold. */
+    ClassMetrics mean;          /**< Mean of the fold metrics. */
+    ClassMetrics stdDev;        /**< Standard deviation of the fold metrics. */
+    int foldsProcessed;         /**< Number of folds processed. */
 } CrossValidationMetrics;
 
+/**
+ * @struct KnnModelArgs
+ * @brief Arguments of knnModelFunction.
+ */
+typedef struct {
+    const DistanceMatrix *distances; /**< Distances between all samples of the dataset. */
+    int k;                           /**< Number of neighbors. */
+} KnnModelArgs;
 
 /**
- * @brief Perform k-fold cross-validation on a dataset using a specified model.
+ * @brief Assigns every sample to a fold, stratified by class.
  *
- * This function divides the dataset into k folds, trains the model on k-1 folds,
- * and evaluates its performance on the remaining fold. This process is repeated k times
- * to ensure each fold serves as the test set exactly once.
+ * Samples are shuffled, grouped by class and dealt to the folds in turn, so every
+ * fold gets the same share of each class (within one sample) and no sample is left out.
+ *
+ * @param data Pointer to the dataset.
+ * @param dataSize Number of elements in the dataset.
+ * @param kFolds Number of folds.
+ * @param seed Seed of the shuffle.
+ * @return Array giving the fold of each sample, NULL on invalid input or allocation failure.
+ */
+int *assignStratifiedFolds(const ShapeData *data, int dataSize, int kFolds, uint64_t seed);
+
+/**
+ * @brief Returns the training size of the smallest fold of a stratified k-fold cross-validation.
+ *
+ * assignStratifiedFolds deals the samples to the folds in turn, so the largest test fold
+ * holds ceil(dataSize / kFolds) samples whatever the classes and the seed.
+ *
+ * @param dataSize Number of elements in the dataset.
+ * @param kFolds Number of folds.
+ * @return The smallest number of training samples of a fold.
+ */
+int smallestFoldTrainingSize(int dataSize, int kFolds);
+
+/**
+ * @brief Perform stratified k-fold cross-validation on a dataset using a specified model.
+ *
+ * Each fold serves as the test set exactly once while the model is trained on the other
+ * folds. Folds are evaluated concurrently on a thread pool and their metrics aggregated.
  *
  * @param data Pointer to the dataset.
  * @param dataSize Number of elements in the dataset.
  * @param kFolds Number of folds for cross-validation.
+ * @param classCount Number of classes of the confusion matrices.
+ * @param modelFunc Function pointer to the model's evaluation function.
+ * @param modelArgs Arguments passed to the model function.
+ * @param threadCount Number of worker threads, 0 for the number of online processors.
+ * @param seed Seed of the fold assignment.
+ * @param metrics Pointer receiving the aggregated metrics, released with freeCrossValidationMetrics.
+ * @return CV_SUCCESS, a CV_ERR_* code, or the first error returned by the model function.
+ */
+int crossValidation(ShapeData *data, int dataSize, int kFolds, int classCount, ModelFunction modelFunc,
+                    void *modelArgs, int threadCount, uint64_t seed, CrossValidationMetrics *metrics);
+
+/**
+ * @brief Evaluates a model on repeated random splits of a dataset (Monte Carlo cross-validation).
+ *
+ * Every repetition draws an independent split with repeatedSplits and the model is scored
+ * on it like on a fold; the splits are index views, so no sample is copied. Repetitions
+ * are evaluated concurrently on a thread pool and reported as the folds of metrics.
+ *
+ * @param data Pointer to the dataset.
+ * @param dataSize Number of elements in the dataset.
+ * @param repetitions Number of random splits.
+ * @param trainingFraction Fraction of the samples in the training set of every split.
+ * @param stratified Keep the class proportions in both sets of every split.
+ * @param classCount Number of classes of the confusion matrices.
  * @param modelFunc Function pointer to the model's evaluation function.
+ * @param modelArgs Arguments passed to the model function.
+ * @param threadCount Number of worker threads, 0 for the number of online processors.
+ * @param seed Seed of the sequence of splits.
+ * @param metrics Pointer receiving the aggregated metrics, released with freeCrossValidationMetrics.
+ * @return CV_SUCCESS, a CV_ERR_* code, or the first error returned by the model function.
  */
-void crossValidation(ShapeData *data, int dataSize, int kFolds, ModelFunction modelFunc);
+int repeatedSubsampling(const ShapeData *data, int dataSize, int repetitions, float trainingFraction, bool stratified,
+                        int classCount, ModelFunction modelFunc, void *modelArgs, int threadCount, uint64_t seed,
+                        CrossValidationMetrics *metrics);
 
 /**
  * @brief Model function for k-Nearest Neighbors (knn) algorithm.
- * @param split The data split containing training and test sets.
+ *
+ * Looks the distances up in the shared matrix instead of recomputing them for the fold.
+ *
+ * @param fold The fold containing training and test indices.
+ * @param modelArgs Pointer to a KnnModelArgs.
+ * @param cm Confusion matrix receiving the results of the test samples.
+ * @return CV_SUCCESS, CV_ERR_INVALID_K if k exceeds the training size of the fold, or CV_ERR_MEMORY_FAILURE.
+ */
+int knnModelFunction(const CrossValidationFold *fold, void *modelArgs, ConfusionMatrix *cm);
+
+/**
+ * @brief Prints the metrics of each fold (or split) and their mean and standard deviation.
+ *
+ * @param metrics Pointer to the aggregated metrics.
+ */
+void printCrossValidationMetrics(const CrossValidationMetrics *metrics);
+
+/**
+ * @brief Frees the memory held by cross-validation metrics.
+ *
+ * @param metrics Pointer to the metrics to be freed.
  */
-void knnModelFunction(SplitData split);
+void freeCrossValidationMetrics(CrossValidationMetrics *metrics);
 
 #endif // CROSS_VALIDATION_H
@@ -1,4 +1,8 @@
 #include "data_reader.h"
+#include "profiler.h"
+
+#include <stdbool.h>
+#include <sys/stat.h>
 
 // Parses the filename to extract class and sample information.
 int parseFilename(const char *filename, int *class, int *sample) {
@@ -7,7 +11,8 @@ int parseFilename(const char *filename, int *class, int *sample) {
     filename_ptr = filename_ptr ? filename_ptr + 1 : filename;
 
     // Using sscanf to extract class and sample information from the filename
-    if (sscanf(filename_ptr, "s%02dn%03d", class, sample) != 2) {
+    // Widths are not limited so that generated sets can go past 99 classes and 999 samples
+    if (sscanf(filename_ptr, "s%dn%d", class, sample) != 2) {
         return ERR_INVALID_FILENAME; // Return an error if the format is incorrect
     }
     return SUCCESS;
@@ -43,10 +48,18 @@ int readFeaturesFromFile(FILE *file, double *features, int featureCount) {
 
 // Reads and processes all files with the specified extension in a directory.
 ShapeData* readAllFiles(const char *directory, const char *extension, int *count) {
+    // A regular file is a binary dataset
+    struct stat status;
+    if (stat(directory, &status) == 0 && S_ISREG(status.st_mode)) {
+        return readBinaryDataset(directory, count);
+    }
+
+    ProfileScope scope = profileBegin(PROFILE_READ);
     DIR *dir;
     struct dirent *ent;
     int capacity = 100, n = 0;
     ShapeData *data = malloc(capacity * sizeof(ShapeData));
+    profileCount(PROFILE_READ, PROFILE_ALLOCATIONS, 1);
     if (!data) {
         perror("Memory allocation failed for ShapeData array");
         exit(ERR_MEMORY_ALLOCATION_FAILED);
@@ -71,6 +84,7 @@ ShapeData* readAllFiles(const char *directory, const char *extension, int *count
             sprintf(filename, "%s/%s", directory, ent->d_name);
             ShapeData fileData = readFile(filename);
             free(filename);
+            profileCount(PROFILE_READ, PROFILE_ALLOCATIONS, 2); // File name and features
 
             // Check if the array needs to be resized
             if (n >= capacity) {
@@ -83,6 +97,7 @@ ShapeData* readAllFiles(const char *directory, const char *extension, int *count
                     exit(ERR_MEMORY_ALLOCATION_FAILED);
                 }
                 data = temp;
+                profileCount(PROFILE_READ, PROFILE_ALLOCATIONS, 1);
             }
             data[n++] = fileData; // Add the read data to the array
         }
@@ -90,6 +105,7 @@ ShapeData* readAllFiles(const char *directory, const char *extension, int *count
 
     closedir(dir);
     *count = n; // Update the count of read files
+    profileEnd(&scope);
     return data; // Return the array of ShapeData
 }
 
@@ -141,12 +157,23 @@ void freeShapeData(ShapeData *data, int count) {
     free(data); // Free the memory for the array of ShapeData
 }
 
+// Returns the largest class label of a dataset.
+int countClasses(const ShapeData *data, int count) {
+    int classCount = 0;
+    for (int i = 0; i < count; i++) {
+        if (data[i].class > classCount) {
+            classCount = data[i].class;
+        }
+    }
+    return classCount;
+}
+
 // Determines the expected number of features based on file extension.
 int getExpectedFeatureCount(const char *filename) {
     // Extract the file extension
     const char *extension = strrchr(filename, '.');
     if (!extension) {
-        return ERR_UNKNOWN_FILE_TYPE; // Unknown file type
+        return -ERR_UNKNOWN_FILE_TYPE; // Unknown file type
     }
 
     // Match the extension with the expected number of features
@@ -160,5 +187,203 @@ int getExpectedFeatureCount(const char *filename) {
         return 90;
     }
 
-    return ERR_UNKNOWN_FILE_TYPE; // Unknown file type
+    // Other extensions hold one feature per line
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        return -ERR_FILE_OPEN_FAILED;
+    }
+    char buffer[1024];
+    int lines = 0;
+    while (fgets(buffer, sizeof(buffer), file)) {
+        if (buffer[0] != '\n') lines++;
+    }
+    fclose(file);
+    return lines > 0 ? lines : -ERR_UNKNOWN_FILE_TYPE;
+}
+
+// Reads and checks the header of a binary dataset file.
+static bool readDatasetHeader(FILE *file, DatasetFileHeader *header, const char *path) {
+    if (fread(header, sizeof(*header), 1, file) != 1 || memcmp(header->magic, DATASET_MAGIC, sizeof(DATASET_MAGIC)) != 0 ||
+        header->version != DATASET_VERSION || header->featureCount == 0 || header->sampleCount > INT32_MAX) {
+        fprintf(stderr, "Not a supported binary dataset: %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+// Reads a binary dataset file.
+ShapeData* readBinaryDataset(const char *path, int *count) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror("Unable to open dataset");
+        return NULL;
+    }
+
+    DatasetFileHeader header;
+    if (!readDatasetHeader(file, &header, path)) {
+        fclose(file);
+        return NULL;
+    }
+
+    ProfileScope scope = profileBegin(PROFILE_READ);
+    int n = (int)header.sampleCount, featureCount = (int)header.featureCount;
+    ShapeData *data = malloc((n > 0 ? n : 1) * sizeof(ShapeData));
+    if (!data) {
+        fprintf(stderr, "Memory allocation failed for dataset %s\n", path);
+        fclose(file);
+        profileEnd(&scope);
+        return NULL;
+    }
+
+    for (int i = 0; i < n; i++) {
+        int32_t labels[2];
+        data[i].featureCount = featureCount;
+        if (fread(labels, sizeof(labels), 1, file) != 1 || allocateFeatures(&data[i]) != SUCCESS) {
+            fprintf(stderr, "Failed to read sample %d of dataset %s\n", i, path);
+            freeShapeData(data, i);
+            fclose(file);
+            profileEnd(&scope);
+            return NULL;
+        }
+        data[i].class = labels[0];
+        data[i].sample = labels[1];
+        if (fread(data[i].features, sizeof(double), featureCount, file) != (size_t)featureCount) {
+            fprintf(stderr, "Failed to read sample %d of dataset %s\n", i, path);
+            freeShapeData(data, i + 1);
+            fclose(file);
+            profileEnd(&scope);
+            return NULL;
+        }
+    }
+    fclose(file);
+
+    profileCount(PROFILE_READ, PROFILE_ALLOCATIONS, n + 1);
+    profileEnd(&scope);
+    *count = n;
+    return data;
+}
+
+// Writes the header of a binary dataset file.
+int writeBinaryDatasetHeader(FILE *file, int featureCount, uint64_t sampleCount) {
+    DatasetFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DATASET_MAGIC, sizeof(DATASET_MAGIC));
+    header.version = DATASET_VERSION;
+    header.featureCount = featureCount;
+    header.sampleCount = sampleCount;
+    return fwrite(&header, sizeof(header), 1, file) == 1 ? SUCCESS : ERR_FEATURES_VALUES;
+}
+
+// Appends one sample to a binary dataset file.
+int writeBinaryDatasetRecord(FILE *file, int shapeClass, int sample, const double *features, int featureCount) {
+    int32_t labels[2] = {shapeClass, sample};
+    if (fwrite(labels, sizeof(labels), 1, file) != 1 ||
+        fwrite(features, sizeof(double), featureCount, file) != (size_t)featureCount) {
+        return ERR_FEATURES_VALUES;
+    }
+    return SUCCESS;
+}
+
+// Writes samples to a binary dataset file.
+int writeBinaryDataset(const char *path, const ShapeData *data, int count) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        return ERR_FILE_OPEN_FAILED;
+    }
+    int featureCount = count > 0 ? data[0].featureCount : 0;
+    int status = writeBinaryDatasetHeader(file, featureCount, count);
+    for (int i = 0; i < count && status == SUCCESS; i++) {
+        status = writeBinaryDatasetRecord(file, data[i].class, data[i].sample, data[i].features, featureCount);
+    }
+    if (fclose(file) != 0 && status == SUCCESS) {
+        status = ERR_FEATURES_VALUES;
+    }
+    return status;
+}
+
+// Opens a directory or a binary dataset for reading in batches.
+int openShapeStream(ShapeStream *stream, const char *path, const char *extension) {
+    memset(stream, 0, sizeof(ShapeStream));
+    stream->directory = path;
+    stream->extension = extension;
+
+    struct stat status;
+    if (stat(path, &status) == 0 && S_ISREG(status.st_mode)) {
+        DatasetFileHeader header;
+        stream->file = fopen(path, "rb");
+        if (!stream->file) {
+            perror("Unable to open dataset");
+            return ERR_FILE_OPEN_FAILED;
+        }
+        if (!readDatasetHeader(stream->file, &header, path)) {
+            closeShapeStream(stream);
+            return ERR_FILE_OPEN_FAILED;
+        }
+        stream->remaining = header.sampleCount;
+        stream->featureCount = (int)header.featureCount;
+        return SUCCESS;
+    }
+
+    stream->dir = opendir(path);
+    if (!stream->dir) {
+        perror("Unable to open directory");
+        return ERR_DIR_OPEN_FAILED;
+    }
+    return SUCCESS;
+}
+
+// Reads up to maxCount samples from the directory listing or the binary records.
+int readShapeBatch(ShapeStream *stream, ShapeData *batch, int maxCount) {
+    ProfileScope scope = profileBegin(PROFILE_READ);
+    int n = 0;
+    while (n < maxCount && stream->file && stream->remaining > 0) {
+        int32_t labels[2];
+        batch[n].featureCount = stream->featureCount;
+        if (fread(labels, sizeof(labels), 1, stream->file) != 1 || allocateFeatures(&batch[n]) != SUCCESS) {
+            freeShapeData(batch, n);
+            profileEnd(&scope);
+            return -ERR_FEATURES_VALUES;
+        }
+        batch[n].class = labels[0];
+        batch[n].sample = labels[1];
+        if (fread(batch[n].features, sizeof(double), stream->featureCount, stream->file) !=
+            (size_t)stream->featureCount) {
+            free(batch[n].features);
+            freeShapeData(batch, n);
+            profileEnd(&scope);
+            return -ERR_FEATURES_VALUES;
+        }
+        stream->remaining--;
+        n++;
+    }
+
+    struct dirent *ent;
+    while (n < maxCount && stream->dir && (ent = readdir(stream->dir)) != NULL) {
+        if (!strstr(ent->d_name, stream->extension)) {
+            continue;
+        }
+        char *filename = malloc(strlen(stream->directory) + strlen(ent->d_name) + 2);
+        if (!filename) {
+            perror("Memory allocation failed for filename");
+            exit(ERR_MEMORY_ALLOCATION_FAILED);
+        }
+        sprintf(filename, "%s/%s", stream->directory, ent->d_name);
+        batch[n++] = readFile(filename);
+        free(filename);
+    }
+    profileCount(PROFILE_READ, PROFILE_ALLOCATIONS, n);
+    profileEnd(&scope);
+    return n;
+}
+
+// Closes the directory or the dataset file of a stream.
+void closeShapeStream(ShapeStream *stream) {
+    if (stream->dir) {
+        closedir(stream->dir);
+    }
+    if (stream->file) {
+        fclose(stream->file);
+    }
+    stream->dir = NULL;
+    stream->file = NULL;
 }
@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <dirent.h>
+#include <stdint.h>
 
 // Error codes for various failure scenarios
 #define SUCCESS 0
@@ -20,6 +21,10 @@
 #define ERR_UNKNOWN_FILE_TYPE 5
 #define ERR_FEATURES_VALUES 6
 
+// Binary dataset format
+#define DATASET_MAGIC "RFDATA"
+#define DATASET_VERSION 1
+
 /**
  * @struct ShapeData
  * @brief Structure representing the data of a shape.
@@ -31,13 +36,42 @@ typedef struct {
     int featureCount;    /**< Number of elements in the features array. */
 } ShapeData;
 
+/**
+ * @struct DatasetFileHeader
+ * @brief Header of a binary dataset file.
+ *
+ * The header is followed by sampleCount records, each made of the int32 class, the
+ * int32 sample number and featureCount doubles, in native byte order.
+ */
+typedef struct {
+    char magic[8];           /**< DATASET_MAGIC, zero padded. */
+    uint32_t version;        /**< DATASET_VERSION. */
+    uint32_t featureCount;   /**< Number of features of every sample. */
+    uint64_t sampleCount;    /**< Number of records following the header. */
+} DatasetFileHeader;
+
+/**
+ * @struct ShapeStream
+ * @brief Reader returning the samples of a directory or a binary dataset a batch at a time.
+ */
+typedef struct {
+    DIR *dir;                /**< Directory being listed, NULL for a binary dataset. */
+    FILE *file;              /**< Binary dataset being read, NULL for a directory. */
+    const char *directory;   /**< Path of the directory; not owned. */
+    const char *extension;   /**< Extension of the files to read; not owned. */
+    uint64_t remaining;      /**< Records left in the binary dataset. */
+    int featureCount;        /**< Features of every record of the binary dataset. */
+} ShapeStream;
+
 /**
  * @brief Reads all files with a specified extension in a given directory.
  *
  * This function reads all files with the specified extension in a directory,
  * extracts shape data from each file, and returns an array of ShapeData structures.
+ * If the path is a regular file instead of a directory, it is read as a binary
+ * dataset with readBinaryDataset and the extension is ignored.
  *
- * @param directory Path to the directory containing files.
+ * @param directory Path to the directory containing files, or to a binary dataset.
  * @param extension File extension to filter the files to be read.
  * @param count Pointer to an integer to store the number of files read.
  * @return Pointer to an array of ShapeData, each element representing one file's data.
@@ -65,13 +99,27 @@ ShapeData readFile(const char *filename);
  */
 void freeShapeData(ShapeData *data, int count);
 
+/**
+ * @brief Returns the number of classes of a dataset.
+ *
+ * Classes are numbered from 1, so this is the largest class label present.
+ *
+ * @param data Pointer to the array of ShapeData.
+ * @param count Number of elements in the array.
+ * @return Largest class label, 0 for an empty dataset.
+ */
+int countClasses(const ShapeData *data, int count);
+
 /**
  * @brief Determines the expected number of features in a file based on its extension.
  *
  * This function determines the expected number of features in a file based on its extension.
  *
  * @param filename Path to the file.
- * @return Expected number of features for known file types, or ERR_UNKNOWN_FILE_TYPE for unknown types.
+ * Files with another extension are assumed to hold one feature per line and their
+ * lines are counted.
+ *
+ * @return Expected number of features, or a negative value if the file cannot be read.
  */
 int getExpectedFeatureCount(const char *filename);
 
@@ -109,4 +157,78 @@ int allocateFeatures(ShapeData *data);
  */
 int readFeaturesFromFile(FILE *file, double *features, int featureCount);
 
+/**
+ * @brief Reads a binary dataset file.
+ *
+ * @param path Path of the file written by writeBinaryDataset.
+ * @param count Pointer to an integer to store the number of samples read.
+ * @return Array of ShapeData released with freeShapeData, or NULL on failure.
+ */
+ShapeData* readBinaryDataset(const char *path, int *count);
+
+/**
+ * @brief Opens a directory of shape files or a binary dataset for reading in batches.
+ *
+ * Only the samples of the current batch are held in memory, so datasets of any size
+ * can be processed in a single pass.
+ *
+ * @param stream Stream to initialize, released with closeShapeStream.
+ * @param path Directory of shape files or binary dataset, as for readAllFiles.
+ * @param extension File extension to filter the files of a directory.
+ * @return SUCCESS, ERR_DIR_OPEN_FAILED or ERR_FILE_OPEN_FAILED.
+ */
+int openShapeStream(ShapeStream *stream, const char *path, const char *extension);
+
+/**
+ * @brief Reads the next samples of a stream.
+ *
+ * @param stream Open stream.
+ * @param batch Output array receiving up to maxCount samples, released with freeShapeData or per sample.
+ * @param maxCount Largest number of samples to read.
+ * @return Number of samples read, 0 at the end of the stream, or -ERR_FEATURES_VALUES on a read error.
+ */
+int readShapeBatch(ShapeStream *stream, ShapeData *batch, int maxCount);
+
+/**
+ * @brief Closes a stream.
+ *
+ * @param stream Stream to close.
+ */
+void closeShapeStream(ShapeStream *stream);
+
+/**
+ * @brief Writes the header of a binary dataset file.
+ *
+ * Together with writeBinaryDatasetRecord, this allows datasets larger than memory
+ * to be streamed to disk one sample at a time.
+ *
+ * @param file File open for writing, positioned at its start.
+ * @param featureCount Number of features of every sample.
+ * @param sampleCount Number of records that will follow.
+ * @return SUCCESS or ERR_FEATURES_VALUES on a write error.
+ */
+int writeBinaryDatasetHeader(FILE *file, int featureCount, uint64_t sampleCount);
+
+/**
+ * @brief Appends one sample to a binary dataset file.
+ *
+ * @param file File whose header has been written.
+ * @param shapeClass Class of the sample.
+ * @param sample Sample number.
+ * @param features Feature values, as many as declared in the header.
+ * @param featureCount Number of features.
+ * @return SUCCESS or ERR_FEATURES_VALUES on a write error.
+ */
+int writeBinaryDatasetRecord(FILE *file, int shapeClass, int sample, const double *features, int featureCount);
+
+/**
+ * @brief Writes samples to a binary dataset file.
+ *
+ * @param path Path of the file to create.
+ * @param data Array of samples, all with the same number of features.
+ * @param count Number of samples.
+ * @return SUCCESS, ERR_FILE_OPEN_FAILED or ERR_FEATURES_VALUES.
+ */
+int writeBinaryDataset(const char *path, const ShapeData *data, int count);
+
 #endif // DATA_READER_H
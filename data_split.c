@@ -1,63 +1,192 @@
 #include "data_split.h"
+#include "random.h"
 
-// Shuffles an array of ShapeData.
-void shuffleData(ShapeData *shapes, int size) {
-    // Initialize random number generator only once
-    static int rand_initialized = 0;
-    if (!rand_initialized) {
-        srand(time(NULL));
-        rand_initialized = 1;
+#include <string.h>
+
+/**
+ * @struct StratumEntry
+ * @brief Sort key grouping the samples by class, in storage order within a class.
+ */
+typedef struct {
+    int class;
+    int index;
+} StratumEntry;
+
+// Orders entries by class, then by index.
+static int compareStratumEntries(const void *a, const void *b) {
+    const StratumEntry *x = a, *y = b;
+    if (x->class != y->class) {
+        return (x->class > y->class) - (x->class < y->class);
     }
+    return (x->index > y->index) - (x->index < y->index);
+}
 
-    // Shuffle using Fisher-Yates algorithm
+// Shuffles an array of indices with the Fisher-Yates algorithm.
+void shuffleIndices(int *indices, int size, uint64_t seed) {
     for (int i = size - 1; i > 0; i--) {
-        int j = rand() % (i + 1);
-        ShapeData temp = shapes[i];
-        shapes[i] = shapes[j];
-        shapes[j] = temp;
+        int j = (int)randomBelow(counterRandom(seed, i), (uint64_t)i + 1);
+        int temp = indices[i];
+        indices[i] = indices[j];
+        indices[j] = temp;
     }
 }
 
-// Splits shape data into training and test sets.
-SplitData splitData(ShapeData *shapes, int totalSize, float trainingFraction) {
+// Marks the training samples of every class, each class shuffled on its own stream.
+static int markStratifiedTraining(const ShapeData *data, int totalSize, float trainingFraction, uint64_t seed,
+                                  int *order, bool *inTraining) {
+    StratumEntry *entries = malloc(totalSize * sizeof(StratumEntry));
+    int *starts = malloc((totalSize + 1) * sizeof(int));
+    if (!entries || !starts) {
+        free(entries);
+        free(starts);
+        return SPLIT_ERR_MEMORY_FAILURE;
+    }
+    for (int i = 0; i < totalSize; i++) {
+        entries[i] = (StratumEntry){data[i].class, i};
+    }
+    qsort(entries, totalSize, sizeof(StratumEntry), compareStratumEntries);
+    int strata = 0;
+    for (int i = 0; i < totalSize; i++) {
+        order[i] = entries[i].index;
+        if (i == 0 || entries[i].class != entries[i - 1].class) {
+            starts[strata++] = i;
+        }
+    }
+    starts[strata] = totalSize;
+
+    // The stream of a class depends only on the seed and the class, not on the other classes
+    #pragma omp parallel for schedule(dynamic)
+    for (int s = 0; s < strata; s++) {
+        int size = starts[s + 1] - starts[s];
+        int *members = order + starts[s];
+        shuffleIndices(members, size, deriveSeed(seed, (uint32_t)data[members[0]].class));
+        int trainingCount = (int)(size * trainingFraction + 0.5f);
+        for (int i = 0; i < trainingCount; i++) {
+            inTraining[members[i]] = true;
+        }
+    }
+
+    free(entries);
+    free(starts);
+    return SPLIT_SUCCESS;
+}
+
+// Draws a random split of a dataset into training and test indices.
+int splitIndices(IndexSplit *split, const ShapeData *data, int totalSize, float trainingFraction, bool stratified,
+                 uint64_t seed) {
+    memset(split, 0, sizeof(IndexSplit));
     // Validate input parameters
-    if (!shapes || trainingFraction < 0.0 || trainingFraction > 1.0) {
-        return (SplitData){NULL, 0, NULL, 0};
+    if (!data || totalSize <= 0 || trainingFraction < 0.0 || trainingFraction > 1.0) {
+        return SPLIT_ERR_INVALID_INPUT;
     }
 
-    // Shuffle data for random distribution
-    shuffleData(shapes, totalSize);
+    int *order = malloc(totalSize * sizeof(int));
+    bool *inTraining = calloc(totalSize, sizeof(bool));
+    int *indices = malloc(totalSize * sizeof(int));
+    if (!order || !inTraining || !indices) {
+        free(order);
+        free(inTraining);
+        free(indices);
+        return SPLIT_ERR_MEMORY_FAILURE;
+    }
 
-    SplitData split = {NULL, 0, NULL, 0};
-    int trainingSize = (int)(totalSize * trainingFraction);
-    int testSize = totalSize - trainingSize;
+    int status = SPLIT_SUCCESS;
+    if (stratified) {
+        status = markStratifiedTraining(data, totalSize, trainingFraction, seed, order, inTraining);
+    } else {
+        for (int i = 0; i < totalSize; i++) {
+            order[i] = i;
+        }
+        shuffleIndices(order, totalSize, seed);
+        int trainingCount = (int)(totalSize * trainingFraction);
+        for (int i = 0; i < trainingCount; i++) {
+            inTraining[order[i]] = true;
+        }
+    }
+    if (status != SPLIT_SUCCESS) {
+        free(order);
+        free(inTraining);
+        free(indices);
+        return status;
+    }
 
-    // Memory allocation for training and test sets
-    split.trainingSet = (ShapeData *)malloc(trainingSize * sizeof(ShapeData));
-    if (!split.trainingSet) {
+    // Emit both sides in storage order
+    int trainingSize = 0;
+    for (int i = 0; i < totalSize; i++) {
+        if (inTraining[i]) indices[trainingSize++] = i;
+    }
+    int testSize = 0;
+    for (int i = 0; i < totalSize; i++) {
+        if (!inTraining[i]) indices[trainingSize + testSize++] = i;
+    }
+
+    *split = (IndexSplit){data, indices, trainingSize, indices + trainingSize, testSize};
+    free(order);
+    free(inTraining);
+    return SPLIT_SUCCESS;
+}
+
+// Draws the independent splits of repeated random subsampling, in parallel.
+int repeatedSplits(IndexSplit *splits, int repetitions, const ShapeData *data, int totalSize, float trainingFraction,
+                   bool stratified, uint64_t seed) {
+    if (!splits || repetitions <= 0) {
+        return SPLIT_ERR_INVALID_INPUT;
+    }
+    int status = SPLIT_SUCCESS;
+    #pragma omp parallel for schedule(dynamic)
+    for (int r = 0; r < repetitions; r++) {
+        int result = splitIndices(&splits[r], data, totalSize, trainingFraction, stratified, deriveSeed(seed, r));
+        if (result != SPLIT_SUCCESS) {
+            #pragma omp atomic write
+            status = result;
+        }
+    }
+    if (status != SPLIT_SUCCESS) {
+        for (int r = 0; r < repetitions; r++) {
+            freeIndexSplit(&splits[r]);
+        }
+    }
+    return status;
+}
+
+// Splits shape data into training and test sets.
+SplitData splitData(const ShapeData *shapes, int totalSize, float trainingFraction, bool stratified, uint64_t seed) {
+    IndexSplit indices;
+    if (splitIndices(&indices, shapes, totalSize, trainingFraction, stratified, seed) != SPLIT_SUCCESS) {
         return (SplitData){NULL, 0, NULL, 0};
     }
 
-    split.testSet = (ShapeData *)malloc(testSize * sizeof(ShapeData));
-    if (!split.testSet) {
+    // Memory allocation for training and test sets
+    SplitData split = {NULL, indices.trainingSize, NULL, indices.testSize};
+    split.trainingSet = malloc((indices.trainingSize > 0 ? indices.trainingSize : 1) * sizeof(ShapeData));
+    split.testSet = malloc((indices.testSize > 0 ? indices.testSize : 1) * sizeof(ShapeData));
+    if (!split.trainingSet || !split.testSet) {
         free(split.trainingSet);
+        free(split.testSet);
+        freeIndexSplit(&indices);
         return (SplitData){NULL, 0, NULL, 0};
     }
 
-    // Distribute data into training and test sets
-    for (int i = 0; i < trainingSize; i++) {
-        split.trainingSet[i] = shapes[i];
+    // Gather the samples of each side; they keep pointing to the features of the dataset
+    for (int i = 0; i < indices.trainingSize; i++) {
+        split.trainingSet[i] = shapes[indices.trainingIndices[i]];
     }
-    for (int i = 0; i < testSize; i++) {
-        split.testSet[i] = shapes[i + trainingSize];
+    for (int i = 0; i < indices.testSize; i++) {
+        split.testSet[i] = shapes[indices.testIndices[i]];
     }
-
-    split.trainingSize = trainingSize;
-    split.testSize = testSize;
-
+    freeIndexSplit(&indices);
     return split;
 }
 
+// Frees the index lists of a split.
+void freeIndexSplit(IndexSplit *split) {
+    if (split) {
+        // The test indices share the allocation of the training indices
+        free(split->trainingIndices);
+        memset(split, 0, sizeof(IndexSplit));
+    }
+}
+
 // Frees the dynamically allocated memory in a SplitData structure.
 void freeSplitData(SplitData *split) {
     if (split) {
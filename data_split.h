@@ -1,6 +1,16 @@
 /**
  * @file data_split.h
  * @brief Header file for functions related to splitting shape data into training and test sets.
+ *
+ * A split is drawn as a pair of index lists over the dataset (IndexSplit). Cross-validation
+ * and repeated random subsampling work on the indices directly. The -f modes (k-NN,
+ * nearest centroid, incremental k-NN, compressed search) take contiguous sample arrays,
+ * so splitData copies the ShapeData records of each side into two new arrays; the
+ * features the records point to stay shared with the dataset. The lists are drawn from
+ * a seeded counter-based generator (see random.h), so a seed reproduces a split exactly,
+ * and independent streams let the classes of a stratified split and the repetitions of
+ * repeated random subsampling be shuffled in parallel with the same result as a
+ * sequential run.
  */
 
 #ifndef DATA_SPLIT_H
@@ -8,16 +18,36 @@
 
 #include "data_reader.h" // Include to access the ShapeData structure definition.
 
-#include <time.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 // Define error codes for split operations
 #define SPLIT_SUCCESS 0
 #define SPLIT_ERR_INVALID_INPUT -1
 #define SPLIT_ERR_MEMORY_FAILURE -2
 
+// Seed of the splits when none is given
+#define SPLIT_DEFAULT_SEED 42
+
 /**
- * @struct ShapeData
- * @brief Structure to hold split data sets: training and test sets.
+ * @struct IndexSplit
+ * @brief Training and test sets given as indices into the whole dataset.
+ *
+ * Both lists are in increasing index order, so the samples are visited in storage order.
+ */
+typedef struct {
+    const ShapeData *data;  /**< The whole dataset; not owned. */
+    int *trainingIndices;   /**< Indices of the training samples, followed in the same allocation by the test indices. */
+    int trainingSize;       /**< Number of training samples. */
+    int *testIndices;       /**< Indices of the test samples. */
+    int testSize;           /**< Number of test samples. */
+} IndexSplit;
+
+/**
+ * @struct SplitData
+ * @brief Training and test sets gathered as sample arrays, for the algorithms that take contiguous samples.
+ *
+ * The samples share the features of the dataset, so preprocessing them transforms the dataset.
  */
 typedef struct {
     ShapeData *trainingSet; /**< Array of ShapeData for the training set. */
@@ -26,27 +56,74 @@ typedef struct {
     int testSize;           /**< Number of elements in the test set. */
 } SplitData;
 
+/**
+ * @brief Draws a random split of a dataset into training and test indices.
+ *
+ * Without stratification the training set is the first floor(totalSize * trainingFraction)
+ * samples of a seeded shuffle. With stratification every class is shuffled on its own
+ * stream and contributes its share of training samples, rounded to the nearest sample.
+ *
+ * @param split Split to initialize, released with freeIndexSplit.
+ * @param data Pointer to the dataset, which must outlive the split.
+ * @param totalSize Number of samples.
+ * @param trainingFraction Fraction of data to be used for training (0.0 - 1.0).
+ * @param stratified Keep the class proportions in both sets.
+ * @param seed Seed of the shuffle.
+ * @return SPLIT_SUCCESS or a SPLIT_ERR_* code.
+ */
+int splitIndices(IndexSplit *split, const ShapeData *data, int totalSize, float trainingFraction, bool stratified,
+                 uint64_t seed);
+
+/**
+ * @brief Draws the independent splits of repeated random subsampling, in parallel.
+ *
+ * Split r uses the sub-stream r of the seed, so the splits do not depend on the thread count.
+ *
+ * @param splits Output array of repetitions splits, each released with freeIndexSplit.
+ * @param repetitions Number of splits.
+ * @param data Pointer to the dataset, which must outlive the splits.
+ * @param totalSize Number of samples.
+ * @param trainingFraction Fraction of data to be used for training (0.0 - 1.0).
+ * @param stratified Keep the class proportions in both sets.
+ * @param seed Seed of the whole sequence of splits.
+ * @return SPLIT_SUCCESS or a SPLIT_ERR_* code; on failure no split is left allocated.
+ */
+int repeatedSplits(IndexSplit *splits, int repetitions, const ShapeData *data, int totalSize, float trainingFraction,
+                   bool stratified, uint64_t seed);
+
 /**
  * @brief Splits shape data into training and test sets.
  *
- * The function shuffles the data before splitting to ensure random distribution.
+ * Draws an IndexSplit and copies the ShapeData records of each side into new arrays; the
+ * features they point to are shared with the dataset, not copied, and the order of the
+ * shapes array is left unchanged.
  *
  * @param shapes Pointer to the array of ShapeData to be split
  * @param totalSize Total number of elements in the shapes array
  * @param trainingFraction Fraction of data to be used for training (0.0 - 1.0)
+ * @param stratified Keep the class proportions in both sets
+ * @param seed Seed of the shuffle
  * @return A SplitData structure containing training and test sets
  */
-SplitData splitData(ShapeData *shapes, int totalSize, float trainingFraction);
+SplitData splitData(const ShapeData *shapes, int totalSize, float trainingFraction, bool stratified, uint64_t seed);
 
 /**
- * @brief Shuffles an array of ShapeData.
+ * @brief Shuffles an array of indices with the Fisher-Yates algorithm.
+ *
+ * Draw i is the i-th output of the stream of the seed, so the same seed gives the same order.
  *
- * Algorithm for randomizing the order of elements.
+ * @param indices Pointer to the array of indices to shuffle
+ * @param size Number of elements in the indices array
+ * @param seed Seed of the shuffle
+ */
+void shuffleIndices(int *indices, int size, uint64_t seed);
+
+/**
+ * @brief Frees the index lists of a split.
  *
- * @param shapes Pointer to the array of ShapeData to shuffle
- * @param size Number of elements in the shapes array
+ * @param split Pointer to the IndexSplit to be freed
  */
-void shuffleData(ShapeData *shapes, int size);
+void freeIndexSplit(IndexSplit *split);
 
 /**
  * @brief Frees the dynamically allocated memory in a SplitData structure.
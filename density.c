@@ -0,0 +1,391 @@
+#include "density.h"
+#include "kd_tree.h"
+#include "hierarchical.h"
+#include "profiler.h"
+#include "arena.h"
+
+#include <float.h>
+#include <math.h>
+#include <omp.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+// Returns the root of a node while other threads may link roots; halves the path on the way.
+static int findRootAtomic(int *parent, int node) {
+    int next;
+    while ((next = __atomic_load_n(&parent[node], __ATOMIC_RELAXED)) != node) {
+        int grandparent = __atomic_load_n(&parent[next], __ATOMIC_RELAXED);
+        if (grandparent != next) {
+            int expected = next;
+            __atomic_compare_exchange_n(&parent[node], &expected, grandparent, false, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED);
+        }
+        node = grandparent;
+    }
+    return node;
+}
+
+// Joins the sets of two nodes without locks; a root is only ever linked under a smaller one, so no cycle forms.
+static void uniteAtomic(int *parent, int a, int b) {
+    while (true) {
+        a = findRootAtomic(parent, a);
+        b = findRootAtomic(parent, b);
+        if (a == b) {
+            return;
+        }
+        if (a < b) {
+            int swap = a;
+            a = b;
+            b = swap;
+        }
+        int expected = a;
+        if (__atomic_compare_exchange_n(&parent[a], &expected, b, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            return;
+        }
+    }
+}
+
+// Numbers the sets of the labeled samples by their first sample; labels name any member of the set on input.
+static int numberClusters(int *parent, int *labels, int dataSize, int *clusterOfRoot) {
+    int clusterCount = 0;
+    for (int i = 0; i < dataSize; i++) {
+        clusterOfRoot[i] = DENSITY_NOISE;
+    }
+    for (int i = 0; i < dataSize; i++) {
+        if (labels[i] != DENSITY_NOISE) {
+            int root = findRootAtomic(parent, labels[i]);
+            if (clusterOfRoot[root] == DENSITY_NOISE) {
+                clusterOfRoot[root] = clusterCount++;
+            }
+            labels[i] = clusterOfRoot[root];
+        }
+    }
+    return clusterCount;
+}
+
+// Clusters samples with DBSCAN.
+int dbscan(const ShapeData *data, int dataSize, int featureCount, int p, double eps, int minPoints, int *labels) {
+    if (!data || !labels || dataSize <= 0 || featureCount <= 0 || p <= 0 || eps < 0 || minPoints <= 0) {
+        fprintf(stderr, "Invalid parameters for DBSCAN\n");
+        return DENSITY_ERR_INVALID_INPUT;
+    }
+    KdTree tree;
+    int status = buildKdTree(&tree, data, dataSize, featureCount, p);
+    if (status != KD_TREE_SUCCESS) {
+        return status == KD_TREE_ERR_MEMORY ? DENSITY_ERR_MEMORY : DENSITY_ERR_INVALID_INPUT;
+    }
+    // The neighborhood of sample i is counts[i] indices at offsets[i] in the list of the thread owner[i]
+    int threadCount = omp_get_max_threads();
+    char *core = malloc(dataSize);
+    int *parent = malloc(dataSize * sizeof(int));
+    int *counts = malloc(dataSize * sizeof(int));
+    int *owner = malloc(dataSize * sizeof(int));
+    size_t *offsets = malloc(dataSize * sizeof(size_t));
+    int **lists = calloc(threadCount, sizeof(int *));
+    if (!core || !parent || !counts || !owner || !offsets || !lists) {
+        fprintf(stderr, "Memory allocation failed for DBSCAN\n");
+        free(core);
+        free(parent);
+        free(counts);
+        free(owner);
+        free(offsets);
+        free(lists);
+        freeKdTree(&tree);
+        return DENSITY_ERR_MEMORY;
+    }
+    profileCount(PROFILE_KMEANS, PROFILE_ALLOCATIONS, 6);
+    ProfileScope scope = profileBegin(PROFILE_KMEANS);
+
+    status = DENSITY_SUCCESS;
+    #pragma omp parallel
+    {
+        int thread = omp_get_thread_num();
+        int *neighbors = NULL;
+        int capacity = 0;
+        size_t used = 0, listCapacity = 0;
+
+        // Core points have at least minPoints samples within eps; each neighborhood is kept for the second pass
+        #pragma omp for schedule(dynamic, DENSITY_QUERY_BLOCK)
+        for (int i = 0; i < dataSize; i++) {
+            int count = kdTreeRadius(&tree, data[i].features, eps, &neighbors, &capacity);
+            if (count > 0 && used + count > listCapacity) {
+                size_t grown = 2 * listCapacity > used + count ? 2 * listCapacity : used + count;
+                int *list = realloc(lists[thread], grown * sizeof(int));
+                if (list) {
+                    lists[thread] = list;
+                    listCapacity = grown;
+                } else {
+                    count = KD_TREE_ERR_MEMORY;
+                }
+            }
+            if (count < 0) {
+                #pragma omp atomic write
+                status = DENSITY_ERR_MEMORY;
+                count = 0;
+            }
+            if (count > 0) {
+                memcpy(lists[thread] + used, neighbors, count * sizeof(int));
+            }
+            owner[i] = thread;
+            offsets[i] = used;
+            counts[i] = count;
+            used += count;
+            core[i] = count >= minPoints;
+            parent[i] = i;
+        }
+        free(neighbors);
+
+        // Core points join their core neighbors, the other samples remember their nearest core neighbor
+        #pragma omp for schedule(dynamic, DENSITY_QUERY_BLOCK)
+        for (int i = 0; i < dataSize; i++) {
+            const int *neighborhood = counts[i] > 0 ? lists[owner[i]] + offsets[i] : NULL;
+            int count = counts[i];
+            int nearest = DENSITY_NOISE;
+            double nearestDistance = INFINITY;
+            for (int n = 0; n < count; n++) {
+                int j = neighborhood[n];
+                if (!core[j] || j == i) {
+                    continue;
+                }
+                if (core[i]) {
+                    // Every pair of core neighbors is seen from both sides; one is enough
+                    if (j > i) {
+                        uniteAtomic(parent, i, j);
+                    }
+                    continue;
+                }
+                double distance = minkowskiPowerSum(data[i].features, data[j].features, featureCount, p);
+                if (distance < nearestDistance || (distance == nearestDistance && j < nearest)) {
+                    nearestDistance = distance;
+                    nearest = j;
+                }
+            }
+            labels[i] = core[i] ? i : nearest;
+        }
+    }
+    for (int t = 0; t < threadCount; t++) {
+        free(lists[t]);
+    }
+
+    int clusterCount = status;
+    if (status == DENSITY_SUCCESS) {
+        Arena *scratch = scratchArena(PROFILE_KMEANS);
+        ArenaMark mark = arenaMark(scratch);
+        int *clusterOfRoot = arenaAlloc(scratch, dataSize * sizeof(int));
+        clusterCount = clusterOfRoot ? numberClusters(parent, labels, dataSize, clusterOfRoot) : DENSITY_ERR_MEMORY;
+        arenaReset(scratch, mark);
+    }
+    profileEnd(&scope);
+    free(core);
+    free(parent);
+    free(counts);
+    free(owner);
+    free(offsets);
+    free(lists);
+    freeKdTree(&tree);
+    return clusterCount;
+}
+
+// Condenses the dendrogram into clusters of at least minClusterSize samples and labels the most stable ones.
+static int selectStableClusters(const Dendrogram *dendrogram, int minClusterSize, int *labels) {
+    int n = dendrogram->size;
+    Arena *scratch = scratchArena(PROFILE_KMEANS);
+    ArenaMark mark = arenaMark(scratch);
+    // Each split creates two clusters, so there are fewer than n of them with the root
+    int *state = arenaAlloc(scratch, n * sizeof(int));
+    int *fallenFrom = arenaAlloc(scratch, n * sizeof(int));
+    int *clusterParent = arenaAlloc(scratch, n * sizeof(int));
+    int *owner = arenaAlloc(scratch, n * sizeof(int));
+    double *birth = arenaAlloc(scratch, n * sizeof(double));
+    double *stability = arenaCalloc(scratch, n, sizeof(double));
+    double *childStability = arenaCalloc(scratch, n, sizeof(double));
+    char *selected = arenaCalloc(scratch, n, 1);
+    if (!state || !fallenFrom || !clusterParent || !owner || !birth || !stability || !childStability || !selected) {
+        arenaReset(scratch, mark);
+        return DENSITY_ERR_MEMORY;
+    }
+
+    // Walk the merges from the root down. state holds the cluster an internal node belongs to,
+    // or -(c + 1) once its samples fell out of cluster c; a fall adds to the stability of c
+    int clusterCount = 1;
+    clusterParent[0] = -1;
+    birth[0] = 0.0;
+    state[n - 2] = 0;
+    for (int i = n - 2; i >= 0; i--) {
+        const DendrogramMerge *merge = &dendrogram->merges[i];
+        int children[2] = {merge->left, merge->right};
+        int cluster = state[i];
+        if (cluster < 0) {
+            for (int c = 0; c < 2; c++) {
+                if (children[c] < n) {
+                    fallenFrom[children[c]] = -cluster - 1;
+                } else {
+                    state[children[c] - n] = cluster;
+                }
+            }
+            continue;
+        }
+
+        double lambda = 1.0 / fmax(merge->height, DBL_EPSILON);
+        int sizes[2];
+        for (int c = 0; c < 2; c++) {
+            sizes[c] = children[c] < n ? 1 : dendrogram->merges[children[c] - n].size;
+        }
+        if (sizes[0] >= minClusterSize && sizes[1] >= minClusterSize) {
+            // A true split: both halves are born as clusters at this density
+            stability[cluster] += (sizes[0] + sizes[1]) * (lambda - birth[cluster]);
+            for (int c = 0; c < 2; c++) {
+                clusterParent[clusterCount] = cluster;
+                birth[clusterCount] = lambda;
+                state[children[c] - n] = clusterCount++;
+            }
+            continue;
+        }
+        for (int c = 0; c < 2; c++) {
+            if (sizes[c] >= minClusterSize) {
+                state[children[c] - n] = cluster;
+                continue;
+            }
+            stability[cluster] += sizes[c] * (lambda - birth[cluster]);
+            if (children[c] < n) {
+                fallenFrom[children[c]] = cluster;
+            } else {
+                state[children[c] - n] = -cluster - 1;
+            }
+        }
+    }
+
+    // Children are numbered after their parents: keep a cluster unless its children are more stable together
+    for (int c = clusterCount - 1; c >= 1; c--) {
+        if (childStability[c] > stability[c]) {
+            stability[c] = childStability[c];
+        } else {
+            selected[c] = 1;
+        }
+        childStability[clusterParent[c]] += stability[c];
+    }
+    // A selected cluster takes the samples of its descendants
+    owner[0] = DENSITY_NOISE;
+    for (int c = 1; c < clusterCount; c++) {
+        owner[c] = owner[clusterParent[c]] != DENSITY_NOISE ? owner[clusterParent[c]]
+                   : selected[c] ? c : DENSITY_NOISE;
+    }
+
+    int *labelOf = state;
+    for (int c = 0; c < clusterCount; c++) {
+        labelOf[c] = DENSITY_NOISE;
+    }
+    int labelCount = 0;
+    for (int i = 0; i < n; i++) {
+        int cluster = owner[fallenFrom[i]];
+        if (cluster != DENSITY_NOISE && labelOf[cluster] == DENSITY_NOISE) {
+            labelOf[cluster] = labelCount++;
+        }
+        labels[i] = cluster == DENSITY_NOISE ? DENSITY_NOISE : labelOf[cluster];
+    }
+    arenaReset(scratch, mark);
+    return labelCount;
+}
+
+// Clusters samples with HDBSCAN.
+int hdbscan(const ShapeData *data, int dataSize, int featureCount, int p, int minPoints, int minClusterSize,
+            int *labels) {
+    if (!data || !labels || dataSize <= 0 || featureCount <= 0 || p <= 0 || minPoints <= 0 ||
+        minPoints > dataSize || minClusterSize < 2) {
+        fprintf(stderr, "Invalid parameters for HDBSCAN\n");
+        return DENSITY_ERR_INVALID_INPUT;
+    }
+    if (dataSize == 1) {
+        labels[0] = DENSITY_NOISE;
+        return 0;
+    }
+    KdTree tree;
+    int status = buildKdTree(&tree, data, dataSize, featureCount, p);
+    if (status != KD_TREE_SUCCESS) {
+        return status == KD_TREE_ERR_MEMORY ? DENSITY_ERR_MEMORY : DENSITY_ERR_INVALID_INPUT;
+    }
+    double *coreDistance = malloc(dataSize * sizeof(double));
+    double *reach = malloc(dataSize * sizeof(double));
+    int *from = malloc(dataSize * sizeof(int));
+    char *inTree = calloc(dataSize, 1);
+    DendrogramEdge *edges = malloc(dataSize * sizeof(DendrogramEdge));
+    if (!coreDistance || !reach || !from || !inTree || !edges) {
+        fprintf(stderr, "Memory allocation failed for HDBSCAN\n");
+        free(coreDistance);
+        free(reach);
+        free(from);
+        free(inTree);
+        free(edges);
+        freeKdTree(&tree);
+        return DENSITY_ERR_MEMORY;
+    }
+    profileCount(PROFILE_KMEANS, PROFILE_ALLOCATIONS, 5);
+    ProfileScope scope = profileBegin(PROFILE_KMEANS);
+
+    // The core distance is the distance to the minPoints-th nearest sample, the sample itself included
+    status = DENSITY_SUCCESS;
+    #pragma omp parallel
+    {
+        Arena *scratch = scratchArena(PROFILE_KMEANS);
+        ArenaMark mark = arenaMark(scratch);
+        DistanceLabel *neighbors = arenaAlloc(scratch, minPoints * sizeof(DistanceLabel));
+
+        #pragma omp for schedule(dynamic, DENSITY_QUERY_BLOCK)
+        for (int i = 0; i < dataSize; i++) {
+            if (!neighbors || kdTreeSearch(&tree, &data[i], minPoints, neighbors) != KD_TREE_SUCCESS) {
+                #pragma omp atomic write
+                status = DENSITY_ERR_MEMORY;
+                continue;
+            }
+            coreDistance[i] = neighbors[minPoints - 1].distance;
+        }
+        arenaReset(scratch, mark);
+    }
+    freeKdTree(&tree);
+
+    // Prim's algorithm on the mutual reachability distance, computed on the fly
+    int current = 0;
+    for (int i = 0; i < dataSize; i++) {
+        reach[i] = INFINITY;
+    }
+    for (int step = 0; step < dataSize - 1 && status == DENSITY_SUCCESS; step++) {
+        inTree[current] = 1;
+        #pragma omp parallel for schedule(static) if (dataSize >= DENSITY_PARALLEL_SIZE)
+        for (int x = 0; x < dataSize; x++) {
+            if (!inTree[x]) {
+                double distance = minkowskiDistance(data[current], data[x], featureCount, p);
+                distance = fmax(distance, fmax(coreDistance[current], coreDistance[x]));
+                if (distance < reach[x]) {
+                    reach[x] = distance;
+                    from[x] = current;
+                }
+            }
+        }
+        int next = -1;
+        for (int x = 0; x < dataSize; x++) {
+            if (!inTree[x] && (next < 0 || reach[x] < reach[next])) {
+                next = x;
+            }
+        }
+        edges[step] = (DendrogramEdge){from[next], next, reach[next]};
+        current = next;
+    }
+    profileCount(PROFILE_KMEANS, PROFILE_DISTANCE_EVALUATIONS, (uint64_t)dataSize * (dataSize - 1) / 2);
+
+    int clusterCount = status;
+    Dendrogram dendrogram;
+    if (status == DENSITY_SUCCESS) {
+        status = dendrogramFromEdges(edges, dataSize, LINKAGE_SINGLE, &dendrogram);
+        clusterCount = status == HIERARCHICAL_SUCCESS ? selectStableClusters(&dendrogram, minClusterSize, labels)
+                                                      : DENSITY_ERR_MEMORY;
+        freeDendrogram(&dendrogram);
+    }
+    profileEnd(&scope);
+    free(coreDistance);
+    free(reach);
+    free(from);
+    free(inTree);
+    free(edges);
+    return clusterCount;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file density.h
+ * @brief Header file for density-based clustering: DBSCAN and HDBSCAN.
+ *
+ * Density-based clusters are regions where samples lie close together, separated by
+ * sparser regions, so they can take any shape instead of the convex cells of k-Means.
+ * Samples in no dense region are labeled as noise (DENSITY_NOISE) rather than forced
+ * into a cluster.
+ *
+ * DBSCAN calls a sample a core point when at least minPoints samples, itself included,
+ * lie within eps of it. Core points within eps of each other share a cluster, and the
+ * other samples within eps of a core point join the cluster of the nearest one. The
+ * eps-neighborhoods come from a KD-tree and are queried once each, in parallel; they are
+ * kept until every core point is known, and core points are joined with a lock-free
+ * union-find, so the clusters do not depend on the schedule.
+ *
+ * HDBSCAN runs DBSCAN for every eps at once. The core distance of a sample is the
+ * distance to its minPoints-th nearest neighbor, found in parallel with the KD-tree, and
+ * the mutual reachability distance of two samples is the largest of their distance and
+ * both core distances. The minimum spanning tree of that distance gives the single
+ * linkage dendrogram, whose splits into clusters of at least minClusterSize samples are
+ * condensed into a tree; the clusters that persist over the widest range of densities
+ * (the most stable ones) are selected, so no eps has to be chosen. The spanning tree is
+ * built with Prim's algorithm in O(n²) distance evaluations and O(n) memory.
+ */
+
+#ifndef DENSITY_H
+#define DENSITY_H
+
+#include "data_reader.h"
+
+// Error codes
+#define DENSITY_SUCCESS 0
+#define DENSITY_ERR_INVALID_INPUT -1
+#define DENSITY_ERR_MEMORY -2
+
+// Label of the samples that belong to no cluster
+#define DENSITY_NOISE -1
+
+// Neighborhood queries handed to a thread at a time
+#define DENSITY_QUERY_BLOCK 16
+
+// Samples from which the spanning tree updates its distances in parallel
+#define DENSITY_PARALLEL_SIZE 1024
+
+/**
+ * @brief Clusters samples with DBSCAN.
+ *
+ * @param data Array of samples.
+ * @param dataSize Number of samples.
+ * @param featureCount Number of features in each sample.
+ * @param p Minkowski distance exponent.
+ * @param eps Radius of the neighborhoods, inclusive.
+ * @param minPoints Samples, the point itself included, that make a core point.
+ * @param labels Output array of dataSize clusters (0 and up, numbered by their first sample) or DENSITY_NOISE.
+ * @return The number of clusters, or a negative DENSITY_ERR_* code.
+ */
+int dbscan(const ShapeData *data, int dataSize, int featureCount, int p, double eps, int minPoints, int *labels);
+
+/**
+ * @brief Clusters samples with HDBSCAN.
+ *
+ * The root of the condensed tree (all the samples in one cluster) is never selected,
+ * so data without density structure comes out as noise.
+ *
+ * @param data Array of samples.
+ * @param dataSize Number of samples, at least minPoints.
+ * @param featureCount Number of features in each sample.
+ * @param p Minkowski distance exponent.
+ * @param minPoints Neighbor, the point itself included, whose distance is the core distance.
+ * @param minClusterSize Smallest number of samples of a cluster, at least 2.
+ * @param labels Output array of dataSize clusters (0 and up, numbered by their first sample) or DENSITY_NOISE.
+ * @return The number of clusters, or a negative DENSITY_ERR_* code.
+ */
+int hdbscan(const ShapeData *data, int dataSize, int featureCount, int p, int minPoints, int minClusterSize,
+            int *labels);
+
+#endif // DENSITY_H
@@ -0,0 +1,444 @@
+#include "distance_cache.h"
+#include "knn.h"
+#include "profiler.h"
+#include "random.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Values converted per write when a matrix is stored in float32
+#define CONVERSION_CHUNK 4096
+
+/**
+ * @struct CachedFile
+ * @brief Size and last use of one file of the cache directory.
+ */
+typedef struct {
+    struct timespec used;
+    off_t size;
+    char *name;
+} CachedFile;
+
+// Serializes the evictions of the threads of this process; other processes only race on unlink
+static pthread_mutex_t evictionLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Numbers the temporary files written concurrently by the threads of this process
+static int temporaryCounter = 0;
+
+// Returns a 64-bit word rotated left.
+static inline uint64_t rotateLeft(uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+// Absorbs one word into the two independent lanes of a key.
+static inline void absorbWord(uint64_t key[2], uint64_t word) {
+    key[0] = rotateLeft(key[0] ^ mixRandom(word), 29) * 0x9E3779B97F4A7C15ULL;
+    key[1] = rotateLeft(key[1] + mixRandom(word ^ 0xD6E8FEB86659FD93ULL), 31) * 0xC2B2AE3D27D4EB4FULL;
+}
+
+// Absorbs a byte range into a key, eight bytes at a time.
+static void absorbBytes(uint64_t key[2], const void *bytes, size_t size) {
+    const unsigned char *cursor = bytes;
+    for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), cursor += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, cursor, sizeof(word));
+        absorbWord(key, word);
+    }
+    if (size > 0) {
+        uint64_t word = 0;
+        memcpy(&word, cursor, size);
+        absorbWord(key, word ^ ((uint64_t)size << 56));
+    }
+}
+
+// Absorbs the class, sample number and features of every sample of a set.
+static void absorbSamples(uint64_t key[2], const ShapeData *samples, int count, int featureCount) {
+    for (int i = 0; i < count; i++) {
+        int32_t identity[2] = {samples[i].class, samples[i].sample};
+        absorbBytes(key, identity, sizeof(identity));
+        absorbBytes(key, samples[i].features, featureCount * sizeof(double));
+    }
+}
+
+// Fills the header of a matrix, its key included, from the samples it is computed on.
+static void describeMatrix(const DistanceCache *cache, DistanceCacheFileHeader *header, uint32_t kind, int p,
+                           int featureCount, const ShapeData *first, int firstCount, const ShapeData *second,
+                           int secondCount, size_t valueCount) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, DISTANCE_CACHE_MAGIC, sizeof(DISTANCE_CACHE_MAGIC));
+    header->version = DISTANCE_CACHE_VERSION;
+    header->kind = kind;
+    header->precision = cache->precision;
+    header->p = p;
+    header->rows = kind == DISTANCE_CACHE_CONDENSED ? firstCount : secondCount;
+    header->cols = firstCount;
+    header->fileSize = DISTANCE_CACHE_ALIGNMENT + valueCount * cache->precision;
+
+    uint64_t key[2] = {0x243F6A8885A308D3ULL, 0x13198A2E03707344ULL};
+    int32_t shape[6] = {(int32_t)kind, p, cache->precision, featureCount, firstCount, secondCount};
+    absorbBytes(key, shape, sizeof(shape));
+    absorbSamples(key, first, firstCount, featureCount);
+    absorbSamples(key, second, secondCount, featureCount);
+    header->key[0] = mixRandom(key[0] ^ rotateLeft(key[1], 17));
+    header->key[1] = mixRandom(key[1] + header->key[0]);
+}
+
+// Returns the newly allocated path of a file of the cache directory.
+static char *cachePath(const char *directory, const char *name) {
+    char *path = malloc(strlen(directory) + strlen(name) + 2);
+    if (path) {
+        sprintf(path, "%s/%s", directory, name);
+    }
+    return path;
+}
+
+// Returns the newly allocated path of the file of a matrix.
+static char *matrixPath(const DistanceCache *cache, const DistanceCacheFileHeader *header) {
+    char name[64];
+    snprintf(name, sizeof(name), "%016llx%016llx%s", (unsigned long long)header->key[0],
+             (unsigned long long)header->key[1], DISTANCE_CACHE_EXTENSION);
+    return cachePath(cache->directory, name);
+}
+
+// Maps the file of a matrix if it exists and matches the header, and marks it as recently used.
+static void *mapCachedMatrix(const char *path, const DistanceCacheFileHeader *expected) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size != expected->fileSize) {
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED && memcmp(map, expected, sizeof(*expected)) != 0) {
+        munmap(map, st.st_size);
+        map = MAP_FAILED;
+    }
+    if (map != MAP_FAILED) {
+        futimens(fd, NULL); // The modification time orders the eviction
+    }
+    close(fd); // The mapping stays valid after the descriptor is closed
+    return map == MAP_FAILED ? NULL : map;
+}
+
+// Widens float32 values into doubles.
+static void widenValues(double *values, const float *stored, size_t valueCount) {
+    for (size_t i = 0; i < valueCount; i++) {
+        values[i] = stored[i];
+    }
+}
+
+// Rounds computed values to float32, so that a computed matrix equals its later hits.
+static void roundValues(double *values, size_t valueCount) {
+    for (size_t i = 0; i < valueCount; i++) {
+        values[i] = (float)values[i];
+    }
+}
+
+// Orders cached files from the least to the most recently used.
+static int compareLastUse(const void *a, const void *b) {
+    const CachedFile *first = a, *second = b;
+    if (first->used.tv_sec != second->used.tv_sec) {
+        return first->used.tv_sec < second->used.tv_sec ? -1 : 1;
+    }
+    return (first->used.tv_nsec > second->used.tv_nsec) - (first->used.tv_nsec < second->used.tv_nsec);
+}
+
+// Removes the least recently used files until the cache directory fits its capacity.
+static void evictDistanceCache(const DistanceCache *cache) {
+    pthread_mutex_lock(&evictionLock);
+    DIR *dir = opendir(cache->directory);
+    if (!dir) {
+        pthread_mutex_unlock(&evictionLock);
+        return;
+    }
+
+    CachedFile *files = NULL;
+    int fileCount = 0, fileCapacity = 0;
+    uint64_t total = 0;
+    size_t extensionLength = strlen(DISTANCE_CACHE_EXTENSION);
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if (length <= extensionLength || strcmp(entry->d_name + length - extensionLength, DISTANCE_CACHE_EXTENSION) != 0) {
+            continue;
+        }
+        char *path = cachePath(cache->directory, entry->d_name);
+        struct stat st;
+        if (!path || stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            free(path);
+            continue;
+        }
+        if (fileCount == fileCapacity) {
+            fileCapacity = fileCapacity ? 2 * fileCapacity : 16;
+            CachedFile *grown = realloc(files, fileCapacity * sizeof(CachedFile));
+            if (!grown) {
+                free(path);
+                break;
+            }
+            files = grown;
+        }
+        files[fileCount++] = (CachedFile){st.st_mtim, st.st_size, path};
+        total += st.st_size;
+    }
+    closedir(dir);
+
+    if (total > cache->capacity) {
+        qsort(files, fileCount, sizeof(CachedFile), compareLastUse);
+        for (int i = 0; i < fileCount && total > cache->capacity; i++) {
+            if (unlink(files[i].name) == 0 || errno == ENOENT) {
+                total -= files[i].size;
+            }
+        }
+    }
+    for (int i = 0; i < fileCount; i++) {
+        free(files[i].name);
+    }
+    free(files);
+    pthread_mutex_unlock(&evictionLock);
+}
+
+// Writes a computed matrix under its key, then evicts the least recently used files over the capacity.
+static void storeCachedMatrix(const DistanceCache *cache, const char *path, const DistanceCacheFileHeader *header,
+                              const double *values, size_t valueCount) {
+    if (header->fileSize > cache->capacity) {
+        return;
+    }
+    int number;
+    #pragma omp atomic capture
+    number = temporaryCounter++;
+    char *temporary = malloc(strlen(path) + 32);
+    if (!temporary) {
+        return;
+    }
+    sprintf(temporary, "%s.%ld.%d.tmp", path, (long)getpid(), number);
+
+    FILE *file = fopen(temporary, "wb");
+    if (!file) {
+        fprintf(stderr, "Failed to write the distance cache file %s\n", temporary);
+        free(temporary);
+        return;
+    }
+    char padding[DISTANCE_CACHE_ALIGNMENT] = {0};
+    bool written = fwrite(header, sizeof(*header), 1, file) == 1 &&
+                   fwrite(padding, DISTANCE_CACHE_ALIGNMENT - sizeof(*header), 1, file) == 1;
+    if (cache->precision == sizeof(double)) {
+        written = written && fwrite(values, sizeof(double), valueCount, file) == valueCount;
+    } else {
+        float chunk[CONVERSION_CHUNK];
+        for (size_t start = 0; written && start < valueCount; start += CONVERSION_CHUNK) {
+            size_t count = valueCount - start < CONVERSION_CHUNK ? valueCount - start : CONVERSION_CHUNK;
+            for (size_t i = 0; i < count; i++) {
+                chunk[i] = (float)values[start + i];
+            }
+            written = fwrite(chunk, sizeof(float), count, file) == count;
+        }
+    }
+    // Renaming is atomic, so other processes see either no file or a complete one
+    if (fclose(file) != 0 || !written || rename(temporary, path) != 0) {
+        fprintf(stderr, "Failed to write the distance cache file %s\n", temporary);
+        remove(temporary);
+    } else {
+        evictDistanceCache(cache);
+    }
+    free(temporary);
+}
+
+// Opens a cache directory, creating it if needed.
+int openDistanceCache(DistanceCache *cache, const char *directory, uint64_t capacity, int precision) {
+    memset(cache, 0, sizeof(DistanceCache));
+    if (!directory || (precision != sizeof(float) && precision != sizeof(double))) {
+        fprintf(stderr, "Invalid parameters for the distance cache\n");
+        return DISTANCE_CACHE_ERR_INVALID_INPUT;
+    }
+    struct stat st;
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+        perror("Failed to create the distance cache directory");
+        return DISTANCE_CACHE_ERR_DIRECTORY;
+    }
+    if (stat(directory, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "The distance cache %s is not a directory\n", directory);
+        return DISTANCE_CACHE_ERR_DIRECTORY;
+    }
+    cache->directory = strdup(directory);
+    if (!cache->directory) {
+        return DISTANCE_CACHE_ERR_MEMORY;
+    }
+    cache->capacity = capacity;
+    cache->precision = precision;
+    return DISTANCE_CACHE_SUCCESS;
+}
+
+// Returns the distances between every pair of samples, from the cache if possible.
+DistanceMatrix cachedDistanceMatrix(DistanceCache *cache, ShapeData *data, int dataSize, int featureCount, int p) {
+    if (!cache || !data || dataSize <= 0 || p <= 0) {
+        return computeDistanceMatrix(data, dataSize, featureCount, p);
+    }
+    size_t pairCount = (size_t)dataSize * (dataSize - 1) / 2;
+    DistanceCacheFileHeader header;
+    describeMatrix(cache, &header, DISTANCE_CACHE_CONDENSED, p, featureCount, data, dataSize, NULL, 0, pairCount);
+    char *path = matrixPath(cache, &header);
+    if (!path) {
+        return computeDistanceMatrix(data, dataSize, featureCount, p);
+    }
+
+    ProfileScope scope = profileBegin(PROFILE_READ);
+    char *map = mapCachedMatrix(path, &header);
+    DistanceMatrix matrix = {dataSize, p, NULL, NULL, 0};
+    if (map && cache->precision == sizeof(double)) {
+        matrix.values = (double *)(map + DISTANCE_CACHE_ALIGNMENT);
+        matrix.mapping = map;
+        matrix.mappingSize = header.fileSize;
+    } else if (map) {
+        matrix.values = malloc((pairCount > 0 ? pairCount : 1) * sizeof(double));
+        if (matrix.values) {
+            widenValues(matrix.values, (const float *)(map + DISTANCE_CACHE_ALIGNMENT), pairCount);
+        }
+        munmap(map, header.fileSize);
+    }
+    profileEnd(&scope);
+    if (matrix.values) {
+        #pragma omp atomic
+        cache->hits++;
+        free(path);
+        return matrix;
+    }
+
+    #pragma omp atomic
+    cache->misses++;
+    matrix = computeDistanceMatrix(data, dataSize, featureCount, p);
+    if (matrix.values) {
+        if (cache->precision == sizeof(float)) {
+            roundValues(matrix.values, pairCount);
+        }
+        storeCachedMatrix(cache, path, &header, matrix.values, pairCount);
+    }
+    free(path);
+    return matrix;
+}
+
+// Computes the distances from every test sample to every training sample into owned storage.
+static int computeDistanceTable(DistanceTable *table, const ShapeData *trainingSet, int trainingSize,
+                                const ShapeData *testSet, int testSize, int featureCount, int p) {
+    size_t valueCount = (size_t)testSize * trainingSize;
+    table->storage = malloc((valueCount > 0 ? valueCount : 1) * sizeof(double));
+    if (!table->storage) {
+        return DISTANCE_CACHE_ERR_MEMORY;
+    }
+    for (int i = 0; i < testSize; i++) {
+        table->values[i] = table->storage + (size_t)i * trainingSize;
+    }
+    ProfileScope scope = profileBegin(PROFILE_DISTANCE);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < testSize; i++) {
+        for (int j = 0; j < trainingSize; j++) {
+            table->values[i][j] = minkowskiDistance(testSet[i], trainingSet[j], featureCount, p);
+        }
+    }
+    profileCount(PROFILE_DISTANCE, PROFILE_DISTANCE_EVALUATIONS, valueCount);
+    profileCount(PROFILE_DISTANCE, PROFILE_ALLOCATIONS, 2);
+    profileEnd(&scope);
+    return DISTANCE_CACHE_SUCCESS;
+}
+
+// Returns the distances from every test sample to every training sample, from the cache if possible.
+int cachedDistanceTable(DistanceCache *cache, DistanceTable *table, const ShapeData *trainingSet, int trainingSize,
+                        const ShapeData *testSet, int testSize, int featureCount, int p) {
+    memset(table, 0, sizeof(DistanceTable));
+    if (!trainingSet || !testSet || trainingSize <= 0 || testSize < 0 || featureCount <= 0 || p <= 0) {
+        fprintf(stderr, "Invalid parameters for the distance table\n");
+        return DISTANCE_CACHE_ERR_INVALID_INPUT;
+    }
+    table->rows = testSize;
+    table->cols = trainingSize;
+    table->values = malloc((testSize > 0 ? testSize : 1) * sizeof(double *));
+    if (!table->values) {
+        return DISTANCE_CACHE_ERR_MEMORY;
+    }
+    if (!cache) {
+        int status = computeDistanceTable(table, trainingSet, trainingSize, testSet, testSize, featureCount, p);
+        if (status != DISTANCE_CACHE_SUCCESS) {
+            freeDistanceTable(table);
+        }
+        return status;
+    }
+
+    size_t valueCount = (size_t)testSize * trainingSize;
+    DistanceCacheFileHeader header;
+    describeMatrix(cache, &header, DISTANCE_CACHE_TABLE, p, featureCount, trainingSet, trainingSize, testSet,
+                   testSize, valueCount);
+    char *path = matrixPath(cache, &header);
+    if (!path) {
+        freeDistanceTable(table);
+        return DISTANCE_CACHE_ERR_MEMORY;
+    }
+
+    ProfileScope scope = profileBegin(PROFILE_READ);
+    char *map = mapCachedMatrix(path, &header);
+    if (map && cache->precision == sizeof(double)) {
+        table->mapping = map;
+        table->mappingSize = header.fileSize;
+        for (int i = 0; i < testSize; i++) {
+            table->values[i] = (double *)(map + DISTANCE_CACHE_ALIGNMENT) + (size_t)i * trainingSize;
+        }
+    } else if (map) {
+        table->storage = malloc((valueCount > 0 ? valueCount : 1) * sizeof(double));
+        if (table->storage) {
+            widenValues(table->storage, (const float *)(map + DISTANCE_CACHE_ALIGNMENT), valueCount);
+            for (int i = 0; i < testSize; i++) {
+                table->values[i] = table->storage + (size_t)i * trainingSize;
+            }
+        }
+        munmap(map, header.fileSize);
+    }
+    profileEnd(&scope);
+    if (table->mapping || table->storage) {
+        #pragma omp atomic
+        cache->hits++;
+        free(path);
+        return DISTANCE_CACHE_SUCCESS;
+    }
+
+    #pragma omp atomic
+    cache->misses++;
+    int status = computeDistanceTable(table, trainingSet, trainingSize, testSet, testSize, featureCount, p);
+    if (status == DISTANCE_CACHE_SUCCESS) {
+        if (cache->precision == sizeof(float)) {
+            roundValues(table->storage, valueCount);
+        }
+        storeCachedMatrix(cache, path, &header, table->storage, valueCount);
+    } else {
+        freeDistanceTable(table);
+    }
+    free(path);
+    return status;
+}
+
+// Frees or unmaps the values of a table.
+void freeDistanceTable(DistanceTable *table) {
+    if (table) {
+        if (table->mapping) {
+            munmap(table->mapping, table->mappingSize);
+        }
+        free(table->storage);
+        free(table->values);
+        memset(table, 0, sizeof(DistanceTable));
+    }
+}
+
+// Releases the directory path of a cache.
+void closeDistanceCache(DistanceCache *cache) {
+    if (cache) {
+        free(cache->directory);
+        cache->directory = NULL;
+    }
+}
@@ -0,0 +1,144 @@
+/**
+ * @file distance_cache.h
+ * @brief Header file for the on-disk cache of distance matrices, shared across runs.
+ *
+ * Experiments keep recomputing the same distances: the same descriptor set, preprocessing
+ * and p give the same matrix every time. The cache stores every computed matrix in a
+ * directory, one file per matrix, named after a 128-bit hash of everything the values
+ * depend on: the kind of matrix, p, the stored precision and, row by row, the class,
+ * sample number and preprocessed features of the samples, training rows then test rows.
+ * Hashing the features after preprocessing covers the dataset, the split (which samples
+ * are on which side, in which order) and the preprocessing at once.
+ *
+ * A file is the DistanceCacheFileHeader followed, at DISTANCE_CACHE_ALIGNMENT, by the
+ * values in float64 or float32. A float64 file is mapped read-only and the matrix points
+ * into the mapping, so a hit costs no copy; a float32 file halves the disk and is widened
+ * on load. A miss computes the matrix, rounds it to the stored precision so that every
+ * run sees the same values, and writes it to a temporary file renamed into place, so
+ * concurrent processes never read a partial file.
+ *
+ * Eviction is least recently used under a size cap: a hit touches the modification time
+ * of its file and, after every store, the oldest files are removed until the directory
+ * fits. Matrices larger than the cap are computed but not stored.
+ */
+
+#ifndef DISTANCE_CACHE_H
+#define DISTANCE_CACHE_H
+
+#include "distance_matrix.h"
+
+#include <stdint.h>
+
+// Error codes
+#define DISTANCE_CACHE_SUCCESS 0
+#define DISTANCE_CACHE_ERR_INVALID_INPUT -1
+#define DISTANCE_CACHE_ERR_MEMORY -2
+#define DISTANCE_CACHE_ERR_DIRECTORY -3
+
+// Kinds of cached matrices
+#define DISTANCE_CACHE_CONDENSED 1   /**< Pairwise distances of one dataset, as in DistanceMatrix. */
+#define DISTANCE_CACHE_TABLE 2       /**< Distances from every test sample to every training sample. */
+
+#define DISTANCE_CACHE_MAGIC "RFDIST"
+#define DISTANCE_CACHE_VERSION 1
+#define DISTANCE_CACHE_ALIGNMENT 64
+#define DISTANCE_CACHE_EXTENSION ".dmat"
+
+// Default size cap of the cache directory in megabytes
+#define DISTANCE_CACHE_DEFAULT_MB 1024
+
+/**
+ * @struct DistanceCacheFileHeader
+ * @brief On-disk header of a cached matrix, in native byte order.
+ */
+typedef struct {
+    char magic[8];          /**< DISTANCE_CACHE_MAGIC, zero padded. */
+    uint32_t version;       /**< DISTANCE_CACHE_VERSION of the writer. */
+    uint32_t kind;          /**< DISTANCE_CACHE_CONDENSED or DISTANCE_CACHE_TABLE. */
+    uint32_t precision;     /**< Bytes per stored value, 4 or 8. */
+    int32_t p;              /**< Minkowski exponent. */
+    int32_t rows;           /**< Samples (condensed) or test samples (table). */
+    int32_t cols;           /**< Samples (condensed) or training samples (table). */
+    uint64_t key[2];        /**< Hash the file is named after. */
+    uint64_t fileSize;      /**< Total size of the file, used to detect truncation. */
+} DistanceCacheFileHeader;
+
+/**
+ * @struct DistanceCache
+ * @brief Directory of cached matrices and the statistics of this run.
+ */
+typedef struct {
+    char *directory;        /**< Directory holding the files, created if missing. */
+    uint64_t capacity;      /**< Size cap of the cached files in bytes. */
+    int precision;          /**< Bytes per stored value, 4 or 8. */
+    int hits;               /**< Matrices read from the cache, updated atomically. */
+    int misses;             /**< Matrices computed, updated atomically. */
+} DistanceCache;
+
+/**
+ * @struct DistanceTable
+ * @brief Distances from every test sample to every training sample, row by row.
+ */
+typedef struct {
+    int rows;               /**< Number of test samples. */
+    int cols;               /**< Number of training samples. */
+    double **values;        /**< values[i][j] is the distance from test sample i to training sample j. */
+    double *storage;        /**< rows x cols owned values, NULL when they point into the mapping. */
+    void *mapping;          /**< Cache file the values point into, NULL when they are owned. */
+    size_t mappingSize;     /**< Size in bytes of the mapping. */
+} DistanceTable;
+
+/**
+ * @brief Opens a cache directory, creating it if needed.
+ *
+ * @param cache Cache to initialize.
+ * @param directory Path of the directory.
+ * @param capacity Size cap of the cached files in bytes.
+ * @param precision Bytes per stored value, 4 for float32 or 8 for float64.
+ * @return DISTANCE_CACHE_SUCCESS or a DISTANCE_CACHE_ERR_* code.
+ */
+int openDistanceCache(DistanceCache *cache, const char *directory, uint64_t capacity, int precision);
+
+/**
+ * @brief Returns the distances between every pair of samples, from the cache if possible.
+ *
+ * @param cache Cache to read and fill, NULL to always compute the matrix.
+ * @param data Array of preprocessed samples.
+ * @param dataSize Number of samples.
+ * @param featureCount Number of features in each sample.
+ * @param p Minkowski distance exponent.
+ * @return The distance matrix, released with freeDistanceMatrix; values is NULL on failure.
+ */
+DistanceMatrix cachedDistanceMatrix(DistanceCache *cache, ShapeData *data, int dataSize, int featureCount, int p);
+
+/**
+ * @brief Returns the distances from every test sample to every training sample, from the cache if possible.
+ *
+ * @param cache Cache to read and fill, NULL to always compute the table.
+ * @param table Table to initialize, released with freeDistanceTable.
+ * @param trainingSet Preprocessed training samples.
+ * @param trainingSize Number of training samples.
+ * @param testSet Preprocessed test samples.
+ * @param testSize Number of test samples.
+ * @param featureCount Number of features in each sample.
+ * @param p Minkowski distance exponent.
+ * @return DISTANCE_CACHE_SUCCESS or a DISTANCE_CACHE_ERR_* code.
+ */
+int cachedDistanceTable(DistanceCache *cache, DistanceTable *table, const ShapeData *trainingSet, int trainingSize,
+                        const ShapeData *testSet, int testSize, int featureCount, int p);
+
+/**
+ * @brief Frees or unmaps the values of a table.
+ *
+ * @param table Table to free.
+ */
+void freeDistanceTable(DistanceTable *table);
+
+/**
+ * @brief Releases the directory path of a cache. The cached files stay on disk.
+ *
+ * @param cache Cache to close.
+ */
+void closeDistanceCache(DistanceCache *cache);
+
+#endif // DISTANCE_CACHE_H
@@ -0,0 +1,70 @@
+#include "distance_matrix.h"
+#include "knn.h"
+#include "profiler.h"
+
+#include <sys/mman.h>
+
+// Computes the distances between every pair of samples.
+DistanceMatrix computeDistanceMatrix(ShapeData *data, int dataSize, int featureCount, int p) {
+    DistanceMatrix matrix = {dataSize, p, NULL, NULL, 0};
+    if (!data || dataSize <= 0 || p <= 0) {
+        fprintf(stderr, "Invalid parameters for the distance matrix\n");
+        return matrix;
+    }
+
+    size_t pairCount = (size_t)dataSize * (dataSize - 1) / 2;
+    matrix.values = malloc((pairCount > 0 ? pairCount : 1) * sizeof(double));
+    if (!matrix.values) {
+        fprintf(stderr, "Memory allocation failed for the distance matrix\n");
+        return matrix;
+    }
+    ProfileScope scope = profileBegin(PROFILE_DISTANCE);
+
+    // Enumerate the tiles on or above the diagonal; each one is an independent task
+    int blocks = (dataSize + DISTANCE_BLOCK_SIZE - 1) / DISTANCE_BLOCK_SIZE;
+    int tileCount = blocks * (blocks + 1) / 2;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int tile = 0; tile < tileCount; tile++) {
+        // Recover the (row block, column block) pair of the tile
+        int rowBlock = 0, remaining = tile;
+        while (remaining >= blocks - rowBlock) {
+            remaining -= blocks - rowBlock;
+            rowBlock++;
+        }
+        int columnBlock = rowBlock + remaining;
+
+        int rowEnd = (rowBlock + 1) * DISTANCE_BLOCK_SIZE;
+        int columnEnd = (columnBlock + 1) * DISTANCE_BLOCK_SIZE;
+        if (rowEnd > dataSize) rowEnd = dataSize;
+        if (columnEnd > dataSize) columnEnd = dataSize;
+
+        for (int i = rowBlock * DISTANCE_BLOCK_SIZE; i < rowEnd; i++) {
+            int columnStart = columnBlock * DISTANCE_BLOCK_SIZE;
+            if (columnStart <= i) columnStart = i + 1;
+            double *row = matrix.values + condensedIndex(dataSize, i, i + 1);
+            for (int j = columnStart; j < columnEnd; j++) {
+                row[j - i - 1] = minkowskiDistance(data[i], data[j], featureCount, p);
+            }
+        }
+    }
+    profileCount(PROFILE_DISTANCE, PROFILE_DISTANCE_EVALUATIONS, pairCount);
+    profileCount(PROFILE_DISTANCE, PROFILE_ALLOCATIONS, 1);
+    profileEnd(&scope);
+    return matrix;
+}
+
+// Frees the memory held by a distance matrix.
+void freeDistanceMatrix(DistanceMatrix *matrix) {
+    if (matrix) {
+        if (matrix->mapping) {
+            munmap(matrix->mapping, matrix->mappingSize);
+        } else {
+            free(matrix->values);
+        }
+        matrix->values = NULL;
+        matrix->mapping = NULL;
+        matrix->mappingSize = 0;
+        matrix->size = 0;
+    }
+}
@@ -0,0 +1,79 @@
+/**
+ * @file distance_matrix.h
+ * @brief Header file for the symmetric matrix of pairwise distances over a whole dataset.
+ */
+
+#ifndef DISTANCE_MATRIX_H
+#define DISTANCE_MATRIX_H
+
+#include "data_reader.h" // Include for ShapeData structure definition.
+
+// Side of the square tiles the matrix is computed in
+#define DISTANCE_BLOCK_SIZE 64
+
+/**
+ * @struct DistanceMatrix
+ * @brief Pairwise Minkowski distances between all samples of a dataset.
+ *
+ * Only the strict upper triangle is stored, row by row (condensed form), which halves
+ * the memory of a full matrix. Computed once and shared read-only, so evaluations over
+ * different subsets of the samples (folds, leave-one-out) only have to look distances up.
+ */
+typedef struct {
+    int size;           /**< Number of samples. */
+    int p;              /**< Minkowski distance exponent the distances were computed with. */
+    double *values;     /**< size * (size - 1) / 2 distances d(i, j) with i < j. */
+    void *mapping;      /**< Cache file the values point into, NULL when they are owned (see distance_cache.h). */
+    size_t mappingSize; /**< Size in bytes of the mapping. */
+} DistanceMatrix;
+
+/**
+ * @brief Computes the distances between every pair of samples.
+ *
+ * The upper triangle is split in DISTANCE_BLOCK_SIZE square tiles computed in parallel,
+ * so both samples of a tile stay in cache while its distances are computed.
+ *
+ * @param data Array of samples.
+ * @param dataSize Number of samples.
+ * @param featureCount Number of features in each sample.
+ * @param p Minkowski distance exponent.
+ * @return The distance matrix; values is NULL on invalid parameters or allocation failure.
+ */
+DistanceMatrix computeDistanceMatrix(ShapeData *data, int dataSize, int featureCount, int p);
+
+/**
+ * @brief Returns the position of d(i, j), i < j, in the condensed storage.
+ *
+ * @param size Number of samples.
+ * @param i Index of the first sample.
+ * @param j Index of the second sample, greater than i.
+ * @return Index into the values array.
+ */
+static inline size_t condensedIndex(int size, int i, int j) {
+    return (size_t)i * size - (size_t)i * (i + 1) / 2 + (j - i - 1);
+}
+
+/**
+ * @brief Returns the distance between samples i and j.
+ *
+ * @param matrix Pointer to the distance matrix.
+ * @param i Index of the first sample.
+ * @param j Index of the second sample.
+ * @return The distance between the two samples.
+ */
+static inline double getDistance(const DistanceMatrix *matrix, int i, int j) {
+    if (i == j) {
+        return 0.0;
+    }
+    return i < j ? matrix->values[condensedIndex(matrix->size, i, j)]
+                 : matrix->values[condensedIndex(matrix->size, j, i)];
+}
+
+/**
+ * @brief Frees the memory held by a distance matrix.
+ *
+ * @param matrix Pointer to the distance matrix to be freed.
+ */
+void freeDistanceMatrix(DistanceMatrix *matrix);
+
+#endif // DISTANCE_MATRIX_H
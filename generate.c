@@ -0,0 +1,176 @@
+/**
+ * @file generate.c
+ * @brief Synthetic dataset generator for scalability testing.
+ *
+ * Draws class-structured Gaussian-mixture descriptor sets: every class owns a number of
+ * components whose centers are drawn uniformly in the unit hypercube, and every sample
+ * is its component center plus isotropic Gaussian noise. Samples are streamed either to
+ * the s%02dn%03d.EXT text layout read by readAllFiles or to one binary dataset file, so
+ * sets far larger than memory can be produced.
+ */
+
+#include "data_reader.h"
+
+#include <errno.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @struct GeneratorOptions
+ * @brief Stores command line options of the generator.
+ */
+typedef struct {
+    const char *output;      /**< Output directory (text) or file (binary). */
+    const char *extension;   /**< Extension of the text files. */
+    long samples;            /**< Total number of samples. */
+    int classes;             /**< Number of classes. */
+    int dimension;           /**< Number of features per sample. */
+    int components;          /**< Gaussian components per class. */
+    double noise;            /**< Standard deviation of the noise around a component center. */
+    unsigned long seed;      /**< Seed of the random generator. */
+    int binary;              /**< Write one binary dataset instead of text files. */
+} GeneratorOptions;
+
+// State of the xorshift64* generator; a local generator keeps runs reproducible across libc versions.
+static uint64_t randomState;
+
+// Returns the next 64 random bits.
+static uint64_t nextRandom(void) {
+    randomState ^= randomState >> 12;
+    randomState ^= randomState << 25;
+    randomState ^= randomState >> 27;
+    return randomState * 2685821657736338717ull;
+}
+
+// Returns a uniform double in [0, 1).
+static double uniformRandom(void) {
+    return (nextRandom() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Returns a standard normal double (Box-Muller).
+static double normalRandom(void) {
+    double u1 = uniformRandom(), u2 = uniformRandom();
+    return sqrt(-2.0 * log(1.0 - u1)) * cos(2.0 * M_PI * u2);
+}
+
+// Writes one sample as a text file with one feature per line.
+static int writeTextSample(const GeneratorOptions *options, int shapeClass, int sample, const double *features) {
+    char filename[4096];
+    snprintf(filename, sizeof(filename), "%s/s%02dn%03d%s", options->output, shapeClass, sample, options->extension);
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        perror(filename);
+        return ERR_FILE_OPEN_FAILED;
+    }
+    for (int f = 0; f < options->dimension; f++) {
+        fprintf(file, "%f\n", features[f]);
+    }
+    return fclose(file) == 0 ? SUCCESS : ERR_FEATURES_VALUES;
+}
+
+// Generates the dataset described by the options.
+static int generate(const GeneratorOptions *options) {
+    int componentCount = options->classes * options->components;
+    double *centers = malloc((size_t)componentCount * options->dimension * sizeof(double));
+    double *features = malloc(options->dimension * sizeof(double));
+    if (!centers || !features) {
+        free(centers);
+        free(features);
+        return ERR_MEMORY_ALLOCATION_FAILED;
+    }
+    for (size_t i = 0; i < (size_t)componentCount * options->dimension; i++) {
+        centers[i] = uniformRandom();
+    }
+
+    FILE *file = NULL;
+    int status = SUCCESS;
+    if (options->binary) {
+        file = fopen(options->output, "wb");
+        status = file ? writeBinaryDatasetHeader(file, options->dimension, options->samples) : ERR_FILE_OPEN_FAILED;
+    } else if (mkdir(options->output, 0755) != 0 && errno != EEXIST) {
+        status = ERR_DIR_OPEN_FAILED;
+    }
+
+    // Classes are dealt round-robin so every class gets the same number of samples, give or take one
+    for (long i = 0; i < options->samples && status == SUCCESS; i++) {
+        int shapeClass = (int)(i % options->classes) + 1;
+        int sample = (int)(i / options->classes) + 1;
+        int component = (shapeClass - 1) * options->components + (int)(nextRandom() % options->components);
+        const double *center = centers + (size_t)component * options->dimension;
+        for (int f = 0; f < options->dimension; f++) {
+            features[f] = center[f] + options->noise * normalRandom();
+        }
+        status = options->binary ? writeBinaryDatasetRecord(file, shapeClass, sample, features, options->dimension)
+                                 : writeTextSample(options, shapeClass, sample, features);
+    }
+
+    if (file && fclose(file) != 0 && status == SUCCESS) {
+        status = ERR_FEATURES_VALUES;
+    }
+    free(centers);
+    free(features);
+    return status;
+}
+
+// Prints the usage message of the generator.
+static void printGeneratorUsage(const char *program_name) {
+    fprintf(stderr, "Usage: %s -o <output> [-n <samples>] [-c <classes>] [-d <dimension>] [-m <components_per_class>]\n"
+                    "          [-s <noise>] [-r <seed>] [-e <extension>] [-b]\n"
+                    "  -b writes one binary dataset file instead of a directory of text files\n", program_name);
+}
+
+int main(int argc, char *argv[]) {
+    GeneratorOptions options = {NULL, ".SYN", 1000, 9, 16, 1, 0.1, 1, 0};
+    int opt;
+    while ((opt = getopt(argc, argv, "o:n:c:d:m:s:r:e:b")) != -1) {
+        switch (opt) {
+            case 'o':
+                options.output = optarg;
+                break;
+            case 'n':
+                options.samples = atol(optarg);
+                break;
+            case 'c':
+                options.classes = atoi(optarg);
+                break;
+            case 'd':
+                options.dimension = atoi(optarg);
+                break;
+            case 'm':
+                options.components = atoi(optarg);
+                break;
+            case 's':
+                options.noise = atof(optarg);
+                break;
+            case 'r':
+                options.seed = strtoul(optarg, NULL, 10);
+                break;
+            case 'e':
+                options.extension = optarg;
+                break;
+            case 'b':
+                options.binary = 1;
+                break;
+            default:
+                printGeneratorUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (!options.output || options.samples <= 0 || options.samples > INT32_MAX || options.classes <= 0 ||
+        options.dimension <= 0 || options.components <= 0 || options.noise < 0) {
+        printGeneratorUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // The state of xorshift must never be zero
+    randomState = (options.seed * 0x9E3779B97F4A7C15ull) | 1;
+    int status = generate(&options);
+    if (status != SUCCESS) {
+        fprintf(stderr, "Failed to generate the dataset %s (error %d)\n", options.output, status);
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "Generated %ld samples of %d features in %d classes to %s\n", options.samples,
+            options.dimension, options.classes, options.output);
+    return EXIT_SUCCESS;
+}
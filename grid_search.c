@@ -0,0 +1,259 @@
+#include "grid_search.h"
+#include "data_reader.h"
+#include "preprocessing.h"
+#include "distance_matrix.h"
+#include "leave_one_out.h"
+#include "thread_pool.h"
+#include "profiler.h"
+
+#include <omp.h>
+
+/**
+ * @struct GridDataset
+ * @brief One descriptor set after one preprocessing, shared read-only by the cells using it.
+ */
+typedef struct {
+    const ShapeData *raw;   /**< Samples as read from disk. */
+    int method;             /**< PREPROCESS_* method applied. */
+    ShapeData *data;        /**< Preprocessed copy of the samples. */
+    int dataSize;           /**< Number of samples. */
+} GridDataset;
+
+/**
+ * @struct GridCell
+ * @brief Work item evaluating all k for one (descriptor, preprocessing, p) point.
+ */
+typedef struct {
+    const GridDataset *dataset;
+    int p;
+    int kMax;
+    int classCount;
+    int innerThreads;          /**< OpenMP threads available to the cell. */
+    DistanceCache *cache;      /**< Distance cache shared by the cells, NULL for none. */
+    ClassMetrics *metrics;     /**< metrics[k - 1] receives the overall metrics for k neighbors. */
+    int status;
+} GridCell;
+
+// Copies the samples into one contiguous feature block.
+static ShapeData *copyShapeData(const ShapeData *data, int dataSize) {
+    int featureCount = data[0].featureCount;
+    ShapeData *copy = malloc(dataSize * sizeof(ShapeData));
+    double *features = malloc((size_t)dataSize * featureCount * sizeof(double));
+    if (!copy || !features) {
+        free(copy);
+        free(features);
+        return NULL;
+    }
+    for (int i = 0; i < dataSize; i++) {
+        copy[i] = data[i];
+        copy[i].features = features + (size_t)i * featureCount;
+        memcpy(copy[i].features, data[i].features, featureCount * sizeof(double));
+    }
+    return copy;
+}
+
+// Frees a copy made by copyShapeData.
+static void freeShapeDataCopy(ShapeData *copy) {
+    if (copy) {
+        free(copy[0].features);
+        free(copy);
+    }
+}
+
+// Thread pool task fitting and applying one preprocessing to a copy of one descriptor set.
+static void preprocessDatasetTask(void *arg) {
+    GridDataset *dataset = arg;
+    dataset->data = copyShapeData(dataset->raw, dataset->dataSize);
+    if (!dataset->data) {
+        return;
+    }
+    PreprocessingParams params = fitPreprocessing(dataset->data, dataset->dataSize,
+                                                  dataset->data[0].featureCount, dataset->method);
+    applyPreprocessing(&params, dataset->data, dataset->dataSize);
+    freePreprocessingParams(&params);
+}
+
+// Thread pool task computing the distances of one cell and evaluating every k from them.
+static void evaluateCellTask(void *arg) {
+    GridCell *cell = arg;
+    const GridDataset *dataset = cell->dataset;
+    omp_set_num_threads(cell->innerThreads);
+
+    DistanceMatrix distances = cachedDistanceMatrix(cell->cache, dataset->data, dataset->dataSize,
+                                                    dataset->data[0].featureCount, cell->p);
+    if (!distances.values) {
+        cell->status = GRID_ERR_MEMORY_FAILURE;
+        return;
+    }
+
+    LeaveOneOutResult result;
+    if (leaveOneOutKnn(dataset->data, dataset->dataSize, &distances, cell->kMax, cell->classCount,
+                       &result) != LOO_SUCCESS) {
+        cell->status = GRID_ERR_MEMORY_FAILURE;
+        freeDistanceMatrix(&distances);
+        return;
+    }
+    Arena *scratch = scratchArena(PROFILE_METRICS);
+    ArenaMark mark = arenaMark(scratch);
+    for (int k = 1; k <= cell->kMax; k++) {
+        ConfusionMatrixMetrics statistics = calculateStatisticsInArena(&result.matrices[k - 1], scratch);
+        cell->metrics[k - 1] = statistics.overallMetrics;
+        arenaReset(scratch, mark);
+    }
+    cell->status = GRID_SUCCESS;
+
+    freeLeaveOneOutResult(&result);
+    freeDistanceMatrix(&distances);
+}
+
+// Returns the descriptor name used in the CSV: the extension without its leading dot.
+static const char *descriptorName(const GridDescriptor *descriptor) {
+    return descriptor->extension[0] == '.' ? descriptor->extension + 1 : descriptor->extension;
+}
+
+// Evaluates every grid point with leave-one-out k-NN and writes one CSV row per point.
+int runGridSearch(const GridSearchConfig *config, FILE *output) {
+    if (!config || !output || config->descriptorCount <= 0 || config->pCount <= 0 ||
+        config->preprocessingCount <= 0 || config->kMax <= 0) {
+        return GRID_ERR_INVALID_INPUT;
+    }
+    for (int i = 0; i < config->pCount; i++) {
+        if (config->pValues[i] <= 0) {
+            fprintf(stderr, "Invalid p value in the grid: %d\n", config->pValues[i]);
+            return GRID_ERR_INVALID_INPUT;
+        }
+    }
+
+    int datasetCount = config->descriptorCount * config->preprocessingCount;
+    int cellCount = datasetCount * config->pCount;
+    ShapeData **raw = calloc(config->descriptorCount, sizeof(ShapeData *));
+    int *rawSizes = calloc(config->descriptorCount, sizeof(int));
+    GridDataset *datasets = calloc(datasetCount, sizeof(GridDataset));
+    GridCell *cells = calloc(cellCount, sizeof(GridCell));
+    ClassMetrics *metrics = malloc((size_t)cellCount * config->kMax * sizeof(ClassMetrics));
+    ThreadPool *pool = createThreadPool(config->threads);
+    int status = GRID_SUCCESS;
+    if (!raw || !rawSizes || !datasets || !cells || !metrics || !pool) {
+        status = GRID_ERR_MEMORY_FAILURE;
+        goto cleanup;
+    }
+
+    // Every descriptor set is read once
+    for (int d = 0; d < config->descriptorCount; d++) {
+        raw[d] = readAllFiles(config->descriptors[d].directory, config->descriptors[d].extension, &rawSizes[d]);
+        if (!raw[d] || rawSizes[d] <= config->kMax) {
+            fprintf(stderr, "Failed to read at least %d samples from %s\n", config->kMax + 1,
+                    config->descriptors[d].directory);
+            status = GRID_ERR_READ_FAILED;
+            goto cleanup;
+        }
+    }
+
+    // Every preprocessing is applied once per descriptor set
+    for (int d = 0; d < config->descriptorCount; d++) {
+        for (int m = 0; m < config->preprocessingCount; m++) {
+            GridDataset *dataset = &datasets[d * config->preprocessingCount + m];
+            *dataset = (GridDataset){raw[d], config->preprocessingMethods[m], NULL, rawSizes[d]};
+            submitTask(pool, preprocessDatasetTask, dataset);
+        }
+    }
+    waitThreadPool(pool);
+    for (int i = 0; i < datasetCount; i++) {
+        if (!datasets[i].data) {
+            status = GRID_ERR_MEMORY_FAILURE;
+            goto cleanup;
+        }
+    }
+
+    // Every cell computes one distance matrix; the processors left over by the pool go to OpenMP
+    int poolSize = threadPoolSize(pool);
+    int concurrentCells = cellCount < poolSize ? cellCount : poolSize;
+    int innerThreads = omp_get_num_procs() / concurrentCells;
+    for (int i = 0; i < datasetCount; i++) {
+        for (int j = 0; j < config->pCount; j++) {
+            GridCell *cell = &cells[i * config->pCount + j];
+            *cell = (GridCell){&datasets[i], config->pValues[j], config->kMax,
+                               countClasses(datasets[i].data, datasets[i].dataSize),
+                               innerThreads > 1 ? innerThreads : 1, config->distanceCache,
+                               metrics + (size_t)(i * config->pCount + j) * config->kMax, GRID_ERR_MEMORY_FAILURE};
+            submitTask(pool, evaluateCellTask, cell);
+        }
+    }
+    waitThreadPool(pool);
+
+    // One tidy row per (descriptor, preprocessing, p, k)
+    fprintf(output, "descriptor,preprocessing,p,k,precision,recall,f1_score,accuracy\n");
+    for (int c = 0; c < cellCount; c++) {
+        const GridCell *cell = &cells[c];
+        if (cell->status != GRID_SUCCESS) {
+            status = cell->status;
+            continue;
+        }
+        const char *descriptor = descriptorName(&config->descriptors[c / (config->preprocessingCount * config->pCount)]);
+        const char *method = preprocessingMethodName(cell->dataset->method);
+        for (int k = 1; k <= cell->kMax; k++) {
+            const ClassMetrics *m = &cell->metrics[k - 1];
+            fprintf(output, "%s,%s,%d,%d,%.6f,%.6f,%.6f,%.6f\n", descriptor, method, cell->p, k,
+                    m->precision, m->recall, m->f1Score, m->accuracy);
+        }
+    }
+    if (fflush(output) != 0 || ferror(output)) {
+        status = GRID_ERR_WRITE_FAILED;
+    }
+
+cleanup:
+    destroyThreadPool(pool);
+    if (datasets) {
+        for (int i = 0; i < datasetCount; i++) {
+            freeShapeDataCopy(datasets[i].data);
+        }
+    }
+    if (raw) {
+        for (int d = 0; d < config->descriptorCount; d++) {
+            if (raw[d]) freeShapeData(raw[d], rawSizes[d]);
+        }
+    }
+    free(metrics);
+    free(cells);
+    free(datasets);
+    free(rawSizes);
+    free(raw);
+    return status;
+}
+
+// Splits a comma separated list into newly allocated strings.
+char **splitGridList(const char *list, int *count) {
+    *count = 1;
+    for (const char *c = list; *c; c++) {
+        if (*c == ',') (*count)++;
+    }
+
+    char **items = calloc(*count, sizeof(char *));
+    if (!items) {
+        return NULL;
+    }
+    const char *start = list;
+    for (int i = 0; i < *count; i++) {
+        const char *end = strchr(start, ',');
+        size_t length = end ? (size_t)(end - start) : strlen(start);
+        items[i] = malloc(length + 1);
+        if (!items[i]) {
+            freeGridList(items, i);
+            return NULL;
+        }
+        memcpy(items[i], start, length);
+        items[i][length] = '\0';
+        start = end ? end + 1 : start + length;
+    }
+    return items;
+}
+
+// Frees a list returned by splitGridList.
+void freeGridList(char **items, int count) {
+    if (items) {
+        for (int i = 0; i < count; i++) {
+            free(items[i]);
+        }
+        free(items);
+    }
+}
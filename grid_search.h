@@ -0,0 +1,75 @@
+/**
+ * @file grid_search.h
+ * @brief Header file for the k-NN hyperparameter grid search over descriptors, preprocessing, p and k.
+ */
+
+#ifndef GRID_SEARCH_H
+#define GRID_SEARCH_H
+
+#include "distance_cache.h"
+
+#include <stdio.h>
+
+// Error codes
+#define GRID_SUCCESS 0
+#define GRID_ERR_INVALID_INPUT -1
+#define GRID_ERR_MEMORY_FAILURE -2
+#define GRID_ERR_READ_FAILED -3
+#define GRID_ERR_WRITE_FAILED -4
+
+/**
+ * @struct GridDescriptor
+ * @brief One descriptor set of the grid, read from a directory of files with a given extension.
+ */
+typedef struct {
+    const char *directory;   /**< Directory containing the data files. */
+    const char *extension;   /**< Extension of the data files. */
+} GridDescriptor;
+
+/**
+ * @struct GridSearchConfig
+ * @brief Axes of the grid and execution settings.
+ */
+typedef struct {
+    const GridDescriptor *descriptors;   /**< Descriptor sets to evaluate. */
+    int descriptorCount;                 /**< Number of descriptor sets. */
+    const int *pValues;                  /**< Minkowski p values to evaluate. */
+    int pCount;                          /**< Number of p values. */
+    const int *preprocessingMethods;     /**< PREPROCESS_* methods to evaluate. */
+    int preprocessingCount;              /**< Number of preprocessing methods. */
+    int kMax;                            /**< Every k from 1 to kMax is evaluated. */
+    int threads;                         /**< Number of cells evaluated concurrently, 0 for the online processors. */
+    DistanceCache *distanceCache;        /**< Cache of the cell distance matrices shared across runs, NULL for none. */
+} GridSearchConfig;
+
+/**
+ * @brief Evaluates every grid point with leave-one-out k-NN and writes one CSV row per point.
+ *
+ * Each descriptor set is read once, each preprocessing is applied once per descriptor and
+ * each (descriptor, preprocessing, p) cell computes its distance matrix once, or maps it
+ * from the distance cache, and derives the metrics of all k from it. Independent cells run in parallel on a thread pool.
+ *
+ * @param config Axes of the grid.
+ * @param output Stream receiving the CSV (header included).
+ * @return GRID_SUCCESS or a GRID_ERR_* code.
+ */
+int runGridSearch(const GridSearchConfig *config, FILE *output);
+
+/**
+ * @brief Splits a comma separated list into newly allocated strings.
+ *
+ * @param list Comma separated list, for example "1,2,3".
+ * @param count Pointer receiving the number of items.
+ * @return Array of items released with freeGridList, or NULL on allocation failure.
+ */
+char **splitGridList(const char *list, int *count);
+
+/**
+ * @brief Frees a list returned by splitGridList.
+ *
+ * @param items Array of items.
+ * @param count Number of items.
+ */
+void freeGridList(char **items, int count);
+
+#endif // GRID_SEARCH_H
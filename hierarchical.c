@@ -0,0 +1,309 @@
+#include "hierarchical.h"
+#include "profiler.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *linkageNames[] = {"ward", "average", "complete", "single"};
+
+// Converts a linkage name to its constant.
+int parseLinkage(const char *name) {
+    for (int i = 0; i <= LINKAGE_SINGLE; i++) {
+        if (strcmp(name, linkageNames[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Returns the name of a linkage.
+const char *linkageName(int linkage) {
+    return linkageNames[linkage];
+}
+
+// Returns the address of d(i, j), i != j, in a condensed matrix.
+static inline double *pairDistance(double *values, int size, int i, int j) {
+    return values + (i < j ? condensedIndex(size, i, j) : condensedIndex(size, j, i));
+}
+
+// Returns the Lance-Williams distance between the merge of clusters a and b and a cluster x.
+static inline double lanceWilliams(int linkage, double ax, double bx, double ab, int na, int nb, int nx) {
+    switch (linkage) {
+        case LINKAGE_WARD:
+            return ((na + nx) * ax + (nb + nx) * bx - nx * ab) / (na + nb + nx);
+        case LINKAGE_AVERAGE:
+            return (na * ax + nb * bx) / (na + nb);
+        case LINKAGE_COMPLETE:
+            return ax > bx ? ax : bx;
+        default:
+            return ax < bx ? ax : bx;
+    }
+}
+
+// Orders edges by height, then by their samples so that ties are numbered deterministically.
+static int compareEdges(const void *a, const void *b) {
+    const DendrogramEdge *first = a, *second = b;
+    if (first->height != second->height) {
+        return first->height < second->height ? -1 : 1;
+    }
+    if (first->first != second->first) {
+        return first->first - second->first;
+    }
+    return first->second - second->second;
+}
+
+// Returns the root of a node in a union-find forest, halving the path on the way.
+static int findRoot(int *parent, int node) {
+    while (parent[node] != node) {
+        parent[node] = parent[parent[node]];
+        node = parent[node];
+    }
+    return node;
+}
+
+// Runs the nearest-neighbor chain on a working copy of the distances; fills merges in the order found.
+static void runChain(double *distances, int size, int linkage, int *sizes, int *chain, char *active,
+                     DendrogramEdge *merges) {
+    int chainLength = 0, mergeCount = 0, start = 0;
+    while (mergeCount < size - 1) {
+        if (chainLength == 0) {
+            while (!active[start]) {
+                start++;
+            }
+            chain[chainLength++] = start;
+        }
+        int top = chain[chainLength - 1];
+        int previous = chainLength >= 2 ? chain[chainLength - 2] : -1;
+
+        // Ties go to the previous cluster of the chain, which guarantees that the chain ends
+        int nearest = previous;
+        double best = previous >= 0 ? *pairDistance(distances, size, top, previous) : INFINITY;
+        for (int x = 0; x < size; x++) {
+            if (active[x] && x != top) {
+                double distance = *pairDistance(distances, size, top, x);
+                if (distance < best) {
+                    best = distance;
+                    nearest = x;
+                }
+            }
+        }
+        if (nearest != previous) {
+            chain[chainLength++] = nearest;
+            continue;
+        }
+
+        // top and previous are reciprocal nearest neighbors; the merged cluster takes the slot of previous
+        chainLength -= 2;
+        int na = sizes[top], nb = sizes[previous];
+        #pragma omp parallel for schedule(static) if (size >= HIERARCHICAL_PARALLEL_SIZE)
+        for (int x = 0; x < size; x++) {
+            if (active[x] && x != top && x != previous) {
+                double *merged = pairDistance(distances, size, previous, x);
+                *merged = lanceWilliams(linkage, *pairDistance(distances, size, top, x), *merged, best, na, nb,
+                                        sizes[x]);
+            }
+        }
+        active[top] = 0;
+        sizes[previous] = na + nb;
+        merges[mergeCount] = (DendrogramEdge){top, previous, best};
+        mergeCount++;
+    }
+}
+
+// Numbers the merges given as edges between samples like the rows of a linkage matrix.
+int dendrogramFromEdges(DendrogramEdge *edges, int size, int linkage, Dendrogram *dendrogram) {
+    memset(dendrogram, 0, sizeof(Dendrogram));
+    if (!edges || size <= 0) {
+        fprintf(stderr, "Invalid parameters for building the dendrogram\n");
+        return HIERARCHICAL_ERR_INVALID_INPUT;
+    }
+    int *parent = malloc(size * sizeof(int));
+    int *clusterOf = malloc(size * sizeof(int));
+    dendrogram->merges = malloc(size * sizeof(DendrogramMerge));
+    if (!parent || !clusterOf || !dendrogram->merges) {
+        fprintf(stderr, "Memory allocation failed for the dendrogram\n");
+        free(parent);
+        free(clusterOf);
+        freeDendrogram(dendrogram);
+        return HIERARCHICAL_ERR_MEMORY;
+    }
+    profileCount(PROFILE_KMEANS, PROFILE_ALLOCATIONS, 3);
+    dendrogram->size = size;
+    dendrogram->linkage = linkage;
+
+    // Merging the components joined by the edges by increasing height yields the clusters bottom-up
+    qsort(edges, size - 1, sizeof(DendrogramEdge), compareEdges);
+    for (int i = 0; i < size; i++) {
+        parent[i] = i;
+        clusterOf[i] = i;
+    }
+    for (int i = 0; i < size - 1; i++) {
+        int first = findRoot(parent, edges[i].first);
+        int second = findRoot(parent, edges[i].second);
+        int a = clusterOf[first], b = clusterOf[second];
+        DendrogramMerge *merge = &dendrogram->merges[i];
+        merge->left = a < b ? a : b;
+        merge->right = a < b ? b : a;
+        merge->height = edges[i].height;
+        merge->size = (a < size ? 1 : dendrogram->merges[a - size].size) +
+                      (b < size ? 1 : dendrogram->merges[b - size].size);
+        parent[second] = first;
+        clusterOf[first] = size + i;
+    }
+    free(parent);
+    free(clusterOf);
+    return HIERARCHICAL_SUCCESS;
+}
+
+// Builds the dendrogram of a precomputed distance matrix with the nearest-neighbor chain.
+int buildDendrogram(const DistanceMatrix *matrix, int linkage, Dendrogram *dendrogram) {
+    memset(dendrogram, 0, sizeof(Dendrogram));
+    if (!matrix || matrix->size <= 0 || (!matrix->values && matrix->size > 1) || linkage < 0 ||
+        linkage > LINKAGE_SINGLE) {
+        fprintf(stderr, "Invalid parameters for hierarchical clustering\n");
+        return HIERARCHICAL_ERR_INVALID_INPUT;
+    }
+    int n = matrix->size;
+    size_t pairCount = (size_t)n * (n - 1) / 2;
+    double *distances = malloc((pairCount > 0 ? pairCount : 1) * sizeof(double));
+    int *sizes = malloc(n * sizeof(int));
+    int *chain = malloc(n * sizeof(int));
+    char *active = malloc(n);
+    DendrogramEdge *merges = malloc(n * sizeof(DendrogramEdge));
+    int status = HIERARCHICAL_ERR_MEMORY;
+    if (distances && sizes && chain && active && merges) {
+        profileCount(PROFILE_KMEANS, PROFILE_ALLOCATIONS, 5);
+        ProfileScope scope = profileBegin(PROFILE_KMEANS);
+
+        // Ward's update holds for squared Euclidean distances
+        for (size_t i = 0; i < pairCount; i++) {
+            distances[i] = linkage == LINKAGE_WARD ? matrix->values[i] * matrix->values[i] : matrix->values[i];
+        }
+        for (int i = 0; i < n; i++) {
+            sizes[i] = 1;
+            active[i] = 1;
+        }
+        runChain(distances, n, linkage, sizes, chain, active, merges);
+        for (int i = 0; i < n - 1 && linkage == LINKAGE_WARD; i++) {
+            merges[i].height = sqrt(merges[i].height);
+        }
+        profileCount(PROFILE_KMEANS, PROFILE_KMEANS_ITERATIONS, n - 1);
+
+        // The chain finds merges out of height order
+        status = dendrogramFromEdges(merges, n, linkage, dendrogram);
+        profileEnd(&scope);
+    } else {
+        fprintf(stderr, "Memory allocation failed for hierarchical clustering\n");
+    }
+    free(distances);
+    free(sizes);
+    free(chain);
+    free(active);
+    free(merges);
+    return status;
+}
+
+// Computes the distance matrix in parallel and builds the dendrogram of the samples.
+int hierarchicalClustering(ShapeData *data, int dataSize, int featureCount, int p, int linkage,
+                           Dendrogram *dendrogram) {
+    memset(dendrogram, 0, sizeof(Dendrogram));
+    if (!data || dataSize <= 0 || featureCount <= 0 || p <= 0) {
+        fprintf(stderr, "Invalid parameters for hierarchical clustering\n");
+        return HIERARCHICAL_ERR_INVALID_INPUT;
+    }
+    DistanceMatrix matrix = computeDistanceMatrix(data, dataSize, featureCount, p);
+    if (!matrix.values) {
+        return HIERARCHICAL_ERR_MEMORY;
+    }
+    int status = buildDendrogram(&matrix, linkage, dendrogram);
+    freeDistanceMatrix(&matrix);
+    return status;
+}
+
+// Applies the n - k lowest merges and numbers the remaining clusters by their first sample.
+int cutDendrogram(const Dendrogram *dendrogram, int k, int *labels) {
+    if (!dendrogram || !dendrogram->merges || !labels || k < 1 || k > dendrogram->size) {
+        fprintf(stderr, "Invalid parameters for cutting the dendrogram\n");
+        return HIERARCHICAL_ERR_INVALID_INPUT;
+    }
+    int n = dendrogram->size;
+    int nodeCount = 2 * n - 1;
+    int *parent = malloc(nodeCount * sizeof(int));
+    int *labelOf = malloc(nodeCount * sizeof(int));
+    if (!parent || !labelOf) {
+        fprintf(stderr, "Memory allocation failed for cutting the dendrogram\n");
+        free(parent);
+        free(labelOf);
+        return HIERARCHICAL_ERR_MEMORY;
+    }
+    profileCount(PROFILE_KMEANS, PROFILE_ALLOCATIONS, 2);
+
+    for (int i = 0; i < nodeCount; i++) {
+        parent[i] = i;
+        labelOf[i] = -1;
+    }
+    for (int i = 0; i < n - k; i++) {
+        parent[dendrogram->merges[i].left] = n + i;
+        parent[dendrogram->merges[i].right] = n + i;
+    }
+    int next = 0;
+    for (int i = 0; i < n; i++) {
+        int root = findRoot(parent, i);
+        if (labelOf[root] < 0) {
+            labelOf[root] = next++;
+        }
+        labels[i] = labelOf[root];
+    }
+    free(parent);
+    free(labelOf);
+    return HIERARCHICAL_SUCCESS;
+}
+
+// Cuts the dendrogram into k clusters whose centroids are the means of their samples.
+Cluster *dendrogramClusters(const Dendrogram *dendrogram, ShapeData *data, int k, int featureCount) {
+    if (!dendrogram || !data || featureCount <= 0) {
+        fprintf(stderr, "Invalid parameters for cutting the dendrogram\n");
+        return NULL;
+    }
+    int n = dendrogram->size;
+    int *labels = malloc(n * sizeof(int));
+    if (!labels) {
+        fprintf(stderr, "Memory allocation failed for cutting the dendrogram\n");
+        return NULL;
+    }
+    if (cutDendrogram(dendrogram, k, labels) != HIERARCHICAL_SUCCESS) {
+        free(labels);
+        return NULL;
+    }
+    Cluster *clusters = meanCentroidClusters(data, n, k, featureCount, labels);
+    free(labels);
+    return clusters;
+}
+
+// Writes the merges as the rows of a linkage matrix.
+int writeDendrogram(const char *filename, const Dendrogram *dendrogram) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        fprintf(stderr, "Failed to open %s for writing\n", filename);
+        return HIERARCHICAL_ERR_INVALID_INPUT;
+    }
+    fprintf(file, "left,right,height,size\n");
+    for (int i = 0; i < dendrogram->size - 1; i++) {
+        const DendrogramMerge *merge = &dendrogram->merges[i];
+        fprintf(file, "%d,%d,%.6f,%d\n", merge->left, merge->right, merge->height, merge->size);
+    }
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Failed to write %s\n", filename);
+        return HIERARCHICAL_ERR_INVALID_INPUT;
+    }
+    return HIERARCHICAL_SUCCESS;
+}
+
+// Frees the merges of a dendrogram.
+void freeDendrogram(Dendrogram *dendrogram) {
+    if (dendrogram) {
+        free(dendrogram->merges);
+        memset(dendrogram, 0, sizeof(Dendrogram));
+    }
+}
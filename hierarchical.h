@@ -0,0 +1,169 @@
+/**
+ * @file hierarchical.h
+ * @brief Header file for agglomerative hierarchical clustering with the nearest-neighbor chain.
+ *
+ * Agglomerative clustering starts from one cluster per sample and repeatedly merges the
+ * two closest clusters, which yields a dendrogram of n - 1 merges. The naive algorithm
+ * searches the closest pair after every merge, O(n³) overall. The nearest-neighbor chain
+ * follows nearest neighbors from an arbitrary cluster until two clusters are each other's
+ * nearest neighbor and merges them; the rest of the chain stays valid, so the whole
+ * dendrogram costs O(n²) time on a working copy of the condensed distance matrix.
+ *
+ * The chain is exact for the reducible linkages supported here (Ward, average, complete
+ * and single), whose distances are updated after a merge with the Lance-Williams formula.
+ * Ward's criterion is the increase of the within-cluster sum of squares for p = 2; with
+ * another p it applies the same update to squared Minkowski distances.
+ *
+ * Once built, the dendrogram can be cut into any number of clusters in O(n), so the
+ * clusterings for every k come from a single run.
+ */
+
+#ifndef HIERARCHICAL_H
+#define HIERARCHICAL_H
+
+#include "kmeans.h"
+#include "distance_matrix.h"
+
+// Error codes
+#define HIERARCHICAL_SUCCESS 0
+#define HIERARCHICAL_ERR_INVALID_INPUT -1
+#define HIERARCHICAL_ERR_MEMORY -2
+
+// Linkages
+#define LINKAGE_WARD 0
+#define LINKAGE_AVERAGE 1
+#define LINKAGE_COMPLETE 2
+#define LINKAGE_SINGLE 3
+
+// Clusters at least this large have their distances updated in parallel after a merge
+#define HIERARCHICAL_PARALLEL_SIZE 4096
+
+/**
+ * @struct DendrogramMerge
+ * @brief One merge of the dendrogram, in the layout of a SciPy linkage matrix row.
+ *
+ * Samples are numbered 0 to n - 1 and the cluster created by merge i is numbered n + i.
+ */
+typedef struct {
+    int left;          /**< Smaller number of the two merged clusters. */
+    int right;         /**< Larger number of the two merged clusters. */
+    double height;     /**< Linkage distance between the two clusters. */
+    int size;          /**< Number of samples in the merged cluster. */
+} DendrogramMerge;
+
+/**
+ * @struct DendrogramEdge
+ * @brief Two clusters joined at a height, each named by any one of its samples.
+ */
+typedef struct {
+    int first;         /**< A sample of the first cluster. */
+    int second;        /**< A sample of the second cluster. */
+    double height;     /**< Linkage distance between the two clusters. */
+} DendrogramEdge;
+
+/**
+ * @struct Dendrogram
+ * @brief The n - 1 merges of a hierarchical clustering, by increasing height.
+ */
+typedef struct {
+    int size;                  /**< Number of clustered samples. */
+    int linkage;               /**< LINKAGE_* criterion of the merges. */
+    DendrogramMerge *merges;   /**< size - 1 merges. */
+} Dendrogram;
+
+/**
+ * @brief Converts a linkage name ('ward', 'average', 'complete' or 'single') to its constant.
+ *
+ * @param name Name of the linkage.
+ * @return The LINKAGE_* constant, or -1 for an unknown name.
+ */
+int parseLinkage(const char *name);
+
+/**
+ * @brief Returns the name of a linkage.
+ *
+ * @param linkage LINKAGE_* constant.
+ * @return The name parsed by parseLinkage.
+ */
+const char *linkageName(int linkage);
+
+/**
+ * @brief Numbers merges found in any order like the rows of a linkage matrix.
+ *
+ * The edges are sorted by height and their clusters merged bottom-up with a union-find,
+ * so any spanning tree of the samples (the merges of the chain, a minimum spanning
+ * tree for single linkage) becomes a dendrogram.
+ *
+ * @param edges size - 1 edges forming a spanning tree of the samples; sorted in place.
+ * @param size Number of samples.
+ * @param linkage LINKAGE_* criterion recorded in the dendrogram.
+ * @param dendrogram Dendrogram to initialize; freeDendrogram releases it.
+ * @return HIERARCHICAL_SUCCESS or a HIERARCHICAL_ERR_* code.
+ */
+int dendrogramFromEdges(DendrogramEdge *edges, int size, int linkage, Dendrogram *dendrogram);
+
+/**
+ * @brief Builds the dendrogram of a precomputed distance matrix with the nearest-neighbor chain.
+ *
+ * @param matrix Pairwise distances of the samples; left unchanged.
+ * @param linkage LINKAGE_* criterion.
+ * @param dendrogram Dendrogram to initialize; freeDendrogram releases it.
+ * @return HIERARCHICAL_SUCCESS or a HIERARCHICAL_ERR_* code.
+ */
+int buildDendrogram(const DistanceMatrix *matrix, int linkage, Dendrogram *dendrogram);
+
+/**
+ * @brief Computes the distance matrix of the samples in parallel and builds their dendrogram.
+ *
+ * @param data Array of samples.
+ * @param dataSize Number of samples, at least 1.
+ * @param featureCount Number of features in each sample.
+ * @param p Minkowski distance exponent.
+ * @param linkage LINKAGE_* criterion.
+ * @param dendrogram Dendrogram to initialize; freeDendrogram releases it.
+ * @return HIERARCHICAL_SUCCESS or a HIERARCHICAL_ERR_* code.
+ */
+int hierarchicalClustering(ShapeData *data, int dataSize, int featureCount, int p, int linkage,
+                           Dendrogram *dendrogram);
+
+/**
+ * @brief Cuts the dendrogram into k clusters by undoing its k - 1 highest merges.
+ *
+ * @param dendrogram Dendrogram to cut.
+ * @param k Number of clusters, from 1 to dendrogram->size.
+ * @param labels Output array of dendrogram->size clusters (0 to k - 1), numbered by their first sample.
+ * @return HIERARCHICAL_SUCCESS or a HIERARCHICAL_ERR_* code.
+ */
+int cutDendrogram(const Dendrogram *dendrogram, int k, int *labels);
+
+/**
+ * @brief Cuts the dendrogram into k clusters with the layout of the result of kmeans().
+ *
+ * The centroid of a cluster is the mean of its samples, so the kmeans_evaluation.c
+ * metrics, the model files and nearest centroid classification all apply.
+ *
+ * @param dendrogram Dendrogram of the samples.
+ * @param data Samples the dendrogram was built on.
+ * @param k Number of clusters.
+ * @param featureCount Number of features in each sample.
+ * @return Array of k clusters released like the result of kmeans(), or NULL on failure.
+ */
+Cluster *dendrogramClusters(const Dendrogram *dendrogram, ShapeData *data, int k, int featureCount);
+
+/**
+ * @brief Writes the merges as CSV rows of a SciPy linkage matrix (left, right, height, size).
+ *
+ * @param filename Path of the CSV file.
+ * @param dendrogram Dendrogram to write.
+ * @return HIERARCHICAL_SUCCESS, or HIERARCHICAL_ERR_INVALID_INPUT if the file cannot be written.
+ */
+int writeDendrogram(const char *filename, const Dendrogram *dendrogram);
+
+/**
+ * @brief Frees the memory held by a dendrogram.
+ *
+ * @param dendrogram Dendrogram to free.
+ */
+void freeDendrogram(Dendrogram *dendrogram);
+
+#endif // HIERARCHICAL_H
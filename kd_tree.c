@@ -0,0 +1,234 @@
+#include "kd_tree.h"
+#include "profiler.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// Returns |x|^p for a non-negative x.
+static inline double powerOf(double x, int p) {
+    return p == 1 ? x : p == 2 ? x * x : pow(x, p);
+}
+
+// Computes the bounding box of a node from its samples.
+static void computeBounds(KdTree *tree, int node) {
+    int d = tree->featureCount;
+    double *lower = tree->lower + (size_t)node * d;
+    double *upper = tree->upper + (size_t)node * d;
+    const KdNode *current = &tree->nodes[node];
+    memcpy(lower, tree->data[tree->order[current->start]].features, d * sizeof(double));
+    memcpy(upper, lower, d * sizeof(double));
+    for (int i = current->start + 1; i < current->end; i++) {
+        const double *features = tree->data[tree->order[i]].features;
+        for (int j = 0; j < d; j++) {
+            if (features[j] < lower[j]) lower[j] = features[j];
+            if (features[j] > upper[j]) upper[j] = features[j];
+        }
+    }
+}
+
+// Reorders order[start, end) so that position nth holds the sample of rank nth along a feature.
+static void selectNth(const ShapeData *data, int *order, int start, int end, int nth, int feature) {
+    int low = start, high = end - 1;
+    while (low < high) {
+        double pivot = data[order[low + (high - low) / 2]].features[feature];
+        int i = low, j = high;
+        while (i <= j) {
+            while (data[order[i]].features[feature] < pivot) i++;
+            while (data[order[j]].features[feature] > pivot) j--;
+            if (i <= j) {
+                int swap = order[i];
+                order[i++] = order[j];
+                order[j--] = swap;
+            }
+        }
+        if (nth <= j) {
+            high = j;
+        } else if (nth >= i) {
+            low = i;
+        } else {
+            return;
+        }
+    }
+}
+
+// Builds a KD-tree over a set of samples.
+int buildKdTree(KdTree *tree, const ShapeData *data, int dataSize, int featureCount, int p) {
+    memset(tree, 0, sizeof(KdTree));
+    if (!data || dataSize <= 0 || featureCount <= 0 || p <= 0) {
+        fprintf(stderr, "Invalid parameters for the KD-tree\n");
+        return KD_TREE_ERR_INVALID_INPUT;
+    }
+    // Halves of a split node hold more than KD_TREE_LEAF_SIZE / 2 samples each
+    int maxNodes = 2 * (dataSize / (KD_TREE_LEAF_SIZE / 2) + 1);
+    tree->data = data;
+    tree->size = dataSize;
+    tree->featureCount = featureCount;
+    tree->p = p;
+    tree->order = malloc(dataSize * sizeof(int));
+    tree->nodes = malloc(maxNodes * sizeof(KdNode));
+    tree->lower = malloc((size_t)maxNodes * featureCount * sizeof(double));
+    tree->upper = malloc((size_t)maxNodes * featureCount * sizeof(double));
+    if (!tree->order || !tree->nodes || !tree->lower || !tree->upper) {
+        fprintf(stderr, "Memory allocation failed for the KD-tree\n");
+        freeKdTree(tree);
+        return KD_TREE_ERR_MEMORY;
+    }
+    profileCount(PROFILE_PREPROCESS, PROFILE_ALLOCATIONS, 4);
+    ProfileScope scope = profileBegin(PROFILE_PREPROCESS);
+
+    for (int i = 0; i < dataSize; i++) {
+        tree->order[i] = i;
+    }
+    tree->nodes[0] = (KdNode){0, dataSize, -1, -1};
+    tree->nodeCount = 1;
+    int pending[KD_TREE_MAX_DEPTH];
+    int pendingCount = 0;
+    pending[pendingCount++] = 0;
+    while (pendingCount > 0) {
+        int node = pending[--pendingCount];
+        computeBounds(tree, node);
+        KdNode *current = &tree->nodes[node];
+        if (current->end - current->start <= KD_TREE_LEAF_SIZE) {
+            continue;
+        }
+
+        // Split at the median of the widest feature; a box of identical samples stays a leaf
+        const double *lower = tree->lower + (size_t)node * featureCount;
+        const double *upper = tree->upper + (size_t)node * featureCount;
+        int feature = 0;
+        for (int j = 1; j < featureCount; j++) {
+            if (upper[j] - lower[j] > upper[feature] - lower[feature]) {
+                feature = j;
+            }
+        }
+        if (upper[feature] <= lower[feature]) {
+            continue;
+        }
+        int middle = current->start + (current->end - current->start) / 2;
+        selectNth(data, tree->order, current->start, current->end, middle, feature);
+
+        current->left = tree->nodeCount;
+        current->right = tree->nodeCount + 1;
+        tree->nodes[current->left] = (KdNode){current->start, middle, -1, -1};
+        tree->nodes[current->right] = (KdNode){middle, current->end, -1, -1};
+        tree->nodeCount += 2;
+        pending[pendingCount++] = current->right;
+        pending[pendingCount++] = current->left;
+    }
+    profileEnd(&scope);
+    return KD_TREE_SUCCESS;
+}
+
+// Returns the p-th power of the distance from a query to the box of a node.
+static double boxPowerDistance(const KdTree *tree, int node, const double *query) {
+    const double *lower = tree->lower + (size_t)node * tree->featureCount;
+    const double *upper = tree->upper + (size_t)node * tree->featureCount;
+    double sum = 0.0;
+    for (int j = 0; j < tree->featureCount; j++) {
+        double gap = query[j] < lower[j] ? lower[j] - query[j] : query[j] > upper[j] ? query[j] - upper[j] : 0.0;
+        sum += powerOf(gap, tree->p);
+    }
+    return sum;
+}
+
+// Visits a node, the nearer child first, skipping the children whose box cannot hold a nearer sample.
+static void searchNode(const KdTree *tree, int node, const double *query, NeighborHeap *heap,
+                       uint64_t *evaluations) {
+    const KdNode *current = &tree->nodes[node];
+    if (current->left < 0) {
+        for (int i = current->start; i < current->end; i++) {
+            int sample = tree->order[i];
+            DistanceLabel candidate = {minkowskiPowerSum(query, tree->data[sample].features, tree->featureCount,
+                                                         tree->p), sample};
+            knnHeapOffer(heap, candidate);
+        }
+        *evaluations += current->end - current->start;
+        return;
+    }
+    double leftDistance = boxPowerDistance(tree, current->left, query);
+    double rightDistance = boxPowerDistance(tree, current->right, query);
+    int near = leftDistance <= rightDistance ? current->left : current->right;
+    int far = near == current->left ? current->right : current->left;
+    double farDistance = near == current->left ? rightDistance : leftDistance;
+
+    searchNode(tree, near, query, heap, evaluations);
+    // A box exactly as far as the k-th neighbor may still hold a tie with a smaller index
+    if (heap->count < heap->capacity || farDistance <= heap->entries[0].distance) {
+        searchNode(tree, far, query, heap, evaluations);
+    }
+}
+
+// Finds the k nearest samples of a query.
+int kdTreeSearch(const void *index, const ShapeData *query, int k, DistanceLabel *neighbors) {
+    const KdTree *tree = index;
+    if (!tree || !query || !neighbors || k <= 0 || k > tree->size) {
+        return KD_TREE_ERR_INVALID_INPUT;
+    }
+    NeighborHeap heap = {neighbors, 0, k};
+    uint64_t evaluations = 0;
+    searchNode(tree, 0, query->features, &heap, &evaluations);
+    profileCount(PROFILE_DISTANCE, PROFILE_DISTANCE_EVALUATIONS, evaluations);
+
+    knnSortNeighbors(neighbors, k);
+    for (int i = 0; i < k; i++) {
+        neighbors[i].distance = minkowskiRoot(neighbors[i].distance, tree->p);
+    }
+    return KD_TREE_SUCCESS;
+}
+
+// Finds every sample within a distance of a query.
+int kdTreeRadius(const KdTree *tree, const double *query, double radius, int **indices, int *capacity) {
+    double limit = powerOf(radius, tree->p);
+    int found = 0;
+    uint64_t evaluations = 0;
+    int pending[KD_TREE_MAX_DEPTH];
+    int pendingCount = 0;
+    pending[pendingCount++] = 0;
+    while (pendingCount > 0) {
+        int node = pending[--pendingCount];
+        if (boxPowerDistance(tree, node, query) > limit) {
+            continue;
+        }
+        const KdNode *current = &tree->nodes[node];
+        if (current->left >= 0) {
+            pending[pendingCount++] = current->right;
+            pending[pendingCount++] = current->left;
+            continue;
+        }
+
+        if (found + (current->end - current->start) > *capacity) {
+            int grown = *capacity > 0 ? *capacity : KD_TREE_LEAF_SIZE;
+            while (grown < found + (current->end - current->start)) {
+                grown *= 2;
+            }
+            int *buffer = realloc(*indices, grown * sizeof(int));
+            if (!buffer) {
+                fprintf(stderr, "Memory allocation failed for a KD-tree range query\n");
+                return KD_TREE_ERR_MEMORY;
+            }
+            *indices = buffer;
+            *capacity = grown;
+        }
+        for (int i = current->start; i < current->end; i++) {
+            int sample = tree->order[i];
+            if (minkowskiPowerSum(query, tree->data[sample].features, tree->featureCount, tree->p) <= limit) {
+                (*indices)[found++] = sample;
+            }
+        }
+        evaluations += current->end - current->start;
+    }
+    profileCount(PROFILE_DISTANCE, PROFILE_DISTANCE_EVALUATIONS, evaluations);
+    return found;
+}
+
+// Frees the order, nodes and boxes of a tree.
+void freeKdTree(KdTree *tree) {
+    if (tree) {
+        free(tree->order);
+        free(tree->nodes);
+        free(tree->lower);
+        free(tree->upper);
+        memset(tree, 0, sizeof(KdTree));
+    }
+}
@@ -0,0 +1,104 @@
+/**
+ * @file kd_tree.h
+ * @brief Header file for a KD-tree answering k-nearest-neighbor and range queries.
+ *
+ * The tree splits the samples at the median of the feature with the largest spread
+ * until a node holds at most KD_TREE_LEAF_SIZE samples, and keeps the bounding box
+ * of every node. A query visits the nearer child first and skips any node whose box
+ * is farther than the current k-th neighbor or the radius, so low-dimensional data
+ * is searched in about O(log n) distance evaluations instead of O(n). The boxes bound
+ * any Minkowski distance, so the tree serves every p.
+ *
+ * The samples are not copied and must outlive the tree. Queries only read the tree
+ * and may run concurrently.
+ */
+
+#ifndef KD_TREE_H
+#define KD_TREE_H
+
+#include "knn.h"
+
+// Error codes
+#define KD_TREE_SUCCESS 0
+#define KD_TREE_ERR_INVALID_INPUT -1
+#define KD_TREE_ERR_MEMORY -2
+
+// Largest number of samples in a leaf
+#define KD_TREE_LEAF_SIZE 16
+
+// Deepest path of a tree; median splits keep it below log2(INT_MAX)
+#define KD_TREE_MAX_DEPTH 64
+
+/**
+ * @struct KdNode
+ * @brief A node of the tree: a range of the sample order and its two halves.
+ */
+typedef struct {
+    int start;    /**< First position of the node's samples in the order array. */
+    int end;      /**< One past the last position of the node's samples. */
+    int left;     /**< Node holding the lower half, -1 for a leaf. */
+    int right;    /**< Node holding the upper half, -1 for a leaf. */
+} KdNode;
+
+/**
+ * @struct KdTree
+ * @brief Nodes, bounding boxes and sample order of a KD-tree.
+ */
+typedef struct {
+    const ShapeData *data;   /**< Indexed samples; not owned. */
+    int size;                /**< Number of indexed samples. */
+    int featureCount;        /**< Number of features of every sample. */
+    int p;                   /**< Minkowski exponent of the queries. */
+    int *order;              /**< Sample indices, the samples of every node contiguous. */
+    KdNode *nodes;           /**< Nodes, the root first. */
+    int nodeCount;           /**< Number of nodes. */
+    double *lower;           /**< Row-major nodeCount x featureCount lower corners of the boxes. */
+    double *upper;           /**< Row-major nodeCount x featureCount upper corners of the boxes. */
+} KdTree;
+
+/**
+ * @brief Builds a KD-tree over a set of samples.
+ *
+ * @param tree Tree to initialize; freeKdTree releases it.
+ * @param data Samples to index, which must outlive the tree.
+ * @param dataSize Number of samples.
+ * @param featureCount Number of features of every sample.
+ * @param p Minkowski exponent of the queries.
+ * @return KD_TREE_SUCCESS or a KD_TREE_ERR_* code.
+ */
+int buildKdTree(KdTree *tree, const ShapeData *data, int dataSize, int featureCount, int p);
+
+/**
+ * @brief Finds the k nearest samples of a query.
+ *
+ * The signature matches KnnIndexSearch, so a tree can be attached to a batch classifier.
+ * Ties are broken by the smaller sample index, like the exact search.
+ *
+ * @param tree KdTree to search.
+ * @param query Sample to search for.
+ * @param k Number of neighbors, from 1 to the number of indexed samples.
+ * @param neighbors Output array of k pairs, nearest first, whose labels are sample indices.
+ * @return KD_TREE_SUCCESS or KD_TREE_ERR_INVALID_INPUT.
+ */
+int kdTreeSearch(const void *tree, const ShapeData *query, int k, DistanceLabel *neighbors);
+
+/**
+ * @brief Finds every sample within a distance of a query, the query itself included if indexed.
+ *
+ * @param tree Tree to search.
+ * @param query featureCount features.
+ * @param radius Largest distance, inclusive.
+ * @param indices Buffer receiving the sample indices in no particular order; grown with realloc as needed.
+ * @param capacity Entries allocated in *indices, updated when the buffer grows.
+ * @return The number of samples found, or KD_TREE_ERR_MEMORY.
+ */
+int kdTreeRadius(const KdTree *tree, const double *query, double radius, int **indices, int *capacity);
+
+/**
+ * @brief Frees the memory held by a tree; the samples are not freed.
+ *
+ * @param tree Tree to free.
+ */
+void freeKdTree(KdTree *tree);
+
+#endif // KD_TREE_H
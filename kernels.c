@@ -0,0 +1,67 @@
+#include "kernels.h"
+
+#include <math.h>
+
+// Defines the kernels of one dimension; BOUND is the trip count, a constant for the specialized ones
+#define DEFINE_FEATURE_KERNELS(NAME, BOUND)                                                              \
+    static double manhattan##NAME(const double *a, const double *b, int featureCount) {                \
+        (void)featureCount;                                                                             \
+        double sum = 0.0;                                                                               \
+        _Pragma("omp simd reduction(+:sum)")                                                            \
+        for (int f = 0; f < (BOUND); f++) {                                                             \
+            sum += fabs(a[f] - b[f]);                                                                   \
+        }                                                                                               \
+        return sum;                                                                                     \
+    }                                                                                                   \
+    static double squaredEuclidean##NAME(const double *a, const double *b, int featureCount) {         \
+        (void)featureCount;                                                                             \
+        double sum = 0.0;                                                                               \
+        _Pragma("omp simd reduction(+:sum)")                                                            \
+        for (int f = 0; f < (BOUND); f++) {                                                             \
+            double difference = a[f] - b[f];                                                            \
+            sum += difference * difference;                                                             \
+        }                                                                                               \
+        return sum;                                                                                     \
+    }                                                                                                   \
+    static double dot##NAME(const double *a, const double *b, int featureCount) {                      \
+        (void)featureCount;                                                                             \
+        double sum = 0.0;                                                                               \
+        _Pragma("omp simd reduction(+:sum)")                                                            \
+        for (int f = 0; f < (BOUND); f++) {                                                             \
+            sum += a[f] * b[f];                                                                         \
+        }                                                                                               \
+        return sum;                                                                                     \
+    }                                                                                                   \
+    static void accumulate##NAME(double *restrict sum, const double *restrict x, int featureCount) {   \
+        (void)featureCount;                                                                             \
+        _Pragma("omp simd")                                                                             \
+        for (int f = 0; f < (BOUND); f++) {                                                             \
+            sum[f] += x[f];                                                                             \
+        }                                                                                               \
+    }                                                                                                   \
+    static void standardize##NAME(double *restrict x, const double *restrict offset,                   \
+                                  const double *restrict scale, int featureCount) {                     \
+        (void)featureCount;                                                                             \
+        _Pragma("omp simd")                                                                             \
+        for (int f = 0; f < (BOUND); f++) {                                                             \
+            x[f] = (x[f] - offset[f]) / scale[f];                                                       \
+        }                                                                                               \
+    }
+
+// Table of the kernels defined for a dimension
+#define FEATURE_KERNELS(NAME, DIMENSION) \
+    {DIMENSION, manhattan##NAME, squaredEuclidean##NAME, dot##NAME, accumulate##NAME, standardize##NAME}
+
+DEFINE_FEATURE_KERNELS(Generic, featureCount)
+DEFINE_FEATURE_KERNELS(16, 16)
+DEFINE_FEATURE_KERNELS(90, 90)
+DEFINE_FEATURE_KERNELS(100, 100)
+DEFINE_FEATURE_KERNELS(128, 128)
+
+const FeatureKernels genericKernels = FEATURE_KERNELS(Generic, 0);
+
+// Kernels compiled for a fixed dimension, one per descriptor set
+const FeatureKernels kernels16 = FEATURE_KERNELS(16, 16);
+const FeatureKernels kernels90 = FEATURE_KERNELS(90, 90);
+const FeatureKernels kernels100 = FEATURE_KERNELS(100, 100);
+const FeatureKernels kernels128 = FEATURE_KERNELS(128, 128);
@@ -0,0 +1,57 @@
+/**
+ * @file kernels.h
+ * @brief Header file for the feature-vector kernels specialized for the descriptor dimensions.
+ *
+ * The descriptor sets only have 16 (E34), 90 (SA), 100 (GFD) or 128 (F0) features.
+ * The inner loops of the distances, centroid sums, scaling and projections are
+ * compiled once per dimension from the same macro with a constant trip count, so the
+ * compiler unrolls and vectorizes them without a runtime remainder loop. Every call
+ * site looks its FeatureKernels table up by the dimension of its vectors, so datasets
+ * of different dimensions in one run (a grid search) each get their own kernels; any
+ * other dimension (PCA components, synthetic data) uses the generic kernels, which
+ * take the bound at run time. Every kernel has the signature of its generic version,
+ * so callers only ask kernelsFor() for the table of their dimension.
+ */
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+/**
+ * @struct FeatureKernels
+ * @brief Kernels over feature vectors of one dimension.
+ */
+typedef struct {
+    int featureCount;  /**< Dimension the kernels are compiled for, 0 for the generic ones. */
+    double (*manhattan)(const double *a, const double *b, int featureCount);         /**< Sum of |a - b|. */
+    double (*squaredEuclidean)(const double *a, const double *b, int featureCount);  /**< Sum of (a - b)^2. */
+    double (*dot)(const double *a, const double *b, int featureCount);               /**< Sum of a * b. */
+    void (*accumulate)(double *sum, const double *x, int featureCount);              /**< sum += x. */
+    void (*standardize)(double *x, const double *offset, const double *scale,
+                        int featureCount);                                           /**< x = (x - offset) / scale. */
+} FeatureKernels;
+
+/** Kernels taking the dimension at run time. */
+extern const FeatureKernels genericKernels;
+
+/** Kernels compiled for the dimension of each descriptor set. */
+extern const FeatureKernels kernels16, kernels90, kernels100, kernels128;
+
+/**
+ * @brief Returns the kernels to use for vectors of a dimension.
+ *
+ * Callers in hot loops look the table up once, outside the loop.
+ *
+ * @param featureCount Number of features of the vectors.
+ * @return The kernels compiled for that dimension, the generic ones if there are none.
+ */
+static inline const FeatureKernels *kernelsFor(int featureCount) {
+    switch (featureCount) {
+        case 16: return &kernels16;
+        case 90: return &kernels90;
+        case 100: return &kernels100;
+        case 128: return &kernels128;
+        default: return &genericKernels;
+    }
+}
+
+#endif // KERNELS_H
@@ -1,45 +1,18 @@
 #include "kmeans.h"
+#include "profiler.h"
+#include "arena.h"
+#include "kernels.h"
 
 // Private helper functions declarations
-static ShapeData* copyShapeData(const ShapeData *src, int featureCount);
 static bool isIndexSelected(const int *selectedIndices, int k, int index);
-static void initializeCentroids(Cluster *clusters, const ShapeData *trainingSet, int k, int featureCount, int trainingSize);
-static void assignPointsToClusters(Cluster *clusters, const ShapeData *trainingSet, int trainingSize, int k, int featureCount, int p);
-static void updateCentroids(Cluster *clusters, int k, int featureCount);
-static void freeClusterPoints(Cluster *clusters, int k);
-static bool isCentroidSimilar(ShapeData *centroid1, ShapeData *centroid2, int featureCount);
-static bool areCentroidsConverged(Cluster *clusters, Cluster *prevClusters, int k, int featureCount);
+static void initializeCentroids(Cluster *clusters, const ShapeData *trainingSet, int k, int featureCount, int trainingSize, Arena *arena);
+static void assignPointsToClusters(Cluster *clusters, const ShapeData *trainingSet, int trainingSize, int k, int featureCount, int p, int *assignments);
+static void updateCentroids(Cluster *clusters, const ShapeData *trainingSet, int trainingSize, int k, int featureCount, const int *assignments, double *sums);
+static int gatherClusterPoints(Cluster *clusters, const ShapeData *trainingSet, int trainingSize, int k, const int *assignments);
+static bool isCentroidSimilar(const double *centroid1, const double *centroid2, int featureCount);
+static bool areCentroidsConverged(Cluster *clusters, const double *prevCentroids, int k, int featureCount);
 
 
-/**
- * @brief Copies ShapeData structure.
- *
- * Allocates memory and creates a copy of a given ShapeData structure.
- * This is useful for creating independent copies of centroids.
- * 
- * @param src Source ShapeData to copy.
- * @param featureCount Number of features in ShapeData.
- * @return ShapeData* Pointer to the newly allocated copy of ShapeData.
- */
-static ShapeData* copyShapeData(const ShapeData *src, int featureCount) {
-    // Allocate memory for the ShapeData structure
-    ShapeData *dest = malloc(sizeof(ShapeData));
-    if (!dest) {
-        return NULL; // Return NULL if memory allocation fails
-    }
-
-    // Allocate memory for the features array within ShapeData
-    dest->features = malloc(featureCount * sizeof(double));
-    if (!dest->features) {
-        free(dest); // Free the ShapeData structure if feature allocation fails
-        return NULL;
-    }
-
-    // Copy the feature values from the source to the newly allocated destination
-    memcpy(dest->features, src->features, featureCount * sizeof(double));
-    return dest;
-}
-
 /**
  * @brief Checks for index in selected indices array.
  *
@@ -65,15 +38,17 @@ static bool isIndexSelected(const int *selectedIndices, int k, int index) {
  * Randomly selects unique data points from the training set to serve as initial centroids.
  * Ensures that each centroid is unique to provide a diverse starting point for clustering.
  * 
- * @param clusters Array of clusters to initialize.
+ * @param clusters Array of clusters to initialize, with allocated centroids.
  * @param trainingSet Array of training data.
  * @param k Number of clusters.
  * @param featureCount Number of features in each ShapeData item.
  * @param trainingSize Size of the training set.
+ * @param arena Arena for the temporary array of selected indices.
  */
-static void initializeCentroids(Cluster *clusters, const ShapeData *trainingSet, int k, int featureCount, int trainingSize) {
-    // Allocate an array to keep track of selected indices for centroids
-    int *selectedIndices = malloc(k * sizeof(int));
+static void initializeCentroids(Cluster *clusters, const ShapeData *trainingSet, int k, int featureCount, int trainingSize, Arena *arena) {
+    // Keep track of selected indices for centroids
+    ArenaMark mark = arenaMark(arena);
+    int *selectedIndices = arenaAlloc(arena, k * sizeof(int));
     if (!selectedIndices) {
         return; // Return if memory allocation fails
     }
@@ -88,26 +63,33 @@ static void initializeCentroids(Cluster *clusters, const ShapeData *trainingSet,
         int index = rand() % trainingSize;
         if (!isIndexSelected(selectedIndices, k, index)) {
             selectedIndices[correctIndex++] = index;
-            clusters[correctIndex - 1].centroid = copyShapeData(&trainingSet[index], featureCount);
+            memcpy(clusters[correctIndex - 1].centroid->features, trainingSet[index].features, featureCount * sizeof(double));
         }
     }
 
-    free(selectedIndices); // Free the memory used for tracking selected indices
+    arenaReset(arena, mark); // Release the array of selected indices
 }
 
 /**
  * @brief Assigns each data point to the nearest cluster.
  *
- * Computes the distance between each data point and each centroid,
- * assigning the point to the cluster with the closest centroid.
+ * Computes the distance between each data point and each centroid, and records
+ * the closest cluster of every point. The cluster sizes are counted on the way;
+ * the point arrays themselves are only built once the clustering has converged.
  * 
  * @param clusters Array of clusters.
  * @param trainingSet Array of training data.
  * @param trainingSize Size of the training set.
  * @param k Number of clusters.
  * @param featureCount Number of features in each ShapeData item.
+ * @param p Minkowski distance exponent.
+ * @param assignments Output array receiving the cluster of every point.
  */
-static void assignPointsToClusters(Cluster *clusters, const ShapeData *trainingSet, int trainingSize, int k, int featureCount, int p) {
+static void assignPointsToClusters(Cluster *clusters, const ShapeData *trainingSet, int trainingSize, int k, int featureCount, int p, int *assignments) {
+    for (int j = 0; j < k; j++) {
+        clusters[j].size = 0;
+    }
+
     for (int i = 0; i < trainingSize; i++) {
         double minDistance = DBL_MAX;
         int closestCluster = 0;
@@ -122,11 +104,8 @@ static void assignPointsToClusters(Cluster *clusters, const ShapeData *trainingS
         }
 
         // Assign the point to the closest cluster
-        clusters[closestCluster].points = realloc(clusters[closestCluster].points, (clusters[closestCluster].size + 1) * sizeof(ShapeData));
-        if (clusters[closestCluster].points) {
-            clusters[closestCluster].points[clusters[closestCluster].size] = trainingSet[i];
-            clusters[closestCluster].size++;
-        }
+        assignments[i] = closestCluster;
+        clusters[closestCluster].size++;
     }
 }
 
@@ -136,65 +115,78 @@ static void assignPointsToClusters(Cluster *clusters, const ShapeData *trainingS
  *
  * Recalculates the centroid of each cluster to be the mean of all points assigned to it.
  * This step is essential for the iterative improvement of cluster assignments.
+ * Empty clusters keep their previous centroid.
  * 
  * @param clusters Array of clusters.
+ * @param trainingSet Array of training data.
+ * @param trainingSize Size of the training set.
  * @param k Number of clusters.
  * @param featureCount Number of features in each ShapeData item.
+ * @param assignments Cluster of every point.
+ * @param sums Work array of k * featureCount doubles.
  */
-static void updateCentroids(Cluster *clusters, int k, int featureCount) {
-    for (int i = 0; i < k; i++) {
-        if (clusters[i].size == 0) continue;
-
-        double *newCentroid = calloc(featureCount, sizeof(double));
-        if (!newCentroid) {
-            continue; // Skip centroid update if memory allocation fails
-        }
+static void updateCentroids(Cluster *clusters, const ShapeData *trainingSet, int trainingSize, int k, int featureCount, const int *assignments, double *sums) {
+    memset(sums, 0, (size_t)k * featureCount * sizeof(double));
 
-        // Calculate the mean of all points in the cluster
-        for (int j = 0; j < clusters[i].size; j++) {
-            for (int f = 0; f < featureCount; f++) {
-                newCentroid[f] += clusters[i].points[j].features[f];
-            }
-        }
+    // Sum the points of every cluster in one pass over the data
+    const FeatureKernels *kernels = kernelsFor(featureCount);
+    for (int i = 0; i < trainingSize; i++) {
+        kernels->accumulate(sums + (size_t)assignments[i] * featureCount, trainingSet[i].features, featureCount);
+    }
 
+    for (int i = 0; i < k; i++) {
+        if (clusters[i].size == 0) continue;
+        const double *sum = sums + (size_t)i * featureCount;
         for (int f = 0; f < featureCount; f++) {
-            clusters[i].centroid->features[f] = newCentroid[f] / clusters[i].size;
+            clusters[i].centroid->features[f] = sum[f] / clusters[i].size;
         }
-
-        free(newCentroid); // Free the memory allocated for the new centroid
     }
 }
 
 /**
- * @brief Frees memory allocated for points in each cluster.
+ * @brief Builds the point array of every cluster from the final assignments.
  *
- * This is a crucial step to prevent memory leaks during the reassignment of points
- * to clusters in each iteration of the k-means algorithm.
+ * Each array is allocated once with its exact size and belongs to the caller of kmeans.
  * 
- * @param clusters Array of clusters.
+ * @param clusters Array of clusters, with their sizes counted.
+ * @param trainingSet Array of training data.
+ * @param trainingSize Size of the training set.
  * @param k Number of clusters.
+ * @param assignments Cluster of every point, negative for points left out.
+ * @return 0 on success, -1 if an allocation failed.
  */
-static void freeClusterPoints(Cluster *clusters, int k) {
+static int gatherClusterPoints(Cluster *clusters, const ShapeData *trainingSet, int trainingSize, int k, const int *assignments) {
     for (int i = 0; i < k; i++) {
-        free(clusters[i].points); // Free the memory allocated for points in each cluster
-        clusters[i].points = NULL;
+        clusters[i].points = clusters[i].size > 0 ? malloc(clusters[i].size * sizeof(ShapeData)) : NULL;
+        if (clusters[i].size > 0 && !clusters[i].points) {
+            return -1;
+        }
         clusters[i].size = 0;
     }
+    profileCount(PROFILE_KMEANS, PROFILE_ALLOCATIONS, k);
+
+    for (int i = 0; i < trainingSize; i++) {
+        if (assignments[i] >= 0) {
+            Cluster *cluster = &clusters[assignments[i]];
+            cluster->points[cluster->size++] = trainingSet[i];
+        }
+    }
+    return 0;
 }
 
 // Function to check if two centroids are similar
-static bool isCentroidSimilar(ShapeData *centroid1, ShapeData *centroid2, int featureCount) {
+static bool isCentroidSimilar(const double *centroid1, const double *centroid2, int featureCount) {
     double distance = 0.0;
     for (int i = 0; i < featureCount; i++) {
-        distance += pow(centroid1->features[i] - centroid2->features[i], 2);
+        distance += pow(centroid1[i] - centroid2[i], 2);
     }
     return sqrt(distance) < CONVERGENCE_THRESHOLD;
 }
 
 // Function to check if all centroids are similar
-static bool areCentroidsConverged(Cluster *clusters, Cluster *prevClusters, int k, int featureCount) {
+static bool areCentroidsConverged(Cluster *clusters, const double *prevCentroids, int k, int featureCount) {
     for (int i = 0; i < k; i++) {
-        if (!isCentroidSimilar(clusters[i].centroid, prevClusters[i].centroid, featureCount)) {
+        if (!isCentroidSimilar(clusters[i].centroid->features, prevCentroids + (size_t)i * featureCount, featureCount)) {
             return false;
         }
     }
@@ -202,6 +194,20 @@ static bool areCentroidsConverged(Cluster *clusters, Cluster *prevClusters, int
 }
 
 
+// Sum of the Euclidean shifts of all centroids since the previous iteration.
+static double centroidShift(Cluster *clusters, const double *prevCentroids, int k, int featureCount) {
+    double shift = 0.0;
+    for (int i = 0; i < k; i++) {
+        double squared = 0.0;
+        for (int f = 0; f < featureCount; f++) {
+            double delta = clusters[i].centroid->features[f] - prevCentroids[(size_t)i * featureCount + f];
+            squared += delta * delta;
+        }
+        shift += sqrt(squared);
+    }
+    return shift;
+}
+
 // Function to find the most frequent class in a cluster
 static int findMostFrequentClass(ShapeData *points, int size) {
     if (size == 0) return -1;
@@ -216,18 +222,17 @@ static int findMostFrequentClass(ShapeData *points, int size) {
     }
 
     int classRange = maxClass - minClass + 1;
-    int *classCount = (int*) calloc(classRange, sizeof(int));
+    Arena *scratch = scratchArena(PROFILE_KMEANS);
+    ArenaMark mark = arenaMark(scratch);
+    int *classCount = arenaCalloc(scratch, classRange, sizeof(int));
     if (!classCount) {
         fprintf(stderr, "Memory allocation failed in findMostFrequentClass\n");
         exit(EXIT_FAILURE);
     }
 
     // Count the frequency of each class
-    #pragma omp parallel for
     for (int i = 0; i < size; i++) {
-        int classIndex = points[i].class - minClass;
-        #pragma omp atomic
-        classCount[classIndex]++;
+        classCount[points[i].class - minClass]++;
     }
 
     int maxClassIndex = 0;
@@ -238,7 +243,7 @@ static int findMostFrequentClass(ShapeData *points, int size) {
     }
 
     int mostFrequentClass = maxClassIndex + minClass;
-    free(classCount);
+    arenaReset(scratch, mark);
     return mostFrequentClass;
 }
 
@@ -247,85 +252,171 @@ static int findMostFrequentClass(ShapeData *points, int size) {
 /**
  * Iteratively performs clustering by assigning points to the nearest centroid
  * and updating centroids until the maximum number of iterations is reached.
+ * The assignments, previous centroids and centroid sums live in the scratch arena
+ * for the whole run, so the iterations themselves do not allocate.
  */
 Cluster* kmeans(ShapeData *trainingSet, int trainingSize, int k, int p, int featureCount, int maxIterations) {
     // Validate input parameters
-    if (!trainingSet || trainingSize <= 0 || k <= 0 || featureCount <= 0 || maxIterations <= 0) {
+    if (!trainingSet || trainingSize <= 0 || k <= 0 || k > trainingSize || featureCount <= 0 || maxIterations <= 0) {
         fprintf(stderr, "Invalid input parameters to kmeans function\n");
         return NULL;
     }
+    ProfileScope scope = profileBegin(PROFILE_KMEANS);
 
-    // Allocate memory for clusters and prevClusters
+    // Allocate memory for the clusters and their centroids, which are returned to the caller
     Cluster *clusters = calloc(k, sizeof(Cluster));
-    Cluster *prevClusters = calloc(k, sizeof(Cluster));
-
-    if (!clusters || !prevClusters) {
+    if (!clusters) {
         fprintf(stderr, "Memory allocation failure for clusters\n");
-        free(clusters); // Free in case one allocation succeeded but the other failed
-        free(prevClusters);
+        profileEnd(&scope);
         return NULL;
     }
-
-    // Initialize each Cluster in clusters and prevClusters
+    profileCount(PROFILE_KMEANS, PROFILE_ALLOCATIONS, 1 + 2 * k);
     for (int i = 0; i < k; i++) {
-        clusters[i].points = NULL;
-        clusters[i].size = 0;
-        clusters[i].centroid = calloc(1,sizeof(ShapeData)); // Allocate memory for centroid
-        if (clusters[i].centroid) {
-            clusters[i].centroid->features = calloc(featureCount, sizeof(double)); // Allocate memory for features
-            if (!clusters[i].centroid->features) {
-                printf("ERROR/n");
-            }
+        clusters[i].centroid = calloc(1, sizeof(ShapeData));
+        if (!clusters[i].centroid || !(clusters[i].centroid->features = calloc(featureCount, sizeof(double)))) {
+            fprintf(stderr, "Memory allocation failure for centroids\n");
+            exit(EXIT_FAILURE);
         }
+        clusters[i].centroid->featureCount = featureCount;
+    }
 
-        prevClusters[i].points = NULL;
-        prevClusters[i].size = 0;
-        prevClusters[i].centroid = calloc(1, sizeof(ShapeData)); // Allocate memory for centroid
-        if (prevClusters[i].centroid) {
-            prevClusters[i].centroid->features = calloc(featureCount, sizeof(double)); // Allocate memory for features
-            if (!prevClusters[i].centroid->features) {
-                printf("ERROR/n");
-            }
-        }
+    // Working memory of the run
+    Arena *scratch = scratchArena(PROFILE_KMEANS);
+    ArenaMark mark = arenaMark(scratch);
+    int *assignments = arenaAlloc(scratch, trainingSize * sizeof(int));
+    double *prevCentroids = arenaAlloc(scratch, (size_t)k * featureCount * sizeof(double));
+    double *sums = arenaAlloc(scratch, (size_t)k * featureCount * sizeof(double));
+    if (!assignments || !prevCentroids || !sums) {
+        fprintf(stderr, "Memory allocation failure for k-means work arrays\n");
+        exit(EXIT_FAILURE);
     }
 
-    initializeCentroids(clusters, trainingSet, k, featureCount, trainingSize);
+    initializeCentroids(clusters, trainingSet, k, featureCount, trainingSize, scratch);
 
     // Main k-means clustering loop
     bool converged = false;
     for (int iteration = 0; iteration < maxIterations && !converged; iteration++) {
         // Store previous centroids
         for (int i = 0; i < k; i++) {
-            if (prevClusters[i].centroid) {
-                free(prevClusters[i].centroid->features);
-                free(prevClusters[i].centroid);
-            }
-            prevClusters[i].centroid = copyShapeData(clusters[i].centroid, featureCount);
+            memcpy(prevCentroids + (size_t)i * featureCount, clusters[i].centroid->features, featureCount * sizeof(double));
         }
 
-        freeClusterPoints(clusters, k);
-        assignPointsToClusters(clusters, trainingSet, trainingSize, k, featureCount, p);
-        updateCentroids(clusters, k, featureCount);
+        assignPointsToClusters(clusters, trainingSet, trainingSize, k, featureCount, p, assignments);
+        updateCentroids(clusters, trainingSet, trainingSize, k, featureCount, assignments, sums);
+
+        profileCount(PROFILE_KMEANS, PROFILE_KMEANS_ITERATIONS, 1);
+        profileCount(PROFILE_KMEANS, PROFILE_DISTANCE_EVALUATIONS, (uint64_t)trainingSize * k);
+        if (profilerEnabled) {
+            profileShift(centroidShift(clusters, prevCentroids, k, featureCount));
+        }
 
         // Check for convergence
-        if (iteration > 0 && areCentroidsConverged(clusters, prevClusters, k, featureCount)) {
+        if (iteration > 0 && areCentroidsConverged(clusters, prevCentroids, k, featureCount)) {
             converged = true;
         }
     }
 
+    if (setClusterMembers(clusters, trainingSet, trainingSize, k, assignments) != KMEANS_SUCCESS) {
+        fprintf(stderr, "Memory allocation failure for cluster points\n");
+        exit(EXIT_FAILURE);
+    }
+
+    arenaReset(scratch, mark);
+    profileEnd(&scope);
+
+    // Return the result, caller is responsible for freeing this memory
+    return clusters;
+}
+
+// Counts, gathers and labels the members of every cluster from the assignments.
+int setClusterMembers(Cluster *clusters, const ShapeData *trainingSet, int trainingSize, int k, const int *assignments) {
+    for (int i = 0; i < k; i++) {
+        clusters[i].size = 0;
+    }
+    for (int i = 0; i < trainingSize; i++) {
+        if (assignments[i] >= 0) {
+            clusters[assignments[i]].size++;
+        }
+    }
+    if (gatherClusterPoints(clusters, trainingSet, trainingSize, k, assignments) != 0) {
+        return KMEANS_ERR_MEMORY;
+    }
     for (int i = 0; i < k; i++) {
         clusters[i].clusterClass = findMostFrequentClass(clusters[i].points, clusters[i].size);
     }
+    return KMEANS_SUCCESS;
+}
 
-    // Free previous clusters
-    for (int i = 0; i < k; i++) {
-        if (prevClusters[i].centroid) {
-            free(prevClusters[i].centroid->features);
-            free(prevClusters[i].centroid);
+// Builds clusters from the assignments, with the mean of its members as the centroid of each one.
+Cluster *meanCentroidClusters(const ShapeData *data, int dataSize, int k, int featureCount, const int *assignments) {
+    if (!data || !assignments || k <= 0 || featureCount <= 0) {
+        fprintf(stderr, "Invalid input parameters to meanCentroidClusters function\n");
+        return NULL;
+    }
+    Cluster *clusters = calloc(k, sizeof(Cluster));
+    if (!clusters) {
+        fprintf(stderr, "Memory allocation failure for clusters\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int c = 0; c < k; c++) {
+        clusters[c].centroid = calloc(1, sizeof(ShapeData));
+        if (!clusters[c].centroid || !(clusters[c].centroid->features = calloc(featureCount, sizeof(double)))) {
+            fprintf(stderr, "Memory allocation failure for centroids\n");
+            exit(EXIT_FAILURE);
         }
+        clusters[c].centroid->featureCount = featureCount;
+    }
+    profileCount(PROFILE_KMEANS, PROFILE_ALLOCATIONS, 1 + 2 * k);
+    if (setClusterMembers(clusters, data, dataSize, k, assignments) != KMEANS_SUCCESS) {
+        fprintf(stderr, "Memory allocation failure for cluster points\n");
+        exit(EXIT_FAILURE);
     }
-    free(prevClusters);
 
-    // Return the result, caller is responsible for freeing this memory
+    const FeatureKernels *kernels = kernelsFor(featureCount);
+    for (int i = 0; i < dataSize; i++) {
+        if (assignments[i] >= 0) {
+            kernels->accumulate(clusters[assignments[i]].centroid->features, data[i].features, featureCount);
+        }
+    }
+    for (int c = 0; c < k; c++) {
+        for (int j = 0; j < featureCount && clusters[c].size > 0; j++) {
+            clusters[c].centroid->features[j] /= clusters[c].size;
+        }
+    }
     return clusters;
 }
+
+// Copies the centroids and classes of the clusters into contiguous arrays.
+void extractCentroids(const Cluster *clusters, int k, int featureCount, double *centroids, int *clusterClasses) {
+    for (int i = 0; i < k; i++) {
+        memcpy(centroids + (size_t)i * featureCount, clusters[i].centroid->features, featureCount * sizeof(double));
+        clusterClasses[i] = clusters[i].clusterClass;
+    }
+}
+
+// Classifies samples by the class of their nearest centroid.
+int nearestCentroidClassify(const double *centroids, const int *clusterClasses, int k, const ShapeData *testSet,
+                            int testSize, int featureCount, int p, int *predictions) {
+    if (!centroids || !clusterClasses || !testSet || !predictions || k <= 0 || featureCount <= 0 || p <= 0) {
+        fprintf(stderr, "Invalid parameters for nearest centroid classification\n");
+        return KMEANS_ERR_INVALID_INPUT;
+    }
+    ProfileScope scope = profileBegin(PROFILE_DISTANCE);
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < testSize; i++) {
+        double minDistance = DBL_MAX;
+        int closestCluster = 0;
+        for (int c = 0; c < k; c++) {
+            double distance = minkowskiPowerSum(testSet[i].features, centroids + (size_t)c * featureCount, featureCount, p);
+            if (distance < minDistance) {
+                minDistance = distance;
+                closestCluster = c;
+            }
+        }
+        predictions[i] = clusterClasses[closestCluster];
+    }
+    profileCount(PROFILE_DISTANCE, PROFILE_DISTANCE_EVALUATIONS, (uint64_t)testSize * k);
+    profileEnd(&scope);
+    return KMEANS_SUCCESS;
+}
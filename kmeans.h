@@ -4,6 +4,11 @@
 // Define a small threshold for convergence check
 #define CONVERGENCE_THRESHOLD 0.001
 
+// Error codes
+#define KMEANS_SUCCESS 0
+#define KMEANS_ERR_INVALID_INPUT -1
+#define KMEANS_ERR_MEMORY -2
+
 #include "data_reader.h"
 #include "knn.h"
 
@@ -34,4 +39,57 @@ typedef struct {
  */
 Cluster* kmeans(ShapeData *trainingSet, int trainingSize, int k, int p, int featureCount, int maxIterations);
 
+/**
+ * Fills the size, points and majority class of every cluster from per-point assignments.
+ * Used by kmeans() and by the other clustering methods that produce Cluster arrays.
+ * @param clusters Array of k clusters; their point arrays are allocated here.
+ * @param trainingSet Array of clustered data.
+ * @param trainingSize Number of elements in trainingSet.
+ * @param k Number of clusters.
+ * @param assignments Cluster of every point, negative for points that belong to no cluster (noise).
+ * @return KMEANS_SUCCESS, or KMEANS_ERR_MEMORY if a point array cannot be allocated.
+ */
+int setClusterMembers(Cluster *clusters, const ShapeData *trainingSet, int trainingSize, int k, const int *assignments);
+
+/**
+ * Builds clusters from per-point assignments, with the mean of its members as the centroid of each one.
+ * Lets clusterings that only label the points (hierarchical, density-based) use the
+ * kmeans_evaluation.c metrics, the model files and nearest centroid classification.
+ * @param data Array of clustered data.
+ * @param dataSize Number of elements in data.
+ * @param k Number of clusters.
+ * @param featureCount Number of features in each ShapeData item.
+ * @param assignments Cluster of every point (0 to k - 1), negative for points that belong to no cluster.
+ * @return Array of k clusters released like the result of kmeans(), or NULL on invalid input.
+ */
+Cluster *meanCentroidClusters(const ShapeData *data, int dataSize, int k, int featureCount, const int *assignments);
+
+/**
+ * Copies the centroids and classes of the clusters into contiguous arrays.
+ * @param clusters Array of clusters returned by kmeans().
+ * @param k Number of clusters.
+ * @param featureCount Number of features in each centroid.
+ * @param centroids Output row-major k x featureCount matrix.
+ * @param clusterClasses Output array of k cluster classes.
+ */
+void extractCentroids(const Cluster *clusters, int k, int featureCount, double *centroids, int *clusterClasses);
+
+/**
+ * Classifies samples by the class of their nearest centroid.
+ * The test set is processed in parallel and the distance loop is vectorized
+ * over the contiguous centroid matrix; distances are compared in p-th power
+ * space, so no root is taken.
+ * @param centroids Row-major k x featureCount centroid matrix.
+ * @param clusterClasses Class of each cluster.
+ * @param k Number of clusters.
+ * @param testSet Array of samples to classify.
+ * @param testSize Number of samples to classify.
+ * @param featureCount Number of features in each sample.
+ * @param p Minkowski distance exponent.
+ * @param predictions Output array receiving the predicted class of each sample.
+ * @return KMEANS_SUCCESS, or KMEANS_ERR_INVALID_INPUT for invalid parameters.
+ */
+int nearestCentroidClassify(const double *centroids, const int *clusterClasses, int k, const ShapeData *testSet,
+                            int testSize, int featureCount, int p, int *predictions);
+
 #endif // KMEANS_H
@@ -53,16 +53,11 @@ echo "k,p,Silhouette Score,WCSS,BCSS" > "$output_file"
 for (( k = $start_k; k <= $end_k; k += $increment )); do
     echo "Running k-Means with k = $k"
 
-    # Adjust the command below according to your main program's expected arguments for k-Means
-    output=$(./main -d "$input_directory" -e "$extension" -f 0.8 -m kmeans -p $p_value -k $k -l none)
-
-    # Adjust these parsing lines to match the output format of your main program
-    silhouette=$(echo "$output" | grep -oP "Silhouette Score: \K[^\n]+")
-    wcss=$(echo "$output" | grep -oP "Within-Cluster Sum of Squares: \K[^\n]+")
-    bcss=$(echo "$output" | grep -oP "Between-Cluster Sum of Squares: \K[^\n]+")
+    # Run k-Means with CSV output and keep the silhouette, WCSS and BCSS columns
+    metrics=$(./main -d "$input_directory" -e "$extension" -f 0.8 -m kmeans -p $p_value -k $k -l none --format=csv | grep "^clustering,[0-9]" | cut -d, -f3-)
 
     # Save metrics to file
-    echo "$k,$p_value,$silhouette,$wcss,$bcss" >> "$output_file"
+    echo "$k,$p_value,$metrics" >> "$output_file"
 done
 
 
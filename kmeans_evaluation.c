@@ -1,8 +1,12 @@
 #include "kmeans_evaluation.h"
+#include "profiler.h"
+#include "kernels.h"
 
 double silhouetteScore(Cluster *clusters, int k, int featureCount) {
+    ProfileScope scope = profileBegin(PROFILE_METRICS);
     double totalSilhouetteScore = 0.0;
     int totalPoints = 0;
+    uint64_t pointCount = 0;
 
     // Loop through each cluster
     for (int c = 0; c < k; c++) {
@@ -31,6 +35,8 @@ double silhouetteScore(Cluster *clusters, int k, int featureCount) {
                 }
             }
 
+            pointCount++;
+
             // Update the total silhouette score
             if (clusters[c].size > 1) {
                 totalSilhouetteScore += (b - a) / fmax(a, b);
@@ -39,12 +45,18 @@ double silhouetteScore(Cluster *clusters, int k, int featureCount) {
         }
     }
 
+    // Every point is compared with every other point
+    profileCount(PROFILE_METRICS, PROFILE_DISTANCE_EVALUATIONS, pointCount > 0 ? pointCount * (pointCount - 1) : 0);
+    profileEnd(&scope);
+
     // Return the average silhouette score
     return totalPoints > 0 ? totalSilhouetteScore / totalPoints : 0;
 }
 
 double withinClusterSumOfSquares(Cluster *clusters, int k, int featureCount) {
+    ProfileScope scope = profileBegin(PROFILE_METRICS);
     double totalWCSS = 0.0;
+    uint64_t pointCount = 0;
 
     // Loop through each cluster
     for (int i = 0; i < k; i++) {
@@ -53,13 +65,17 @@ double withinClusterSumOfSquares(Cluster *clusters, int k, int featureCount) {
             double distance = minkowskiDistance(*clusters[i].centroid, clusters[i].points[j], featureCount, 2);
             totalWCSS += distance * distance;
         }
+        pointCount += clusters[i].size;
     }
+    profileCount(PROFILE_METRICS, PROFILE_DISTANCE_EVALUATIONS, pointCount);
+    profileEnd(&scope);
 
     // Return the total WCSS
     return totalWCSS;
 }
 
 double betweenClusterSumOfSquares(Cluster *clusters, int k, int featureCount, ShapeData *globalCentroid, int dataSize) {
+    ProfileScope scope = profileBegin(PROFILE_METRICS);
     double totalBCSS = 0.0;
 
     // Loop through each cluster
@@ -70,14 +86,18 @@ double betweenClusterSumOfSquares(Cluster *clusters, int k, int featureCount, Sh
 
     // Normalize the BCSS by the total number of data points
     totalBCSS /= dataSize;
+    profileCount(PROFILE_METRICS, PROFILE_DISTANCE_EVALUATIONS, k);
+    profileEnd(&scope);
 
     // Return the total BCSS
     return totalBCSS;
 }
 
 ShapeData calculateGlobalCentroid(ShapeData *shapes, int count, int featureCount) {
+    ProfileScope scope = profileBegin(PROFILE_METRICS);
     ShapeData centroid;
     centroid.features = calloc(featureCount, sizeof(double));
+    profileCount(PROFILE_METRICS, PROFILE_ALLOCATIONS, 1);
 
     // Check for memory allocation failure
     if (!centroid.features) {
@@ -86,16 +106,16 @@ ShapeData calculateGlobalCentroid(ShapeData *shapes, int count, int featureCount
     }
 
     // Sum up all the features for all points
+    const FeatureKernels *kernels = kernelsFor(featureCount);
     for (int i = 0; i < count; i++) {
-        for (int j = 0; j < featureCount; j++) {
-            centroid.features[j] += shapes[i].features[j];
-        }
+        kernels->accumulate(centroid.features, shapes[i].features, featureCount);
     }
 
     // Calculate the average for each feature
     for (int j = 0; j < featureCount; j++) {
         centroid.features[j] /= count;
     }
+    profileEnd(&scope);
 
     // Return the calculated global centroid
     return centroid;
@@ -0,0 +1,330 @@
+#include "kmedoids.h"
+#include "profiler.h"
+#include "arena.h"
+#include "random.h"
+
+/**
+ * @struct MedoidCache
+ * @brief Nearest and second nearest medoid of every sample, the state FasterPAM scores swaps from.
+ */
+typedef struct {
+    int *nearest;            /**< Position in the medoid array of the nearest medoid. */
+    double *nearestDistance; /**< Distance to the nearest medoid. */
+    double *secondDistance;  /**< Distance to the second nearest medoid. */
+    double *removalLoss;     /**< Increase of the deviation if each medoid were removed. */
+} MedoidCache;
+
+// Recomputes the nearest and second nearest medoid of every sample and the removal losses; returns the deviation.
+static double updateCache(const DistanceMatrix *matrix, const int *medoids, int k, MedoidCache *cache) {
+    int n = matrix->size;
+    double deviation = 0;
+    #pragma omp parallel for schedule(static) reduction(+:deviation)
+    for (int i = 0; i < n; i++) {
+        int nearest = 0;
+        double best = DBL_MAX, second = DBL_MAX;
+        for (int m = 0; m < k; m++) {
+            double distance = getDistance(matrix, i, medoids[m]);
+            if (distance < best) {
+                second = best;
+                best = distance;
+                nearest = m;
+            } else if (distance < second) {
+                second = distance;
+            }
+        }
+        cache->nearest[i] = nearest;
+        cache->nearestDistance[i] = best;
+        cache->secondDistance[i] = second;
+        deviation += best;
+    }
+
+    memset(cache->removalLoss, 0, k * sizeof(double));
+    for (int i = 0; i < n && k > 1; i++) {
+        cache->removalLoss[cache->nearest[i]] += cache->secondDistance[i] - cache->nearestDistance[i];
+    }
+    return deviation;
+}
+
+// Picks the medoids greedily: each one is the sample that lowers the deviation the most (PAM's BUILD).
+static void buildMedoids(const DistanceMatrix *matrix, int k, int *medoids, double *nearestDistance, double *gains) {
+    int n = matrix->size;
+    for (int i = 0; i < n; i++) {
+        nearestDistance[i] = DBL_MAX;
+    }
+    for (int m = 0; m < k; m++) {
+        // The first medoid minimizes the sum of distances, later ones maximize the decrease of the deviation
+        #pragma omp parallel for schedule(static)
+        for (int c = 0; c < n; c++) {
+            double gain = 0;
+            for (int i = 0; i < n; i++) {
+                double distance = getDistance(matrix, c, i);
+                gain += m == 0 ? -distance : (distance < nearestDistance[i] ? nearestDistance[i] - distance : 0);
+            }
+            gains[c] = gain;
+        }
+        int best = -1;
+        for (int c = 0; c < n; c++) {
+            if (nearestDistance[c] > 0 && (best < 0 || gains[c] > gains[best])) {
+                best = c;
+            }
+        }
+        // Only duplicates of the medoids are left, any sample not picked yet will do
+        for (int c = 0; best < 0 && c < n; c++) {
+            bool picked = false;
+            for (int j = 0; j < m; j++) {
+                picked = picked || medoids[j] == c;
+            }
+            best = picked ? -1 : c;
+        }
+        medoids[m] = best;
+        for (int i = 0; i < n; i++) {
+            double distance = getDistance(matrix, best, i);
+            nearestDistance[i] = distance < nearestDistance[i] ? distance : nearestDistance[i];
+        }
+    }
+}
+
+// Scores swapping a candidate in for every medoid in one pass over the samples; returns the best change.
+static double scoreCandidate(const DistanceMatrix *matrix, const MedoidCache *cache, int k, int candidate,
+                             double *deltas, int *bestMedoid) {
+    memcpy(deltas, cache->removalLoss, k * sizeof(double));
+    double shared = 0;
+    for (int i = 0; i < matrix->size; i++) {
+        double distance = getDistance(matrix, i, candidate);
+        double nearest = cache->nearestDistance[i], second = cache->secondDistance[i];
+        if (distance < nearest) {
+            // The candidate becomes the nearest medoid whichever medoid leaves
+            shared += distance - nearest;
+            deltas[cache->nearest[i]] += nearest - second;
+        } else if (distance < second) {
+            // The candidate replaces the second nearest if the nearest leaves
+            deltas[cache->nearest[i]] += distance - second;
+        }
+    }
+    int best = 0;
+    for (int m = 1; m < k; m++) {
+        if (deltas[m] < deltas[best]) {
+            best = m;
+        }
+    }
+    *bestMedoid = best;
+    return deltas[best] + shared;
+}
+
+// Runs BUILD then FasterPAM on a precomputed distance matrix.
+double fasterPam(const DistanceMatrix *matrix, int k, int maxPasses, int *medoids, int *assignments) {
+    if (!matrix || !matrix->values || !medoids || k <= 0 || k > matrix->size || maxPasses < 0) {
+        fprintf(stderr, "Invalid parameters for FasterPAM\n");
+        return KMEDOIDS_ERR_INVALID_INPUT;
+    }
+    int n = matrix->size;
+    ProfileScope scope = profileBegin(PROFILE_KMEANS);
+    Arena *scratch = scratchArena(PROFILE_KMEANS);
+    ArenaMark mark = arenaMark(scratch);
+    MedoidCache cache = {arenaAlloc(scratch, n * sizeof(int)), arenaAlloc(scratch, n * sizeof(double)),
+                         arenaAlloc(scratch, n * sizeof(double)), arenaAlloc(scratch, k * sizeof(double))};
+    double *gains = arenaAlloc(scratch, n * sizeof(double));
+    double *deltas = arenaAlloc(scratch, (size_t)KMEDOIDS_SWAP_BLOCK * k * sizeof(double));
+    double *scores = arenaAlloc(scratch, KMEDOIDS_SWAP_BLOCK * sizeof(double));
+    int *targets = arenaAlloc(scratch, KMEDOIDS_SWAP_BLOCK * sizeof(int));
+    char *isMedoid = arenaCalloc(scratch, n, 1);
+    if (!cache.nearest || !cache.nearestDistance || !cache.secondDistance || !cache.removalLoss || !gains ||
+        !deltas || !scores || !targets || !isMedoid) {
+        arenaReset(scratch, mark);
+        profileEnd(&scope);
+        return KMEDOIDS_ERR_MEMORY;
+    }
+
+    buildMedoids(matrix, k, medoids, cache.nearestDistance, gains);
+    for (int m = 0; m < k; m++) {
+        isMedoid[medoids[m]] = 1;
+    }
+    double deviation = updateCache(matrix, medoids, k, &cache);
+
+    // BUILD is optimal for a single medoid; otherwise swap until a whole pass finds no improvement
+    bool improved = k > 1;
+    for (int pass = 0; pass < maxPasses && improved; pass++) {
+        improved = false;
+        for (int start = 0; start < n; start += KMEDOIDS_SWAP_BLOCK) {
+            int end = start + KMEDOIDS_SWAP_BLOCK < n ? start + KMEDOIDS_SWAP_BLOCK : n;
+            #pragma omp parallel for schedule(dynamic)
+            for (int c = start; c < end; c++) {
+                scores[c - start] = isMedoid[c] ? 0 : scoreCandidate(matrix, &cache, k, c,
+                                                                     deltas + (size_t)(c - start) * k,
+                                                                     &targets[c - start]);
+            }
+            profileCount(PROFILE_KMEANS, PROFILE_DISTANCE_EVALUATIONS, (uint64_t)(end - start) * n);
+
+            int best = -1;
+            for (int c = 0; c < end - start; c++) {
+                if (scores[c] < (best < 0 ? 0 : scores[best])) {
+                    best = c;
+                }
+            }
+            // Rounding can make a neutral swap look like a tiny gain, which would never converge
+            if (best < 0 || scores[best] > -1e-12 * (deviation > 1 ? deviation : 1)) {
+                continue;
+            }
+            isMedoid[medoids[targets[best]]] = 0;
+            medoids[targets[best]] = start + best;
+            isMedoid[start + best] = 1;
+            deviation = updateCache(matrix, medoids, k, &cache);
+            improved = true;
+        }
+        profileCount(PROFILE_KMEANS, PROFILE_KMEANS_ITERATIONS, 1);
+    }
+
+    if (assignments) {
+        memcpy(assignments, cache.nearest, n * sizeof(int));
+    }
+    arenaReset(scratch, mark);
+    profileEnd(&scope);
+    return deviation;
+}
+
+// Assigns every sample to its nearest medoid and returns the total deviation.
+static double assignToMedoids(const ShapeData *data, int dataSize, const int *medoids, int k, int p,
+                              int featureCount, int *assignments) {
+    double deviation = 0;
+    #pragma omp parallel for schedule(static) reduction(+:deviation)
+    for (int i = 0; i < dataSize; i++) {
+        int nearest = 0;
+        double best = DBL_MAX;
+        for (int m = 0; m < k; m++) {
+            double distance = minkowskiDistance(data[i], data[medoids[m]], featureCount, p);
+            if (distance < best) {
+                best = distance;
+                nearest = m;
+            }
+        }
+        assignments[i] = nearest;
+        deviation += best;
+    }
+    profileCount(PROFILE_KMEANS, PROFILE_DISTANCE_EVALUATIONS, (uint64_t)dataSize * k);
+    return deviation;
+}
+
+// Runs FasterPAM on random subsets and keeps the medoids with the lowest deviation over all samples.
+static double clara(ShapeData *data, int dataSize, int k, int p, int featureCount, uint64_t seed, int *medoids,
+                    int *assignments) {
+    int sampleSize = CLARA_SAMPLE_SIZE > 40 + 2 * k ? CLARA_SAMPLE_SIZE : 40 + 2 * k;
+    sampleSize = sampleSize < dataSize ? sampleSize : dataSize;
+    int *order = malloc(dataSize * sizeof(int));
+    ShapeData *subset = malloc(sampleSize * sizeof(ShapeData));
+    int *candidates = malloc(k * sizeof(int));
+    if (!order || !subset || !candidates) {
+        free(order);
+        free(subset);
+        free(candidates);
+        return KMEDOIDS_ERR_MEMORY;
+    }
+    profileCount(PROFILE_KMEANS, PROFILE_ALLOCATIONS, 3);
+    for (int i = 0; i < dataSize; i++) {
+        order[i] = i;
+    }
+
+    double best = DBL_MAX;
+    for (int draw = 0; draw < CLARA_DRAWS; draw++) {
+        // The best medoids so far are kept in every subset, the rest is a partial Fisher-Yates shuffle
+        int fixed = draw > 0 ? k : 0;
+        for (int m = 0; m < fixed; m++) {
+            for (int i = m; i < dataSize; i++) {
+                if (order[i] == medoids[m]) {
+                    order[i] = order[m];
+                    order[m] = medoids[m];
+                    break;
+                }
+            }
+        }
+        for (int i = fixed; i < sampleSize; i++) {
+            int j = i + (int)(nextRandom(&seed) % (uint64_t)(dataSize - i));
+            int swap = order[i];
+            order[i] = order[j];
+            order[j] = swap;
+        }
+        for (int i = 0; i < sampleSize; i++) {
+            subset[i] = data[order[i]];
+        }
+
+        DistanceMatrix matrix = computeDistanceMatrix(subset, sampleSize, featureCount, p);
+        double subsetDeviation = matrix.values ? fasterPam(&matrix, k, KMEDOIDS_MAX_PASSES, candidates, NULL)
+                                               : KMEDOIDS_ERR_MEMORY;
+        freeDistanceMatrix(&matrix);
+        if (subsetDeviation < 0) {
+            best = subsetDeviation;
+            break;
+        }
+        for (int m = 0; m < k; m++) {
+            candidates[m] = order[candidates[m]];
+        }
+        double deviation = assignToMedoids(data, dataSize, candidates, k, p, featureCount, assignments);
+        if (deviation < best) {
+            best = deviation;
+            memcpy(medoids, candidates, k * sizeof(int));
+        }
+    }
+
+    if (best >= 0) {
+        best = assignToMedoids(data, dataSize, medoids, k, p, featureCount, assignments);
+    }
+    free(order);
+    free(subset);
+    free(candidates);
+    return best;
+}
+
+// Clusters samples around k medoids, on the full distance matrix or with CLARA.
+Cluster *kmedoids(ShapeData *data, int dataSize, int k, int p, int featureCount, uint64_t seed, double *deviation) {
+    if (!data || dataSize <= 0 || k <= 0 || k > dataSize || p <= 0 || featureCount <= 0) {
+        fprintf(stderr, "Invalid input parameters to kmedoids function\n");
+        return NULL;
+    }
+    int *medoids = malloc(k * sizeof(int));
+    int *assignments = malloc(dataSize * sizeof(int));
+    Cluster *clusters = calloc(k, sizeof(Cluster));
+    if (!medoids || !assignments || !clusters) {
+        fprintf(stderr, "Memory allocation failure for k-medoids\n");
+        exit(EXIT_FAILURE);
+    }
+    profileCount(PROFILE_KMEANS, PROFILE_ALLOCATIONS, 3 + 2 * k);
+
+    double total;
+    if (dataSize <= KMEDOIDS_MAX_MATRIX_SIZE) {
+        DistanceMatrix matrix = computeDistanceMatrix(data, dataSize, featureCount, p);
+        total = matrix.values ? fasterPam(&matrix, k, KMEDOIDS_MAX_PASSES, medoids, assignments)
+                              : KMEDOIDS_ERR_MEMORY;
+        freeDistanceMatrix(&matrix);
+    } else {
+        total = clara(data, dataSize, k, p, featureCount, seed, medoids, assignments);
+    }
+    if (total < 0) {
+        fprintf(stderr, "Failed to perform k-medoids clustering\n");
+        free(medoids);
+        free(assignments);
+        free(clusters);
+        return NULL;
+    }
+
+    // The centroid of a cluster is a copy of its medoid
+    for (int m = 0; m < k; m++) {
+        clusters[m].centroid = calloc(1, sizeof(ShapeData));
+        if (!clusters[m].centroid || !(clusters[m].centroid->features = malloc(featureCount * sizeof(double)))) {
+            fprintf(stderr, "Memory allocation failure for medoids\n");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(clusters[m].centroid->features, data[medoids[m]].features, featureCount * sizeof(double));
+        clusters[m].centroid->featureCount = featureCount;
+        clusters[m].centroid->class = data[medoids[m]].class;
+        clusters[m].centroid->sample = data[medoids[m]].sample;
+    }
+    if (setClusterMembers(clusters, data, dataSize, k, assignments) != KMEANS_SUCCESS) {
+        fprintf(stderr, "Memory allocation failure for cluster points\n");
+        exit(EXIT_FAILURE);
+    }
+    if (deviation) {
+        *deviation = total;
+    }
+    free(medoids);
+    free(assignments);
+    return clusters;
+}
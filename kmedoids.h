@@ -0,0 +1,80 @@
+/**
+ * @file kmedoids.h
+ * @brief Header file for k-Medoids clustering with FasterPAM and CLARA.
+ *
+ * k-Medoids picks k samples (the medoids) that minimize the sum of the Minkowski
+ * distances of every sample to its nearest medoid. Unlike the mean taken by kmeans(),
+ * the medoid is optimal for any p, so -p 1 minimizes the L1 deviation it reports.
+ *
+ * The medoids are initialized greedily (PAM's BUILD) and improved with FasterPAM's
+ * swaps: a candidate is scored against every medoid at once in O(n) from the nearest
+ * and second nearest medoid of each sample, and an improving swap is applied as soon
+ * as it is found instead of after a full O(k·n²) scan. Candidates are scored in blocks
+ * of KMEDOIDS_SWAP_BLOCK in parallel and the best improving swap of a block is applied,
+ * so the result does not depend on the number of threads.
+ *
+ * FasterPAM reads a precomputed DistanceMatrix. Above KMEDOIDS_MAX_MATRIX_SIZE samples
+ * the matrix would not fit, so CLARA runs FasterPAM on random subsets and keeps the
+ * medoids with the lowest total deviation over the whole dataset.
+ */
+
+#ifndef KMEDOIDS_H
+#define KMEDOIDS_H
+
+#include "kmeans.h"
+#include "distance_matrix.h"
+
+#include <stdint.h>
+
+// Error codes
+#define KMEDOIDS_SUCCESS 0
+#define KMEDOIDS_ERR_INVALID_INPUT -1
+#define KMEDOIDS_ERR_MEMORY -2
+
+// Largest dataset clustered on a full distance matrix; larger ones use CLARA
+#define KMEDOIDS_MAX_MATRIX_SIZE 4096
+
+// Swap candidates scored in parallel before the best improving one is applied
+#define KMEDOIDS_SWAP_BLOCK 64
+
+// Passes over all the swap candidates before FasterPAM gives up converging
+#define KMEDOIDS_MAX_PASSES 100
+
+// Subsets drawn by CLARA and their size (at least 40 + 2k, as in the original CLARA)
+#define CLARA_DRAWS 5
+#define CLARA_SAMPLE_SIZE 1000
+
+// Seed of the CLARA subsets when the caller has no preference
+#define KMEDOIDS_DEFAULT_SEED 42
+
+/**
+ * @brief Runs BUILD then FasterPAM on a precomputed distance matrix.
+ *
+ * @param matrix Pairwise distances of the samples.
+ * @param k Number of medoids, at most matrix->size.
+ * @param maxPasses Largest number of passes over the swap candidates.
+ * @param medoids Output array of k sample indices.
+ * @param assignments Output array of matrix->size medoid positions (0 to k - 1), or NULL.
+ * @return The total deviation (sum of the distances to the nearest medoid), or a negative KMEDOIDS_ERR_* code.
+ */
+double fasterPam(const DistanceMatrix *matrix, int k, int maxPasses, int *medoids, int *assignments);
+
+/**
+ * @brief Clusters samples around k medoids.
+ *
+ * The returned clusters have the same layout as the ones of kmeans(): the centroid is
+ * a copy of the medoid and the points are the members, so the kmeans_evaluation.c
+ * metrics, the model files and nearest centroid classification all apply.
+ *
+ * @param data Array of samples.
+ * @param dataSize Number of samples.
+ * @param k Number of clusters.
+ * @param p Minkowski distance exponent.
+ * @param featureCount Number of features in each sample.
+ * @param seed Seed of the CLARA subsets, unused when the full matrix fits.
+ * @param deviation Optional output of the total deviation, or NULL.
+ * @return Array of k clusters released like the result of kmeans(), or NULL on failure.
+ */
+Cluster *kmedoids(ShapeData *data, int dataSize, int k, int p, int featureCount, uint64_t seed, double *deviation);
+
+#endif // KMEDOIDS_H
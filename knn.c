@@ -1,4 +1,7 @@
 #include "knn.h"
+#include "profiler.h"
+#include "arena.h"
+#include "kernels.h"
 
 // Implementation of Minkowski distance
 double minkowskiDistance(ShapeData a, ShapeData b, int featureCount, int p) {
@@ -7,13 +10,22 @@ double minkowskiDistance(ShapeData a, ShapeData b, int featureCount, int p) {
         return KNN_ERR_INVALID_P; // Error handling for invalid 'p' values.
     }
 
+    return minkowskiRoot(minkowskiPowerSum(a.features, b.features, featureCount, p), p);
+}
+
+// p-th power of the Minkowski distance; the common exponents use the kernels of the dimension so the loop vectorizes.
+double minkowskiPowerSum(const double *a, const double *b, int featureCount, int p) {
+    if (p == 1) {
+        return kernelsFor(featureCount)->manhattan(a, b, featureCount);
+    }
+    if (p == 2) {
+        return kernelsFor(featureCount)->squaredEuclidean(a, b, featureCount);
+    }
     double sum = 0.0;
-    for (int i = 0; i < featureCount; i++) {
-        // Add the p-th power of absolute difference of each feature to the sum.
-        sum += pow(fabs(a.features[i] - b.features[i]), p);
+    for (int f = 0; f < featureCount; f++) {
+        sum += pow(fabs(a[f] - b[f]), p);
     }
-    // The p-th root of the sum gives the Minkowski distance.
-    return pow(sum, 1.0 / p);
+    return sum;
 }
 
 // Precompute distances between test and training samples
@@ -27,6 +39,7 @@ double** precomputeDistances(ShapeData *trainingSet, int trainingSize, ShapeData
     if (!distances) {
         return NULL;
     }
+    ProfileScope scope = profileBegin(PROFILE_DISTANCE);
 
     for (int i = 0; i < testSize; i++) {
         distances[i] = malloc(trainingSize * sizeof(double));
@@ -47,10 +60,14 @@ double** precomputeDistances(ShapeData *trainingSet, int trainingSize, ShapeData
                     free(distances[k]);
                 }
                 free(distances);
+                profileEnd(&scope);
                 return NULL;
             }
         }
     }
+    profileCount(PROFILE_DISTANCE, PROFILE_DISTANCE_EVALUATIONS, (uint64_t)testSize * trainingSize);
+    profileCount(PROFILE_DISTANCE, PROFILE_ALLOCATIONS, testSize + 1);
+    profileEnd(&scope);
     return distances;
 }
 
@@ -69,8 +86,10 @@ int knnClassify(double **distances, int testIndex, ShapeData *trainingSet, int t
         return KNN_ERR_INVALID_K; // Error handling for invalid 'k' values.
     }
 
-    // Allocate memory for storing the distance and label of each training sample.
-    DistanceLabel *distanceLabels = malloc(trainingSize * sizeof(DistanceLabel));
+    // Take the distance-label pairs from the thread's scratch arena, so repeated calls do not allocate.
+    Arena *scratch = scratchArena(PROFILE_VOTE);
+    ArenaMark mark = arenaMark(scratch);
+    DistanceLabel *distanceLabels = arenaAlloc(scratch, trainingSize * sizeof(DistanceLabel));
     if (!distanceLabels) {
         return KNN_ERR_MEMORY_ALLOCATION; // Memory allocation check
     }
@@ -81,28 +100,210 @@ int knnClassify(double **distances, int testIndex, ShapeData *trainingSet, int t
         distanceLabels[i].label = trainingSet[i].class;
     }
 
-    // Sort the distance-label pairs in ascending order of distance.
-    qsort(distanceLabels, trainingSize, sizeof(DistanceLabel), compareDistanceLabels);
+    // Select the k nearest neighbors and take the majority class among them.
+    int predictedClass = knnVote(distanceLabels, trainingSize, k);
+
+    // Release the distance-label pairs.
+    arenaReset(scratch, mark);
+
+    // Return the predicted class.
+    return predictedClass;
+}
+
+// Classifies every test sample in parallel into thread-local confusion matrices.
+int knnClassifyBatch(double **distances, ShapeData *trainingSet, int trainingSize, const ShapeData *testSet,
+                     int testSize, int k, ConfusionMatrix *cm, int *predictions) {
+    int status = KNN_SUCCESS;
+    #pragma omp parallel
+    {
+        ConfusionMatrix local = createConfusionMatrix(cm->classCount);
+        #pragma omp for schedule(static)
+        for (int i = 0; i < testSize; i++) {
+            predictions[i] = knnClassify(distances, i, trainingSet, trainingSize, k);
+            if (predictions[i] < 0) {
+                #pragma omp atomic write
+                status = predictions[i];
+            } else {
+                updateConfusionMatrix(&local, testSet[i].class, predictions[i]);
+            }
+        }
+        #pragma omp critical(knn_confusion_merge)
+        mergeConfusionMatrix(cm, &local);
+        freeConfusionMatrix(&local);
+    }
+    return status;
+}
 
-    // Determine the most frequent class among the k nearest neighbors
+// Classifies every test sample with a search function into thread-local confusion matrices.
+int classifyWithSearch(const void *index, KnnIndexSearch search, const ShapeData *trainingSet,
+                       const ShapeData *testSet, int testSize, int k, ConfusionMatrix *cm, int *predictions) {
+    int status = KNN_SUCCESS;
+    #pragma omp parallel
+    {
+        ConfusionMatrix local = createConfusionMatrix(cm->classCount);
+        Arena *scratch = scratchArena(PROFILE_VOTE);
+        ArenaMark mark = arenaMark(scratch);
+        DistanceLabel *neighbors = arenaAlloc(scratch, k * sizeof(DistanceLabel));
+
+        #pragma omp for schedule(static)
+        for (int i = 0; i < testSize; i++) {
+            int result = neighbors ? search(index, &testSet[i], k, neighbors) : KNN_ERR_MEMORY_ALLOCATION;
+            if (result < 0) {
+                predictions[i] = result;
+                #pragma omp atomic write
+                status = result;
+                continue;
+            }
+            // Vote on the classes of the neighbors, with the usual tie-breaking
+            for (int j = 0; j < k; j++) {
+                neighbors[j].label = trainingSet[neighbors[j].label].class;
+            }
+            predictions[i] = knnVote(neighbors, k, k);
+            updateConfusionMatrix(&local, testSet[i].class, predictions[i]);
+        }
+        #pragma omp critical(search_confusion_merge)
+        mergeConfusionMatrix(cm, &local);
+        freeConfusionMatrix(&local);
+        arenaReset(scratch, mark);
+    }
+    return status;
+}
+
+// Moves the entry at a position down the max-heap until its children are nearer.
+static void siftDown(NeighborHeap *heap, int position) {
+    while (1) {
+        int farthest = position;
+        int left = 2 * position + 1, right = left + 1;
+        if (left < heap->count && knnIsFarther(heap->entries[left], heap->entries[farthest])) farthest = left;
+        if (right < heap->count && knnIsFarther(heap->entries[right], heap->entries[farthest])) farthest = right;
+        if (farthest == position) {
+            return;
+        }
+        DistanceLabel swap = heap->entries[position];
+        heap->entries[position] = heap->entries[farthest];
+        heap->entries[farthest] = swap;
+        position = farthest;
+    }
+}
+
+// Offers a candidate to the heap, replacing the farthest entry once the heap is full.
+void knnHeapOffer(NeighborHeap *heap, DistanceLabel candidate) {
+    if (heap->count < heap->capacity) {
+        int position = heap->count++;
+        while (position > 0 && knnIsFarther(candidate, heap->entries[(position - 1) / 2])) {
+            heap->entries[position] = heap->entries[(position - 1) / 2];
+            position = (position - 1) / 2;
+        }
+        heap->entries[position] = candidate;
+    } else if (knnIsFarther(heap->entries[0], candidate)) {
+        heap->entries[0] = candidate;
+        siftDown(heap, 0);
+    }
+}
+
+// Orders neighbors by distance, then by label.
+static int compareNeighbors(const void *a, const void *b) {
+    const DistanceLabel *first = a, *second = b;
+    return knnIsFarther(*first, *second) ? 1 : knnIsFarther(*second, *first) ? -1 : 0;
+}
+
+// Sorts neighbors by distance, then by label.
+void knnSortNeighbors(DistanceLabel *neighbors, int count) {
+    qsort(neighbors, count, sizeof(DistanceLabel), compareNeighbors);
+}
+
+// Moves the k smallest distances to the front of the array, in ascending order.
+void knnSelectNearest(DistanceLabel *distanceLabels, int count, int k) {
+    // Quickselect partitions the array so that the first k entries are the smallest.
+    int left = 0, right = count - 1, target = k - 1;
+    while (left < right) {
+        double pivot = distanceLabels[left + (right - left) / 2].distance;
+        int i = left, j = right;
+        while (i <= j) {
+            while (distanceLabels[i].distance < pivot) i++;
+            while (distanceLabels[j].distance > pivot) j--;
+            if (i <= j) {
+                DistanceLabel temp = distanceLabels[i];
+                distanceLabels[i++] = distanceLabels[j];
+                distanceLabels[j--] = temp;
+            }
+        }
+        if (target <= j) {
+            right = j;
+        } else if (target >= i) {
+            left = i;
+        } else {
+            break;
+        }
+    }
+    // Only the selected neighbors need to be ordered.
+    qsort(distanceLabels, k, sizeof(DistanceLabel), compareDistanceLabels);
+}
+
+// Selects the k nearest candidates and returns their majority class.
+int knnVote(DistanceLabel *distanceLabels, int count, int k) {
+    if (k <= 0 || k > count || !distanceLabels) {
+        return KNN_ERR_INVALID_K;
+    }
+    ProfileScope scope = profileBegin(PROFILE_VOTE);
+    knnSelectNearest(distanceLabels, count, k);
+
+    // Count the votes of each label; scanning in distance order makes the nearest win ties.
     int predictedClass = -1, maxCount = 0;
     for (int i = 0; i < k; i++) {
-        int currentLabel = distanceLabels[i].label;
-        int count = 1;
-         // Count occurrences of the current label in the k nearest neighbors.
-        for (int j = i + 1; j < k && distanceLabels[j].label == currentLabel; j++) {
-            count++;
+        int votes = 0;
+        for (int j = 0; j < k; j++) {
+            votes += distanceLabels[j].label == distanceLabels[i].label;
         }
-        // Update the predicted class if this label is more frequent.
-        if (count > maxCount) {
-            maxCount = count;
-            predictedClass = currentLabel;
+        if (votes > maxCount) {
+            maxCount = votes;
+            predictedClass = distanceLabels[i].label;
         }
     }
+    profileEnd(&scope);
+    return predictedClass;
+}
 
-    // Free the memory allocated for the distance-label pairs.
-    free(distanceLabels);
+// Returns the kNN prediction for every k from 1 to kMax in a single pass.
+int knnVoteRange(DistanceLabel *distanceLabels, int count, int kMax, int *predictions) {
+    if (kMax <= 0 || kMax > count || !distanceLabels || !predictions) {
+        return KNN_ERR_INVALID_K;
+    }
+    ProfileScope scope = profileBegin(PROFILE_VOTE);
+    knnSelectNearest(distanceLabels, count, kMax);
 
-    // Return the predicted class.
-    return predictedClass;
+    // Distinct labels seen so far with their vote count and the rank of their nearest neighbor
+    Arena *scratch = scratchArena(PROFILE_VOTE);
+    ArenaMark mark = arenaMark(scratch);
+    int *labels = arenaAlloc(scratch, 3 * kMax * sizeof(int));
+    if (!labels) {
+        profileEnd(&scope);
+        return KNN_ERR_MEMORY_ALLOCATION;
+    }
+    int *votes = labels + kMax;
+    int *firstRank = votes + kMax;
+    int distinct = 0, winner = 0;
+
+    for (int k = 1; k <= kMax; k++) {
+        int label = distanceLabels[k - 1].label;
+        int slot = 0;
+        while (slot < distinct && labels[slot] != label) slot++;
+        if (slot == distinct) {
+            labels[slot] = label;
+            votes[slot] = 0;
+            firstRank[slot] = k - 1;
+            distinct++;
+        }
+        votes[slot]++;
+
+        // Only the updated label can overtake the current winner
+        if (votes[slot] > votes[winner] || (votes[slot] == votes[winner] && firstRank[slot] < firstRank[winner])) {
+            winner = slot;
+        }
+        predictions[k - 1] = labels[winner];
+    }
+
+    arenaReset(scratch, mark);
+    profileEnd(&scope);
+    return KNN_SUCCESS;
 }
@@ -2,6 +2,7 @@
 #define KNN_H
 
 #include "data_reader.h" // Include for ShapeData structure definition.
+#include "confusion_matrix.h"
 
 #include <math.h>
 
@@ -22,6 +23,48 @@ typedef struct {
     int label;       /**< Class label of the training sample. */
 } DistanceLabel;
 
+/**
+ * Bounded max-heap of the k nearest candidates found so far, the farthest on top.
+ * The distances may be in any space with the same order, such as p-th powers; the
+ * labels are training indices, the larger index being farther on ties.
+ */
+typedef struct {
+    DistanceLabel *entries; /**< Heap entries, the farthest first. */
+    int count;              /**< Entries in the heap. */
+    int capacity;           /**< k. */
+} NeighborHeap;
+
+/**
+ * Returns non-zero if a candidate is farther than another, the larger label being farther on ties.
+ * @param a First candidate.
+ * @param b Second candidate.
+ * @return Non-zero if a is farther than b.
+ */
+static inline int knnIsFarther(DistanceLabel a, DistanceLabel b) {
+    return a.distance > b.distance || (a.distance == b.distance && a.label > b.label);
+}
+
+/**
+ * Converts a p-th power sum of absolute differences back to the Minkowski distance.
+ * @param sum Sum of the p-th powers, as returned by minkowskiPowerSum.
+ * @param p Minkowski exponent, at least 1.
+ * @return The p-th root of the sum.
+ */
+static inline double minkowskiRoot(double sum, int p) {
+    return p == 1 ? sum : p == 2 ? sqrt(sum) : pow(sum, 1.0 / p);
+}
+
+/**
+ * Exact neighbor search of an index.
+ * @param index Index searched, such as a k-d tree or a LAESA index.
+ * @param query Sample to search for.
+ * @param k Number of neighbors.
+ * @param neighbors Output array of k pairs, nearest first, holding the Minkowski
+ *                  distance and the training index of every neighbor.
+ * @return 0 on success, a negative error code otherwise.
+ */
+typedef int (*KnnIndexSearch)(const void *index, const ShapeData *query, int k, DistanceLabel *neighbors);
+
 /** 
  * DistanceFunction: Pointer type for various distance calculation functions.
  */
@@ -37,6 +80,17 @@ typedef double (*DistanceFunction)(ShapeData, ShapeData, int);
  */
 double minkowskiDistance(ShapeData a, ShapeData b, int featureCount, int p);
 
+/**
+ * Computes the p-th power of the Minkowski distance between two feature vectors.
+ * Comparing distances in p-th power space gives the same order without the root.
+ * @param a First feature vector.
+ * @param b Second feature vector.
+ * @param featureCount Number of features in each vector.
+ * @param p Minkowski exponent, at least 1.
+ * @return Sum of the p-th powers of the absolute differences.
+ */
+double minkowskiPowerSum(const double *a, const double *b, int featureCount, int p);
+
 /**
  * Precomputes distances between test and training samples.
  * @param trainingSet Array of training samples.
@@ -60,4 +114,85 @@ double** precomputeDistances(ShapeData *trainingSet, int trainingSize, ShapeData
  */
 int knnClassify(double **distances, int testIndex, ShapeData *trainingSet, int trainingSize, int k);
 
+/**
+ * Classifies every test sample in parallel and tallies the results.
+ * Each thread fills its own confusion matrix, and the matrices are merged at the end,
+ * so no counter is shared while classifying.
+ * @param distances Precomputed distances array, one row per test sample.
+ * @param trainingSet Array of training samples.
+ * @param trainingSize Number of samples in the training set.
+ * @param testSet Array of test samples, whose classes are the actual classes.
+ * @param testSize Number of samples in the test set.
+ * @param k Number of nearest neighbors to use.
+ * @param cm Confusion matrix receiving the results.
+ * @param predictions Output array of testSize predicted classes.
+ * @return KNN_SUCCESS, or the first error returned by knnClassify.
+ */
+int knnClassifyBatch(double **distances, ShapeData *trainingSet, int trainingSize, const ShapeData *testSet,
+                     int testSize, int k, ConfusionMatrix *cm, int *predictions);
+
+/**
+ * Classifies every test sample in parallel with the neighbors found by a search function.
+ * Each thread searches into its own scratch neighbors and fills its own confusion matrix;
+ * the training indices returned by the search are mapped to their classes before the vote.
+ * @param index Index passed to the search.
+ * @param search Search function returning the k nearest training indices of a query.
+ * @param trainingSet Training samples indexed by the search.
+ * @param testSet Array of test samples, whose classes are the actual classes.
+ * @param testSize Number of samples in the test set.
+ * @param k Number of nearest neighbors to use.
+ * @param cm Confusion matrix receiving the results.
+ * @param predictions Output array of testSize predicted classes; a failed query receives the error.
+ * @return KNN_SUCCESS, KNN_ERR_MEMORY_ALLOCATION, or the last error returned by the search.
+ */
+int classifyWithSearch(const void *index, KnnIndexSearch search, const ShapeData *trainingSet,
+                       const ShapeData *testSet, int testSize, int k, ConfusionMatrix *cm, int *predictions);
+
+/**
+ * Offers a candidate to a neighbor heap, replacing the farthest entry once the heap is full.
+ * @param heap Heap of the nearest candidates.
+ * @param candidate Distance and training index of the candidate.
+ */
+void knnHeapOffer(NeighborHeap *heap, DistanceLabel candidate);
+
+/**
+ * Sorts neighbors by distance, then by label.
+ * @param neighbors Neighbors to sort, such as the entries of a full heap.
+ * @param count Number of neighbors.
+ */
+void knnSortNeighbors(DistanceLabel *neighbors, int count);
+
+/**
+ * Moves the k smallest distances to the front of the array, in ascending order.
+ * The remaining entries are left in no particular order.
+ * @param distanceLabels Distances and labels of all candidates (reordered).
+ * @param count Number of candidates.
+ * @param k Number of entries to select, between 1 and count.
+ */
+void knnSelectNearest(DistanceLabel *distanceLabels, int count, int k);
+
+/**
+ * Selects the k nearest candidates and returns their majority class.
+ * The array is reordered so that its first k entries are the nearest candidates in
+ * ascending order of distance. Ties between classes are won by the class of the
+ * nearest neighbor among the tied classes.
+ * @param distanceLabels Distances and labels of all candidates.
+ * @param count Number of candidates.
+ * @param k Number of nearest neighbors to use.
+ * @return Predicted class label, or KNN_ERR_INVALID_K for invalid k value.
+ */
+int knnVote(DistanceLabel *distanceLabels, int count, int k);
+
+/**
+ * Returns the kNN prediction for every k from 1 to kMax in a single pass.
+ * The kMax nearest candidates are selected once and the votes are updated
+ * incrementally, with the same tie-breaking as knnVote.
+ * @param distanceLabels Distances and labels of all candidates (reordered).
+ * @param count Number of candidates.
+ * @param kMax Largest number of neighbors.
+ * @param predictions Output array, predictions[k - 1] receives the prediction for k.
+ * @return KNN_SUCCESS, KNN_ERR_INVALID_K or KNN_ERR_MEMORY_ALLOCATION.
+ */
+int knnVoteRange(DistanceLabel *distanceLabels, int count, int kMax, int *predictions);
+
 #endif // KNN_H
\ No newline at end of file
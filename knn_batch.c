@@ -0,0 +1,256 @@
+#include "knn_batch.h"
+#include "profiler.h"
+#include "arena.h"
+
+/**
+ * @struct BatchJob
+ * @brief Completion state of one knnBatchClassify call, so that calls sharing a pool wait only for their own tasks.
+ */
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t done;    /**< Signaled when the last task finishes. */
+    int remaining;          /**< Tasks not finished yet. */
+    int status;             /**< First error reported by a task. */
+} BatchJob;
+
+/**
+ * @struct BatchTask
+ * @brief Block of consecutive queries classified by one pool task.
+ */
+typedef struct {
+    const KnnBatchClassifier *classifier;
+    BatchJob *job;
+    const double *queries;
+    int stride;
+    int first;              /**< Index of the first query of the block. */
+    int count;              /**< Number of queries in the block. */
+    int k;
+    int strategy;           /**< Resolved KNN_SEARCH_* strategy. */
+    int *predictions;
+    int *neighborIndices;
+    double *neighborDistances;
+} BatchTask;
+
+// Creates a classifier and starts its worker pool.
+int createKnnBatchClassifier(KnnBatchClassifier *classifier, const ShapeData *trainingSet, int trainingSize,
+                             int featureCount, int p, int threads) {
+    memset(classifier, 0, sizeof(KnnBatchClassifier));
+    if (!trainingSet || trainingSize <= 0 || featureCount <= 0 || p <= 0) {
+        fprintf(stderr, "Invalid parameters for the batch classifier\n");
+        return KNN_BATCH_ERR_INVALID_INPUT;
+    }
+    classifier->pool = createThreadPool(threads);
+    if (!classifier->pool) {
+        return KNN_BATCH_ERR_MEMORY;
+    }
+    classifier->trainingSet = trainingSet;
+    classifier->trainingSize = trainingSize;
+    classifier->featureCount = featureCount;
+    classifier->p = p;
+
+    // pow() makes every term expensive, so large exponents search with early abandoning
+    if (p >= PARTIAL_DISTANCE_MIN_P) {
+        classifier->partial = malloc(sizeof(PartialDistanceIndex));
+        if (!classifier->partial || buildPartialDistanceIndex(classifier->partial, trainingSet, trainingSize,
+                                                              featureCount, p) != PARTIAL_DISTANCE_SUCCESS) {
+            freeKnnBatchClassifier(classifier);
+            return KNN_BATCH_ERR_MEMORY;
+        }
+        knnBatchAttachIndex(classifier, classifier->partial, partialDistanceSearch);
+    }
+    return KNN_BATCH_SUCCESS;
+}
+
+// Attaches an exact index.
+void knnBatchAttachIndex(KnnBatchClassifier *classifier, const void *index, KnnIndexSearch search) {
+    classifier->index = index;
+    classifier->indexSearch = search;
+}
+
+// Attaches a compressed index.
+void knnBatchAttachCompressed(KnnBatchClassifier *classifier, const CompressedIndex *compressed, int shortlist) {
+    classifier->compressed = compressed;
+    classifier->shortlist = shortlist > 0 ? shortlist : COMPRESSED_DEFAULT_SHORTLIST;
+}
+
+// Returns the concrete strategy of a request.
+int knnBatchResolveStrategy(const KnnBatchClassifier *classifier, int strategy) {
+    switch (strategy) {
+        case KNN_SEARCH_AUTO:
+            if (classifier->indexSearch) {
+                return KNN_SEARCH_INDEXED;
+            }
+            if (classifier->compressed && classifier->trainingSize >= KNN_BATCH_APPROXIMATE_MIN_SIZE) {
+                return KNN_SEARCH_APPROXIMATE;
+            }
+            return KNN_SEARCH_BRUTE_FORCE;
+        case KNN_SEARCH_BRUTE_FORCE:
+            return strategy;
+        case KNN_SEARCH_INDEXED:
+            return classifier->indexSearch ? strategy : KNN_BATCH_ERR_UNAVAILABLE;
+        case KNN_SEARCH_APPROXIMATE:
+            return classifier->compressed ? strategy : KNN_BATCH_ERR_UNAVAILABLE;
+    }
+    return KNN_BATCH_ERR_INVALID_INPUT;
+}
+
+// Writes the neighbors of a query and votes on their classes.
+static void finishQuery(const BatchTask *task, int query, DistanceLabel *neighbors) {
+    const KnnBatchClassifier *classifier = task->classifier;
+    int k = task->k;
+    for (int j = 0; j < k; j++) {
+        if (task->neighborIndices) {
+            task->neighborIndices[(size_t)query * k + j] = neighbors[j].label;
+        }
+        if (task->neighborDistances) {
+            task->neighborDistances[(size_t)query * k + j] = neighbors[j].distance;
+        }
+        neighbors[j].label = classifier->trainingSet[neighbors[j].label].class;
+    }
+    task->predictions[query] = knnVote(neighbors, k, k);
+}
+
+// Compares a block of queries with the training set one tile of training samples at a time.
+static int bruteForceBlock(const BatchTask *task, DistanceLabel *neighbors, Arena *scratch) {
+    const KnnBatchClassifier *classifier = task->classifier;
+    int n = classifier->trainingSize, d = classifier->featureCount, p = classifier->p;
+    double *distances = arenaAlloc(scratch, (size_t)task->count * n * sizeof(double));
+    DistanceLabel *candidates = arenaAlloc(scratch, n * sizeof(DistanceLabel));
+    if (!distances || !candidates) {
+        return KNN_BATCH_ERR_MEMORY;
+    }
+
+    // The tile of training samples stays in cache while every query of the block passes over it
+    for (int tile = 0; tile < n; tile += KNN_BATCH_TRAINING_BLOCK) {
+        int tileEnd = tile + KNN_BATCH_TRAINING_BLOCK < n ? tile + KNN_BATCH_TRAINING_BLOCK : n;
+        for (int q = 0; q < task->count; q++) {
+            const double *query = task->queries + (size_t)(task->first + q) * task->stride;
+            double *row = distances + (size_t)q * n;
+            for (int j = tile; j < tileEnd; j++) {
+                row[j] = minkowskiPowerSum(query, classifier->trainingSet[j].features, d, p);
+            }
+        }
+    }
+    profileCount(PROFILE_DISTANCE, PROFILE_DISTANCE_EVALUATIONS, (uint64_t)task->count * n);
+
+    for (int q = 0; q < task->count; q++) {
+        for (int j = 0; j < n; j++) {
+            candidates[j].distance = distances[(size_t)q * n + j];
+            candidates[j].label = j;
+        }
+        knnSelectNearest(candidates, n, task->k);
+        for (int j = 0; j < task->k; j++) {
+            neighbors[j].distance = minkowskiRoot(candidates[j].distance, p);
+            neighbors[j].label = candidates[j].label;
+        }
+        finishQuery(task, task->first + q, neighbors);
+    }
+    return KNN_BATCH_SUCCESS;
+}
+
+// Pool task: classifies one block of queries.
+static void runBatchTask(void *arg) {
+    BatchTask *task = arg;
+    const KnnBatchClassifier *classifier = task->classifier;
+    ProfileScope scope = profileBegin(PROFILE_DISTANCE);
+    Arena *scratch = scratchArena(PROFILE_DISTANCE);
+    ArenaMark mark = arenaMark(scratch);
+
+    int status = KNN_BATCH_SUCCESS;
+    DistanceLabel *neighbors = arenaAlloc(scratch, task->k * sizeof(DistanceLabel));
+    if (!neighbors) {
+        status = KNN_BATCH_ERR_MEMORY;
+    } else if (task->strategy == KNN_SEARCH_BRUTE_FORCE) {
+        status = bruteForceBlock(task, neighbors, scratch);
+    } else {
+        for (int q = 0; q < task->count && status == KNN_BATCH_SUCCESS; q++) {
+            int index = task->first + q;
+            ShapeData query = {0, index, (double *)task->queries + (size_t)index * task->stride,
+                               classifier->featureCount};
+            int result = task->strategy == KNN_SEARCH_INDEXED
+                             ? classifier->indexSearch(classifier->index, &query, task->k, neighbors)
+                             : compressedSearch(classifier->compressed, &query, task->k, classifier->shortlist,
+                                                neighbors);
+            if (result < 0) {
+                status = KNN_BATCH_ERR_SEARCH;
+            } else {
+                finishQuery(task, index, neighbors);
+            }
+        }
+    }
+    arenaReset(scratch, mark);
+    profileEnd(&scope);
+
+    BatchJob *job = task->job;
+    pthread_mutex_lock(&job->mutex);
+    if (status != KNN_BATCH_SUCCESS && job->status == KNN_BATCH_SUCCESS) {
+        job->status = status;
+    }
+    if (--job->remaining == 0) {
+        pthread_cond_signal(&job->done);
+    }
+    pthread_mutex_unlock(&job->mutex);
+}
+
+// Classifies a matrix of query samples on the worker pool.
+int knnBatchClassify(KnnBatchClassifier *classifier, const double *queries, int querySize, int stride, int k,
+                     int strategy, int *predictions, int *neighborIndices, double *neighborDistances) {
+    if (!classifier || !classifier->pool || (!queries && querySize > 0) || querySize < 0 ||
+        stride < classifier->featureCount || k <= 0 || k > classifier->trainingSize ||
+        (!predictions && querySize > 0)) {
+        fprintf(stderr, "Invalid parameters for batch k-NN classification\n");
+        return KNN_BATCH_ERR_INVALID_INPUT;
+    }
+    strategy = knnBatchResolveStrategy(classifier, strategy);
+    if (strategy < 0) {
+        return strategy;
+    }
+    if (querySize == 0) {
+        return KNN_BATCH_SUCCESS;
+    }
+
+    int taskCount = (querySize + KNN_BATCH_QUERY_BLOCK - 1) / KNN_BATCH_QUERY_BLOCK;
+    BatchTask *tasks = malloc(taskCount * sizeof(BatchTask));
+    if (!tasks) {
+        return KNN_BATCH_ERR_MEMORY;
+    }
+    profileCount(PROFILE_DISTANCE, PROFILE_ALLOCATIONS, 1);
+
+    BatchJob job = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, taskCount, KNN_BATCH_SUCCESS};
+    for (int t = 0; t < taskCount; t++) {
+        int first = t * KNN_BATCH_QUERY_BLOCK;
+        tasks[t] = (BatchTask){classifier, &job, queries, stride, first,
+                               querySize - first < KNN_BATCH_QUERY_BLOCK ? querySize - first : KNN_BATCH_QUERY_BLOCK,
+                               k, strategy, predictions, neighborIndices, neighborDistances};
+    }
+
+    // Tasks that cannot be queued are run by the caller
+    for (int t = 0; t < taskCount; t++) {
+        if (submitTask(classifier->pool, runBatchTask, &tasks[t]) != POOL_SUCCESS) {
+            runBatchTask(&tasks[t]);
+        }
+    }
+
+    pthread_mutex_lock(&job.mutex);
+    while (job.remaining > 0) {
+        pthread_cond_wait(&job.done, &job.mutex);
+    }
+    pthread_mutex_unlock(&job.mutex);
+    pthread_mutex_destroy(&job.mutex);
+    pthread_cond_destroy(&job.done);
+    free(tasks);
+    return job.status;
+}
+
+// Stops the worker pool of a classifier.
+void freeKnnBatchClassifier(KnnBatchClassifier *classifier) {
+    if (classifier && classifier->pool) {
+        destroyThreadPool(classifier->pool);
+        classifier->pool = NULL;
+    }
+    if (classifier && classifier->partial) {
+        freePartialDistanceIndex(classifier->partial);
+        free(classifier->partial);
+        classifier->partial = NULL;
+    }
+}
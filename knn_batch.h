@@ -0,0 +1,140 @@
+/**
+ * @file knn_batch.h
+ * @brief Header file for the batch k-NN classification API.
+ *
+ * A KnnBatchClassifier wraps a training set and a persistent thread pool. Each call
+ * classifies a row-major matrix of query samples: the queries are cut into blocks,
+ * every block is a pool task, and the predicted labels, and optionally the indices
+ * and distances of the neighbors, are written to caller-owned arrays. The workers
+ * live as long as the classifier, so a call costs no thread creation.
+ *
+ * Three search strategies are available:
+ *
+ * - Brute force, blocked so that a tile of training samples stays in cache while a
+ *   block of queries is compared with it.
+ * - Indexed, through an exact search function attached with knnBatchAttachIndex.
+ * - Approximate, through a compressed index attached with knnBatchAttachCompressed.
+ *
+ * KNN_SEARCH_AUTO takes the attached index, then the compressed index for training
+ * sets of at least KNN_BATCH_APPROXIMATE_MIN_SIZE samples, then brute force. From
+ * p = PARTIAL_DISTANCE_MIN_P on, the classifier attaches its own early-abandoning
+ * index at creation, which a later knnBatchAttachIndex replaces.
+ */
+
+#ifndef KNN_BATCH_H
+#define KNN_BATCH_H
+
+#include "knn.h"
+#include "compressed_search.h"
+#include "partial_distance.h"
+#include "thread_pool.h"
+
+// Error codes
+#define KNN_BATCH_SUCCESS 0
+#define KNN_BATCH_ERR_INVALID_INPUT -1
+#define KNN_BATCH_ERR_MEMORY -2
+#define KNN_BATCH_ERR_UNAVAILABLE -3
+#define KNN_BATCH_ERR_SEARCH -4
+
+// Search strategies
+#define KNN_SEARCH_AUTO 0
+#define KNN_SEARCH_BRUTE_FORCE 1
+#define KNN_SEARCH_INDEXED 2
+#define KNN_SEARCH_APPROXIMATE 3
+
+// Queries per pool task
+#define KNN_BATCH_QUERY_BLOCK 16
+
+// Training samples compared with a block of queries before moving to the next tile
+#define KNN_BATCH_TRAINING_BLOCK 256
+
+// Smallest training set for which KNN_SEARCH_AUTO prefers the compressed index
+#define KNN_BATCH_APPROXIMATE_MIN_SIZE 4096
+
+/**
+ * @struct KnnBatchClassifier
+ * @brief Training set, search structures and worker pool of the batch API.
+ */
+typedef struct {
+    const ShapeData *trainingSet;        /**< Training samples; not owned. */
+    int trainingSize;                    /**< Number of training samples. */
+    int featureCount;                    /**< Number of features in every sample. */
+    int p;                               /**< Minkowski exponent. */
+    ThreadPool *pool;                    /**< Persistent workers running the query blocks. */
+    const void *index;                   /**< Exact index searched by indexSearch, NULL if none. */
+    KnnIndexSearch indexSearch;          /**< Search function of the exact index. */
+    const CompressedIndex *compressed;   /**< Compressed index of the approximate search, NULL if none. */
+    int shortlist;                       /**< Candidates re-ranked by the approximate search. */
+    PartialDistanceIndex *partial;       /**< Early-abandoning index built from PARTIAL_DISTANCE_MIN_P on, owned. */
+} KnnBatchClassifier;
+
+/**
+ * @brief Creates a classifier and starts its worker pool.
+ *
+ * @param classifier Classifier to initialize.
+ * @param trainingSet Training samples, which must outlive the classifier.
+ * @param trainingSize Number of training samples.
+ * @param featureCount Number of features in every sample.
+ * @param p Minkowski exponent.
+ * @param threads Number of worker threads, 0 for the number of online processors.
+ * @return KNN_BATCH_SUCCESS or a KNN_BATCH_ERR_* code.
+ */
+int createKnnBatchClassifier(KnnBatchClassifier *classifier, const ShapeData *trainingSet, int trainingSize,
+                             int featureCount, int p, int threads);
+
+/**
+ * @brief Attaches an exact index used by KNN_SEARCH_INDEXED.
+ *
+ * @param classifier Classifier to extend.
+ * @param index Index built on the classifier's training set; not owned.
+ * @param search Search function of the index.
+ */
+void knnBatchAttachIndex(KnnBatchClassifier *classifier, const void *index, KnnIndexSearch search);
+
+/**
+ * @brief Attaches a compressed index used by KNN_SEARCH_APPROXIMATE.
+ *
+ * @param classifier Classifier to extend.
+ * @param compressed Index built on the classifier's training set; not owned.
+ * @param shortlist Candidates re-ranked exactly per query, 0 for COMPRESSED_DEFAULT_SHORTLIST.
+ */
+void knnBatchAttachCompressed(KnnBatchClassifier *classifier, const CompressedIndex *compressed, int shortlist);
+
+/**
+ * @brief Returns the strategy a call with the given request would use.
+ *
+ * @param classifier Classifier to query.
+ * @param strategy Requested KNN_SEARCH_* strategy.
+ * @return The concrete strategy, or KNN_BATCH_ERR_UNAVAILABLE if its structure is not attached.
+ */
+int knnBatchResolveStrategy(const KnnBatchClassifier *classifier, int strategy);
+
+/**
+ * @brief Classifies a matrix of query samples.
+ *
+ * The queries must already be preprocessed like the training set. The call blocks
+ * until every query is classified; separate calls on the same classifier may run
+ * concurrently from different threads.
+ *
+ * @param classifier Classifier to use.
+ * @param queries Row-major matrix of query features.
+ * @param querySize Number of queries.
+ * @param stride Distance in doubles between consecutive queries, at least featureCount.
+ * @param k Number of neighbors.
+ * @param strategy KNN_SEARCH_* strategy.
+ * @param predictions Output array of querySize predicted classes.
+ * @param neighborIndices Optional querySize x k output of training indices, nearest first, or NULL.
+ * @param neighborDistances Optional querySize x k output of neighbor distances, or NULL.
+ * @return KNN_BATCH_SUCCESS or a KNN_BATCH_ERR_* code.
+ */
+int knnBatchClassify(KnnBatchClassifier *classifier, const double *queries, int querySize, int stride, int k,
+                     int strategy, int *predictions, int *neighborIndices, double *neighborDistances);
+
+/**
+ * @brief Stops the worker pool and frees the classifier's own index; the attached indexes and the training set are not freed.
+ *
+ * @param classifier Classifier to free.
+ */
+void freeKnnBatchClassifier(KnnBatchClassifier *classifier);
+
+#endif // KNN_BATCH_H
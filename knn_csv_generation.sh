@@ -53,11 +53,8 @@ echo "k,p,Overall Precision,Overall Recall,Overall Specificity,Overall F1 Score,
 # Loop over the range of k values
 for (( k = $start_k; k <= $end_k; k += $increment )); do
     echo "Running with k = $k"
-    # Run command and store the output
-    output=$(./main -d "$input_directory" -e "$extension" -f 0.8 -m knn -p $p_value -k $k -l none)
-
-    # Extract the first occurrence of overall metrics and format them
-    overall_metrics=$(echo "$output" | grep -P "Overall Precision = \K[^\n]+" -A 6 | head -n 7 | awk -F" = " '{print $2}' | paste -sd, - | sed 's/,$//')
+    # Run command with CSV output and keep the overall metrics of the test set
+    overall_metrics=$(./main -d "$input_directory" -e "$extension" -f 0.8 -m knn -p $p_value -k $k -l none --format=csv | grep "^overall,test," | cut -d, -f3-)
 
     # Save to file
     echo "$k,$p_value,$overall_metrics" >> "$output_file"
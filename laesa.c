@@ -0,0 +1,270 @@
+#include "laesa.h"
+#include "profiler.h"
+#include "arena.h"
+
+#include <string.h>
+
+/**
+ * @struct LaesaSectionHeader
+ * @brief Start of the MODEL_INDEX_LAESA section, followed by the trainingSize x pivotCount
+ *        pivot distances as doubles and the pivotCount pivot indices as int32.
+ */
+typedef struct {
+    int32_t pivotCount;      /**< Number of pivots. */
+    int32_t trainingSize;    /**< Rows of the pivot distance table. */
+} LaesaSectionHeader;
+
+// Returns the Minkowski distance between two feature vectors.
+static double sampleDistance(const double *a, const double *b, int featureCount, int p) {
+    return minkowskiRoot(minkowskiPowerSum(a, b, featureCount, p), p);
+}
+
+// Allocates the pivots, ranks and table of an index.
+static int allocateLaesaIndex(LaesaIndex *index, int trainingSize, int pivotCount) {
+    index->pivotCount = pivotCount;
+    index->pivots = malloc(pivotCount * sizeof(int));
+    index->pivotRank = malloc(trainingSize * sizeof(int));
+    index->pivotDistances = malloc((size_t)trainingSize * pivotCount * sizeof(double));
+    if (!index->pivots || !index->pivotRank || !index->pivotDistances) {
+        fprintf(stderr, "Memory allocation failed for the LAESA index\n");
+        freeLaesaIndex(index);
+        return LAESA_ERR_MEMORY;
+    }
+    profileCount(PROFILE_PREPROCESS, PROFILE_ALLOCATIONS, 3);
+    for (int i = 0; i < trainingSize; i++) {
+        index->pivotRank[i] = -1;
+    }
+    return LAESA_SUCCESS;
+}
+
+// Returns the sample that is not a pivot and is farthest from the pivots, the smallest index on ties.
+static int farthestSample(const LaesaIndex *index, const double *separation) {
+    int farthest = -1;
+    for (int i = 0; i < index->trainingSize; i++) {
+        if (index->pivotRank[i] < 0 && (farthest < 0 || separation[i] > separation[farthest])) {
+            farthest = i;
+        }
+    }
+    return farthest;
+}
+
+// Selects the pivots by farthest-first traversal and fills the pivot distance table.
+int buildLaesaIndex(LaesaIndex *index, const ShapeData *trainingSet, int trainingSize, int featureCount, int p,
+                    int pivotCount) {
+    memset(index, 0, sizeof(LaesaIndex));
+    if (!trainingSet || trainingSize <= 0 || featureCount <= 0 || p <= 0 || pivotCount <= 0 ||
+        pivotCount > trainingSize) {
+        fprintf(stderr, "Invalid parameters for the LAESA index\n");
+        return LAESA_ERR_INVALID_INPUT;
+    }
+    index->trainingSet = trainingSet;
+    index->trainingSize = trainingSize;
+    index->featureCount = featureCount;
+    index->p = p;
+    if (allocateLaesaIndex(index, trainingSize, pivotCount) != LAESA_SUCCESS) {
+        return LAESA_ERR_MEMORY;
+    }
+    ProfileScope scope = profileBegin(PROFILE_PREPROCESS);
+    Arena *scratch = scratchArena(PROFILE_PREPROCESS);
+    ArenaMark mark = arenaMark(scratch);
+    double *separation = arenaAlloc(scratch, trainingSize * sizeof(double));
+    if (!separation) {
+        fprintf(stderr, "Memory allocation failed for the LAESA index\n");
+        profileEnd(&scope);
+        freeLaesaIndex(index);
+        return LAESA_ERR_MEMORY;
+    }
+
+    // The first pivot is the sample farthest from the first sample, an end of a long axis of the data
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < trainingSize; i++) {
+        separation[i] = sampleDistance(trainingSet[i].features, trainingSet[0].features, featureCount, p);
+    }
+    int next = farthestSample(index, separation);
+
+    // Every pivot is the sample farthest from its nearest earlier pivot
+    for (int j = 0; j < pivotCount; j++) {
+        const double *pivot = trainingSet[next].features;
+        index->pivots[j] = next;
+        index->pivotRank[next] = j;
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < trainingSize; i++) {
+            double distance = sampleDistance(trainingSet[i].features, pivot, featureCount, p);
+            index->pivotDistances[(size_t)i * pivotCount + j] = distance;
+            if (j == 0 || distance < separation[i]) {
+                separation[i] = distance;
+            }
+        }
+        next = farthestSample(index, separation);
+    }
+    profileCount(PROFILE_PREPROCESS, PROFILE_DISTANCE_EVALUATIONS, (uint64_t)trainingSize * (pivotCount + 1));
+    arenaReset(scratch, mark);
+    profileEnd(&scope);
+    return LAESA_SUCCESS;
+}
+
+// Finds the k nearest samples of a query, counting the distances evaluated.
+static int searchPivots(const LaesaIndex *index, const ShapeData *query, int k, DistanceLabel *neighbors,
+                        uint64_t *evaluations) {
+    if (!index || !query || !neighbors || k <= 0 || k > index->trainingSize) {
+        return LAESA_ERR_INVALID_INPUT;
+    }
+    int n = index->trainingSize, m = index->pivotCount, d = index->featureCount, p = index->p;
+    Arena *scratch = scratchArena(PROFILE_DISTANCE);
+    ArenaMark mark = arenaMark(scratch);
+    double *queryDistances = arenaAlloc(scratch, m * sizeof(double));
+    if (!queryDistances) {
+        return LAESA_ERR_MEMORY;
+    }
+
+    // The pivots are training samples, so their distances also seed the heap
+    NeighborHeap heap = {neighbors, 0, k};
+    for (int j = 0; j < m; j++) {
+        queryDistances[j] = sampleDistance(query->features, index->trainingSet[index->pivots[j]].features, d, p);
+        knnHeapOffer(&heap, (DistanceLabel){queryDistances[j], index->pivots[j]});
+    }
+    uint64_t evaluated = m;
+
+    for (int i = 0; i < n; i++) {
+        if (index->pivotRank[i] >= 0) {
+            continue;
+        }
+        // Any pivot whose distances differ by more than the k-th neighbor proves the sample too far
+        if (heap.count == k) {
+            double threshold = heap.entries[0].distance * (1.0 + LAESA_BOUND_SLACK);
+            const double *row = index->pivotDistances + (size_t)i * m;
+            int j = 0;
+            while (j < m && fabs(queryDistances[j] - row[j]) <= threshold) {
+                j++;
+            }
+            if (j < m) {
+                continue;
+            }
+        }
+        double distance = sampleDistance(query->features, index->trainingSet[i].features, d, p);
+        knnHeapOffer(&heap, (DistanceLabel){distance, i});
+        evaluated++;
+    }
+    arenaReset(scratch, mark);
+    profileCount(PROFILE_DISTANCE, PROFILE_DISTANCE_EVALUATIONS, evaluated);
+    knnSortNeighbors(neighbors, k);
+    *evaluations = evaluated;
+    return LAESA_SUCCESS;
+}
+
+// Finds the k nearest training samples of a query.
+int laesaSearch(const void *index, const ShapeData *query, int k, DistanceLabel *neighbors) {
+    uint64_t evaluations;
+    return searchPivots(index, query, k, neighbors, &evaluations);
+}
+
+/**
+ * @struct CountingSearch
+ * @brief LAESA index searched by classifyWithSearch, with the distance evaluations of all its queries.
+ */
+typedef struct {
+    const LaesaIndex *index;
+    uint64_t evaluations;    /**< Updated atomically, the queries run on several threads. */
+} CountingSearch;
+
+// Search of a CountingSearch: finds the neighbors of a query and adds up its distance evaluations.
+static int countingSearch(const void *arg, const ShapeData *query, int k, DistanceLabel *neighbors) {
+    CountingSearch *counting = (CountingSearch *)arg;
+    uint64_t evaluations = 0;
+    int status = searchPivots(counting->index, query, k, neighbors, &evaluations);
+    #pragma omp atomic
+    counting->evaluations += evaluations;
+    return status;
+}
+
+// Classifies every test sample in parallel into thread-local confusion matrices.
+int laesaClassifyBatch(const LaesaIndex *index, const ShapeData *testSet, int testSize, int k, ConfusionMatrix *cm,
+                       int *predictions, double *avoided) {
+    if (!index || !testSet || !cm || !predictions || k <= 0 || k > index->trainingSize) {
+        fprintf(stderr, "Invalid parameters for LAESA classification\n");
+        return LAESA_ERR_INVALID_INPUT;
+    }
+    ProfileScope scope = profileBegin(PROFILE_DISTANCE);
+    CountingSearch counting = {index, 0};
+    int status = classifyWithSearch(&counting, countingSearch, index->trainingSet, testSet, testSize, k, cm,
+                                    predictions);
+    if (avoided) {
+        double total = (double)testSize * index->trainingSize;
+        *avoided = total > 0 ? 1.0 - counting.evaluations / total : 0.0;
+    }
+    profileEnd(&scope);
+    return status == KNN_ERR_MEMORY_ALLOCATION ? LAESA_ERR_MEMORY : status;
+}
+
+// Saves the training set of the index with its pivots and pivot distance table.
+int saveLaesaModel(const char *filename, const LaesaIndex *index, int k, const PreprocessingParams *preprocessing) {
+    size_t tableBytes = (size_t)index->trainingSize * index->pivotCount * sizeof(double);
+    size_t pivotBytes = index->pivotCount * sizeof(int32_t);
+    size_t sectionSize = sizeof(LaesaSectionHeader) + tableBytes + pivotBytes;
+    char *section = malloc(sectionSize);
+    if (!section) {
+        return MODEL_ERR_MEMORY;
+    }
+    LaesaSectionHeader header = {index->pivotCount, index->trainingSize};
+    memcpy(section, &header, sizeof(header));
+    memcpy(section + sizeof(header), index->pivotDistances, tableBytes);
+    for (int j = 0; j < index->pivotCount; j++) {
+        int32_t pivot = index->pivots[j];
+        memcpy(section + sizeof(header) + tableBytes + j * sizeof(int32_t), &pivot, sizeof(pivot));
+    }
+    int status = saveIndexedKnnModel(filename, index->trainingSet, index->trainingSize, index->featureCount,
+                                     index->p, k, preprocessing, MODEL_INDEX_LAESA, section, sectionSize);
+    free(section);
+    return status;
+}
+
+// Copies the pivots and the pivot distance table of a loaded model.
+int restoreLaesaIndex(LaesaIndex *index, const KnnModel *model) {
+    memset(index, 0, sizeof(LaesaIndex));
+    LaesaSectionHeader header;
+    if (model->indexType != MODEL_INDEX_LAESA || model->indexSize < sizeof(header)) {
+        fprintf(stderr, "The model holds no LAESA index\n");
+        return LAESA_ERR_FORMAT;
+    }
+    memcpy(&header, model->index, sizeof(header));
+    if (header.pivotCount <= 0 || header.pivotCount > model->trainingSize ||
+        header.trainingSize != model->trainingSize ||
+        model->indexSize != sizeof(header) + (uint64_t)header.trainingSize * header.pivotCount * sizeof(double) +
+                                header.pivotCount * sizeof(int32_t)) {
+        fprintf(stderr, "The LAESA index of the model is corrupted\n");
+        return LAESA_ERR_FORMAT;
+    }
+    index->trainingSet = model->trainingSet;
+    index->trainingSize = model->trainingSize;
+    index->featureCount = model->featureCount;
+    index->p = model->p;
+    if (allocateLaesaIndex(index, model->trainingSize, header.pivotCount) != LAESA_SUCCESS) {
+        return LAESA_ERR_MEMORY;
+    }
+
+    const char *section = model->index;
+    size_t tableBytes = (size_t)header.trainingSize * header.pivotCount * sizeof(double);
+    memcpy(index->pivotDistances, section + sizeof(header), tableBytes);
+    for (int j = 0; j < header.pivotCount; j++) {
+        int32_t pivot;
+        memcpy(&pivot, section + sizeof(header) + tableBytes + j * sizeof(int32_t), sizeof(pivot));
+        if (pivot < 0 || pivot >= index->trainingSize || index->pivotRank[pivot] >= 0) {
+            fprintf(stderr, "The LAESA index of the model is corrupted\n");
+            freeLaesaIndex(index);
+            return LAESA_ERR_FORMAT;
+        }
+        index->pivots[j] = pivot;
+        index->pivotRank[pivot] = j;
+    }
+    return LAESA_SUCCESS;
+}
+
+// Frees the pivots and the pivot distance table.
+void freeLaesaIndex(LaesaIndex *index) {
+    if (index) {
+        free(index->pivots);
+        free(index->pivotRank);
+        free(index->pivotDistances);
+        memset(index, 0, sizeof(LaesaIndex));
+    }
+}
@@ -0,0 +1,127 @@
+/**
+ * @file laesa.h
+ * @brief Header file for the LAESA pivot index: exact k-NN with triangle-inequality pruning.
+ *
+ * Space partitioning trees lose their pruning power on the 90 to 128 features of the
+ * descriptors, but the triangle inequality holds in any dimension for a metric, and the
+ * Minkowski distance is one for every p >= 1. LAESA (Linear AESA) keeps m training
+ * samples as pivots and the n x m table of the distances from every training sample to
+ * every pivot. For a query q and a sample x, |d(q, pivot) - d(x, pivot)| <= d(q, x) for
+ * every pivot, so the largest of these differences is a lower bound of d(q, x) that
+ * costs m lookups instead of a distance.
+ *
+ * A query computes its m pivot distances, which also enter the pivots into the heap of
+ * its k nearest samples, then scans the other samples. A sample is evaluated only if
+ * none of its pivot bounds exceeds the current k-th nearest distance; the bounds are
+ * checked pivot by pivot and the first one above it rejects the sample. The result is
+ * the same as a full scan, and queries are searched in parallel.
+ *
+ * The pivots are chosen greedily for maximum separation: each new pivot is the sample
+ * farthest from the pivots chosen so far (farthest-first traversal), and the distances
+ * computed while choosing them fill the table. The index can be stored in a k-NN model
+ * file as a MODEL_INDEX_LAESA section, so a loaded model does not recompute the table.
+ */
+
+#ifndef LAESA_H
+#define LAESA_H
+
+#include "knn.h"
+#include "model_io.h"
+
+#include <stdint.h>
+
+// Error codes
+#define LAESA_SUCCESS 0
+#define LAESA_ERR_INVALID_INPUT -1
+#define LAESA_ERR_MEMORY -2
+#define LAESA_ERR_FORMAT -3
+
+// Relative slack of the lower bounds, so that rounding never prunes a sample as far as the k-th neighbor
+#define LAESA_BOUND_SLACK 1e-12
+
+/**
+ * @struct LaesaIndex
+ * @brief Pivots of a training set and the distances from every sample to them.
+ */
+typedef struct {
+    const ShapeData *trainingSet; /**< Training samples, whose classes vote; not owned. */
+    int trainingSize;             /**< Number of training samples. */
+    int featureCount;             /**< Number of features in every sample. */
+    int p;                        /**< Minkowski exponent. */
+    int pivotCount;               /**< Number of pivots m. */
+    int *pivots;                  /**< Training indices of the pivots, in selection order. */
+    int *pivotRank;               /**< Rank of every training sample among the pivots, -1 for the others. */
+    double *pivotDistances;       /**< trainingSize x pivotCount distances from every sample to every pivot. */
+} LaesaIndex;
+
+/**
+ * @brief Selects the pivots of a training set and computes the pivot distance table.
+ *
+ * @param index Index to initialize.
+ * @param trainingSet Training samples, which must outlive the index.
+ * @param trainingSize Number of training samples.
+ * @param featureCount Number of features in every sample.
+ * @param p Minkowski exponent.
+ * @param pivotCount Number of pivots, at most the training size.
+ * @return LAESA_SUCCESS or a LAESA_ERR_* code.
+ */
+int buildLaesaIndex(LaesaIndex *index, const ShapeData *trainingSet, int trainingSize, int featureCount, int p,
+                    int pivotCount);
+
+/**
+ * @brief Finds the k nearest training samples of a query.
+ *
+ * The signature matches KnnIndexSearch, so the index can be attached to a batch classifier.
+ *
+ * @param index Built LaesaIndex.
+ * @param query Sample to search for.
+ * @param k Number of neighbors, between 1 and the training size.
+ * @param neighbors Output array of k Minkowski distances and training indices, nearest first,
+ *                  ties going to the smaller index.
+ * @return LAESA_SUCCESS or a LAESA_ERR_* code.
+ */
+int laesaSearch(const void *index, const ShapeData *query, int k, DistanceLabel *neighbors);
+
+/**
+ * @brief Classifies every test sample in parallel and tallies the results.
+ *
+ * @param index Built index.
+ * @param testSet Samples to classify, whose classes are the actual classes.
+ * @param testSize Number of samples.
+ * @param k Number of neighbors voting.
+ * @param cm Confusion matrix receiving the results.
+ * @param predictions Output array of testSize predicted classes.
+ * @param avoided Output fraction of the testSize x trainingSize distances that were not evaluated, or NULL.
+ * @return LAESA_SUCCESS or a LAESA_ERR_* code.
+ */
+int laesaClassifyBatch(const LaesaIndex *index, const ShapeData *testSet, int testSize, int k, ConfusionMatrix *cm,
+                       int *predictions, double *avoided);
+
+/**
+ * @brief Saves a k-NN model with the pivot table of its index.
+ *
+ * @param filename Path of the model file to write.
+ * @param index Index built on the preprocessed training samples saved in the model.
+ * @param k Number of neighbors.
+ * @param preprocessing Preprocessing fitted on the training set, NULL for none.
+ * @return MODEL_SUCCESS or a MODEL_ERR_* code.
+ */
+int saveLaesaModel(const char *filename, const LaesaIndex *index, int k, const PreprocessingParams *preprocessing);
+
+/**
+ * @brief Restores the index stored in a loaded k-NN model.
+ *
+ * @param index Index to initialize over the training samples of the model.
+ * @param model Loaded k-NN model holding a MODEL_INDEX_LAESA section.
+ * @return LAESA_SUCCESS or a LAESA_ERR_* code.
+ */
+int restoreLaesaIndex(LaesaIndex *index, const KnnModel *model);
+
+/**
+ * @brief Frees the pivots and the pivot distance table of an index.
+ *
+ * @param index Index to free.
+ */
+void freeLaesaIndex(LaesaIndex *index);
+
+#endif // LAESA_H
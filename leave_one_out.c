@@ -0,0 +1,97 @@
+#include "leave_one_out.h"
+#include "knn.h"
+#include "profiler.h"
+
+// Classifies every sample against all the others for every k from 1 to kMax.
+int leaveOneOutKnn(const ShapeData *data, int dataSize, const DistanceMatrix *distances, int kMax,
+                   int classCount, LeaveOneOutResult *result) {
+    result->kMax = 0;
+    result->matrices = NULL;
+    if (!data || !distances || !distances->values || distances->size != dataSize || kMax <= 0 || kMax >= dataSize) {
+        fprintf(stderr, "Invalid parameters for leave-one-out evaluation\n");
+        return LOO_ERR_INVALID_INPUT;
+    }
+
+    // predictions[i * kMax + k - 1] is the prediction for sample i with k neighbors
+    int *predictions = malloc((size_t)dataSize * kMax * sizeof(int));
+    if (!predictions) {
+        return LOO_ERR_MEMORY_FAILURE;
+    }
+
+    int failed = 0;
+    #pragma omp parallel reduction(|:failed)
+    {
+        DistanceLabel *distanceLabels = malloc((dataSize - 1) * sizeof(DistanceLabel));
+        failed |= !distanceLabels;
+
+        #pragma omp for schedule(dynamic, 16)
+        for (int i = 0; i < dataSize; i++) {
+            if (!distanceLabels) continue;
+            int candidates = 0;
+            for (int j = 0; j < dataSize; j++) {
+                if (j != i) {
+                    distanceLabels[candidates].distance = getDistance(distances, i, j);
+                    distanceLabels[candidates].label = data[j].class;
+                    candidates++;
+                }
+            }
+            failed |= knnVoteRange(distanceLabels, candidates, kMax, predictions + (size_t)i * kMax) != KNN_SUCCESS;
+        }
+        free(distanceLabels);
+    }
+    if (failed) {
+        free(predictions);
+        return LOO_ERR_MEMORY_FAILURE;
+    }
+
+    result->matrices = malloc(kMax * sizeof(ConfusionMatrix));
+    if (!result->matrices) {
+        free(predictions);
+        return LOO_ERR_MEMORY_FAILURE;
+    }
+    result->kMax = kMax;
+    for (int k = 1; k <= kMax; k++) {
+        result->matrices[k - 1] = createConfusionMatrix(classCount);
+        for (int i = 0; i < dataSize; i++) {
+            updateConfusionMatrix(&result->matrices[k - 1], data[i].class, predictions[(size_t)i * kMax + k - 1]);
+        }
+    }
+
+    free(predictions);
+    return LOO_SUCCESS;
+}
+
+// Prints the overall metrics for every k and the confusion matrix of the best k.
+void printLeaveOneOutResult(const LeaveOneOutResult *result) {
+    printf("\nLeave-One-Out Metrics by k:\n");
+    int bestK = 1;
+    double bestAccuracy = -1;
+    Arena *scratch = scratchArena(PROFILE_METRICS);
+    ArenaMark mark = arenaMark(scratch);
+    for (int k = 1; k <= result->kMax; k++) {
+        ConfusionMatrixMetrics metrics = calculateStatisticsInArena(&result->matrices[k - 1], scratch);
+        const ClassMetrics *m = &metrics.overallMetrics;
+        printf("k = %d: Precision = %.4f, Recall = %.4f, F1 Score = %.4f, Accuracy = %.2f%%\n",
+               k, m->precision, m->recall, m->f1Score, m->accuracy * 100);
+        if (m->accuracy > bestAccuracy) {
+            bestAccuracy = m->accuracy;
+            bestK = k;
+        }
+        arenaReset(scratch, mark);
+    }
+
+    printf("\nBest k = %d (Accuracy = %.2f%%)\n", bestK, bestAccuracy * 100);
+    printDetailedConfusionMatrix(result->matrices[bestK - 1]);
+}
+
+// Frees the memory held by a leave-one-out result.
+void freeLeaveOneOutResult(LeaveOneOutResult *result) {
+    if (result && result->matrices) {
+        for (int k = 0; k < result->kMax; k++) {
+            freeConfusionMatrix(&result->matrices[k]);
+        }
+        free(result->matrices);
+        result->matrices = NULL;
+        result->kMax = 0;
+    }
+}
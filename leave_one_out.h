@@ -0,0 +1,59 @@
+/**
+ * @file leave_one_out.h
+ * @brief Header file for leave-one-out evaluation of k-NN over a range of k.
+ */
+
+#ifndef LEAVE_ONE_OUT_H
+#define LEAVE_ONE_OUT_H
+
+#include "data_reader.h"      // Include for ShapeData structure definition.
+#include "confusion_matrix.h" // Include for ConfusionMatrix definition.
+#include "distance_matrix.h"  // Include for DistanceMatrix definition.
+
+// Error codes
+#define LOO_SUCCESS 0
+#define LOO_ERR_INVALID_INPUT -1
+#define LOO_ERR_MEMORY_FAILURE -2
+
+/**
+ * @struct LeaveOneOutResult
+ * @brief Confusion matrices of a leave-one-out evaluation, one per value of k.
+ */
+typedef struct {
+    int kMax;                    /**< Largest k evaluated. */
+    ConfusionMatrix *matrices;   /**< matrices[k - 1] holds the results for k neighbors. */
+} LeaveOneOutResult;
+
+/**
+ * @brief Classifies every sample against all the others for every k from 1 to kMax.
+ *
+ * The symmetric distance matrix is shared by all samples; each sample selects its
+ * kMax nearest neighbors once and derives the vote of every smaller k from them.
+ * Samples are processed in parallel.
+ *
+ * @param data Array of samples.
+ * @param dataSize Number of samples.
+ * @param distances Distances between all samples.
+ * @param kMax Largest number of neighbors, at most dataSize - 1.
+ * @param classCount Number of classes of the confusion matrices.
+ * @param result Pointer receiving the matrices, released with freeLeaveOneOutResult.
+ * @return LOO_SUCCESS or a LOO_ERR_* code.
+ */
+int leaveOneOutKnn(const ShapeData *data, int dataSize, const DistanceMatrix *distances, int kMax,
+                   int classCount, LeaveOneOutResult *result);
+
+/**
+ * @brief Prints the overall metrics for every k and the confusion matrix of the best k.
+ *
+ * @param result Pointer to the leave-one-out result.
+ */
+void printLeaveOneOutResult(const LeaveOneOutResult *result);
+
+/**
+ * @brief Frees the memory held by a leave-one-out result.
+ *
+ * @param result Pointer to the result to be freed.
+ */
+void freeLeaveOneOutResult(LeaveOneOutResult *result);
+
+#endif // LEAVE_ONE_OUT_H
@@ -4,14 +4,34 @@
 #include "standardization.h"
 #include "knn.h"
 #include "kmeans.h"
+#include "kmedoids.h"
+#include "hierarchical.h"
+#include "density.h"
 #include "confusion_matrix.h"
 #include "cross_validation.h"
 #include "kmeans_evaluation.h"
+#include "leave_one_out.h"
+#include "grid_search.h"
+#include "profiler.h"
+#include "output.h"
+#include "preprocessing.h"
+#include "pca.h"
+#include "compressed_search.h"
+#include "partial_distance.h"
+#include "laesa.h"
+#include "distance_cache.h"
+#include "knn_batch.h"
+#include "reference_store.h"
+#include "online_kmeans.h"
+#include "model_io.h"
+#include "server.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <time.h>
 
 
 /**
@@ -22,15 +42,57 @@ typedef struct {
     char *directory;            /**< Path to the directory containing data files. */
     char *extension;            /**< extension File extension of data files. */
     float trainingFraction;     /**< Fraction of data to be used for training. */
-    char *method;               /**< Machine learning method to use ('knn' or 'kmeans'). */
+    char *method;               /**< Machine learning method to use ('knn', 'knn_incremental', 'knn_loo', 'grid', 'kmeans', 'kmedoids', 'hierarchical', 'dbscan', 'hdbscan', 'kmeans_online' or 'nearest_centroid'). */
     int p;                      /**< Distance metric parameter (used in k-NN and k-Means). */
+    char *pList;                /**< Raw p argument, a comma separated list for the grid search. */
     int k;                      /**< Number of neighbors/clusters. */
     char *preprocessing;        /**< Preprocessing method ('normalize' or 'standardize'). */
+    char *modelOutput;          /**< Path where the trained model is saved, NULL to skip saving. */
+    char *modelInput;           /**< Path of a saved model used to classify the data, NULL to train. */
+    char *socketPath;           /**< Unix domain socket to serve the loaded model on, NULL to classify once. */
+    int batchSize;              /**< Maximum number of requests classified together in server mode, or samples read per batch by online k-Means. */
+    int folds;                  /**< Number of cross-validation folds, 0 for a single train/test split. */
+    int threads;                /**< Number of worker threads, 0 for the number of online processors. */
+    char *output;               /**< Path of the grid search CSV, NULL for the standard output. */
+    int profile;                /**< Print the per-phase profile once the run is done. */
+    char *traceOutput;          /**< Path of the Chrome trace written with the profile, NULL to skip it. */
+    int format;                 /**< OUTPUT_* format of the results. */
+    int predictions;            /**< Write one record per classified sample. */
+    char *confusionFile;        /**< File receiving the detailed confusion matrix, NULL to skip it. */
+    int pcaComponents;          /**< Principal components kept after the scaling, 0 for none or a variance threshold. */
+    double pcaVariance;         /**< Fraction of the variance kept by PCA when no component count is given, 0 for no PCA. */
+    int compression;            /**< COMPRESS_* method of the k-NN search, COMPRESS_NONE for the exact search. */
+    int codeSize;               /**< Projected dimensions or product quantization subspaces. */
+    int codebookSize;           /**< Centroids per product quantization subspace. */
+    int shortlist;              /**< Candidates re-ranked exactly by the compressed search. */
+    double decay;               /**< Smallest centroid step of online k-Means, 0 for MacQueen updates. */
+    int snapshotEvery;          /**< Samples between two online k-Means snapshots, 0 to snapshot only at the end. */
+    int resume;                 /**< Resume online k-Means from the snapshot at the model output path. */
+    int linkage;                /**< LINKAGE_* criterion of hierarchical clustering. */
+    double eps;                 /**< Neighborhood radius of DBSCAN. */
+    int minClusterSize;         /**< Smallest HDBSCAN cluster, 0 for the -k value. */
+    int pivots;                 /**< Pivots of the LAESA k-NN search, 0 for none. */
+    char *cacheDirectory;       /**< Directory of the on-disk distance matrix cache, NULL for no cache. */
+    int cacheSize;              /**< Size cap of the distance cache in megabytes, 0 for the default. */
+    int cachePrecision;         /**< Bits per cached distance, 32 or 64, 0 for 64. */
+    uint64_t seed;              /**< Seed of the random splits and folds. */
+    int stratify;               /**< Keep the class proportions in the training and test sets. */
+    int repeats;                /**< Random splits of repeated random subsampling, 0 for a single split. */
+    char *removeIds;            /**< File of reference set ids removed after the insertions, NULL for none. */
 } CommandLineOptions;
 
 // Function declarations
 void runKnn(const CommandLineOptions *options);
 void runKmeans(const CommandLineOptions *options);
+void runHierarchical(const CommandLineOptions *options);
+void runDensity(const CommandLineOptions *options);
+void runCrossValidation(const CommandLineOptions *options);
+void runLeaveOneOut(const CommandLineOptions *options);
+void runGrid(const CommandLineOptions *options);
+void runNearestCentroid(const CommandLineOptions *options);
+void runIncrementalKnn(const CommandLineOptions *options);
+void runOnlineKmeans(const CommandLineOptions *options);
+void runClassify(const CommandLineOptions *options);
 void parseOptions(int argc, char *argv[], CommandLineOptions *options);
 bool validateOptions(const CommandLineOptions *options);
 void runModel(const CommandLineOptions *options);
@@ -38,6 +100,7 @@ void printUsage(const char *program_name);
 
 int main(int argc, char *argv[]) {
     CommandLineOptions options = {0};
+    options.seed = SPLIT_DEFAULT_SEED;
 
     // Parse command line options
     parseOptions(argc, argv, &options);
@@ -48,8 +111,23 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     }
 
+    initOutput(options.format, options.predictions, options.confusionFile);
+    if (options.profile && profilerEnable(options.traceOutput != NULL) != PROFILER_SUCCESS) {
+        fprintf(stderr, "Failed to enable the profiler\n");
+        return EXIT_FAILURE;
+    }
+
     // Run the specified model (kNN or kMeans)
     runModel(&options);
+    finishOutput();
+
+    if (options.profile) {
+        profilerPrintSummary(stderr);
+        if (options.traceOutput && profilerWriteTrace(options.traceOutput) != PROFILER_SUCCESS) {
+            fprintf(stderr, "Failed to write the trace %s\n", options.traceOutput);
+            return EXIT_FAILURE;
+        }
+    }
 
     return EXIT_SUCCESS;
 }
@@ -62,8 +140,33 @@ int main(int argc, char *argv[]) {
  * @param options Pointer to CommandLineOptions to be filled.
  */
 void parseOptions(int argc, char *argv[], CommandLineOptions *options) {
+    // Long options only; their values do not collide with the short option characters
+    static const struct option longOptions[] = {
+        {"profile", optional_argument, NULL, 256},
+        {"format", required_argument, NULL, 257},
+        {"predictions", no_argument, NULL, 258},
+        {"confusion-file", required_argument, NULL, 259},
+        {"pca", required_argument, NULL, 260},
+        {"compress", required_argument, NULL, 261},
+        {"shortlist", required_argument, NULL, 262},
+        {"decay", required_argument, NULL, 263},
+        {"snapshot-every", required_argument, NULL, 264},
+        {"resume", no_argument, NULL, 265},
+        {"linkage", required_argument, NULL, 266},
+        {"eps", required_argument, NULL, 267},
+        {"min-cluster-size", required_argument, NULL, 268},
+        {"pivots", required_argument, NULL, 269},
+        {"distance-cache", required_argument, NULL, 270},
+        {"cache-size", required_argument, NULL, 271},
+        {"cache-precision", required_argument, NULL, 272},
+        {"seed", required_argument, NULL, 273},
+        {"stratify", no_argument, NULL, 274},
+        {"repeats", required_argument, NULL, 275},
+        {"remove-ids", required_argument, NULL, 276},
+        {NULL, 0, NULL, 0}
+    };
     int opt;
-    while ((opt = getopt(argc, argv, "d:e:f:m:p:k:l:")) != -1) {
+    while ((opt = getopt_long(argc, argv, "d:e:f:m:p:k:l:w:r:u:b:c:t:o:", longOptions, NULL)) != -1) {
         switch (opt) {
             case 'd':
                 options->directory = optarg;
@@ -79,6 +182,7 @@ void parseOptions(int argc, char *argv[], CommandLineOptions *options) {
                 break;
             case 'p':
                 options->p = atoi(optarg);
+                options->pList = optarg;
                 break;
             case 'k':
                 options->k = atoi(optarg);
@@ -90,6 +194,125 @@ void parseOptions(int argc, char *argv[], CommandLineOptions *options) {
                     options->preprocessing = "";
                 }
                 break;
+            case 'w':
+                options->modelOutput = optarg;
+                break;
+            case 'r':
+                options->modelInput = optarg;
+                break;
+            case 'u':
+                options->socketPath = optarg;
+                break;
+            case 'b':
+                options->batchSize = atoi(optarg);
+                break;
+            case 'c':
+                options->folds = atoi(optarg);
+                break;
+            case 't':
+                options->threads = atoi(optarg);
+                break;
+            case 'o':
+                options->output = optarg;
+                break;
+            case 256:
+                options->profile = 1;
+                options->traceOutput = optarg;
+                break;
+            case 257:
+                options->format = parseOutputFormat(optarg);
+                if (options->format < 0) {
+                    fprintf(stderr, "Unknown output format: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 258:
+                options->predictions = 1;
+                break;
+            case 259:
+                options->confusionFile = optarg;
+                break;
+            case 260:
+                // A fraction keeps enough components for that share of the variance, an integer keeps that many
+                if (strchr(optarg, '.')) {
+                    options->pcaVariance = atof(optarg);
+                } else {
+                    options->pcaComponents = atoi(optarg);
+                }
+                if (options->pcaVariance <= 0 && options->pcaComponents <= 0) {
+                    fprintf(stderr, "Invalid PCA setting: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 261: {
+                // <method>:<code size>[:<centroids per subspace>]
+                char method[8] = "";
+                options->codebookSize = PQ_MAX_CENTROIDS;
+                if (sscanf(optarg, "%7[^:]:%d:%d", method, &options->codeSize, &options->codebookSize) < 2 ||
+                    (options->compression = parseCompressionMethod(method)) < 0 || options->codeSize <= 0 ||
+                    options->codebookSize <= 0) {
+                    fprintf(stderr, "Invalid compression setting: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            }
+            case 262:
+                options->shortlist = atoi(optarg);
+                break;
+            case 263:
+                options->decay = atof(optarg);
+                break;
+            case 264:
+                options->snapshotEvery = atoi(optarg);
+                break;
+            case 265:
+                options->resume = 1;
+                break;
+            case 266:
+                options->linkage = parseLinkage(optarg);
+                if (options->linkage < 0) {
+                    fprintf(stderr, "Unknown linkage: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 267:
+                options->eps = atof(optarg);
+                break;
+            case 268:
+                options->minClusterSize = atoi(optarg);
+                break;
+            case 269:
+                options->pivots = atoi(optarg);
+                break;
+            case 270:
+                options->cacheDirectory = optarg;
+                break;
+            case 271:
+                options->cacheSize = atoi(optarg);
+                if (options->cacheSize <= 0) {
+                    fprintf(stderr, "Invalid distance cache size: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 272:
+                options->cachePrecision = atoi(optarg);
+                if (options->cachePrecision != 32 && options->cachePrecision != 64) {
+                    fprintf(stderr, "The distance cache precision must be 32 or 64: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 273:
+                options->seed = strtoull(optarg, NULL, 0);
+                break;
+            case 274:
+                options->stratify = 1;
+                break;
+            case 275:
+                options->repeats = atoi(optarg);
+                break;
+            case 276:
+                options->removeIds = optarg;
+                break;
             default:
                 printUsage(argv[0]);
                 exit(EXIT_FAILURE);
@@ -104,8 +327,63 @@ void parseOptions(int argc, char *argv[], CommandLineOptions *options) {
  * @return bool True if options are valid, false otherwise.
  */
 bool validateOptions(const CommandLineOptions *options) {
+    // Serving a saved model only needs the model and the socket
+    if (options->socketPath) {
+        return options->modelInput && options->batchSize >= 0;
+    }
+    // Classifying with a saved model only needs the data to classify, k is optional
+    if (options->modelInput) {
+        return options->directory && options->extension && options->k >= 0;
+    }
+    // The evaluations sharing one distance matrix would fit the projection on their test samples
+    bool sharedMatrix = options->folds != 0 || options->repeats != 0 ||
+                        (options->method && (strcmp(options->method, "knn_loo") == 0 ||
+                                             strcmp(options->method, "grid") == 0));
+    if (sharedMatrix && (options->pcaComponents > 0 || options->pcaVariance > 0)) {
+        fprintf(stderr, "--pca cannot be used with -c, --repeats, knn_loo or grid\n");
+        return false;
+    }
+    // Cross-validation uses the folds instead of the training fraction
+    if (options->folds != 0) {
+        return options->directory && options->extension && options->folds >= 2 && options->threads >= 0 &&
+               options->method && strcmp(options->method, "knn") == 0 &&
+               options->p > 0 && options->k > 0 && options->preprocessing;
+    }
+    // The grid search takes lists for the descriptors, p and preprocessing and the largest k
+    if (options->method && strcmp(options->method, "grid") == 0) {
+        return options->directory && options->extension && options->pList && options->k > 0 &&
+               options->preprocessing && options->threads >= 0;
+    }
+    // Online k-Means streams the whole dataset and snapshots to the model output
+    if (options->method && strcmp(options->method, "kmeans_online") == 0) {
+        return options->directory && options->extension && options->p > 0 && options->k > 0 &&
+               options->preprocessing && options->batchSize >= 0 && options->decay >= 0 && options->decay < 1 &&
+               options->snapshotEvery >= 0 && (!options->resume || options->modelOutput);
+    }
+    // Hierarchical clustering uses the whole dataset and sweeps k up to the given value
+    if (options->method && strcmp(options->method, "hierarchical") == 0) {
+        return options->directory && options->extension && options->p > 0 && options->k >= 2 && options->preprocessing;
+    }
+    // Density-based clustering uses the whole dataset; -k is the number of samples of a dense neighborhood
+    if (options->method && (strcmp(options->method, "dbscan") == 0 || strcmp(options->method, "hdbscan") == 0)) {
+        bool dbscanMode = strcmp(options->method, "dbscan") == 0;
+        int minClusterSize = options->minClusterSize > 0 ? options->minClusterSize : options->k;
+        return options->directory && options->extension && options->p > 0 && options->k > 0 && options->preprocessing &&
+               (dbscanMode ? options->eps > 0 : minClusterSize >= 2);
+    }
+    // Repeated random subsampling draws its splits with the training fraction
+    if (options->repeats != 0) {
+        return options->directory && options->extension && options->repeats >= 1 && options->threads >= 0 &&
+               options->trainingFraction > 0.0 && options->trainingFraction < 1.0 &&
+               options->method && strcmp(options->method, "knn") == 0 &&
+               options->p > 0 && options->k > 0 && options->preprocessing;
+    }
+    // Leave-one-out evaluates every sample against all the others, no training fraction
+    if (options->method && strcmp(options->method, "knn_loo") == 0) {
+        return options->directory && options->extension && options->p > 0 && options->k > 0 && options->preprocessing;
+    }
     if (!options->directory || !options->extension || options->trainingFraction <= 0.0 ||
-        !options->method || options->p <= 0 || options->k <= 0 || !options->preprocessing) {
+        options->trainingFraction > 1.0 || !options->method || options->p <= 0 || options->k <= 0 || !options->preprocessing || options->pivots < 0) {
         return false;
     }
     return true;
@@ -117,10 +395,34 @@ bool validateOptions(const CommandLineOptions *options) {
  * @param options Parsed and validated command line options.
  */
 void runModel(const CommandLineOptions *options) {
-    if (strcmp(options->method, "knn") == 0) {
+    if (options->socketPath) {
+        ServerConfig config = {options->socketPath, options->modelInput, options->batchSize, SERVER_DEFAULT_BATCH_WINDOW_US,
+                               options->threads};
+        if (runClassificationServer(&config) != SERVER_SUCCESS) {
+            exit(EXIT_FAILURE);
+        }
+    } else if (options->modelInput) {
+        runClassify(options);
+    } else if (strcmp(options->method, "knn") == 0 && (options->folds > 0 || options->repeats > 0)) {
+        runCrossValidation(options);
+    } else if (strcmp(options->method, "grid") == 0) {
+        runGrid(options);
+    } else if (strcmp(options->method, "knn_loo") == 0) {
+        runLeaveOneOut(options);
+    } else if (strcmp(options->method, "knn") == 0) {
         runKnn(options);
-    } else if (strcmp(options->method, "kmeans") == 0) {
+    } else if (strcmp(options->method, "knn_incremental") == 0) {
+        runIncrementalKnn(options);
+    } else if (strcmp(options->method, "kmeans") == 0 || strcmp(options->method, "kmedoids") == 0) {
         runKmeans(options);
+    } else if (strcmp(options->method, "hierarchical") == 0) {
+        runHierarchical(options);
+    } else if (strcmp(options->method, "dbscan") == 0 || strcmp(options->method, "hdbscan") == 0) {
+        runDensity(options);
+    } else if (strcmp(options->method, "kmeans_online") == 0) {
+        runOnlineKmeans(options);
+    } else if (strcmp(options->method, "nearest_centroid") == 0) {
+        runNearestCentroid(options);
     } else {
         fprintf(stderr, "Method not supported\n");
         exit(EXIT_FAILURE);
@@ -133,9 +435,184 @@ void runModel(const CommandLineOptions *options) {
  * @param program_name Name of the program.
  */
 void printUsage(const char *program_name) {
-    fprintf(stderr, "Usage: %s -d <directory> -e <file_extension> -f <training_fraction> -m <method> -p <p-value> -k <k-value> -l <pre-processing>\n", program_name);
+    fprintf(stderr, "Usage: %s -d <directory> -e <file_extension> -f <training_fraction> -m <method> -p <p-value> -k <k-value> -l <pre-processing> [-w <model_output>]\n", program_name);
+    fprintf(stderr, "       %s -d <directory> -e <file_extension> -c <folds> -m knn -p <p-value> -k <k-value> -l <pre-processing> [-t <threads>]\n", program_name);
+    fprintf(stderr, "       %s -d <directory> -e <file_extension> -f <training_fraction> --repeats=<splits> -m knn -p <p-value> -k <k-value> -l <pre-processing> [-t <threads>]\n", program_name);
+    fprintf(stderr, "       %s -d <directory> -e <file_extension> -m knn_loo -p <p-value> -k <max-k-value> -l <pre-processing>\n", program_name);
+    fprintf(stderr, "       %s -d <dir1,dir2,...> -e <ext1,ext2,...> -m grid -p <p1,p2,...> -k <max-k-value> -l <pre1,pre2,...> [-t <threads>] [-o <csv_output>]\n", program_name);
+    fprintf(stderr, "       %s -d <directory> -e <file_extension> -m kmeans_online -p <p-value> -k <k-value> -l <pre-processing> [-b <batch_size>] [--decay=<rate>] [-w <snapshot> [--snapshot-every=<samples>] [--resume]]\n", program_name);
+    fprintf(stderr, "       %s -d <directory> -e <file_extension> -m hierarchical -p <p-value> -k <max-k-value> -l <pre-processing> [--linkage=ward|average|complete|single] [-o <dendrogram_csv>] [-w <model_output>]\n", program_name);
+    fprintf(stderr, "       %s -d <directory> -e <file_extension> -m dbscan --eps=<radius> -p <p-value> -k <min-points> -l <pre-processing>\n", program_name);
+    fprintf(stderr, "       %s -d <directory> -e <file_extension> -m hdbscan -p <p-value> -k <min-points> -l <pre-processing> [--min-cluster-size=<samples>]\n", program_name);
+    fprintf(stderr, "       %s -r <model_input> -d <directory> -e <file_extension> [-k <k-value>]\n", program_name);
+    fprintf(stderr, "       %s -r <model_input> -u <socket_path> [-b <batch_size>] [-t <threads>]\n", program_name);
+    fprintf(stderr, "Any mode accepts --profile[=<trace.json>] to print per-phase timings and counters to stderr\n");
+    fprintf(stderr, "Results: --format=text|quiet|csv|json, --predictions for per-sample records, --confusion-file=<path>\n");
+    fprintf(stderr, "Training modes accept --pca=<components> or --pca=<variance fraction> to project the scaled features\n");
+    fprintf(stderr, "  (not -c, --repeats, knn_loo or grid, whose shared distance matrix would fit it on the test folds)\n");
+    fprintf(stderr, "k-NN accepts --compress=rp:<dims> or --compress=pq:<subspaces>[:<centroids>] with --shortlist=<candidates>\n");
+    fprintf(stderr, "k-NN accepts --pivots=<count> for an exact search pruned with pivot distances (LAESA), saved with -w\n");
+    fprintf(stderr, "-c, --repeats, knn_loo and grid fit the scaling on every sample, test folds included, to share one distance matrix,\n");
+    fprintf(stderr, "  so their scores are slightly optimistic with normalize or standardize\n");
+    fprintf(stderr, "knn, knn_loo, grid and cross-validation accept --distance-cache=<dir> [--cache-size=<MB>] [--cache-precision=32|64]\n");
+    fprintf(stderr, "Splits and folds are drawn with --seed=<n> (default %d); --stratify keeps the class proportions of -f splits\n", SPLIT_DEFAULT_SEED);
+    fprintf(stderr, "-m knn_incremental inserts the training split one sample at a time into an updatable reference set;\n");
+    fprintf(stderr, "  --remove-ids=<file> then removes the whitespace separated ids (training split positions) listed in the file\n");
+}
+
+/**
+ * @brief Fits the scaling selected on the command line and, with --pca, the projection after it.
+ *
+ * @param options The CommandLineOptions containing the settings for the run.
+ * @param data Samples to fit on, not yet transformed.
+ * @param dataSize Number of samples.
+ * @return PreprocessingParams Fitted parameters to pass to applyPreprocessing.
+ */
+static PreprocessingParams fitCommandLinePreprocessing(const CommandLineOptions *options, ShapeData *data,
+                                                       int dataSize) {
+    PreprocessingParams preprocessing = fitPreprocessing(data, dataSize, data->featureCount,
+                                                         parsePreprocessingMethod(options->preprocessing));
+    if (options->pcaComponents > 0 || options->pcaVariance > 0) {
+        int status = fitPca(&preprocessing, data, dataSize, options->pcaComponents, options->pcaVariance);
+        if (status != PCA_SUCCESS) {
+            fprintf(stderr, "Failed to fit PCA (error %d)\n", status);
+            exit(EXIT_FAILURE);
+        }
+        outputMessage("PCA keeps %d of %d features (%.2f%% of the variance)\n", preprocessing.components,
+                      preprocessing.featureCount, preprocessing.explainedVariance * 100);
+    }
+    return preprocessing;
+}
+
+/**
+ * @brief Splits the samples with the training fraction, seed and stratification of the command line.
+ *
+ * @param options The CommandLineOptions containing the settings for the run.
+ * @param shapes Samples to split.
+ * @param count Number of samples.
+ * @return The split, with at least one training sample; exits on failure.
+ */
+static SplitData splitCommandLineData(const CommandLineOptions *options, ShapeData *shapes, int count) {
+    SplitData split = splitData(shapes, count, options->trainingFraction, options->stratify, options->seed);
+    if (!split.trainingSet || split.trainingSize == 0) {
+        fprintf(stderr, "Failed to split the data: the training set is empty\n");
+        exit(EXIT_FAILURE);
+    }
+    return split;
+}
+
+/**
+ * @brief Opens the distance cache selected with --distance-cache.
+ *
+ * @param options The CommandLineOptions containing the settings for the run.
+ * @param cache Cache to initialize.
+ * @return The opened cache, or NULL when the run does not use one.
+ */
+static DistanceCache *openCommandLineCache(const CommandLineOptions *options, DistanceCache *cache) {
+    if (!options->cacheDirectory) {
+        return NULL;
+    }
+    uint64_t capacity = (uint64_t)(options->cacheSize > 0 ? options->cacheSize : DISTANCE_CACHE_DEFAULT_MB) << 20;
+    int precision = options->cachePrecision == 32 ? sizeof(float) : sizeof(double);
+    if (openDistanceCache(cache, options->cacheDirectory, capacity, precision) != DISTANCE_CACHE_SUCCESS) {
+        exit(EXIT_FAILURE);
+    }
+    return cache;
+}
+
+/**
+ * @brief Reports the hits and misses of a distance cache on stderr and closes it.
+ *
+ * Standard output is left to the results, which may be a CSV.
+ *
+ * @param cache Cache returned by openCommandLineCache, NULL for none.
+ */
+static void closeCommandLineCache(DistanceCache *cache) {
+    if (cache) {
+        fprintf(stderr, "Distance cache %s: %d hits, %d misses\n", cache->directory, cache->hits, cache->misses);
+        closeDistanceCache(cache);
+    }
+}
+
+/**
+ * @brief Classifies the test split with the compressed k-NN search and reports its cost and recall.
+ *
+ * @param options The CommandLineOptions containing the settings for the run.
+ * @param split Preprocessed training and test sets.
+ * @param featureCount Number of features after the preprocessing.
+ * @param cm Confusion matrix receiving the results.
+ * @param predictions Output array of predicted classes.
+ */
+static void classifyCompressed(const CommandLineOptions *options, const SplitData *split, int featureCount,
+                               ConfusionMatrix *cm, int *predictions) {
+    CompressedIndex index;
+    int status = buildCompressedIndex(&index, split->trainingSet, split->trainingSize, featureCount, options->p,
+                                      options->compression, options->codeSize, options->codebookSize,
+                                      RP_DEFAULT_SEED);
+    if (status != COMPRESSED_SUCCESS) {
+        fprintf(stderr, "Failed to build the compressed index (error %d)\n", status);
+        exit(EXIT_FAILURE);
+    }
+    int shortlist = options->shortlist > 0 ? options->shortlist : COMPRESSED_DEFAULT_SHORTLIST;
+
+    outputMessage("Applying compressed k-NN Classification (k = %d, %s, shortlist %d):\n", options->k,
+                  options->compression == COMPRESS_RANDOM_PROJECTION ? "random projection" : "product quantization",
+                  shortlist);
+    if (compressedClassifyBatch(&index, split->testSet, split->testSize, options->k, shortlist, cm,
+                                predictions) != COMPRESSED_SUCCESS) {
+        fprintf(stderr, "Failed to apply compressed k-NN classification\n");
+        exit(EXIT_FAILURE);
+    }
+    double recall = compressedRecallAtK(&index, split->testSet, split->testSize, options->k, shortlist);
+    outputMessage("Compressed samples use %zu bytes instead of %zu, recall@%d = %.4f\n",
+                  compressedBytesPerSample(&index), featureCount * sizeof(double), options->k, recall);
+    freeCompressedIndex(&index);
+}
+
+/**
+ * @brief Classifies the test split with the early-abandoning search instead of a distance matrix.
+ * @param options The CommandLineOptions containing the settings for the run.
+ * @param split Preprocessed training and test sets.
+ * @param featureCount Number of features after the preprocessing.
+ * @param cm Confusion matrix receiving the results.
+ * @param predictions Output array of predicted classes.
+ */
+static void classifyPartialDistance(const CommandLineOptions *options, const SplitData *split, int featureCount,
+                                    ConfusionMatrix *cm, int *predictions) {
+    PartialDistanceIndex index;
+    if (buildPartialDistanceIndex(&index, split->trainingSet, split->trainingSize, featureCount, options->p) !=
+        PARTIAL_DISTANCE_SUCCESS) {
+        fprintf(stderr, "Failed to build the partial distance index\n");
+        exit(EXIT_FAILURE);
+    }
+    outputMessage("Applying k-NN Classification (k = %d):\n", options->k);
+    if (partialDistanceClassifyBatch(&index, split->testSet, split->testSize, options->k, cm, predictions) !=
+        PARTIAL_DISTANCE_SUCCESS) {
+        fprintf(stderr, "Failed to apply k-NN classification\n");
+        exit(EXIT_FAILURE);
+    }
+    freePartialDistanceIndex(&index);
 }
 
+/**
+ * @brief Classifies the test split with the LAESA pivot index.
+ * @param options The CommandLineOptions containing the settings for the run.
+ * @param index Pivot index built on the preprocessed training set.
+ * @param split Preprocessed training and test sets.
+ * @param cm Confusion matrix receiving the results.
+ * @param predictions Output array of predicted classes.
+ */
+static void classifyLaesa(const CommandLineOptions *options, const LaesaIndex *index, const SplitData *split,
+                          ConfusionMatrix *cm, int *predictions) {
+    outputMessage("Applying k-NN Classification (k = %d, LAESA with %d pivots):\n", options->k, index->pivotCount);
+    double avoided;
+    if (laesaClassifyBatch(index, split->testSet, split->testSize, options->k, cm, predictions, &avoided) !=
+        LAESA_SUCCESS) {
+        fprintf(stderr, "Failed to apply LAESA k-NN classification\n");
+        exit(EXIT_FAILURE);
+    }
+    outputMessage("Pivot bounds avoided %.2f%% of the distance evaluations\n", 100.0 * avoided);
+}
 
 /**
  * @brief Runs the k-NN algorithm based on the provided command line options.
@@ -156,50 +633,83 @@ void runKnn(const CommandLineOptions *options) {
         exit(EXIT_FAILURE);
     }
 
-    // Normalize or standardize data if required
-    if (strcmp(options->method, "normalize") == 0) {
-        normalizeData(shapes, count, shapes->featureCount);
-    } else if (strcmp(options->method, "standardize") == 0) {
-        standardizeData(shapes, count, shapes->featureCount);
-    }
-
     // Split data into training and test sets
-    SplitData split = splitData(shapes, count, options->trainingFraction);
+    SplitData split = splitCommandLineData(options, shapes, count);
 
-    // Precompute distances
-    double **distances = precomputeDistances(split.trainingSet, split.trainingSize, split.testSet, split.testSize, shapes->featureCount, options->p);
+    // Normalize or standardize data if required, fitting on the training set only
+    PreprocessingParams preprocessing = fitCommandLinePreprocessing(options, split.trainingSet, split.trainingSize);
+    applyPreprocessing(&preprocessing, split.trainingSet, split.trainingSize);
+    applyPreprocessing(&preprocessing, split.testSet, split.testSize);
+    int featureCount = preprocessedFeatureCount(&preprocessing);
 
-    if (!distances) {
-        fprintf(stderr, "Failed to precompute distances\n");
+    // Build the pivot index first, so that a saved model stores it
+    LaesaIndex pivotIndex = {0};
+    if (options->pivots > 0 && buildLaesaIndex(&pivotIndex, split.trainingSet, split.trainingSize, featureCount,
+                                               options->p, options->pivots) != LAESA_SUCCESS) {
+        fprintf(stderr, "Failed to build the LAESA index\n");
         exit(EXIT_FAILURE);
     }
 
-    // Apply k-NN classification
-    printf("Applying k-NN Classification (k = %d):\n", options->k);
+    // Save the trained model if requested
+    if (options->modelOutput) {
+        int status = options->pivots > 0
+                         ? saveLaesaModel(options->modelOutput, &pivotIndex, options->k, &preprocessing)
+                         : saveKnnModel(options->modelOutput, split.trainingSet, split.trainingSize, featureCount,
+                                        options->p, options->k, &preprocessing);
+        if (status != MODEL_SUCCESS) {
+            fprintf(stderr, "Failed to save model %s: %s\n", options->modelOutput, modelErrorString(status));
+            exit(EXIT_FAILURE);
+        }
+    }
 
     // Create a confusion matrix
-    int classCount = 9;
+    int classCount = countClasses(shapes, count);
     ConfusionMatrix cm = createConfusionMatrix(classCount);
-
     int *predictedClasses = malloc(split.testSize * sizeof(int)); // Store predicted classes
+    if (!predictedClasses && split.testSize > 0) {
+        fprintf(stderr, "Failed to apply k-NN classification\n");
+        exit(EXIT_FAILURE);
+    }
 
+    // A cached table is cheaper than any search, so it takes precedence over early abandoning
+    DistanceCache cacheStorage;
+    DistanceCache *distanceCache = openCommandLineCache(options, &cacheStorage);
+    DistanceTable distances = {0};
+    if (options->compression != COMPRESS_NONE) {
+        classifyCompressed(options, &split, featureCount, &cm, predictedClasses);
+    } else if (options->pivots > 0) {
+        classifyLaesa(options, &pivotIndex, &split, &cm, predictedClasses);
+    } else if (options->p >= PARTIAL_DISTANCE_MIN_P && !distanceCache) {
+        classifyPartialDistance(options, &split, featureCount, &cm, predictedClasses);
+    } else {
+        // Precompute distances, or map them from the cache
+        if (cachedDistanceTable(distanceCache, &distances, split.trainingSet, split.trainingSize, split.testSet,
+                                split.testSize, featureCount, options->p) != DISTANCE_CACHE_SUCCESS) {
+            fprintf(stderr, "Failed to precompute distances\n");
+            exit(EXIT_FAILURE);
+        }
+
+        // Apply k-NN classification
+        outputMessage("Applying k-NN Classification (k = %d):\n", options->k);
+        if (knnClassifyBatch(distances.values, split.trainingSet, split.trainingSize, split.testSet, split.testSize,
+                             options->k, &cm, predictedClasses) != KNN_SUCCESS) {
+            fprintf(stderr, "Failed to apply k-NN classification\n");
+            exit(EXIT_FAILURE);
+        }
+    }
     for (int i = 0; i < split.testSize; i++) {
-        int predictedClass = knnClassify(distances, i, split.trainingSet, split.trainingSize, options->k);
-        int actualClass = split.testSet[i].class;
-        updateConfusionMatrix(&cm, actualClass, predictedClass);
-        printf("Test Sample %d predicted as class %d (Actual Class: %d)\n", i, predictedClass, split.testSet[i].class);
-        //printMatrix(cm);
+        outputPrediction(i, split.testSet[i].class, predictedClasses[i]);
     }
 
-    printDetailedConfusionMatrix(cm);
+    outputConfusionMatrix(&cm, "test");
 
     // Free the allocated resources
-    for (int i = 0; i < split.testSize; i++) {
-        free(distances[i]);
-    }
-    free(distances);
+    freeDistanceTable(&distances);
+    closeCommandLineCache(distanceCache);
     free(predictedClasses);
+    freeLaesaIndex(&pivotIndex);
     freeConfusionMatrix(&cm);
+    freePreprocessingParams(&preprocessing);
     freeShapeData(shapes, count);
     free(split.trainingSet);
     free(split.testSet);
@@ -207,33 +717,198 @@ void runKnn(const CommandLineOptions *options) {
 
 
 
-void knnModelFunction(SplitData split) {
-    // Precompute distances for the current fold
-    double **distances = precomputeDistances(split.trainingSet, split.trainingSize, split.testSet, split.testSize, split.trainingSet->featureCount, 2);
+/**
+ * @brief Runs stratified k-fold cross-validation of k-NN, or repeated random subsampling with --repeats.
+ *
+ * The preprocessing is fitted on the whole dataset and the pairwise distances are
+ * computed once; every fold or split then only looks up the rows of its test samples.
+ *
+ * @param options The CommandLineOptions containing the settings for the run.
+ */
+void runCrossValidation(const CommandLineOptions *options) {
+    int count;
+    ShapeData *shapes = readAllFiles(options->directory, options->extension, &count);
+    if (!shapes) {
+        fprintf(stderr, "Failed to read files\n");
+        exit(EXIT_FAILURE);
+    }
+    // Every vote must see k training samples, or the sample would drop out of the metrics
+    if (options->repeats == 0 && options->folds <= count &&
+        options->k >= smallestFoldTrainingSize(count, options->folds)) {
+        fprintf(stderr, "k must be smaller than the training size of every fold (%d)\n",
+                smallestFoldTrainingSize(count, options->folds));
+        exit(EXIT_FAILURE);
+    }
+
+    PreprocessingParams preprocessing = fitCommandLinePreprocessing(options, shapes, count);
+    applyPreprocessing(&preprocessing, shapes, count);
 
-    if (!distances) {
-        fprintf(stderr, "Failed to precompute distances\n");
-        return;
+    DistanceCache cacheStorage;
+    DistanceCache *distanceCache = openCommandLineCache(options, &cacheStorage);
+    DistanceMatrix distances = cachedDistanceMatrix(distanceCache, shapes, count, shapes->featureCount, options->p);
+    if (!distances.values) {
+        fprintf(stderr, "Failed to compute the distance matrix\n");
+        exit(EXIT_FAILURE);
     }
 
-    int classCount = 9;
-    ConfusionMatrix cm = createConfusionMatrix(classCount);
+    int classCount = countClasses(shapes, count);
+    KnnModelArgs modelArgs = {&distances, options->k};
+    CrossValidationMetrics metrics;
+    int status;
+    if (options->repeats > 0) {
+        outputMessage("Applying repeated random subsampling of k-NN (k = %d, %d splits, %.0f%% training%s):\n",
+                      options->k, options->repeats, options->trainingFraction * 100.0,
+                      options->stratify ? ", stratified" : "");
+        status = repeatedSubsampling(shapes, count, options->repeats, options->trainingFraction, options->stratify,
+                                     classCount, knnModelFunction, &modelArgs, options->threads, options->seed,
+                                     &metrics);
+    } else {
+        outputMessage("Applying %d-fold cross-validation of k-NN (k = %d):\n", options->folds, options->k);
+        status = crossValidation(shapes, count, options->folds, classCount, knnModelFunction, &modelArgs,
+                                 options->threads, options->seed, &metrics);
+    }
+    if (status != CV_SUCCESS) {
+        fprintf(stderr, "Cross-validation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    if (outputFormat() == OUTPUT_TEXT) {
+        printCrossValidationMetrics(&metrics);
+    } else {
+        char label[32];
+        for (int f = 0; f < metrics.foldsProcessed; f++) {
+            snprintf(label, sizeof(label), options->repeats > 0 ? "split %d" : "fold %d", f + 1);
+            outputMetrics(label, &metrics.foldMetrics[f]);
+        }
+        outputMetrics("mean", &metrics.mean);
+        outputMetrics("stddev", &metrics.stdDev);
+    }
 
-    for (int i = 0; i < split.testSize; i++) {
-        // Use the existing knnClassify function that utilizes precomputed distances
-        int predictedClass = knnClassify(distances, i, split.trainingSet, split.trainingSize, 5);
+    freeCrossValidationMetrics(&metrics);
+    freeDistanceMatrix(&distances);
+    closeCommandLineCache(distanceCache);
+    freePreprocessingParams(&preprocessing);
+    freeShapeData(shapes, count);
+}
 
-        updateConfusionMatrix(&cm, split.testSet[i].class, predictedClass);
+/**
+ * @brief Runs leave-one-out evaluation of k-NN for every k from 1 to the given k.
+ *
+ * The pairwise distances are computed once and every sample is classified against
+ * all the others, so the whole range of k costs a single neighbor selection per sample.
+ *
+ * @param options The CommandLineOptions containing the settings for the run.
+ */
+void runLeaveOneOut(const CommandLineOptions *options) {
+    int count;
+    ShapeData *shapes = readAllFiles(options->directory, options->extension, &count);
+    if (!shapes) {
+        fprintf(stderr, "Failed to read files\n");
+        exit(EXIT_FAILURE);
+    }
+    if (options->k >= count) {
+        fprintf(stderr, "k must be smaller than the number of samples (%d)\n", count);
+        exit(EXIT_FAILURE);
     }
 
-    printDetailedConfusionMatrix(cm);
+    PreprocessingParams preprocessing = fitCommandLinePreprocessing(options, shapes, count);
+    applyPreprocessing(&preprocessing, shapes, count);
 
-    // Free the resources used by the confusion matrix and distances
-    freeConfusionMatrix(&cm);
-    for (int i = 0; i < split.testSize; i++) {
-        free(distances[i]);
+    DistanceCache cacheStorage;
+    DistanceCache *distanceCache = openCommandLineCache(options, &cacheStorage);
+    DistanceMatrix distances = cachedDistanceMatrix(distanceCache, shapes, count, shapes->featureCount, options->p);
+    if (!distances.values) {
+        fprintf(stderr, "Failed to compute the distance matrix\n");
+        exit(EXIT_FAILURE);
+    }
+
+    outputMessage("Applying leave-one-out evaluation of k-NN (k = 1..%d):\n", options->k);
+    int classCount = countClasses(shapes, count);
+    LeaveOneOutResult result;
+    if (leaveOneOutKnn(shapes, count, &distances, options->k, classCount, &result) != LOO_SUCCESS) {
+        fprintf(stderr, "Leave-one-out evaluation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    if (outputFormat() == OUTPUT_TEXT) {
+        printLeaveOneOutResult(&result);
+    } else {
+        char label[32];
+        for (int k = 1; k <= result.kMax; k++) {
+            snprintf(label, sizeof(label), "k=%d", k);
+            outputConfusionMatrix(&result.matrices[k - 1], label);
+        }
     }
-    free(distances);
+
+    freeLeaveOneOutResult(&result);
+    freeDistanceMatrix(&distances);
+    closeCommandLineCache(distanceCache);
+    freePreprocessingParams(&preprocessing);
+    freeShapeData(shapes, count);
+}
+
+/**
+ * @brief Runs the k-NN grid search over descriptors, p values, preprocessing methods and k.
+ *
+ * The descriptor directories and extensions are matched by position, every cell of the
+ * grid is evaluated with leave-one-out and the results are written as one CSV.
+ *
+ * @param options The CommandLineOptions containing the settings for the run.
+ */
+void runGrid(const CommandLineOptions *options) {
+    int directoryCount, extensionCount, pCount, preprocessingCount;
+    char **directories = splitGridList(options->directory, &directoryCount);
+    char **extensions = splitGridList(options->extension, &extensionCount);
+    char **pItems = splitGridList(options->pList, &pCount);
+    char **preprocessingItems = splitGridList(options->preprocessing, &preprocessingCount);
+    GridDescriptor *descriptors = malloc(directoryCount * sizeof(GridDescriptor));
+    int *pValues = malloc(pCount * sizeof(int));
+    int *methods = malloc(preprocessingCount * sizeof(int));
+    if (!directories || !extensions || !pItems || !preprocessingItems || !descriptors || !pValues || !methods) {
+        fprintf(stderr, "Memory allocation failed for the grid\n");
+        exit(EXIT_FAILURE);
+    }
+    if (directoryCount != extensionCount) {
+        fprintf(stderr, "The grid needs one extension per directory (%d directories, %d extensions)\n",
+                directoryCount, extensionCount);
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < directoryCount; i++) {
+        descriptors[i] = (GridDescriptor){directories[i], extensions[i]};
+    }
+    for (int i = 0; i < pCount; i++) {
+        pValues[i] = atoi(pItems[i]);
+    }
+    for (int i = 0; i < preprocessingCount; i++) {
+        methods[i] = parsePreprocessingMethod(preprocessingItems[i]);
+    }
+
+    FILE *output = options->output ? fopen(options->output, "w") : stdout;
+    if (!output) {
+        perror("Failed to open the grid output");
+        exit(EXIT_FAILURE);
+    }
+
+    DistanceCache cacheStorage;
+    DistanceCache *distanceCache = openCommandLineCache(options, &cacheStorage);
+    GridSearchConfig config = {descriptors, directoryCount, pValues, pCount, methods, preprocessingCount,
+                               options->k, options->threads, distanceCache};
+    int status = runGridSearch(&config, output);
+    closeCommandLineCache(distanceCache);
+    if (options->output) {
+        fclose(output);
+    }
+    if (status != GRID_SUCCESS) {
+        fprintf(stderr, "Grid search failed (error %d)\n", status);
+        exit(EXIT_FAILURE);
+    }
+
+    free(methods);
+    free(pValues);
+    free(descriptors);
+    freeGridList(preprocessingItems, preprocessingCount);
+    freeGridList(pItems, pCount);
+    freeGridList(extensions, extensionCount);
+    freeGridList(directories, directoryCount);
 }
 
 /**
@@ -241,7 +916,8 @@ void knnModelFunction(SplitData split) {
  * 
  * This function reads data files, preprocesses the data, applies k-Means clustering,
  * prints the clustering results, evaluates the clustering performance using different metrics,
- * and frees allocated resources.
+ * and frees allocated resources. With -m kmedoids the clusters are built around k medoids
+ * instead, which minimizes the Minkowski deviation for any p.
  *
  * @param options The CommandLineOptions containing the settings for the run.
  */
@@ -253,29 +929,40 @@ void runKmeans(const CommandLineOptions *options) {
         exit(EXIT_FAILURE);
     }
 
-    if (strcmp(options->preprocessing, "normalize") == 0) {
-        normalizeData(shapes, count, shapes->featureCount);
-    } else if (strcmp(options->preprocessing, "standardize") == 0) {
-        standardizeData(shapes, count, shapes->featureCount);
-    }
+    PreprocessingParams preprocessing = fitCommandLinePreprocessing(options, shapes, count);
+    applyPreprocessing(&preprocessing, shapes, count);
 
+    bool medoids = strcmp(options->method, "kmedoids") == 0;
     int maxIterations = 100; 
-    Cluster *clusters = kmeans(shapes, count, options->k, options->p, shapes->featureCount, maxIterations);
+    double deviation = 0;
+    Cluster *clusters = medoids ? kmedoids(shapes, count, options->k, options->p, shapes->featureCount,
+                                           KMEDOIDS_DEFAULT_SEED, &deviation)
+                                : kmeans(shapes, count, options->k, options->p, shapes->featureCount, maxIterations);
 
     if (!clusters) {
-        fprintf(stderr, "Failed to perform k-means clustering\n");
+        fprintf(stderr, "Failed to perform %s clustering\n", medoids ? "k-medoids" : "k-means");
         exit(EXIT_FAILURE);
     }
 
-    // Printing the classes of points in each cluster
-    printf("k-Means Clustering Results (k = %d):\n", options->k);
+    // Save the trained model if requested
+    if (options->modelOutput) {
+        int status = saveKmeansModel(options->modelOutput, clusters, options->k, shapes->featureCount,
+                                     options->p, &preprocessing);
+        if (status != MODEL_SUCCESS) {
+            fprintf(stderr, "Failed to save model %s: %s\n", options->modelOutput, modelErrorString(status));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // The classes of the points in each cluster are only listed with --predictions
+    outputMessage("%s Clustering Results (k = %d):\n", medoids ? "k-Medoids" : "k-Means", options->k);
+    if (medoids) {
+        outputMessage("Total deviation (sum of L%d distances to the medoids): %f\n", options->p, deviation);
+    }
     for (int i = 0; i < options->k; i++) {
-        printf("Cluster %d:\n", clusters[i].clusterClass);
-        printf("  Classes in Cluster:\n");
         for (int j = 0; j < clusters[i].size; j++) {
-            printf("    Point %d: Class %d\n", j + 1, clusters[i].points[j].class);
+            outputClusterMember(i, clusters[i].clusterClass, j, clusters[i].points[j].class);
         }
-        printf("\n");
     }
 
      // Calculate the global centroid for BCSS
@@ -286,9 +973,7 @@ void runKmeans(const CommandLineOptions *options) {
     double wcss = withinClusterSumOfSquares(clusters, options->k, shapes->featureCount);
     double bcss = betweenClusterSumOfSquares(clusters, options->k, shapes->featureCount, &globalCentroid, count);
 
-    printf("Silhouette Score: %f\n", silhouette);
-    printf("Within-Cluster Sum of Squares: %f\n", wcss);
-    printf("Between-Cluster Sum of Squares: %f\n", bcss);
+    outputClustering(options->k, silhouette, wcss, bcss);
 
     // Free resources
     free(globalCentroid.features);
@@ -300,5 +985,716 @@ void runKmeans(const CommandLineOptions *options) {
         free(clusters[i].points);
     }
     free(clusters);
+    freePreprocessingParams(&preprocessing);
+    freeShapeData(shapes, count);
+}
+
+
+/**
+ * @brief Builds the dendrogram of the dataset and evaluates its cuts for every k up to -k.
+ *
+ * The nearest-neighbor chain clusters the samples once; each cut then costs O(n), so
+ * the scores of every k come from a single clustering. The members of the clusters are
+ * listed for the largest k, whose clusters are also the ones saved with -w, and -o
+ * writes the merges as a linkage matrix.
+ *
+ * @param options The CommandLineOptions containing the settings for the run.
+ */
+void runHierarchical(const CommandLineOptions *options) {
+    int count;
+    ShapeData *shapes = readAllFiles(options->directory, options->extension, &count);
+    if (!shapes) {
+        fprintf(stderr, "Failed to read files\n");
+        exit(EXIT_FAILURE);
+    }
+    if (options->k > count) {
+        fprintf(stderr, "k cannot exceed the %d samples\n", count);
+        exit(EXIT_FAILURE);
+    }
+
+    PreprocessingParams preprocessing = fitCommandLinePreprocessing(options, shapes, count);
+    applyPreprocessing(&preprocessing, shapes, count);
+    int featureCount = shapes->featureCount;
+
+    Dendrogram dendrogram;
+    if (hierarchicalClustering(shapes, count, featureCount, options->p, options->linkage, &dendrogram) !=
+        HIERARCHICAL_SUCCESS) {
+        fprintf(stderr, "Failed to perform hierarchical clustering\n");
+        exit(EXIT_FAILURE);
+    }
+    if (options->output && writeDendrogram(options->output, &dendrogram) != HIERARCHICAL_SUCCESS) {
+        exit(EXIT_FAILURE);
+    }
+
+    outputMessage("Hierarchical Clustering Results (%s linkage, k = 2 to %d):\n", linkageName(options->linkage),
+                  options->k);
+    ShapeData globalCentroid = calculateGlobalCentroid(shapes, count, featureCount);
+    for (int k = 2; k <= options->k; k++) {
+        Cluster *clusters = dendrogramClusters(&dendrogram, shapes, k, featureCount);
+        if (!clusters) {
+            fprintf(stderr, "Failed to cut the dendrogram into %d clusters\n", k);
+            exit(EXIT_FAILURE);
+        }
+        // The lowest merge the cut undoes bounds the height the tree is cut at
+        outputMessage("\nk = %d (cut below height %f):\n", k, dendrogram.merges[count - k].height);
+
+        if (k == options->k) {
+            if (options->modelOutput) {
+                int status = saveKmeansModel(options->modelOutput, clusters, k, featureCount, options->p,
+                                             &preprocessing);
+                if (status != MODEL_SUCCESS) {
+                    fprintf(stderr, "Failed to save model %s: %s\n", options->modelOutput, modelErrorString(status));
+                    exit(EXIT_FAILURE);
+                }
+            }
+            for (int i = 0; i < k; i++) {
+                for (int j = 0; j < clusters[i].size; j++) {
+                    outputClusterMember(i, clusters[i].clusterClass, j, clusters[i].points[j].class);
+                }
+            }
+        }
+
+        double silhouette = silhouetteScore(clusters, k, featureCount);
+        double wcss = withinClusterSumOfSquares(clusters, k, featureCount);
+        double bcss = betweenClusterSumOfSquares(clusters, k, featureCount, &globalCentroid, count);
+        outputClustering(k, silhouette, wcss, bcss);
+
+        for (int i = 0; i < k; i++) {
+            free(clusters[i].centroid->features);
+            free(clusters[i].centroid);
+            free(clusters[i].points);
+        }
+        free(clusters);
+    }
+
+    free(globalCentroid.features);
+    freeDendrogram(&dendrogram);
+    freePreprocessingParams(&preprocessing);
     freeShapeData(shapes, count);
-}
\ No newline at end of file
+}
+
+
+/**
+ * @brief Clusters the dataset with DBSCAN or HDBSCAN and evaluates the clusters found.
+ *
+ * -k is the number of samples, the point itself included, that makes a neighborhood
+ * dense. The noise points are listed as cluster -1 with --predictions and left out of
+ * the scores, which are computed over the clustered samples only.
+ *
+ * @param options The CommandLineOptions containing the settings for the run.
+ */
+void runDensity(const CommandLineOptions *options) {
+    int count;
+    ShapeData *shapes = readAllFiles(options->directory, options->extension, &count);
+    if (!shapes) {
+        fprintf(stderr, "Failed to read files\n");
+        exit(EXIT_FAILURE);
+    }
+
+    PreprocessingParams preprocessing = fitCommandLinePreprocessing(options, shapes, count);
+    applyPreprocessing(&preprocessing, shapes, count);
+    int featureCount = shapes->featureCount;
+
+    bool hierarchical = strcmp(options->method, "hdbscan") == 0;
+    int minClusterSize = options->minClusterSize > 0 ? options->minClusterSize : options->k;
+    int *labels = malloc(count * sizeof(int));
+    if (!labels) {
+        fprintf(stderr, "Memory allocation failed for the cluster labels\n");
+        exit(EXIT_FAILURE);
+    }
+    int clusterCount = hierarchical ? hdbscan(shapes, count, featureCount, options->p, options->k, minClusterSize, labels)
+                                    : dbscan(shapes, count, featureCount, options->p, options->eps, options->k, labels);
+    if (clusterCount < 0) {
+        fprintf(stderr, "Failed to perform %s clustering\n", hierarchical ? "HDBSCAN" : "DBSCAN");
+        exit(EXIT_FAILURE);
+    }
+
+    // The clustered samples are gathered for the global centroid of the BCSS
+    ShapeData *clustered = malloc(count * sizeof(ShapeData));
+    if (!clustered) {
+        fprintf(stderr, "Memory allocation failed for the clustered samples\n");
+        exit(EXIT_FAILURE);
+    }
+    int clusteredCount = 0;
+    for (int i = 0; i < count; i++) {
+        if (labels[i] != DENSITY_NOISE) {
+            clustered[clusteredCount++] = shapes[i];
+        }
+    }
+    outputMessage("%s Clustering Results: %d clusters, %d noise points out of %d samples\n",
+                  hierarchical ? "HDBSCAN" : "DBSCAN", clusterCount, count - clusteredCount, count);
+
+    if (clusterCount > 0) {
+        Cluster *clusters = meanCentroidClusters(shapes, count, clusterCount, featureCount, labels);
+        if (!clusters) {
+            fprintf(stderr, "Failed to gather the clusters\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < clusterCount; i++) {
+            for (int j = 0; j < clusters[i].size; j++) {
+                outputClusterMember(i, clusters[i].clusterClass, j, clusters[i].points[j].class);
+            }
+        }
+        for (int i = 0, j = 0; i < count; i++) {
+            if (labels[i] == DENSITY_NOISE) {
+                outputClusterMember(DENSITY_NOISE, DENSITY_NOISE, j++, shapes[i].class);
+            }
+        }
+
+        // A single cluster has no other cluster to be separated from
+        ShapeData globalCentroid = calculateGlobalCentroid(clustered, clusteredCount, featureCount);
+        double silhouette = clusterCount > 1 ? silhouetteScore(clusters, clusterCount, featureCount) : 0.0;
+        double wcss = withinClusterSumOfSquares(clusters, clusterCount, featureCount);
+        double bcss = betweenClusterSumOfSquares(clusters, clusterCount, featureCount, &globalCentroid, clusteredCount);
+        outputClustering(clusterCount, silhouette, wcss, bcss);
+
+        free(globalCentroid.features);
+        for (int i = 0; i < clusterCount; i++) {
+            free(clusters[i].centroid->features);
+            free(clusters[i].centroid);
+            free(clusters[i].points);
+        }
+        free(clusters);
+    }
+
+    free(clustered);
+    free(labels);
+    freePreprocessingParams(&preprocessing);
+    freeShapeData(shapes, count);
+}
+
+
+/**
+ * @brief Runs k-Means on the training split and classifies the test split by nearest centroid.
+ *
+ * Each test sample gets the majority class of the cluster whose centroid is closest,
+ * which costs O(k * featureCount) per sample instead of a pass over the whole training set.
+ *
+ * @param options The CommandLineOptions containing the settings for the run.
+ */
+void runNearestCentroid(const CommandLineOptions *options) {
+    int count;
+    ShapeData *shapes = readAllFiles(options->directory, options->extension, &count);
+    if (!shapes) {
+        fprintf(stderr, "Failed to read files\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Split, then fit the preprocessing on the training set only
+    SplitData split = splitCommandLineData(options, shapes, count);
+    PreprocessingParams preprocessing = fitCommandLinePreprocessing(options, split.trainingSet, split.trainingSize);
+    applyPreprocessing(&preprocessing, split.trainingSet, split.trainingSize);
+    applyPreprocessing(&preprocessing, split.testSet, split.testSize);
+    int featureCount = preprocessedFeatureCount(&preprocessing);
+
+    int maxIterations = 100;
+    Cluster *clusters = kmeans(split.trainingSet, split.trainingSize, options->k, options->p, featureCount, maxIterations);
+    if (!clusters) {
+        fprintf(stderr, "Failed to perform k-means clustering\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (options->modelOutput) {
+        int status = saveKmeansModel(options->modelOutput, clusters, options->k, featureCount, options->p, &preprocessing);
+        if (status != MODEL_SUCCESS) {
+            fprintf(stderr, "Failed to save model %s: %s\n", options->modelOutput, modelErrorString(status));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    double *centroids = malloc((size_t)options->k * featureCount * sizeof(double));
+    int *clusterClasses = malloc(options->k * sizeof(int));
+    int *predictions = malloc(split.testSize * sizeof(int));
+    if (!centroids || !clusterClasses || (!predictions && split.testSize > 0)) {
+        fprintf(stderr, "Memory allocation failed for nearest centroid classification\n");
+        exit(EXIT_FAILURE);
+    }
+    extractCentroids(clusters, options->k, featureCount, centroids, clusterClasses);
+    nearestCentroidClassify(centroids, clusterClasses, options->k, split.testSet, split.testSize, featureCount,
+                            options->p, predictions);
+
+    outputMessage("Applying nearest centroid classification (k = %d):\n", options->k);
+    int classCount = countClasses(shapes, count);
+    ConfusionMatrix cm = createConfusionMatrix(classCount);
+    for (int i = 0; i < split.testSize; i++) {
+        updateConfusionMatrix(&cm, split.testSet[i].class, predictions[i]);
+        outputPrediction(i, split.testSet[i].class, predictions[i]);
+    }
+    outputConfusionMatrix(&cm, "test");
+
+    // Free resources
+    freeConfusionMatrix(&cm);
+    free(predictions);
+    free(clusterClasses);
+    free(centroids);
+    for (int i = 0; i < options->k; i++) {
+        free(clusters[i].centroid->features);
+        free(clusters[i].centroid);
+        free(clusters[i].points);
+    }
+    free(clusters);
+    freePreprocessingParams(&preprocessing);
+    freeSplitData(&split);
+    freeShapeData(shapes, count);
+}
+
+
+/**
+ * @brief Returns the elapsed time in milliseconds between two timestamps.
+ * @param start Start timestamp.
+ * @param end End timestamp.
+ * @return double Elapsed milliseconds.
+ */
+static double elapsedMilliseconds(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+
+/**
+ * @brief Classifies query samples with a saved k-NN model.
+ * @param options Parsed command line options, k overrides the model's k when set.
+ * @param queries Query samples, already preprocessed with the model parameters.
+ * @param queryCount Number of query samples.
+ * @param model Loaded k-NN model.
+ */
+static void classifyWithKnnModel(const CommandLineOptions *options, ShapeData *queries, int queryCount, KnnModel *model) {
+    int k = options->k > 0 ? options->k : model->k;
+    KnnBatchClassifier classifier;
+    if (createKnnBatchClassifier(&classifier, model->trainingSet, model->trainingSize, model->featureCount, model->p,
+                                 options->threads) != KNN_BATCH_SUCCESS) {
+        fprintf(stderr, "Failed to create the batch classifier\n");
+        exit(EXIT_FAILURE);
+    }
+    LaesaIndex pivotIndex = {0};
+    if (model->indexType == MODEL_INDEX_LAESA) {
+        if (restoreLaesaIndex(&pivotIndex, model) != LAESA_SUCCESS) {
+            exit(EXIT_FAILURE);
+        }
+        knnBatchAttachIndex(&classifier, &pivotIndex, laesaSearch);
+    }
+
+    // The batch API takes the queries as one row-major matrix
+    double *queryMatrix = malloc((size_t)queryCount * model->featureCount * sizeof(double));
+    int *predictions = malloc(queryCount * sizeof(int));
+    if (!queryMatrix || !predictions) {
+        fprintf(stderr, "Memory allocation failed for the queries\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < queryCount; i++) {
+        memcpy(queryMatrix + (size_t)i * model->featureCount, queries[i].features, model->featureCount * sizeof(double));
+    }
+
+    outputMessage("Applying k-NN Classification (k = %d):\n", k);
+    if (knnBatchClassify(&classifier, queryMatrix, queryCount, model->featureCount, k, KNN_SEARCH_AUTO, predictions,
+                         NULL, NULL) != KNN_BATCH_SUCCESS) {
+        fprintf(stderr, "Failed to apply k-NN classification\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int classCount = countClasses(queries, queryCount);
+    int modelClassCount = countClasses(model->trainingSet, model->trainingSize);
+    ConfusionMatrix cm = createConfusionMatrix(modelClassCount > classCount ? modelClassCount : classCount);
+    for (int i = 0; i < queryCount; i++) {
+        updateConfusionMatrix(&cm, queries[i].class, predictions[i]);
+        outputPrediction(i, queries[i].class, predictions[i]);
+    }
+    outputConfusionMatrix(&cm, "test");
+
+    free(queryMatrix);
+    free(predictions);
+    freeConfusionMatrix(&cm);
+    freeKnnBatchClassifier(&classifier);
+    freeLaesaIndex(&pivotIndex);
+}
+
+
+/**
+ * @brief Classifies query samples with a saved k-Means model by nearest centroid.
+ * @param queries Query samples, already preprocessed with the model parameters.
+ * @param queryCount Number of query samples.
+ * @param model Loaded k-Means model.
+ */
+static void classifyWithKmeansModel(ShapeData *queries, int queryCount, KmeansModel *model) {
+    int *predictions = malloc(queryCount * sizeof(int));
+    if (!predictions || nearestCentroidClassify(model->centroids, model->clusterClasses, model->k, queries, queryCount,
+                                                model->featureCount, model->p, predictions) != KMEANS_SUCCESS) {
+        fprintf(stderr, "Failed to classify samples by nearest centroid\n");
+        exit(EXIT_FAILURE);
+    }
+
+    outputMessage("Applying nearest centroid classification (k = %d):\n", model->k);
+    int classCount = countClasses(queries, queryCount);
+    for (int i = 0; i < model->k; i++) {
+        if (model->clusterClasses[i] > classCount) {
+            classCount = model->clusterClasses[i];
+        }
+    }
+    ConfusionMatrix cm = createConfusionMatrix(classCount);
+    for (int i = 0; i < queryCount; i++) {
+        updateConfusionMatrix(&cm, queries[i].class, predictions[i]);
+        outputPrediction(i, queries[i].class, predictions[i]);
+    }
+    outputConfusionMatrix(&cm, "test");
+    freeConfusionMatrix(&cm);
+    free(predictions);
+}
+
+
+/**
+ * @brief Classifies the data in the given directory with a previously saved model.
+ *
+ * The model file is mapped into memory, so no training data is read or preprocessed:
+ * only the query descriptors are loaded, transformed with the stored preprocessing
+ * parameters and classified.
+ *
+ * @param options The CommandLineOptions containing the settings for the run.
+ */
+void runClassify(const CommandLineOptions *options) {
+    struct timespec start, loaded;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int modelType = readModelType(options->modelInput);
+    KnnModel knnModel;
+    KmeansModel kmeansModel;
+    int status = modelType;
+    int featureCount = 0;
+    const PreprocessingParams *preprocessing = NULL;
+    if (modelType == MODEL_TYPE_KNN) {
+        status = loadKnnModel(options->modelInput, &knnModel);
+        featureCount = knnModel.preprocessing.featureCount;
+        preprocessing = &knnModel.preprocessing;
+    } else if (modelType == MODEL_TYPE_KMEANS) {
+        status = loadKmeansModel(options->modelInput, &kmeansModel);
+        featureCount = kmeansModel.preprocessing.featureCount;
+        preprocessing = &kmeansModel.preprocessing;
+    }
+    if (status < 0) {
+        fprintf(stderr, "Failed to load model %s: %s\n", options->modelInput, modelErrorString(status));
+        exit(EXIT_FAILURE);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &loaded);
+    outputMessage("Model %s loaded in %.3f ms\n", options->modelInput, elapsedMilliseconds(start, loaded));
+
+    int count;
+    ShapeData *queries = readAllFiles(options->directory, options->extension, &count);
+    if (!queries || count == 0) {
+        fprintf(stderr, "Failed to read files\n");
+        exit(EXIT_FAILURE);
+    }
+    if (queries->featureCount != featureCount) {
+        fprintf(stderr, "Model expects %d features but the data has %d\n", featureCount, queries->featureCount);
+        exit(EXIT_FAILURE);
+    }
+    applyPreprocessing(preprocessing, queries, count);
+
+    if (modelType == MODEL_TYPE_KNN) {
+        classifyWithKnnModel(options, queries, count, &knnModel);
+        freeKnnModel(&knnModel);
+    } else {
+        classifyWithKmeansModel(queries, count, &kmeansModel);
+        freeKmeansModel(&kmeansModel);
+    }
+    freeShapeData(queries, count);
+}
+
+
+/**
+ * @brief Reads a whitespace separated list of ids.
+ *
+ * @param path Path of the file.
+ * @param count Pointer receiving the number of ids.
+ * @return Newly allocated ids; exits on a read error or a malformed file.
+ */
+static int *readIdList(const char *path, int *count) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror("Failed to open the id list");
+        exit(EXIT_FAILURE);
+    }
+    int *ids = NULL, capacity = 0, id;
+    *count = 0;
+    while (fscanf(file, "%d", &id) == 1) {
+        if (*count == capacity) {
+            capacity = capacity ? 2 * capacity : 64;
+            ids = realloc(ids, capacity * sizeof(int));
+            if (!ids) {
+                fprintf(stderr, "Memory allocation failed for the id list\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        ids[(*count)++] = id;
+    }
+    if (!feof(file)) {
+        fprintf(stderr, "Malformed id list %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    fclose(file);
+    return ids;
+}
+
+/**
+ * @brief Builds an updatable reference set from the training split one sample at a time and classifies the test split.
+ *
+ * Half of the training split seeds the store and fits its scaling, the rest is inserted
+ * sample by sample, refitting whenever the running statistics drift too far. The ids
+ * listed with --remove-ids are then removed; the id of a sample is its position in the
+ * training split. With --compress the store keeps codes of every sample up to date and
+ * searches through them.
+ *
+ * @param options The CommandLineOptions containing the settings for the run.
+ */
+void runIncrementalKnn(const CommandLineOptions *options) {
+    if (options->pcaComponents > 0 || options->pcaVariance > 0) {
+        fprintf(stderr, "The incremental reference set does not support PCA\n");
+        exit(EXIT_FAILURE);
+    }
+    int count;
+    ShapeData *shapes = readAllFiles(options->directory, options->extension, &count);
+    if (!shapes) {
+        fprintf(stderr, "Failed to read files\n");
+        exit(EXIT_FAILURE);
+    }
+    SplitData split = splitCommandLineData(options, shapes, count);
+    int featureCount = shapes->featureCount;
+
+    ReferenceStore store;
+    int initialSize = split.trainingSize / 2;
+    if (createReferenceStore(&store, split.trainingSet, initialSize, featureCount, options->p,
+                             parsePreprocessingMethod(options->preprocessing), 0) != REFERENCE_SUCCESS) {
+        fprintf(stderr, "Failed to create the reference set\n");
+        exit(EXIT_FAILURE);
+    }
+    CompressedIndex index;
+    if (options->compression != COMPRESS_NONE) {
+        int status = buildCompressedIndex(&index, store.samples, store.size, featureCount, options->p,
+                                          options->compression, options->codeSize, options->codebookSize,
+                                          RP_DEFAULT_SEED);
+        if (status != COMPRESSED_SUCCESS || referenceStoreAttachIndex(&store, &index, options->shortlist) !=
+                                                REFERENCE_SUCCESS) {
+            fprintf(stderr, "Failed to build the compressed index (error %d)\n", status);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Insert the rest of the training split, refitting when the statistics drift
+    int refits = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = initialSize; i < split.trainingSize; i++) {
+        if (referenceStoreInsert(&store, split.trainingSet[i].features, split.trainingSet[i].class) < 0) {
+            fprintf(stderr, "Failed to insert into the reference set\n");
+            exit(EXIT_FAILURE);
+        }
+        if (store.needsRefit) {
+            referenceStoreRefit(&store);
+            refits++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    int inserted = split.trainingSize - initialSize;
+    outputMessage("Inserted %d samples into a reference set of %d in %.3f ms (%d refits, drift %.4f)\n", inserted,
+                  initialSize, elapsedMilliseconds(start, end), refits, referenceStoreDrift(&store));
+
+    if (options->removeIds) {
+        int removeCount;
+        int *ids = readIdList(options->removeIds, &removeCount);
+        for (int i = 0; i < removeCount; i++) {
+            if (referenceStoreRemove(&store, ids[i]) != REFERENCE_SUCCESS) {
+                fprintf(stderr, "Failed to remove id %d from the reference set\n", ids[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (store.liveCount < options->k) {
+            fprintf(stderr, "Only %d samples are left, fewer than k = %d\n", store.liveCount, options->k);
+            exit(EXIT_FAILURE);
+        }
+        if (store.needsRefit) {
+            referenceStoreRefit(&store);
+        }
+        outputMessage("Removed %d samples (%d live in %d slots)\n", removeCount, store.liveCount, store.size);
+        free(ids);
+    }
+
+    outputMessage("Applying incremental k-NN Classification (k = %d):\n", options->k);
+    int classCount = countClasses(shapes, count);
+    ConfusionMatrix cm = createConfusionMatrix(classCount);
+    for (int i = 0; i < split.testSize; i++) {
+        int predicted = referenceStoreClassify(&store, split.testSet[i].features, options->k);
+        if (predicted < 0) {
+            fprintf(stderr, "Failed to apply incremental k-NN classification\n");
+            exit(EXIT_FAILURE);
+        }
+        updateConfusionMatrix(&cm, split.testSet[i].class, predicted);
+        outputPrediction(i, split.testSet[i].class, predicted);
+    }
+    outputConfusionMatrix(&cm, "test");
+
+    // Free resources
+    freeConfusionMatrix(&cm);
+    freeReferenceStore(&store);
+    if (options->compression != COMPRESS_NONE) {
+        freeCompressedIndex(&index);
+    }
+    freeSplitData(&split);
+    freeShapeData(shapes, count);
+}
+
+
+/**
+ * @brief Appends a prequential result, growing the arrays by doubling.
+ * @param actual Growable array of actual classes.
+ * @param predicted Growable array of predicted classes.
+ * @param count Number of results stored.
+ * @param capacity Number of results allocated.
+ * @param actualClass Class of the sample.
+ * @param predictedClass Class predicted before the sample was absorbed.
+ */
+static void appendResult(int **actual, int **predicted, int *count, int *capacity, int actualClass,
+                         int predictedClass) {
+    if (*count == *capacity) {
+        *capacity = *capacity > 0 ? *capacity * 2 : ONLINE_KMEANS_DEFAULT_BATCH;
+        int *actualGrown = realloc(*actual, *capacity * sizeof(int));
+        if (actualGrown) *actual = actualGrown;
+        int *predictedGrown = actualGrown ? realloc(*predicted, *capacity * sizeof(int)) : NULL;
+        if (!predictedGrown) {
+            fprintf(stderr, "Memory allocation failed for online k-Means results\n");
+            exit(EXIT_FAILURE);
+        }
+        *predicted = predictedGrown;
+    }
+    (*actual)[*count] = actualClass;
+    (*predicted)[(*count)++] = predictedClass;
+}
+
+/**
+ * @brief Clusters the dataset as a stream of batches with online k-Means.
+ *
+ * The preprocessing is fitted on the first batch, or taken from the snapshot with
+ * --resume. Every sample is classified by the clustering before it is absorbed, so
+ * the confusion matrix is a prequential (test-then-train) evaluation. With -w the
+ * state is snapshotted every --snapshot-every samples and once the stream ends.
+ *
+ * @param options The CommandLineOptions containing the settings for the run.
+ */
+void runOnlineKmeans(const CommandLineOptions *options) {
+    ShapeStream stream;
+    if (openShapeStream(&stream, options->directory, options->extension) != SUCCESS) {
+        fprintf(stderr, "Failed to read files\n");
+        exit(EXIT_FAILURE);
+    }
+    int batchCapacity = options->batchSize > 0 ? options->batchSize : ONLINE_KMEANS_DEFAULT_BATCH;
+    ShapeData *batch = malloc(batchCapacity * sizeof(ShapeData));
+    if (!batch) {
+        fprintf(stderr, "Memory allocation failed for online k-Means\n");
+        exit(EXIT_FAILURE);
+    }
+    int count = readShapeBatch(&stream, batch, batchCapacity);
+    if (count <= 0) {
+        fprintf(stderr, "Failed to read files\n");
+        exit(EXIT_FAILURE);
+    }
+
+    OnlineKmeans model;
+    PreprocessingParams preprocessing;
+    if (options->resume) {
+        KmeansModel snapshot;
+        int status = loadKmeansModel(options->modelOutput, &snapshot);
+        if (status != MODEL_SUCCESS) {
+            fprintf(stderr, "Failed to load snapshot %s: %s\n", options->modelOutput, modelErrorString(status));
+            exit(EXIT_FAILURE);
+        }
+        if (restoreOnlineKmeans(&model, &snapshot) != ONLINE_KMEANS_SUCCESS ||
+            snapshot.preprocessing.featureCount != batch->featureCount) {
+            fprintf(stderr, "Snapshot %s cannot resume clustering of this data\n", options->modelOutput);
+            exit(EXIT_FAILURE);
+        }
+        // The parameters are owned by the snapshot until they are moved out of it
+        preprocessing = snapshot.preprocessing;
+        memset(&snapshot.preprocessing, 0, sizeof(PreprocessingParams));
+        freeKmeansModel(&snapshot);
+        if (options->decay > 0) {
+            model.decay = options->decay;
+        }
+        outputMessage("Resumed from %s after %llu samples\n", options->modelOutput,
+                      (unsigned long long)model.samplesSeen);
+    } else {
+        preprocessing = fitCommandLinePreprocessing(options, batch, count);
+        if (createOnlineKmeans(&model, options->k, preprocessedFeatureCount(&preprocessing), options->p,
+                               options->decay) != ONLINE_KMEANS_SUCCESS) {
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int *actual = NULL, *predicted = NULL, results = 0, resultCapacity = 0, snapshots = 0, sinceSnapshot = 0;
+    uint64_t streamed = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (count > 0) {
+        applyPreprocessing(&preprocessing, batch, count);
+        // Test then train: each sample is classified before the batch is absorbed
+        for (int i = 0; i < count && model.seeded == model.k; i++) {
+            appendResult(&actual, &predicted, &results, &resultCapacity, batch[i].class,
+                         onlineKmeansClassify(&model, batch[i].features));
+        }
+        if (onlineKmeansUpdateBatch(&model, batch, count, NULL) != ONLINE_KMEANS_SUCCESS) {
+            fprintf(stderr, "Failed to update the online clustering\n");
+            exit(EXIT_FAILURE);
+        }
+        streamed += count;
+        sinceSnapshot += count;
+        for (int i = 0; i < count; i++) {
+            free(batch[i].features);
+        }
+
+        if (options->modelOutput && options->snapshotEvery > 0 && sinceSnapshot >= options->snapshotEvery &&
+            model.seeded == model.k) {
+            int status = saveOnlineKmeansSnapshot(options->modelOutput, &model, &preprocessing);
+            if (status != MODEL_SUCCESS) {
+                fprintf(stderr, "Failed to save snapshot %s: %s\n", options->modelOutput, modelErrorString(status));
+                exit(EXIT_FAILURE);
+            }
+            snapshots++;
+            sinceSnapshot = 0;
+        }
+        count = readShapeBatch(&stream, batch, batchCapacity);
+    }
+    if (count < 0) {
+        fprintf(stderr, "Failed to read files\n");
+        exit(EXIT_FAILURE);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (options->modelOutput && model.seeded < model.k) {
+        fprintf(stderr, "Fewer samples than clusters, no snapshot saved\n");
+    } else if (options->modelOutput) {
+        int status = saveOnlineKmeansSnapshot(options->modelOutput, &model, &preprocessing);
+        if (status != MODEL_SUCCESS) {
+            fprintf(stderr, "Failed to save snapshot %s: %s\n", options->modelOutput, modelErrorString(status));
+            exit(EXIT_FAILURE);
+        }
+        snapshots++;
+    }
+    outputMessage("Clustered %llu samples online in %.3f ms (k = %d, decay %g, %d snapshots)\n",
+                  (unsigned long long)streamed, elapsedMilliseconds(start, end), model.k, model.decay, snapshots);
+
+    // Classes are only known once the stream is over
+    int classCount = 0;
+    for (int i = 0; i < results; i++) {
+        classCount = actual[i] > classCount ? actual[i] : classCount;
+    }
+    ConfusionMatrix cm = createConfusionMatrix(classCount > 0 ? classCount : 1);
+    for (int i = 0; i < results; i++) {
+        updateConfusionMatrix(&cm, actual[i], predicted[i]);
+        outputPrediction(i, actual[i], predicted[i]);
+    }
+    outputConfusionMatrix(&cm, "prequential");
+
+    // Free resources
+    freeConfusionMatrix(&cm);
+    free(actual);
+    free(predicted);
+    free(batch);
+    closeShapeStream(&stream);
+    freeOnlineKmeans(&model);
+    freePreprocessingParams(&preprocessing);
+}
@@ -0,0 +1,418 @@
+#include "model_io.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Rounds an offset up to the next section boundary.
+static uint64_t alignOffset(uint64_t offset) {
+    return (offset + MODEL_SECTION_ALIGNMENT - 1) & ~(uint64_t)(MODEL_SECTION_ALIGNMENT - 1);
+}
+
+// Writes zero bytes until the file position reaches the given offset.
+static int padTo(FILE *file, uint64_t offset) {
+    static const char zeros[MODEL_SECTION_ALIGNMENT] = {0};
+    long position = ftell(file);
+    if (position < 0) {
+        return MODEL_ERR_WRITE;
+    }
+    uint64_t padding = offset - (uint64_t)position;
+    if (padding > 0 && fwrite(zeros, 1, padding, file) != padding) {
+        return MODEL_ERR_WRITE;
+    }
+    return MODEL_SUCCESS;
+}
+
+// Fills the fields shared by both model types and lays out the sections after the header.
+static void layoutHeader(ModelFileHeader *header, uint32_t modelType, int rows, int featureCount,
+                         int p, int k, const PreprocessingParams *preprocessing, uint32_t indexType,
+                         uint64_t indexSize) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, MODEL_MAGIC, sizeof(MODEL_MAGIC));
+    header->version = MODEL_VERSION;
+    header->modelType = modelType;
+    header->sampleCount = rows;
+    header->featureCount = featureCount;
+    header->p = p;
+    header->k = k;
+    header->preprocessing = preprocessing ? preprocessing->method : PREPROCESS_NONE;
+    header->indexType = indexSize > 0 ? indexType : MODEL_INDEX_NONE;
+    header->inputFeatureCount = preprocessing ? preprocessing->featureCount : featureCount;
+    header->pcaComponents = preprocessing ? preprocessing->components : 0;
+
+    uint64_t offset = alignOffset(sizeof(ModelFileHeader));
+    if (header->preprocessing != PREPROCESS_NONE) {
+        header->preprocessingOffset = offset;
+        offset = alignOffset(offset + 2 * (uint64_t)header->inputFeatureCount * sizeof(double));
+    }
+    if (header->pcaComponents > 0) {
+        header->pcaOffset = offset;
+        offset = alignOffset(offset + (1 + (uint64_t)header->pcaComponents) * header->inputFeatureCount * sizeof(double));
+    }
+    header->labelsOffset = offset;
+    offset = alignOffset(offset + (uint64_t)rows * sizeof(int32_t));
+    header->featuresOffset = offset;
+    header->fileSize = offset + (uint64_t)rows * featureCount * sizeof(double);
+    if (indexSize > 0) {
+        header->indexOffset = alignOffset(header->fileSize);
+        header->indexSize = indexSize;
+        header->fileSize = header->indexOffset + indexSize;
+    }
+}
+
+// Writes the header and the preprocessing section, leaving the file positioned for the labels.
+static int writeHeaderAndPreprocessing(FILE *file, const ModelFileHeader *header, const PreprocessingParams *preprocessing) {
+    if (fwrite(header, sizeof(*header), 1, file) != 1) {
+        return MODEL_ERR_WRITE;
+    }
+    size_t inputCount = header->inputFeatureCount;
+    if (header->preprocessingOffset) {
+        if (padTo(file, header->preprocessingOffset) != MODEL_SUCCESS ||
+            fwrite(preprocessing->offset, sizeof(double), inputCount, file) != inputCount ||
+            fwrite(preprocessing->scale, sizeof(double), inputCount, file) != inputCount) {
+            return MODEL_ERR_WRITE;
+        }
+    }
+    if (header->pcaOffset) {
+        size_t projectionCount = (size_t)header->pcaComponents * inputCount;
+        if (padTo(file, header->pcaOffset) != MODEL_SUCCESS ||
+            fwrite(preprocessing->pcaMean, sizeof(double), inputCount, file) != inputCount ||
+            fwrite(preprocessing->projection, sizeof(double), projectionCount, file) != projectionCount) {
+            return MODEL_ERR_WRITE;
+        }
+    }
+    return padTo(file, header->labelsOffset);
+}
+
+// Saves a trained k-NN model.
+int saveKnnModel(const char *filename, const ShapeData *trainingSet, int trainingSize, int featureCount,
+                 int p, int k, const PreprocessingParams *preprocessing) {
+    return saveIndexedKnnModel(filename, trainingSet, trainingSize, featureCount, p, k, preprocessing,
+                               MODEL_INDEX_NONE, NULL, 0);
+}
+
+// Saves a trained k-NN model with an optional index section.
+int saveIndexedKnnModel(const char *filename, const ShapeData *trainingSet, int trainingSize, int featureCount,
+                        int p, int k, const PreprocessingParams *preprocessing, uint32_t indexType,
+                        const void *index, uint64_t indexSize) {
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        return MODEL_ERR_FILE_OPEN;
+    }
+
+    ModelFileHeader header;
+    layoutHeader(&header, MODEL_TYPE_KNN, trainingSize, featureCount, p, k, preprocessing, indexType,
+                 index ? indexSize : 0);
+
+    int status = writeHeaderAndPreprocessing(file, &header, preprocessing);
+    for (int i = 0; i < trainingSize && status == MODEL_SUCCESS; i++) {
+        int32_t label = trainingSet[i].class;
+        if (fwrite(&label, sizeof(label), 1, file) != 1) {
+            status = MODEL_ERR_WRITE;
+        }
+    }
+    if (status == MODEL_SUCCESS) {
+        status = padTo(file, header.featuresOffset);
+    }
+    for (int i = 0; i < trainingSize && status == MODEL_SUCCESS; i++) {
+        if (fwrite(trainingSet[i].features, sizeof(double), featureCount, file) != (size_t)featureCount) {
+            status = MODEL_ERR_WRITE;
+        }
+    }
+    if (status == MODEL_SUCCESS && header.indexSize > 0 &&
+        (padTo(file, header.indexOffset) != MODEL_SUCCESS || fwrite(index, 1, indexSize, file) != indexSize)) {
+        status = MODEL_ERR_WRITE;
+    }
+
+    if (fclose(file) != 0 && status == MODEL_SUCCESS) {
+        status = MODEL_ERR_WRITE;
+    }
+    return status;
+}
+
+// Saves a trained k-Means model.
+int saveKmeansModel(const char *filename, const Cluster *clusters, int k, int featureCount,
+                    int p, const PreprocessingParams *preprocessing) {
+    double *centroids = malloc((size_t)k * featureCount * sizeof(double));
+    int *clusterClasses = malloc(k * sizeof(int));
+    if (!centroids || !clusterClasses) {
+        free(centroids);
+        free(clusterClasses);
+        return MODEL_ERR_MEMORY;
+    }
+    extractCentroids(clusters, k, featureCount, centroids, clusterClasses);
+    int status = saveCentroidModel(filename, centroids, clusterClasses, k, featureCount, p, preprocessing,
+                                   MODEL_INDEX_NONE, NULL, 0);
+    free(centroids);
+    free(clusterClasses);
+    return status;
+}
+
+// Saves a k-Means model from a contiguous centroid matrix, with an optional index section.
+int saveCentroidModel(const char *filename, const double *centroids, const int *clusterClasses, int k,
+                      int featureCount, int p, const PreprocessingParams *preprocessing, uint32_t indexType,
+                      const void *index, uint64_t indexSize) {
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        return MODEL_ERR_FILE_OPEN;
+    }
+
+    ModelFileHeader header;
+    layoutHeader(&header, MODEL_TYPE_KMEANS, k, featureCount, p, k, preprocessing, indexType, index ? indexSize : 0);
+
+    int status = writeHeaderAndPreprocessing(file, &header, preprocessing);
+    for (int i = 0; i < k && status == MODEL_SUCCESS; i++) {
+        int32_t clusterClass = clusterClasses[i];
+        if (fwrite(&clusterClass, sizeof(clusterClass), 1, file) != 1) {
+            status = MODEL_ERR_WRITE;
+        }
+    }
+    if (status == MODEL_SUCCESS) {
+        status = padTo(file, header.featuresOffset);
+    }
+    size_t valueCount = (size_t)k * featureCount;
+    if (status == MODEL_SUCCESS && fwrite(centroids, sizeof(double), valueCount, file) != valueCount) {
+        status = MODEL_ERR_WRITE;
+    }
+    if (status == MODEL_SUCCESS && header.indexSize > 0 &&
+        (padTo(file, header.indexOffset) != MODEL_SUCCESS || fwrite(index, 1, indexSize, file) != indexSize)) {
+        status = MODEL_ERR_WRITE;
+    }
+
+    if (fclose(file) != 0 && status == MODEL_SUCCESS) {
+        status = MODEL_ERR_WRITE;
+    }
+    return status;
+}
+
+// Checks that count elements of the given size starting at offset lie within the file, without overflow.
+static bool sectionFits(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t fileSize) {
+    if (offset > fileSize || count > (fileSize - offset) / elementSize) {
+        return false;
+    }
+    return true;
+}
+
+// Checks that a header describes a well-formed file of the given size.
+static int validateHeader(const ModelFileHeader *header, size_t fileSize) {
+    if (memcmp(header->magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)) != 0) {
+        return MODEL_ERR_FORMAT;
+    }
+    if (header->version != MODEL_VERSION) {
+        return MODEL_ERR_VERSION;
+    }
+    if (header->pcaComponents < 0 || header->inputFeatureCount <= 0 ||
+        header->featureCount != (header->pcaComponents > 0 ? header->pcaComponents : header->inputFeatureCount)) {
+        return MODEL_ERR_FORMAT;
+    }
+    if (header->preprocessing != PREPROCESS_NONE && header->preprocessing != PREPROCESS_NORMALIZE &&
+        header->preprocessing != PREPROCESS_STANDARDIZE) {
+        return MODEL_ERR_FORMAT;
+    }
+    if (header->sampleCount <= 0 || header->featureCount <= 0 || header->fileSize != fileSize) {
+        return MODEL_ERR_FORMAT;
+    }
+
+    // Every section the loaders read must lie within the file
+    uint64_t inputFeatures = (uint64_t)header->inputFeatureCount;
+    if (header->labelsOffset == 0 ||
+        !sectionFits(header->labelsOffset, (uint64_t)header->sampleCount, sizeof(int32_t), fileSize) ||
+        !sectionFits(header->featuresOffset, (uint64_t)header->sampleCount * header->featureCount, sizeof(double),
+                     fileSize) ||
+        !sectionFits(header->indexOffset, header->indexSize, 1, fileSize)) {
+        return MODEL_ERR_FORMAT;
+    }
+    if (header->preprocessing != PREPROCESS_NONE &&
+        (header->preprocessingOffset == 0 ||
+         !sectionFits(header->preprocessingOffset, 2 * inputFeatures, sizeof(double), fileSize))) {
+        return MODEL_ERR_FORMAT;
+    }
+    if (header->pcaComponents > 0 &&
+        (header->pcaOffset == 0 ||
+         !sectionFits(header->pcaOffset, (1 + (uint64_t)header->pcaComponents) * inputFeatures, sizeof(double),
+                      fileSize))) {
+        return MODEL_ERR_FORMAT;
+    }
+    return MODEL_SUCCESS;
+}
+
+// Maps a model file read-only and validates its header.
+static int mapModelFile(const char *filename, uint32_t expectedType, void **mapping, size_t *mappingSize) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return MODEL_ERR_FILE_OPEN;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ModelFileHeader)) {
+        close(fd);
+        return MODEL_ERR_FORMAT;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping stays valid after the descriptor is closed
+    if (map == MAP_FAILED) {
+        return MODEL_ERR_MEMORY;
+    }
+
+    const ModelFileHeader *header = map;
+    int status = validateHeader(header, st.st_size);
+    if (status == MODEL_SUCCESS && header->modelType != expectedType) {
+        status = MODEL_ERR_TYPE;
+    }
+    if (status != MODEL_SUCCESS) {
+        munmap(map, st.st_size);
+        return status;
+    }
+
+    *mapping = map;
+    *mappingSize = st.st_size;
+    return MODEL_SUCCESS;
+}
+
+// Copies the preprocessing section of a mapped model into owned parameters.
+static int loadPreprocessing(const ModelFileHeader *header, const char *base, PreprocessingParams *params) {
+    memset(params, 0, sizeof(*params));
+    params->method = PREPROCESS_NONE;
+    params->featureCount = header->inputFeatureCount;
+
+    size_t bytes = header->inputFeatureCount * sizeof(double);
+    if (header->preprocessing != PREPROCESS_NONE) {
+        params->offset = malloc(bytes);
+        params->scale = malloc(bytes);
+        if (!params->offset || !params->scale) {
+            freePreprocessingParams(params);
+            return MODEL_ERR_MEMORY;
+        }
+        memcpy(params->offset, base + header->preprocessingOffset, bytes);
+        memcpy(params->scale, base + header->preprocessingOffset + bytes, bytes);
+        params->method = header->preprocessing;
+    }
+    if (header->pcaComponents > 0) {
+        params->pcaMean = malloc(bytes);
+        params->projection = malloc(header->pcaComponents * bytes);
+        if (!params->pcaMean || !params->projection) {
+            freePreprocessingParams(params);
+            return MODEL_ERR_MEMORY;
+        }
+        memcpy(params->pcaMean, base + header->pcaOffset, bytes);
+        memcpy(params->projection, base + header->pcaOffset + bytes, header->pcaComponents * bytes);
+        params->components = header->pcaComponents;
+    }
+    return MODEL_SUCCESS;
+}
+
+// Reads the type of a model file without loading it.
+int readModelType(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        return MODEL_ERR_FILE_OPEN;
+    }
+    ModelFileHeader header;
+    size_t read = fread(&header, sizeof(header), 1, file);
+    fclose(file);
+    if (read != 1 || memcmp(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)) != 0) {
+        return MODEL_ERR_FORMAT;
+    }
+    return header.version == MODEL_VERSION ? (int)header.modelType : MODEL_ERR_VERSION;
+}
+
+// Loads a k-NN model by mapping the file into memory.
+int loadKnnModel(const char *filename, KnnModel *model) {
+    memset(model, 0, sizeof(*model));
+    int status = mapModelFile(filename, MODEL_TYPE_KNN, &model->mapping, &model->mappingSize);
+    if (status != MODEL_SUCCESS) {
+        return status;
+    }
+
+    const char *base = model->mapping;
+    const ModelFileHeader *header = model->mapping;
+    model->trainingSize = header->sampleCount;
+    model->featureCount = header->featureCount;
+    model->p = header->p;
+    model->k = header->k;
+    model->indexType = header->indexType;
+    model->index = header->indexSize ? base + header->indexOffset : NULL;
+    model->indexSize = header->indexSize;
+
+    // Only the sample descriptors are built, the features stay in the mapped file
+    model->trainingSet = malloc(model->trainingSize * sizeof(ShapeData));
+    if (!model->trainingSet || loadPreprocessing(header, base, &model->preprocessing) != MODEL_SUCCESS) {
+        freeKnnModel(model);
+        return MODEL_ERR_MEMORY;
+    }
+    const int32_t *labels = (const int32_t *)(base + header->labelsOffset);
+    double *features = (double *)(base + header->featuresOffset);
+    for (int i = 0; i < model->trainingSize; i++) {
+        model->trainingSet[i].class = labels[i];
+        model->trainingSet[i].sample = i;
+        model->trainingSet[i].featureCount = model->featureCount;
+        model->trainingSet[i].features = features + (size_t)i * model->featureCount;
+    }
+    return MODEL_SUCCESS;
+}
+
+// Loads a k-Means model by mapping the file into memory.
+int loadKmeansModel(const char *filename, KmeansModel *model) {
+    memset(model, 0, sizeof(*model));
+    int status = mapModelFile(filename, MODEL_TYPE_KMEANS, &model->mapping, &model->mappingSize);
+    if (status != MODEL_SUCCESS) {
+        return status;
+    }
+
+    const char *base = model->mapping;
+    const ModelFileHeader *header = model->mapping;
+    model->k = header->sampleCount;
+    model->featureCount = header->featureCount;
+    model->p = header->p;
+    model->clusterClasses = (const int32_t *)(base + header->labelsOffset);
+    model->centroids = (const double *)(base + header->featuresOffset);
+    model->indexType = header->indexType;
+    model->index = header->indexSize ? base + header->indexOffset : NULL;
+    model->indexSize = header->indexSize;
+
+    if (loadPreprocessing(header, base, &model->preprocessing) != MODEL_SUCCESS) {
+        freeKmeansModel(model);
+        return MODEL_ERR_MEMORY;
+    }
+    return MODEL_SUCCESS;
+}
+
+// Unmaps a k-NN model and frees its resources.
+void freeKnnModel(KnnModel *model) {
+    if (model) {
+        free(model->trainingSet);
+        freePreprocessingParams(&model->preprocessing);
+        if (model->mapping) {
+            munmap(model->mapping, model->mappingSize);
+        }
+        memset(model, 0, sizeof(*model));
+    }
+}
+
+// Unmaps a k-Means model and frees its resources.
+void freeKmeansModel(KmeansModel *model) {
+    if (model) {
+        freePreprocessingParams(&model->preprocessing);
+        if (model->mapping) {
+            munmap(model->mapping, model->mappingSize);
+        }
+        memset(model, 0, sizeof(*model));
+    }
+}
+
+// Returns a human readable message for a MODEL_ERR_* code.
+const char *modelErrorString(int error) {
+    switch (error) {
+        case MODEL_SUCCESS: return "success";
+        case MODEL_ERR_FILE_OPEN: return "unable to open model file";
+        case MODEL_ERR_WRITE: return "error writing model file";
+        case MODEL_ERR_FORMAT: return "not a model file or file is truncated";
+        case MODEL_ERR_VERSION: return "unsupported model file version";
+        case MODEL_ERR_TYPE: return "model file holds a different model type";
+        case MODEL_ERR_MEMORY: return "memory allocation or mapping failed";
+        default: return "unknown model error";
+    }
+}
@@ -0,0 +1,219 @@
+/**
+ * @file model_io.h
+ * @brief Header file for saving and loading trained k-NN and k-Means models.
+ *
+ * Models are stored in a versioned binary file made of a fixed-size header followed
+ * by sections aligned on MODEL_SECTION_ALIGNMENT bytes. Loading maps the file into
+ * memory, so the training matrix and the centroids are used in place without parsing.
+ * Values are stored in the native byte order of the machine that wrote the file.
+ * Version 2 added the PCA projection; version 1 files are rejected.
+ */
+
+#ifndef MODEL_IO_H
+#define MODEL_IO_H
+
+#include "data_reader.h"   // Include for ShapeData structure definition.
+#include "kmeans.h"        // Include for Cluster structure definition.
+#include "preprocessing.h" // Include for PreprocessingParams structure definition.
+
+#include <stdint.h>
+
+// Error codes
+#define MODEL_SUCCESS 0
+#define MODEL_ERR_FILE_OPEN -1
+#define MODEL_ERR_WRITE -2
+#define MODEL_ERR_FORMAT -3
+#define MODEL_ERR_VERSION -4
+#define MODEL_ERR_TYPE -5
+#define MODEL_ERR_MEMORY -6
+
+// Model types
+#define MODEL_TYPE_KNN 1
+#define MODEL_TYPE_KMEANS 2
+
+// Optional index types stored after the features of a model
+#define MODEL_INDEX_NONE 0
+#define MODEL_INDEX_ONLINE_KMEANS 1   /**< Running state of an online k-Means model (see online_kmeans.h). */
+#define MODEL_INDEX_LAESA 2           /**< Pivots and pivot distance table of a k-NN model (see laesa.h). */
+
+#define MODEL_MAGIC "RFMODEL"
+#define MODEL_VERSION 2
+#define MODEL_SECTION_ALIGNMENT 64
+
+/**
+ * @struct ModelFileHeader
+ * @brief On-disk header of a model file. Section offsets are relative to the start of the file.
+ */
+typedef struct {
+    char magic[8];               /**< MODEL_MAGIC, NUL terminated. */
+    uint32_t version;            /**< MODEL_VERSION of the writer. */
+    uint32_t modelType;          /**< MODEL_TYPE_KNN or MODEL_TYPE_KMEANS. */
+    int32_t sampleCount;         /**< Training samples (k-NN) or clusters (k-Means). */
+    int32_t featureCount;        /**< Number of features per stored sample, after any PCA projection. */
+    int32_t p;                   /**< Minkowski distance exponent. */
+    int32_t k;                   /**< Number of neighbors (k-NN) or clusters (k-Means). */
+    int32_t preprocessing;       /**< PREPROCESS_* method the stored data was transformed with. */
+    uint32_t indexType;          /**< MODEL_INDEX_* type of the optional index section. */
+    int32_t inputFeatureCount;   /**< Number of features of a raw query sample. */
+    int32_t pcaComponents;       /**< Principal components of the projection, 0 without PCA. */
+    uint64_t preprocessingOffset;/**< Offset of the offset[] then scale[] arrays, 0 if none. */
+    uint64_t pcaOffset;          /**< Offset of the PCA mean[] then projection[] arrays, 0 if none. */
+    uint64_t labelsOffset;       /**< Offset of the int32 labels (k-NN) or cluster classes (k-Means). */
+    uint64_t featuresOffset;     /**< Offset of the row-major double matrix. */
+    uint64_t indexOffset;        /**< Offset of the optional index section, 0 if none. */
+    uint64_t indexSize;          /**< Size in bytes of the optional index section. */
+    uint64_t fileSize;           /**< Total size of the file, used to detect truncation. */
+} ModelFileHeader;
+
+/**
+ * @struct KnnModel
+ * @brief A k-NN model loaded from disk. The sample features point into the mapped file.
+ */
+typedef struct {
+    ShapeData *trainingSet;           /**< Preprocessed training samples. */
+    int trainingSize;                 /**< Number of training samples. */
+    int featureCount;                 /**< Number of features per sample. */
+    int p;                            /**< Minkowski distance exponent used for training. */
+    int k;                            /**< Number of neighbors used for training. */
+    PreprocessingParams preprocessing;/**< Preprocessing to apply to query samples. */
+    uint32_t indexType;               /**< Type of the optional index, MODEL_INDEX_NONE if absent. */
+    const void *index;                /**< Optional index bytes inside the mapped file. */
+    uint64_t indexSize;               /**< Size of the optional index. */
+    void *mapping;                    /**< Start of the memory mapped file. */
+    size_t mappingSize;               /**< Size of the memory mapped file. */
+} KnnModel;
+
+/**
+ * @struct KmeansModel
+ * @brief A k-Means model loaded from disk. The centroids point into the mapped file.
+ */
+typedef struct {
+    const double *centroids;          /**< Row-major k x featureCount centroid matrix. */
+    const int32_t *clusterClasses;    /**< Majority class of each cluster. */
+    int k;                            /**< Number of clusters. */
+    int featureCount;                 /**< Number of features per centroid. */
+    int p;                            /**< Minkowski distance exponent used for training. */
+    PreprocessingParams preprocessing;/**< Preprocessing to apply to query samples. */
+    uint32_t indexType;               /**< Type of the optional index, MODEL_INDEX_NONE if absent. */
+    const void *index;                /**< Optional index bytes inside the mapped file. */
+    uint64_t indexSize;               /**< Size of the optional index. */
+    void *mapping;                    /**< Start of the memory mapped file. */
+    size_t mappingSize;               /**< Size of the memory mapped file. */
+} KmeansModel;
+
+/**
+ * @brief Saves a trained k-NN model.
+ *
+ * @param filename Path of the model file to write.
+ * @param trainingSet Preprocessed training samples.
+ * @param trainingSize Number of training samples.
+ * @param featureCount Number of features per sample, after preprocessing.
+ * @param p Minkowski distance exponent.
+ * @param k Number of neighbors.
+ * @param preprocessing Preprocessing fitted on the training set, NULL for none.
+ * @return MODEL_SUCCESS or a MODEL_ERR_* code.
+ */
+int saveKnnModel(const char *filename, const ShapeData *trainingSet, int trainingSize, int featureCount,
+                 int p, int k, const PreprocessingParams *preprocessing);
+
+/**
+ * @brief Saves a trained k-NN model with an optional index section.
+ *
+ * @param filename Path of the model file to write.
+ * @param trainingSet Preprocessed training samples.
+ * @param trainingSize Number of training samples.
+ * @param featureCount Number of features per sample, after preprocessing.
+ * @param p Minkowski distance exponent.
+ * @param k Number of neighbors.
+ * @param preprocessing Preprocessing fitted on the training set, NULL for none.
+ * @param indexType MODEL_INDEX_* type of the index section, MODEL_INDEX_NONE for none.
+ * @param index Bytes of the index section, NULL for none.
+ * @param indexSize Size in bytes of the index section.
+ * @return MODEL_SUCCESS or a MODEL_ERR_* code.
+ */
+int saveIndexedKnnModel(const char *filename, const ShapeData *trainingSet, int trainingSize, int featureCount,
+                        int p, int k, const PreprocessingParams *preprocessing, uint32_t indexType,
+                        const void *index, uint64_t indexSize);
+
+/**
+ * @brief Saves a trained k-Means model.
+ *
+ * @param filename Path of the model file to write.
+ * @param clusters Array of clusters returned by kmeans().
+ * @param k Number of clusters.
+ * @param featureCount Number of features per centroid, after preprocessing.
+ * @param p Minkowski distance exponent.
+ * @param preprocessing Preprocessing fitted on the clustered data, NULL for none.
+ * @return MODEL_SUCCESS or a MODEL_ERR_* code.
+ */
+int saveKmeansModel(const char *filename, const Cluster *clusters, int k, int featureCount,
+                    int p, const PreprocessingParams *preprocessing);
+
+/**
+ * @brief Saves a k-Means model from a contiguous centroid matrix, with an optional index section.
+ *
+ * @param filename Path of the model file to write.
+ * @param centroids Row-major k x featureCount centroid matrix.
+ * @param clusterClasses Majority class of each cluster.
+ * @param k Number of clusters.
+ * @param featureCount Number of features per centroid, after preprocessing.
+ * @param p Minkowski distance exponent.
+ * @param preprocessing Preprocessing fitted on the clustered data, NULL for none.
+ * @param indexType MODEL_INDEX_* type of the index section, MODEL_INDEX_NONE for none.
+ * @param index Bytes of the index section, NULL for none.
+ * @param indexSize Size in bytes of the index section.
+ * @return MODEL_SUCCESS or a MODEL_ERR_* code.
+ */
+int saveCentroidModel(const char *filename, const double *centroids, const int *clusterClasses, int k,
+                      int featureCount, int p, const PreprocessingParams *preprocessing, uint32_t indexType,
+                      const void *index, uint64_t indexSize);
+
+/**
+ * @brief Reads the type of a model file without loading it.
+ *
+ * @param filename Path of the model file.
+ * @return MODEL_TYPE_KNN, MODEL_TYPE_KMEANS or a MODEL_ERR_* code.
+ */
+int readModelType(const char *filename);
+
+/**
+ * @brief Loads a k-NN model by mapping the file into memory.
+ *
+ * @param filename Path of the model file.
+ * @param model Pointer to the model to fill, released with freeKnnModel.
+ * @return MODEL_SUCCESS or a MODEL_ERR_* code.
+ */
+int loadKnnModel(const char *filename, KnnModel *model);
+
+/**
+ * @brief Loads a k-Means model by mapping the file into memory.
+ *
+ * @param filename Path of the model file.
+ * @param model Pointer to the model to fill, released with freeKmeansModel.
+ * @return MODEL_SUCCESS or a MODEL_ERR_* code.
+ */
+int loadKmeansModel(const char *filename, KmeansModel *model);
+
+/**
+ * @brief Unmaps a k-NN model and frees its resources.
+ *
+ * @param model Pointer to the model to be freed.
+ */
+void freeKnnModel(KnnModel *model);
+
+/**
+ * @brief Unmaps a k-Means model and frees its resources.
+ *
+ * @param model Pointer to the model to be freed.
+ */
+void freeKmeansModel(KmeansModel *model);
+
+/**
+ * @brief Returns a human readable message for a MODEL_ERR_* code.
+ *
+ * @param error Error code returned by one of the model functions.
+ * @return Static string describing the error.
+ */
+const char *modelErrorString(int error);
+
+#endif // MODEL_IO_H
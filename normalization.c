@@ -1,4 +1,6 @@
 #include "normalization.h"
+#include "profiler.h"
+#include "arena.h"
 #include <float.h>   // For DBL_MAX and DBL_MIN constants.
 #include <stdlib.h>  // For dynamic memory allocation functions.
 
@@ -29,12 +31,20 @@ void findMinMax(ShapeData *data, int dataSize, double *min, double *max, int fea
 
     // Divide the data among threads and initialize local min and max values.
     int chunkSize = dataSize / numThreads;  // Determine size of data chunk per thread.
+    Arena *scratch = scratchArena(PROFILE_PREPROCESS);
+    ArenaMark mark = arenaMark(scratch);
+    double *local = arenaAlloc(scratch, 2 * (size_t)numThreads * featureCount * sizeof(double));
+    if (!local) {
+        fprintf(stderr, "Memory allocation failed for normalization\n");
+        exit(EXIT_FAILURE);
+    }
     for (int i = 0; i < numThreads; i++) {
         threadArgs[i].data = data;
         threadArgs[i].startIdx = i * chunkSize;
         threadArgs[i].endIdx = (i == numThreads - 1) ? dataSize : (i + 1) * chunkSize;
-        threadArgs[i].min = (double *)malloc(featureCount * sizeof(double));
-        threadArgs[i].max = (double *)malloc(featureCount * sizeof(double));
+        threadArgs[i].featureCount = featureCount;
+        threadArgs[i].min = local + (size_t)(2 * i) * featureCount;
+        threadArgs[i].max = local + (size_t)(2 * i + 1) * featureCount;
         // Initialize local min and max arrays.
         for (int j = 0; j < featureCount; j++) {
             threadArgs[i].min[j] = DBL_MAX;
@@ -56,17 +66,25 @@ void findMinMax(ShapeData *data, int dataSize, double *min, double *max, int fea
                 max[j] = threadArgs[i].max[j];
             }
         }
-        // Free memory allocated for thread-local min and max arrays.
-        free(threadArgs[i].min);
-        free(threadArgs[i].max);
     }
+    arenaReset(scratch, mark); // Release the thread-local min and max arrays.
 }
 
 // Normalizes the data by scaling feature values to a 0-1 range.
 void normalizeData(ShapeData *data, int dataSize, int featureCount) {
-    // Allocate memory for global min and max values.
-    double *min = (double *)malloc(featureCount * sizeof(double));
-    double *max = (double *)malloc(featureCount * sizeof(double));
+    // Take the global min and max arrays from the scratch arena.
+    Arena *scratch = scratchArena(PROFILE_PREPROCESS);
+    ArenaMark mark = arenaMark(scratch);
+    double *min = arenaAlloc(scratch, 2 * featureCount * sizeof(double));
+    if (!min) {
+        fprintf(stderr, "Memory allocation failed for normalization\n");
+        exit(EXIT_FAILURE);
+    }
+    double *max = min + featureCount;
+    for (int j = 0; j < featureCount; j++) {
+        min[j] = DBL_MAX;
+        max[j] = -DBL_MAX;
+    }
 
     // Find the min and max values for each feature across all data.
     findMinMax(data, dataSize, min, max, featureCount);
@@ -78,7 +96,6 @@ void normalizeData(ShapeData *data, int dataSize, int featureCount) {
         }
     }
 
-    // Free memory allocated for min and max values.
-    free(min);
-    free(max);
+    // Release the min and max arrays.
+    arenaReset(scratch, mark);
 }
@@ -20,6 +20,20 @@ typedef struct {
     int featureCount;     /**< Number of features in each ShapeData item. */
 } ThreadArgs;
 
+/**
+ * @brief Finds the minimum and maximum value of each feature across an array of ShapeData.
+ *
+ * The min and max arrays are merged with the values found, so they must be initialized
+ * to DBL_MAX and -DBL_MAX by the caller.
+ *
+ * @param data Pointer to the array of ShapeData.
+ * @param dataSize Total number of ShapeData items.
+ * @param min Array receiving the minimum of each feature.
+ * @param max Array receiving the maximum of each feature.
+ * @param featureCount Number of features in each ShapeData item.
+ */
+void findMinMax(ShapeData *data, int dataSize, double *min, double *max, int featureCount);
+
 /**
  * @brief Normalizes the feature values in an array of ShapeData.
  *
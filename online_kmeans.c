@@ -0,0 +1,264 @@
+#include "online_kmeans.h"
+#include "knn.h"
+#include "profiler.h"
+#include "arena.h"
+
+#include <float.h>
+#include <stdio.h>
+
+/**
+ * @struct OnlineKmeansSnapshotHeader
+ * @brief Start of the MODEL_INDEX_ONLINE_KMEANS section, followed by the k counts and
+ *        the k x classSlots histograms as doubles.
+ */
+typedef struct {
+    uint32_t classSlots;     /**< Columns of the histograms. */
+    int32_t seeded;          /**< Seeded clusters, always k in a snapshot. */
+    double decay;            /**< Decay rate of the clustering. */
+    uint64_t samplesSeen;    /**< Samples absorbed before the snapshot. */
+} OnlineKmeansSnapshotHeader;
+
+// Creates an empty online clustering.
+int createOnlineKmeans(OnlineKmeans *model, int k, int featureCount, int p, double decay) {
+    memset(model, 0, sizeof(OnlineKmeans));
+    if (k <= 0 || featureCount <= 0 || p <= 0 || decay < 0 || decay >= 1) {
+        fprintf(stderr, "Invalid parameters for online k-Means\n");
+        return ONLINE_KMEANS_ERR_INVALID_INPUT;
+    }
+    model->k = k;
+    model->featureCount = featureCount;
+    model->p = p;
+    model->decay = decay;
+    model->centroids = calloc((size_t)k * featureCount, sizeof(double));
+    model->counts = calloc(k, sizeof(double));
+    if (!model->centroids || !model->counts) {
+        fprintf(stderr, "Memory allocation failed for online k-Means\n");
+        freeOnlineKmeans(model);
+        return ONLINE_KMEANS_ERR_MEMORY;
+    }
+    profileCount(PROFILE_KMEANS, PROFILE_ALLOCATIONS, 2);
+    return ONLINE_KMEANS_SUCCESS;
+}
+
+// Widens the histograms so that the given class has a column.
+static int growClassSlots(OnlineKmeans *model, int class) {
+    if (class < model->classSlots) {
+        return ONLINE_KMEANS_SUCCESS;
+    }
+    int slots = class + 1;
+    double *histograms = calloc((size_t)model->k * slots, sizeof(double));
+    if (!histograms) {
+        fprintf(stderr, "Memory allocation failed for online k-Means\n");
+        return ONLINE_KMEANS_ERR_MEMORY;
+    }
+    profileCount(PROFILE_KMEANS, PROFILE_ALLOCATIONS, 1);
+    for (int c = 0; c < model->k && model->histograms; c++) {
+        memcpy(histograms + (size_t)c * slots, model->histograms + (size_t)c * model->classSlots,
+               model->classSlots * sizeof(double));
+    }
+    free(model->histograms);
+    model->histograms = histograms;
+    model->classSlots = slots;
+    return ONLINE_KMEANS_SUCCESS;
+}
+
+// Returns the nearest seeded centroid, the first one on ties.
+int onlineKmeansNearest(const OnlineKmeans *model, const double *features) {
+    if (model->seeded == 0) {
+        return ONLINE_KMEANS_ERR_EMPTY;
+    }
+    int nearest = 0;
+    double best = DBL_MAX;
+    for (int c = 0; c < model->seeded; c++) {
+        double distance = minkowskiPowerSum(features, model->centroids + (size_t)c * model->featureCount,
+                                            model->featureCount, model->p);
+        if (distance < best) {
+            best = distance;
+            nearest = c;
+        }
+    }
+    profileCount(PROFILE_KMEANS, PROFILE_DISTANCE_EVALUATIONS, model->seeded);
+    return nearest;
+}
+
+// Moves a centroid towards a sample and shifts its class histogram by the same step.
+static void absorbSample(OnlineKmeans *model, int cluster, const double *features, int class) {
+    double *centroid = model->centroids + (size_t)cluster * model->featureCount;
+    double *histogram = model->histograms + (size_t)cluster * model->classSlots;
+    double step = 1.0 / ++model->counts[cluster];
+    if (step < model->decay) {
+        step = model->decay;
+    }
+    for (int j = 0; j < model->featureCount; j++) {
+        centroid[j] += step * (features[j] - centroid[j]);
+    }
+    // The histogram stays a distribution: the new class gets the weight the centroid gives the sample
+    for (int c = 0; c < model->classSlots; c++) {
+        histogram[c] *= 1 - step;
+    }
+    histogram[class] += step;
+    model->samplesSeen++;
+}
+
+// Seeds the next empty cluster or moves the nearest centroid towards the sample.
+int onlineKmeansUpdate(OnlineKmeans *model, const double *features, int class) {
+    if (!model || !features || class < 0) {
+        fprintf(stderr, "Invalid parameters for online k-Means\n");
+        return ONLINE_KMEANS_ERR_INVALID_INPUT;
+    }
+    int status = growClassSlots(model, class);
+    if (status != ONLINE_KMEANS_SUCCESS) {
+        return status;
+    }
+    int cluster = model->seeded < model->k ? model->seeded++ : onlineKmeansNearest(model, features);
+    absorbSample(model, cluster, features, class);
+    return cluster;
+}
+
+// Seeds the empty clusters one sample at a time, then assigns the rest of the batch before updating.
+int onlineKmeansUpdateBatch(OnlineKmeans *model, const ShapeData *batch, int count, int *assignments) {
+    if (!model || (!batch && count > 0) || count < 0) {
+        fprintf(stderr, "Invalid parameters for online k-Means\n");
+        return ONLINE_KMEANS_ERR_INVALID_INPUT;
+    }
+    ProfileScope scope = profileBegin(PROFILE_KMEANS);
+    int first = 0;
+    for (; first < count && model->seeded < model->k; first++) {
+        int cluster = onlineKmeansUpdate(model, batch[first].features, batch[first].class);
+        if (cluster < 0) {
+            profileEnd(&scope);
+            return cluster;
+        }
+        if (assignments) {
+            assignments[first] = cluster;
+        }
+    }
+
+    Arena *scratch = scratchArena(PROFILE_KMEANS);
+    ArenaMark mark = arenaMark(scratch);
+    int *nearest = assignments ? assignments : arenaAlloc(scratch, (count > 0 ? count : 1) * sizeof(int));
+    int status = nearest ? ONLINE_KMEANS_SUCCESS : ONLINE_KMEANS_ERR_MEMORY;
+    for (int i = first; i < count && status == ONLINE_KMEANS_SUCCESS; i++) {
+        if (batch[i].class < 0) {
+            status = ONLINE_KMEANS_ERR_INVALID_INPUT;
+        } else {
+            status = growClassSlots(model, batch[i].class);
+        }
+    }
+
+    if (status == ONLINE_KMEANS_SUCCESS) {
+        #pragma omp parallel for schedule(static) if (count - first >= ONLINE_KMEANS_PARALLEL_BATCH)
+        for (int i = first; i < count; i++) {
+            nearest[i] = onlineKmeansNearest(model, batch[i].features);
+        }
+        for (int i = first; i < count; i++) {
+            absorbSample(model, nearest[i], batch[i].features, batch[i].class);
+        }
+    }
+    arenaReset(scratch, mark);
+    profileEnd(&scope);
+    return status;
+}
+
+// Returns the class with the largest weight in a cluster's histogram.
+int onlineKmeansClusterClass(const OnlineKmeans *model, int cluster) {
+    const double *histogram = model->histograms + (size_t)cluster * model->classSlots;
+    int best = 0;
+    for (int c = 1; c < model->classSlots; c++) {
+        if (histogram[c] > histogram[best]) {
+            best = c;
+        }
+    }
+    return best;
+}
+
+// Predicts the majority class of the nearest cluster.
+int onlineKmeansClassify(const OnlineKmeans *model, const double *features) {
+    int cluster = onlineKmeansNearest(model, features);
+    return cluster < 0 ? cluster : onlineKmeansClusterClass(model, cluster);
+}
+
+// Writes the centroids, majority classes and running state to a temporary file renamed over the snapshot.
+int saveOnlineKmeansSnapshot(const char *filename, const OnlineKmeans *model,
+                             const PreprocessingParams *preprocessing) {
+    if (model->seeded < model->k) {
+        return MODEL_ERR_WRITE;
+    }
+    size_t countBytes = model->k * sizeof(double);
+    size_t histogramBytes = (size_t)model->k * model->classSlots * sizeof(double);
+    size_t stateSize = sizeof(OnlineKmeansSnapshotHeader) + countBytes + histogramBytes;
+    char *state = malloc(stateSize);
+    int *clusterClasses = malloc(model->k * sizeof(int));
+    char *temporary = malloc(strlen(filename) + 5);
+    if (!state || !clusterClasses || !temporary) {
+        free(state);
+        free(clusterClasses);
+        free(temporary);
+        return MODEL_ERR_MEMORY;
+    }
+
+    OnlineKmeansSnapshotHeader header = {model->classSlots, model->seeded, model->decay, model->samplesSeen};
+    memcpy(state, &header, sizeof(header));
+    memcpy(state + sizeof(header), model->counts, countBytes);
+    memcpy(state + sizeof(header) + countBytes, model->histograms, histogramBytes);
+    for (int c = 0; c < model->k; c++) {
+        clusterClasses[c] = onlineKmeansClusterClass(model, c);
+    }
+
+    sprintf(temporary, "%s.tmp", filename);
+    int status = saveCentroidModel(temporary, model->centroids, clusterClasses, model->k, model->featureCount,
+                                   model->p, preprocessing, MODEL_INDEX_ONLINE_KMEANS, state, stateSize);
+    if (status == MODEL_SUCCESS && rename(temporary, filename) != 0) {
+        status = MODEL_ERR_WRITE;
+    }
+    if (status != MODEL_SUCCESS) {
+        remove(temporary);
+    }
+    free(state);
+    free(clusterClasses);
+    free(temporary);
+    return status;
+}
+
+// Copies the centroids and the running state of a snapshot.
+int restoreOnlineKmeans(OnlineKmeans *model, const KmeansModel *snapshot) {
+    memset(model, 0, sizeof(OnlineKmeans));
+    OnlineKmeansSnapshotHeader header;
+    if (snapshot->indexType != MODEL_INDEX_ONLINE_KMEANS || snapshot->indexSize < sizeof(header)) {
+        fprintf(stderr, "The model holds no online k-Means state\n");
+        return ONLINE_KMEANS_ERR_FORMAT;
+    }
+    memcpy(&header, snapshot->index, sizeof(header));
+    size_t countBytes = snapshot->k * sizeof(double);
+    size_t histogramBytes = (size_t)snapshot->k * header.classSlots * sizeof(double);
+    if (header.seeded != snapshot->k || snapshot->indexSize != sizeof(header) + countBytes + histogramBytes) {
+        fprintf(stderr, "The online k-Means state of the model is corrupted\n");
+        return ONLINE_KMEANS_ERR_FORMAT;
+    }
+
+    int status = createOnlineKmeans(model, snapshot->k, snapshot->featureCount, snapshot->p, header.decay);
+    if (status == ONLINE_KMEANS_SUCCESS && header.classSlots > 0) {
+        status = growClassSlots(model, (int)header.classSlots - 1);
+    }
+    if (status != ONLINE_KMEANS_SUCCESS) {
+        freeOnlineKmeans(model);
+        return status;
+    }
+    const char *state = snapshot->index;
+    memcpy(model->centroids, snapshot->centroids, (size_t)snapshot->k * snapshot->featureCount * sizeof(double));
+    memcpy(model->counts, state + sizeof(header), countBytes);
+    memcpy(model->histograms, state + sizeof(header) + countBytes, histogramBytes);
+    model->seeded = header.seeded;
+    model->samplesSeen = header.samplesSeen;
+    return ONLINE_KMEANS_SUCCESS;
+}
+
+// Frees the centroids, counts and histograms.
+void freeOnlineKmeans(OnlineKmeans *model) {
+    if (model) {
+        free(model->centroids);
+        free(model->counts);
+        free(model->histograms);
+        memset(model, 0, sizeof(OnlineKmeans));
+    }
+}
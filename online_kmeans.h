@@ -0,0 +1,149 @@
+/**
+ * @file online_kmeans.h
+ * @brief Header file for sequential (online) k-Means clustering.
+ *
+ * Samples are clustered as they arrive instead of from a complete training set. The
+ * first k samples become the centroids; every later sample moves its nearest centroid
+ * towards itself with MacQueen's update c += (x - c) / n, where n counts the samples
+ * the cluster has absorbed. With a decay rate the step never drops below the rate,
+ * so the centroids follow an exponential moving average and keep adapting when the
+ * data drifts. Each cluster also keeps a histogram of the classes it absorbed, decayed
+ * at the same rate, and its majority class labels it. A sample costs O(k·d).
+ *
+ * The state can be snapshotted to a k-Means model file: the centroids and majority
+ * classes make it usable by -r and the server like any k-Means model, and the counts
+ * and histograms are stored in a MODEL_INDEX_ONLINE_KMEANS section so that clustering
+ * can resume from the snapshot.
+ */
+
+#ifndef ONLINE_KMEANS_H
+#define ONLINE_KMEANS_H
+
+#include "data_reader.h"
+#include "preprocessing.h"
+#include "model_io.h"
+
+// Error codes
+#define ONLINE_KMEANS_SUCCESS 0
+#define ONLINE_KMEANS_ERR_INVALID_INPUT -1
+#define ONLINE_KMEANS_ERR_MEMORY -2
+#define ONLINE_KMEANS_ERR_EMPTY -3
+#define ONLINE_KMEANS_ERR_FORMAT -4
+
+// Samples read and clustered together when no batch size is given
+#define ONLINE_KMEANS_DEFAULT_BATCH 16
+
+// Batches at least this large are assigned to their clusters in parallel
+#define ONLINE_KMEANS_PARALLEL_BATCH 256
+
+/**
+ * @struct OnlineKmeans
+ * @brief Centroids, counts and class histograms of an online clustering.
+ */
+typedef struct {
+    int k;                   /**< Number of clusters. */
+    int featureCount;        /**< Number of features of every sample. */
+    int p;                   /**< Minkowski exponent of the assignment. */
+    double decay;            /**< Smallest step of a centroid update, 0 for plain MacQueen updates. */
+    int seeded;              /**< Clusters that received their first sample. */
+    uint64_t samplesSeen;    /**< Samples absorbed since the clustering started. */
+    double *centroids;       /**< Row-major k x featureCount centroid matrix. */
+    double *counts;          /**< Samples absorbed by every cluster. */
+    int classSlots;          /**< Columns of the histograms: the largest class seen plus one. */
+    double *histograms;      /**< Row-major k x classSlots class weights. */
+} OnlineKmeans;
+
+/**
+ * @brief Creates an empty online clustering.
+ *
+ * @param model Clustering to initialize; freeOnlineKmeans releases it.
+ * @param k Number of clusters.
+ * @param featureCount Number of features of every sample.
+ * @param p Minkowski exponent.
+ * @param decay Smallest update step in [0, 1), 0 for MacQueen's running means.
+ * @return ONLINE_KMEANS_SUCCESS or an ONLINE_KMEANS_ERR_* code.
+ */
+int createOnlineKmeans(OnlineKmeans *model, int k, int featureCount, int p, double decay);
+
+/**
+ * @brief Returns the nearest centroid of a sample.
+ *
+ * @param model Clustering to search.
+ * @param features featureCount features.
+ * @return Index of the nearest seeded cluster, or ONLINE_KMEANS_ERR_EMPTY before the first sample.
+ */
+int onlineKmeansNearest(const OnlineKmeans *model, const double *features);
+
+/**
+ * @brief Absorbs one sample.
+ *
+ * @param model Clustering to update.
+ * @param features featureCount features, preprocessed like the other samples.
+ * @param class Class of the sample, 0 or more.
+ * @return Index of the cluster that absorbed the sample, or a negative ONLINE_KMEANS_ERR_* code.
+ */
+int onlineKmeansUpdate(OnlineKmeans *model, const double *features, int class);
+
+/**
+ * @brief Absorbs a batch of samples.
+ *
+ * Once every cluster is seeded the samples are assigned with the centroids as they were
+ * before the batch, in parallel for large batches, then the updates are applied in order.
+ *
+ * @param model Clustering to update.
+ * @param batch Samples to absorb.
+ * @param count Number of samples.
+ * @param assignments Optional output array of count cluster indices, or NULL.
+ * @return ONLINE_KMEANS_SUCCESS or an ONLINE_KMEANS_ERR_* code.
+ */
+int onlineKmeansUpdateBatch(OnlineKmeans *model, const ShapeData *batch, int count, int *assignments);
+
+/**
+ * @brief Returns the majority class of a cluster.
+ *
+ * @param model Clustering to inspect.
+ * @param cluster Cluster index.
+ * @return The class with the largest weight in the cluster's histogram, 0 for an empty histogram.
+ */
+int onlineKmeansClusterClass(const OnlineKmeans *model, int cluster);
+
+/**
+ * @brief Predicts the class of a sample as the majority class of its nearest cluster.
+ *
+ * @param model Clustering to use.
+ * @param features featureCount features.
+ * @return The predicted class, or ONLINE_KMEANS_ERR_EMPTY before the first sample.
+ */
+int onlineKmeansClassify(const OnlineKmeans *model, const double *features);
+
+/**
+ * @brief Writes the clustering to a k-Means model file.
+ *
+ * The file is written next to its destination and renamed over it, so a reader never
+ * sees a partial snapshot.
+ *
+ * @param filename Path of the model file.
+ * @param model Clustering whose k clusters are all seeded; the caller checks seeded == k.
+ * @param preprocessing Preprocessing applied to the samples, NULL for none.
+ * @return MODEL_SUCCESS or a MODEL_ERR_* code; MODEL_ERR_WRITE, with nothing written, if a cluster is not seeded.
+ */
+int saveOnlineKmeansSnapshot(const char *filename, const OnlineKmeans *model,
+                             const PreprocessingParams *preprocessing);
+
+/**
+ * @brief Restores a clustering from a snapshot.
+ *
+ * @param model Clustering to initialize; freeOnlineKmeans releases it.
+ * @param snapshot Loaded k-Means model holding a MODEL_INDEX_ONLINE_KMEANS section.
+ * @return ONLINE_KMEANS_SUCCESS or an ONLINE_KMEANS_ERR_* code.
+ */
+int restoreOnlineKmeans(OnlineKmeans *model, const KmeansModel *snapshot);
+
+/**
+ * @brief Frees the memory held by an online clustering.
+ *
+ * @param model Clustering to free.
+ */
+void freeOnlineKmeans(OnlineKmeans *model);
+
+#endif // ONLINE_KMEANS_H
@@ -0,0 +1,253 @@
+#include "output.h"
+#include "profiler.h"
+
+#include <stdarg.h>
+
+// Size of the standard output buffer
+#define OUTPUT_BUFFER_SIZE (1 << 16)
+
+// Record types, each with its own CSV header
+#define RECORD_PREDICTION 0
+#define RECORD_CONFUSION 1
+#define RECORD_CLASS 2
+#define RECORD_OVERALL 3
+#define RECORD_MEMBER 4
+#define RECORD_CLUSTERING 5
+#define RECORD_TYPE_COUNT 6
+
+static const char *csvHeaders[RECORD_TYPE_COUNT] = {
+    "prediction,index,actual,predicted",
+    "confusion,label,actual,predicted,count",
+    "class,label,class,tp,fp,fn,tn,precision,recall,specificity,f1_score,fpr,accuracy",
+    "overall,label,precision,recall,specificity,f1_score,fpr,accuracy",
+    "member,cluster,cluster_class,point,point_class",
+    "clustering,k,silhouette,wcss,bcss",
+};
+
+static int format = OUTPUT_TEXT;
+static int writePredictions = 0;
+static const char *confusionPath = NULL;
+static int headerWritten[RECORD_TYPE_COUNT];
+static int recordCount = 0;
+static int lastCluster = -1;
+
+// Converts a format name to its constant.
+int parseOutputFormat(const char *name) {
+    if (strcmp(name, "text") == 0) {
+        return OUTPUT_TEXT;
+    } else if (strcmp(name, "quiet") == 0) {
+        return OUTPUT_QUIET;
+    } else if (strcmp(name, "csv") == 0) {
+        return OUTPUT_CSV;
+    } else if (strcmp(name, "json") == 0) {
+        return OUTPUT_JSON;
+    }
+    return -1;
+}
+
+// Configures the output layer.
+void initOutput(int selectedFormat, int predictions, const char *confusionFile) {
+    format = selectedFormat;
+    writePredictions = predictions;
+    confusionPath = confusionFile;
+    setvbuf(stdout, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+    if (format == OUTPUT_JSON) {
+        printf("{\"records\": [");
+    }
+}
+
+// Returns the configured output format.
+int outputFormat(void) {
+    return format;
+}
+
+// Prints a human-readable message, only in text mode.
+void outputMessage(const char *message, ...) {
+    if (format != OUTPUT_TEXT) {
+        return;
+    }
+    va_list arguments;
+    va_start(arguments, message);
+    vprintf(message, arguments);
+    va_end(arguments);
+}
+
+// Starts a structured record: the CSV header on first use, or the JSON separator.
+static void beginRecord(int type) {
+    if (format == OUTPUT_CSV && !headerWritten[type]) {
+        printf("%s\n", csvHeaders[type]);
+        headerWritten[type] = 1;
+    } else if (format == OUTPUT_JSON) {
+        printf(recordCount > 0 ? ",\n" : "\n");
+    }
+    recordCount++;
+}
+
+// Writes a string as a JSON string literal.
+static void printJsonString(const char *text) {
+    putchar('"');
+    for (const char *c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') putchar('\\');
+        putchar(*c);
+    }
+    putchar('"');
+}
+
+// Writes the prediction of one sample when predictions are requested.
+void outputPrediction(int index, int actualClass, int predictedClass) {
+    if (!writePredictions || format == OUTPUT_QUIET) {
+        return;
+    }
+    if (format == OUTPUT_TEXT) {
+        printf("Test Sample %d predicted as class %d (Actual Class: %d)\n", index, predictedClass, actualClass);
+        return;
+    }
+    beginRecord(RECORD_PREDICTION);
+    if (format == OUTPUT_CSV) {
+        printf("prediction,%d,%d,%d\n", index, actualClass, predictedClass);
+    } else {
+        printf("{\"type\": \"prediction\", \"index\": %d, \"actual\": %d, \"predicted\": %d}",
+               index, actualClass, predictedClass);
+    }
+}
+
+// Writes overall metrics as one record.
+static void writeOverall(const char *label, const ClassMetrics *m) {
+    beginRecord(RECORD_OVERALL);
+    if (format == OUTPUT_CSV) {
+        printf("overall,%s,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f\n", label, m->precision, m->recall, m->specificity,
+               m->f1Score, m->fpr, m->accuracy);
+    } else {
+        printf("{\"type\": \"overall\", \"label\": ");
+        printJsonString(label);
+        printf(", \"precision\": %.6f, \"recall\": %.6f, \"specificity\": %.6f, \"f1_score\": %.6f, "
+               "\"fpr\": %.6f, \"accuracy\": %.6f}",
+               m->precision, m->recall, m->specificity, m->f1Score, m->fpr, m->accuracy);
+    }
+}
+
+// Writes a confusion matrix with its per-class and overall metrics.
+void outputConfusionMatrix(const ConfusionMatrix *cm, const char *label) {
+    if (confusionPath) {
+        saveDetailedConfusionMatrixToFile(*cm, confusionPath, label);
+    }
+    if (format == OUTPUT_QUIET) {
+        return;
+    }
+    if (format == OUTPUT_TEXT) {
+        printDetailedConfusionMatrix(*cm);
+        return;
+    }
+
+    // Matrix cells, rows are actual classes and columns predicted classes
+    if (format == OUTPUT_CSV) {
+        for (int i = 0; i < cm->classCount; i++) {
+            for (int j = 0; j < cm->classCount; j++) {
+                beginRecord(RECORD_CONFUSION);
+                printf("confusion,%s,%d,%d,%d\n", label, i + 1, j + 1, confusionCell(cm, i, j));
+            }
+        }
+    } else {
+        beginRecord(RECORD_CONFUSION);
+        printf("{\"type\": \"confusion\", \"label\": ");
+        printJsonString(label);
+        printf(", \"matrix\": [");
+        for (int i = 0; i < cm->classCount; i++) {
+            printf(i > 0 ? ", [" : "[");
+            for (int j = 0; j < cm->classCount; j++) {
+                printf(j > 0 ? ", %d" : "%d", confusionCell(cm, i, j));
+            }
+            printf("]");
+        }
+        printf("]}");
+    }
+
+    Arena *scratch = scratchArena(PROFILE_METRICS);
+    ArenaMark mark = arenaMark(scratch);
+    ConfusionMatrixMetrics metrics = calculateStatisticsInArena(cm, scratch);
+    for (int i = 0; i < cm->classCount; i++) {
+        ClassCounts c = confusionClassCounts(cm, i);
+        int TP = c.truePositives, FP = c.falsePositives, FN = c.falseNegatives, TN = c.trueNegatives;
+        const ClassMetrics *m = &metrics.classMetrics[i];
+
+        beginRecord(RECORD_CLASS);
+        if (format == OUTPUT_CSV) {
+            printf("class,%s,%d,%d,%d,%d,%d,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f\n", label, i + 1, TP, FP, FN, TN,
+                   m->precision, m->recall, m->specificity, m->f1Score, m->fpr, m->accuracy);
+        } else {
+            printf("{\"type\": \"class\", \"label\": ");
+            printJsonString(label);
+            printf(", \"class\": %d, \"tp\": %d, \"fp\": %d, \"fn\": %d, \"tn\": %d, \"precision\": %.6f, "
+                   "\"recall\": %.6f, \"specificity\": %.6f, \"f1_score\": %.6f, \"fpr\": %.6f, \"accuracy\": %.6f}",
+                   i + 1, TP, FP, FN, TN, m->precision, m->recall, m->specificity, m->f1Score, m->fpr, m->accuracy);
+        }
+    }
+    writeOverall(label, &metrics.overallMetrics);
+    char microLabel[256];
+    snprintf(microLabel, sizeof(microLabel), "%s micro", label);
+    writeOverall(microLabel, &metrics.microMetrics);
+    arenaReset(scratch, mark);
+}
+
+// Writes overall metrics computed elsewhere.
+void outputMetrics(const char *label, const ClassMetrics *metrics) {
+    if (format == OUTPUT_QUIET) {
+        return;
+    }
+    if (format == OUTPUT_TEXT) {
+        printf("%s: Precision = %.4f, Recall = %.4f, F1 Score = %.4f, Accuracy = %.2f%%\n", label,
+               metrics->precision, metrics->recall, metrics->f1Score, metrics->accuracy * 100);
+        return;
+    }
+    writeOverall(label, metrics);
+}
+
+// Writes the membership of one clustered point when predictions are requested.
+void outputClusterMember(int cluster, int clusterClass, int point, int pointClass) {
+    if (!writePredictions || format == OUTPUT_QUIET) {
+        return;
+    }
+    if (format == OUTPUT_TEXT) {
+        if (cluster != lastCluster) {
+            printf("%sCluster %d:\n  Classes in Cluster:\n", lastCluster >= 0 ? "\n" : "", clusterClass);
+            lastCluster = cluster;
+        }
+        printf("    Point %d: Class %d\n", point + 1, pointClass);
+        return;
+    }
+    beginRecord(RECORD_MEMBER);
+    if (format == OUTPUT_CSV) {
+        printf("member,%d,%d,%d,%d\n", cluster, clusterClass, point, pointClass);
+    } else {
+        printf("{\"type\": \"member\", \"cluster\": %d, \"cluster_class\": %d, \"point\": %d, \"point_class\": %d}",
+               cluster, clusterClass, point, pointClass);
+    }
+}
+
+// Writes the quality scores of a clustering.
+void outputClustering(int k, double silhouette, double wcss, double bcss) {
+    if (format == OUTPUT_QUIET) {
+        return;
+    }
+    if (format == OUTPUT_TEXT) {
+        printf("%sSilhouette Score: %f\n", lastCluster >= 0 ? "\n" : "", silhouette);
+        printf("Within-Cluster Sum of Squares: %f\n", wcss);
+        printf("Between-Cluster Sum of Squares: %f\n", bcss);
+        return;
+    }
+    beginRecord(RECORD_CLUSTERING);
+    if (format == OUTPUT_CSV) {
+        printf("clustering,%d,%.6f,%.6f,%.6f\n", k, silhouette, wcss, bcss);
+    } else {
+        printf("{\"type\": \"clustering\", \"k\": %d, \"silhouette\": %.6f, \"wcss\": %.6f, \"bcss\": %.6f}",
+               k, silhouette, wcss, bcss);
+    }
+}
+
+// Closes the JSON document and flushes the buffered output.
+void finishOutput(void) {
+    if (format == OUTPUT_JSON) {
+        printf("\n]}\n");
+    }
+    fflush(stdout);
+}
@@ -0,0 +1,102 @@
+/**
+ * @file output.h
+ * @brief Header file for the result output layer: text, quiet, CSV and JSON modes.
+ *
+ * Results are written to the standard output through one large buffer. In CSV mode
+ * every line starts with its record type and the first line of each type is its
+ * header, so a single record type can be extracted with grep. In JSON mode the run
+ * produces one document holding an array of typed records. Per-sample records are
+ * only written when predictions are requested.
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include "confusion_matrix.h"
+
+// Output formats
+#define OUTPUT_TEXT 0
+#define OUTPUT_QUIET 1
+#define OUTPUT_CSV 2
+#define OUTPUT_JSON 3
+
+/**
+ * @brief Converts a format name ('text', 'quiet', 'csv' or 'json') to its constant.
+ *
+ * @param name Name given on the command line.
+ * @return The matching OUTPUT_* constant, or -1 for unknown names.
+ */
+int parseOutputFormat(const char *name);
+
+/**
+ * @brief Configures the output layer; must be called before any other output function.
+ *
+ * @param format OUTPUT_* format of the standard output.
+ * @param predictions Non-zero to write one record per classified sample or clustered point.
+ * @param confusionFile Path receiving every confusion matrix in the detailed text layout, NULL to skip it.
+ */
+void initOutput(int format, int predictions, const char *confusionFile);
+
+/**
+ * @brief Returns the configured output format.
+ */
+int outputFormat(void);
+
+/**
+ * @brief Prints a human-readable message, only in text mode.
+ *
+ * @param format printf format string.
+ */
+void outputMessage(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+/**
+ * @brief Writes the prediction of one sample when predictions are requested.
+ *
+ * @param index Index of the sample in the evaluated set.
+ * @param actualClass Known class of the sample.
+ * @param predictedClass Predicted class.
+ */
+void outputPrediction(int index, int actualClass, int predictedClass);
+
+/**
+ * @brief Writes a confusion matrix with its per-class and overall metrics.
+ *
+ * @param cm Pointer to the confusion matrix.
+ * @param label Label identifying the evaluation, for example "test".
+ */
+void outputConfusionMatrix(const ConfusionMatrix *cm, const char *label);
+
+/**
+ * @brief Writes overall metrics computed elsewhere, for example those of one fold.
+ *
+ * @param label Label identifying the evaluation, for example "fold 1".
+ * @param metrics Pointer to the metrics.
+ */
+void outputMetrics(const char *label, const ClassMetrics *metrics);
+
+/**
+ * @brief Writes the membership of one clustered point when predictions are requested.
+ *
+ * @param cluster Index of the cluster.
+ * @param clusterClass Majority class of the cluster.
+ * @param point Index of the point within the cluster.
+ * @param pointClass Known class of the point.
+ */
+void outputClusterMember(int cluster, int clusterClass, int point, int pointClass);
+
+/**
+ * @brief Writes the quality scores of a clustering.
+ *
+ * @param k Number of clusters.
+ * @param silhouette Silhouette score.
+ * @param wcss Within-cluster sum of squares.
+ * @param bcss Between-cluster sum of squares.
+ */
+void outputClustering(int k, double silhouette, double wcss, double bcss);
+
+/**
+ * @brief Closes the JSON document and flushes the buffered output.
+ */
+void finishOutput(void);
+
+#endif // OUTPUT_H
@@ -0,0 +1,168 @@
+#include "partial_distance.h"
+#include "profiler.h"
+#include "arena.h"
+
+#include <string.h>
+
+/**
+ * @struct FeatureSpread
+ * @brief Variance of one feature over the training set.
+ */
+typedef struct {
+    double variance;
+    int feature;
+} FeatureSpread;
+
+// Orders features by decreasing variance, then by index.
+static int compareSpread(const void *a, const void *b) {
+    const FeatureSpread *first = a, *second = b;
+    if (first->variance != second->variance) {
+        return first->variance < second->variance ? 1 : -1;
+    }
+    return first->feature - second->feature;
+}
+
+// Returns the p-th power of an absolute difference.
+static inline double powerTerm(double difference, int p) {
+    return p == 1 ? fabs(difference) : p == 2 ? difference * difference : pow(fabs(difference), p);
+}
+
+// Builds the index of a training set.
+int buildPartialDistanceIndex(PartialDistanceIndex *index, const ShapeData *trainingSet, int trainingSize,
+                              int featureCount, int p) {
+    memset(index, 0, sizeof(PartialDistanceIndex));
+    if (!trainingSet || trainingSize <= 0 || featureCount <= 0 || p <= 0) {
+        fprintf(stderr, "Invalid parameters for the partial distance index\n");
+        return PARTIAL_DISTANCE_ERR_INVALID_INPUT;
+    }
+    index->trainingSet = trainingSet;
+    index->trainingSize = trainingSize;
+    index->featureCount = featureCount;
+    index->p = p;
+    index->featureOrder = malloc(featureCount * sizeof(int));
+    index->features = malloc((size_t)trainingSize * featureCount * sizeof(double));
+    if (!index->featureOrder || !index->features) {
+        fprintf(stderr, "Memory allocation failed for the partial distance index\n");
+        freePartialDistanceIndex(index);
+        return PARTIAL_DISTANCE_ERR_MEMORY;
+    }
+    profileCount(PROFILE_PREPROCESS, PROFILE_ALLOCATIONS, 2);
+    ProfileScope scope = profileBegin(PROFILE_PREPROCESS);
+
+    // Rank the features by their variance over the training set as it is searched
+    Arena *scratch = scratchArena(PROFILE_PREPROCESS);
+    ArenaMark mark = arenaMark(scratch);
+    FeatureSpread *spread = arenaCalloc(scratch, featureCount, sizeof(FeatureSpread));
+    double *mean = arenaCalloc(scratch, featureCount, sizeof(double));
+    if (!spread || !mean) {
+        fprintf(stderr, "Memory allocation failed for the partial distance index\n");
+        arenaReset(scratch, mark);
+        profileEnd(&scope);
+        freePartialDistanceIndex(index);
+        return PARTIAL_DISTANCE_ERR_MEMORY;
+    }
+    for (int i = 0; i < trainingSize; i++) {
+        for (int f = 0; f < featureCount; f++) {
+            mean[f] += trainingSet[i].features[f];
+        }
+    }
+    for (int f = 0; f < featureCount; f++) {
+        mean[f] /= trainingSize;
+        spread[f].feature = f;
+    }
+    for (int i = 0; i < trainingSize; i++) {
+        for (int f = 0; f < featureCount; f++) {
+            double deviation = trainingSet[i].features[f] - mean[f];
+            spread[f].variance += deviation * deviation;
+        }
+    }
+    qsort(spread, featureCount, sizeof(FeatureSpread), compareSpread);
+    for (int f = 0; f < featureCount; f++) {
+        index->featureOrder[f] = spread[f].feature;
+    }
+    arenaReset(scratch, mark);
+
+    for (int i = 0; i < trainingSize; i++) {
+        double *row = index->features + (size_t)i * featureCount;
+        for (int f = 0; f < featureCount; f++) {
+            row[f] = trainingSet[i].features[index->featureOrder[f]];
+        }
+    }
+    profileEnd(&scope);
+    return PARTIAL_DISTANCE_SUCCESS;
+}
+
+// Finds the k nearest training samples of a query, abandoning every sample once it cannot enter the heap.
+int partialDistanceSearch(const void *searchIndex, const ShapeData *query, int k, DistanceLabel *neighbors) {
+    const PartialDistanceIndex *index = searchIndex;
+    if (!index || !query || !neighbors || k <= 0 || k > index->trainingSize) {
+        return PARTIAL_DISTANCE_ERR_INVALID_INPUT;
+    }
+    int n = index->trainingSize, d = index->featureCount, p = index->p;
+    Arena *scratch = scratchArena(PROFILE_DISTANCE);
+    ArenaMark mark = arenaMark(scratch);
+    double *ordered = arenaAlloc(scratch, d * sizeof(double));
+    if (!ordered) {
+        return PARTIAL_DISTANCE_ERR_MEMORY;
+    }
+    for (int f = 0; f < d; f++) {
+        ordered[f] = query->features[index->featureOrder[f]];
+    }
+
+    // Cheap terms are compared with the threshold once per block, pow() terms after every feature
+    int block = p <= 2 ? PARTIAL_DISTANCE_BLOCK : 1;
+    NeighborHeap heap = {neighbors, 0, k};
+    uint64_t abandoned = 0, skipped = 0;
+    for (int i = 0; i < n; i++) {
+        const double *row = index->features + (size_t)i * d;
+        double threshold = heap.count < k ? INFINITY : heap.entries[0].distance;
+        double sum = 0.0;
+        int f = 0;
+        while (f < d && sum <= threshold) {
+            int end = f + block < d ? f + block : d;
+            for (; f < end; f++) {
+                sum += powerTerm(ordered[f] - row[f], p);
+            }
+        }
+        // The terms are non-negative, so a partial sum above the k-th smallest can only grow
+        if (sum > threshold) {
+            abandoned++;
+            skipped += d - f;
+            continue;
+        }
+        knnHeapOffer(&heap, (DistanceLabel){sum, i});
+    }
+    arenaReset(scratch, mark);
+    profileCount(PROFILE_DISTANCE, PROFILE_DISTANCE_EVALUATIONS, n);
+    profileCount(PROFILE_DISTANCE, PROFILE_ABANDONED_DISTANCES, abandoned);
+    profileCount(PROFILE_DISTANCE, PROFILE_SKIPPED_FEATURES, skipped);
+
+    knnSortNeighbors(neighbors, k);
+    for (int i = 0; i < k; i++) {
+        neighbors[i].distance = minkowskiRoot(neighbors[i].distance, p);
+    }
+    return PARTIAL_DISTANCE_SUCCESS;
+}
+
+// Classifies every test sample in parallel into thread-local confusion matrices.
+int partialDistanceClassifyBatch(const PartialDistanceIndex *index, const ShapeData *testSet, int testSize, int k,
+                                 ConfusionMatrix *cm, int *predictions) {
+    if (!index || !testSet || !cm || !predictions || k <= 0 || k > index->trainingSize) {
+        fprintf(stderr, "Invalid parameters for partial distance classification\n");
+        return PARTIAL_DISTANCE_ERR_INVALID_INPUT;
+    }
+    ProfileScope scope = profileBegin(PROFILE_DISTANCE);
+    int status = classifyWithSearch(index, partialDistanceSearch, index->trainingSet, testSet, testSize, k, cm,
+                                    predictions);
+    profileEnd(&scope);
+    return status == KNN_ERR_MEMORY_ALLOCATION ? PARTIAL_DISTANCE_ERR_MEMORY : status;
+}
+
+// Frees the reordered features of an index.
+void freePartialDistanceIndex(PartialDistanceIndex *index) {
+    if (index) {
+        free(index->featureOrder);
+        free(index->features);
+        memset(index, 0, sizeof(PartialDistanceIndex));
+    }
+}
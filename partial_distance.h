@@ -0,0 +1,98 @@
+/**
+ * @file partial_distance.h
+ * @brief Header file for the exact k-NN search with early abandoning (partial distance search).
+ *
+ * A query only needs to know whether a training sample is nearer than its current k-th
+ * nearest neighbor. The search keeps the k nearest samples in a max-heap and compares
+ * in p-th power space, where the distance is a sum of non-negative terms: once the
+ * partial sum of a sample exceeds the k-th smallest sum, the sample cannot enter the
+ * heap and the rest of its features are skipped. The result is the same as a full scan.
+ *
+ * The features are visited by decreasing variance over the training set, so the terms
+ * that are likely to be largest come first and the threshold is crossed early. The
+ * training features are stored once in that order as a row-major matrix, and every
+ * query is permuted to match before its scan.
+ *
+ * For p above 2 every term costs a pow() call, so skipping features pays the most there.
+ * The classifiers use this search by default from PARTIAL_DISTANCE_MIN_P on. The
+ * abandoned distances and skipped features are reported as profiler counters.
+ */
+
+#ifndef PARTIAL_DISTANCE_H
+#define PARTIAL_DISTANCE_H
+
+#include "knn.h"
+
+// Error codes
+#define PARTIAL_DISTANCE_SUCCESS 0
+#define PARTIAL_DISTANCE_ERR_INVALID_INPUT -1
+#define PARTIAL_DISTANCE_ERR_MEMORY -2
+
+// Smallest Minkowski exponent for which the k-NN classifiers search with early abandoning
+#define PARTIAL_DISTANCE_MIN_P 3
+
+// Features added between two comparisons with the threshold for p = 1 and p = 2, whose terms are cheap
+#define PARTIAL_DISTANCE_BLOCK 8
+
+/**
+ * @struct PartialDistanceIndex
+ * @brief Training features reordered by decreasing variance.
+ */
+typedef struct {
+    const ShapeData *trainingSet; /**< Training samples, whose classes vote; not owned. */
+    int trainingSize;             /**< Number of training samples. */
+    int featureCount;             /**< Number of features in every sample. */
+    int p;                        /**< Minkowski exponent. */
+    int *featureOrder;            /**< Features by decreasing variance. */
+    double *features;             /**< trainingSize x featureCount training features, in featureOrder. */
+} PartialDistanceIndex;
+
+/**
+ * @brief Builds the index of a training set.
+ *
+ * @param index Index to initialize.
+ * @param trainingSet Training samples, which must outlive the index.
+ * @param trainingSize Number of training samples.
+ * @param featureCount Number of features in every sample.
+ * @param p Minkowski exponent.
+ * @return PARTIAL_DISTANCE_SUCCESS or a PARTIAL_DISTANCE_ERR_* code.
+ */
+int buildPartialDistanceIndex(PartialDistanceIndex *index, const ShapeData *trainingSet, int trainingSize,
+                              int featureCount, int p);
+
+/**
+ * @brief Finds the k nearest training samples of a query.
+ *
+ * The signature matches KnnIndexSearch, so the index can be attached to a batch classifier.
+ *
+ * @param index Built PartialDistanceIndex.
+ * @param query Sample to search for.
+ * @param k Number of neighbors, between 1 and the training size.
+ * @param neighbors Output array of k Minkowski distances and training indices, nearest first,
+ *                  ties going to the smaller index.
+ * @return PARTIAL_DISTANCE_SUCCESS or a PARTIAL_DISTANCE_ERR_* code.
+ */
+int partialDistanceSearch(const void *index, const ShapeData *query, int k, DistanceLabel *neighbors);
+
+/**
+ * @brief Classifies every test sample in parallel and tallies the results.
+ *
+ * @param index Built index.
+ * @param testSet Samples to classify, whose classes are the actual classes.
+ * @param testSize Number of samples.
+ * @param k Number of neighbors voting.
+ * @param cm Confusion matrix receiving the results.
+ * @param predictions Output array of testSize predicted classes.
+ * @return PARTIAL_DISTANCE_SUCCESS or a PARTIAL_DISTANCE_ERR_* code.
+ */
+int partialDistanceClassifyBatch(const PartialDistanceIndex *index, const ShapeData *testSet, int testSize, int k,
+                                 ConfusionMatrix *cm, int *predictions);
+
+/**
+ * @brief Frees the reordered features of an index.
+ *
+ * @param index Index to free.
+ */
+void freePartialDistanceIndex(PartialDistanceIndex *index);
+
+#endif // PARTIAL_DISTANCE_H
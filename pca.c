@@ -0,0 +1,272 @@
+#include "pca.h"
+#include "profiler.h"
+#include "arena.h"
+#include "kernels.h"
+
+#include <math.h>
+
+// Writes the scaled features of a sample, as applyPreprocessing would produce them.
+static void scaleSample(const PreprocessingParams *params, const double *features, double *scaled) {
+    if (params->method == PREPROCESS_NONE) {
+        memcpy(scaled, features, params->featureCount * sizeof(double));
+        return;
+    }
+    for (int j = 0; j < params->featureCount; j++) {
+        scaled[j] = (features[j] - params->offset[j]) / params->scale[j];
+    }
+}
+
+// Computes the mean and covariance of the scaled features with thread-local accumulators.
+int computeCovariance(const PreprocessingParams *params, const ShapeData *data, int dataSize, double *mean,
+                      double *covariance) {
+    int d = params->featureCount;
+    if (!data || dataSize < 2 || d <= 0) {
+        return PCA_ERR_INVALID_INPUT;
+    }
+    memset(mean, 0, d * sizeof(double));
+    memset(covariance, 0, (size_t)d * d * sizeof(double));
+
+    int failed = 0;
+    #pragma omp parallel reduction(|:failed)
+    {
+        Arena *scratch = scratchArena(PROFILE_PREPROCESS);
+        ArenaMark mark = arenaMark(scratch);
+        double *scaled = arenaAlloc(scratch, d * sizeof(double));
+        double *sums = arenaCalloc(scratch, d, sizeof(double));
+        double *scatter = arenaCalloc(scratch, (size_t)d * d, sizeof(double));
+        // Every thread has to reach the worksharing constructs, so a failed thread only skips the work
+        int ready = scaled && sums && scatter;
+        failed = !ready;
+
+        #pragma omp for schedule(static)
+        for (int i = 0; i < dataSize; i++) {
+            if (!ready) continue;
+            scaleSample(params, data[i].features, scaled);
+            for (int j = 0; j < d; j++) {
+                sums[j] += scaled[j];
+            }
+        }
+        #pragma omp critical(pca_mean_merge)
+        for (int j = 0; ready && j < d; j++) {
+            mean[j] += sums[j];
+        }
+        #pragma omp barrier
+        #pragma omp single
+        for (int j = 0; j < d; j++) {
+            mean[j] /= dataSize;
+        }
+
+        // Upper triangle of the scatter matrix of the centered samples
+        #pragma omp for schedule(static)
+        for (int i = 0; i < dataSize; i++) {
+            if (!ready) continue;
+            scaleSample(params, data[i].features, scaled);
+            for (int j = 0; j < d; j++) {
+                scaled[j] -= mean[j];
+            }
+            for (int a = 0; a < d; a++) {
+                double *row = scatter + (size_t)a * d;
+                double x = scaled[a];
+                for (int b = a; b < d; b++) {
+                    row[b] += x * scaled[b];
+                }
+            }
+        }
+        #pragma omp critical(pca_scatter_merge)
+        for (int a = 0; ready && a < d; a++) {
+            for (int b = a; b < d; b++) {
+                covariance[(size_t)a * d + b] += scatter[(size_t)a * d + b];
+            }
+        }
+        arenaReset(scratch, mark);
+    }
+    if (failed) {
+        return PCA_ERR_MEMORY;
+    }
+
+    for (int a = 0; a < d; a++) {
+        for (int b = a; b < d; b++) {
+            covariance[(size_t)a * d + b] /= dataSize - 1;
+            covariance[(size_t)b * d + a] = covariance[(size_t)a * d + b];
+        }
+    }
+    return PCA_SUCCESS;
+}
+
+// Diagonalizes a symmetric matrix with cyclic Jacobi rotations.
+int symmetricEigen(double *matrix, int n, double *eigenvalues, double *eigenvectors) {
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            eigenvectors[(size_t)i * n + j] = i == j ? 1.0 : 0.0;
+        }
+    }
+
+    double norm = 0;
+    for (size_t i = 0; i < (size_t)n * n; i++) {
+        norm += matrix[i] * matrix[i];
+    }
+
+    int status = PCA_ERR_NO_CONVERGENCE;
+    for (int sweep = 0; sweep < PCA_MAX_SWEEPS; sweep++) {
+        double offDiagonal = 0;
+        for (int p = 0; p < n; p++) {
+            for (int q = p + 1; q < n; q++) {
+                offDiagonal += matrix[(size_t)p * n + q] * matrix[(size_t)p * n + q];
+            }
+        }
+        if (offDiagonal <= 1e-24 * norm) {
+            status = PCA_SUCCESS;
+            break;
+        }
+
+        for (int p = 0; p < n; p++) {
+            for (int q = p + 1; q < n; q++) {
+                double apq = matrix[(size_t)p * n + q];
+                if (fabs(apq) < 1e-300) continue;
+
+                // Rotation angle that zeroes the (p, q) entry, taking the smaller root for stability
+                double theta = (matrix[(size_t)q * n + q] - matrix[(size_t)p * n + p]) / (2 * apq);
+                double t = (theta >= 0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1));
+                double c = 1 / sqrt(t * t + 1), s = t * c;
+
+                for (int k = 0; k < n; k++) {
+                    double akp = matrix[(size_t)k * n + p], akq = matrix[(size_t)k * n + q];
+                    matrix[(size_t)k * n + p] = c * akp - s * akq;
+                    matrix[(size_t)k * n + q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < n; k++) {
+                    double apk = matrix[(size_t)p * n + k], aqk = matrix[(size_t)q * n + k];
+                    matrix[(size_t)p * n + k] = c * apk - s * aqk;
+                    matrix[(size_t)q * n + k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < n; k++) {
+                    double vkp = eigenvectors[(size_t)k * n + p], vkq = eigenvectors[(size_t)k * n + q];
+                    eigenvectors[(size_t)k * n + p] = c * vkp - s * vkq;
+                    eigenvectors[(size_t)k * n + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        eigenvalues[i] = matrix[(size_t)i * n + i];
+    }
+    return status;
+}
+
+// Fits the principal axes of the scaled samples.
+int fitPca(PreprocessingParams *params, const ShapeData *data, int dataSize, int components,
+           double varianceThreshold) {
+    int d = params->featureCount;
+    if (!data || dataSize < 2 || d <= 0 || components < 0 || components > d ||
+        (components == 0 && (varianceThreshold <= 0 || varianceThreshold > 1))) {
+        fprintf(stderr, "Invalid parameters for PCA\n");
+        return PCA_ERR_INVALID_INPUT;
+    }
+    ProfileScope scope = profileBegin(PROFILE_PREPROCESS);
+
+    Arena *scratch = scratchArena(PROFILE_PREPROCESS);
+    ArenaMark mark = arenaMark(scratch);
+    double *covariance = arenaAlloc(scratch, (size_t)d * d * sizeof(double));
+    double *eigenvectors = arenaAlloc(scratch, (size_t)d * d * sizeof(double));
+    double *eigenvalues = arenaAlloc(scratch, d * sizeof(double));
+    int *order = arenaAlloc(scratch, d * sizeof(int));
+    double *mean = malloc(d * sizeof(double));
+    if (!covariance || !eigenvectors || !eigenvalues || !order || !mean) {
+        free(mean);
+        arenaReset(scratch, mark);
+        profileEnd(&scope);
+        return PCA_ERR_MEMORY;
+    }
+
+    int status = computeCovariance(params, data, dataSize, mean, covariance);
+    if (status == PCA_SUCCESS) {
+        status = symmetricEigen(covariance, d, eigenvalues, eigenvectors);
+    }
+    if (status != PCA_SUCCESS) {
+        free(mean);
+        arenaReset(scratch, mark);
+        profileEnd(&scope);
+        return status;
+    }
+
+    // Order the axes by decreasing variance; rounding can leave tiny negative eigenvalues
+    double totalVariance = 0;
+    for (int i = 0; i < d; i++) {
+        if (eigenvalues[i] < 0) eigenvalues[i] = 0;
+        totalVariance += eigenvalues[i];
+        order[i] = i;
+    }
+    for (int i = 1; i < d; i++) {
+        int current = order[i], j = i;
+        while (j > 0 && eigenvalues[order[j - 1]] < eigenvalues[current]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = current;
+    }
+
+    double kept = 0;
+    if (components == 0) {
+        while (components < d && (components == 0 || kept < varianceThreshold * totalVariance)) {
+            kept += eigenvalues[order[components++]];
+        }
+    } else {
+        for (int c = 0; c < components; c++) {
+            kept += eigenvalues[order[c]];
+        }
+    }
+
+    double *projection = malloc((size_t)components * d * sizeof(double));
+    if (!projection) {
+        free(mean);
+        arenaReset(scratch, mark);
+        profileEnd(&scope);
+        return PCA_ERR_MEMORY;
+    }
+    for (int c = 0; c < components; c++) {
+        for (int j = 0; j < d; j++) {
+            projection[(size_t)c * d + j] = eigenvectors[(size_t)j * d + order[c]];
+        }
+    }
+
+    free(params->pcaMean);
+    free(params->projection);
+    params->pcaMean = mean;
+    params->projection = projection;
+    params->components = components;
+    params->explainedVariance = totalVariance > 0 ? kept / totalVariance : 1.0;
+    profileCount(PROFILE_PREPROCESS, PROFILE_ALLOCATIONS, 2);
+    arenaReset(scratch, mark);
+    profileEnd(&scope);
+    return PCA_SUCCESS;
+}
+
+// Replaces the scaled features of every sample by their principal components.
+void projectPca(const PreprocessingParams *params, ShapeData *data, int dataSize) {
+    int d = params->featureCount, r = params->components;
+    const FeatureKernels *kernels = kernelsFor(d);
+    #pragma omp parallel
+    {
+        Arena *scratch = scratchArena(PROFILE_PREPROCESS);
+        ArenaMark mark = arenaMark(scratch);
+        double *centered = arenaAlloc(scratch, d * sizeof(double));
+        if (!centered) {
+            fprintf(stderr, "Memory allocation failed for the PCA projection\n");
+            exit(ERR_MEMORY_ALLOCATION_FAILED);
+        }
+
+        #pragma omp for schedule(static)
+        for (int i = 0; i < dataSize; i++) {
+            for (int j = 0; j < d; j++) {
+                centered[j] = data[i].features[j] - params->pcaMean[j];
+            }
+            // r <= d, so the projection fits in the existing feature array
+            for (int c = 0; c < r; c++) {
+                data[i].features[c] = kernels->dot(params->projection + (size_t)c * d, centered, d);
+            }
+            data[i].featureCount = r;
+        }
+        arenaReset(scratch, mark);
+    }
+}
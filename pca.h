@@ -0,0 +1,73 @@
+/**
+ * @file pca.h
+ * @brief Header file for principal component analysis as a preprocessing stage.
+ *
+ * The covariance of the scaled training features is accumulated in parallel and
+ * diagonalized with the cyclic Jacobi method, so no LAPACK is needed. The descriptors
+ * have at most a few hundred features, for which the O(d^3) sweeps take milliseconds.
+ */
+
+#ifndef PCA_H
+#define PCA_H
+
+#include "preprocessing.h"
+
+// Error codes
+#define PCA_SUCCESS 0
+#define PCA_ERR_INVALID_INPUT -1
+#define PCA_ERR_MEMORY -2
+#define PCA_ERR_NO_CONVERGENCE -3
+
+// Maximum number of Jacobi sweeps before giving up
+#define PCA_MAX_SWEEPS 100
+
+/**
+ * @brief Computes the mean and covariance of the features as scaled by the parameters.
+ *
+ * The samples are not modified. Every thread accumulates the upper triangle of the
+ * scatter matrix of its share of the samples, and the partial matrices are summed.
+ *
+ * @param params Fitted scaling parameters; the PCA fields are ignored.
+ * @param data Samples to fit on.
+ * @param dataSize Number of samples, at least 2.
+ * @param mean Output array of featureCount means.
+ * @param covariance Output featureCount x featureCount symmetric matrix, row-major.
+ * @return PCA_SUCCESS or a PCA_ERR_* code.
+ */
+int computeCovariance(const PreprocessingParams *params, const ShapeData *data, int dataSize, double *mean,
+                      double *covariance);
+
+/**
+ * @brief Computes the eigenvalues and eigenvectors of a symmetric matrix with the cyclic Jacobi method.
+ *
+ * @param matrix Row-major n x n symmetric matrix; destroyed by the rotations.
+ * @param n Order of the matrix.
+ * @param eigenvalues Output array of n eigenvalues, in no particular order.
+ * @param eigenvectors Output row-major n x n matrix whose column i is the eigenvector of eigenvalue i.
+ * @return PCA_SUCCESS, or PCA_ERR_NO_CONVERGENCE after PCA_MAX_SWEEPS sweeps.
+ */
+int symmetricEigen(double *matrix, int n, double *eigenvalues, double *eigenvectors);
+
+/**
+ * @brief Fits a PCA projection on the scaled samples and stores it in the parameters.
+ *
+ * @param params Parameters returned by fitPreprocessing on the same samples.
+ * @param data Samples to fit on, usually the training set, not yet transformed.
+ * @param dataSize Number of samples, at least 2.
+ * @param components Number of components to keep, 0 to choose it by varianceThreshold.
+ * @param varianceThreshold Smallest fraction of the variance to keep, used when components is 0.
+ * @return PCA_SUCCESS or a PCA_ERR_* code.
+ */
+int fitPca(PreprocessingParams *params, const ShapeData *data, int dataSize, int components,
+           double varianceThreshold);
+
+/**
+ * @brief Projects scaled samples in place on the fitted principal axes.
+ *
+ * @param params Parameters holding a fitted projection.
+ * @param data Samples already scaled with the same parameters.
+ * @param dataSize Number of samples.
+ */
+void projectPca(const PreprocessingParams *params, ShapeData *data, int dataSize);
+
+#endif // PCA_H
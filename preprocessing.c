@@ -0,0 +1,109 @@
+#include "preprocessing.h"
+#include "normalization.h"
+#include "standardization.h"
+#include "pca.h"
+#include "profiler.h"
+#include "kernels.h"
+#include <float.h>   // For DBL_MAX.
+
+// Converts a preprocessing name to its method constant.
+int parsePreprocessingMethod(const char *name) {
+    if (name && strcmp(name, "normalize") == 0) {
+        return PREPROCESS_NORMALIZE;
+    } else if (name && strcmp(name, "standardize") == 0) {
+        return PREPROCESS_STANDARDIZE;
+    }
+    return PREPROCESS_NONE;
+}
+
+// Converts a preprocessing method constant back to its name.
+const char *preprocessingMethodName(int method) {
+    if (method == PREPROCESS_NORMALIZE) {
+        return "normalize";
+    } else if (method == PREPROCESS_STANDARDIZE) {
+        return "standardize";
+    }
+    return "none";
+}
+
+// Fits the per-feature offset and scale on the given samples.
+PreprocessingParams fitPreprocessing(ShapeData *data, int dataSize, int featureCount, int method) {
+    PreprocessingParams params = {PREPROCESS_NONE, featureCount, NULL, NULL, 0, NULL, NULL, 0};
+    if (method == PREPROCESS_NONE || !data || dataSize <= 0) {
+        return params;
+    }
+    ProfileScope scope = profileBegin(PROFILE_PREPROCESS);
+
+    params.offset = malloc(featureCount * sizeof(double));
+    params.scale = malloc(featureCount * sizeof(double));
+    if (!params.offset || !params.scale) {
+        fprintf(stderr, "Memory allocation failed for preprocessing parameters\n");
+        exit(ERR_MEMORY_ALLOCATION_FAILED);
+    }
+    params.method = method;
+
+    if (method == PREPROCESS_NORMALIZE) {
+        // Offset is the minimum, scale is the range of each feature.
+        for (int j = 0; j < featureCount; j++) {
+            params.offset[j] = DBL_MAX;
+            params.scale[j] = -DBL_MAX;
+        }
+        findMinMax(data, dataSize, params.offset, params.scale, featureCount);
+        for (int j = 0; j < featureCount; j++) {
+            params.scale[j] -= params.offset[j];
+        }
+    } else {
+        // Offset is the mean, scale is the standard deviation of each feature.
+        calcMeanAndStd(data, dataSize, featureCount, params.offset, params.scale);
+    }
+
+    // Constant features are only shifted to avoid a division by zero.
+    for (int j = 0; j < featureCount; j++) {
+        if (params.scale[j] == 0) {
+            params.scale[j] = 1.0;
+        }
+    }
+    profileCount(PROFILE_PREPROCESS, PROFILE_ALLOCATIONS, 2);
+    profileEnd(&scope);
+    return params;
+}
+
+// Applies (x - offset) / scale to every feature of every sample, then the PCA projection if any.
+void applyPreprocessing(const PreprocessingParams *params, ShapeData *data, int dataSize) {
+    if (!params || (params->method == PREPROCESS_NONE && params->components == 0) || !data) {
+        return;
+    }
+    ProfileScope scope = profileBegin(PROFILE_PREPROCESS);
+
+    if (params->method != PREPROCESS_NONE) {
+        const FeatureKernels *kernels = kernelsFor(params->featureCount);
+        for (int i = 0; i < dataSize; i++) {
+            kernels->standardize(data[i].features, params->offset, params->scale, params->featureCount);
+        }
+    }
+    if (params->components > 0) {
+        projectPca(params, data, dataSize);
+    }
+    profileEnd(&scope);
+}
+
+// Returns the number of features of the samples after preprocessing.
+int preprocessedFeatureCount(const PreprocessingParams *params) {
+    return params->components > 0 ? params->components : params->featureCount;
+}
+
+// Frees the memory held by preprocessing parameters.
+void freePreprocessingParams(PreprocessingParams *params) {
+    if (params) {
+        free(params->offset);
+        free(params->scale);
+        free(params->pcaMean);
+        free(params->projection);
+        params->offset = NULL;
+        params->scale = NULL;
+        params->pcaMean = NULL;
+        params->projection = NULL;
+        params->method = PREPROCESS_NONE;
+        params->components = 0;
+    }
+}
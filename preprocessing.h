@@ -0,0 +1,92 @@
+/**
+ * @file preprocessing.h
+ * @brief Header file for fitting and applying feature preprocessing (normalization or standardization).
+ *
+ * The scaling can be followed by a PCA projection fitted with fitPca (see pca.h), after
+ * which the transformed samples hold only the leading principal components.
+ */
+
+#ifndef PREPROCESSING_H
+#define PREPROCESSING_H
+
+#include "data_reader.h" // Include to use the ShapeData structure
+
+// Supported preprocessing methods
+#define PREPROCESS_NONE 0
+#define PREPROCESS_NORMALIZE 1
+#define PREPROCESS_STANDARDIZE 2
+
+/**
+ * @struct PreprocessingParams
+ * @brief Fitted preprocessing parameters, applied as (x - offset) / scale per feature.
+ *
+ * For normalization the offset is the minimum and the scale the range of each feature,
+ * for standardization they are the mean and the standard deviation. When components is
+ * non-zero the scaled features are then centered and projected on the principal axes.
+ */
+typedef struct {
+    int method;          /**< One of the PREPROCESS_* constants. */
+    int featureCount;    /**< Number of features the parameters were fitted on. */
+    double *offset;      /**< Per-feature offset (NULL for PREPROCESS_NONE). */
+    double *scale;       /**< Per-feature scale (NULL for PREPROCESS_NONE). */
+    int components;      /**< Principal components kept, 0 without PCA. */
+    double *pcaMean;     /**< Mean of the scaled features (NULL without PCA). */
+    double *projection;  /**< Row-major components x featureCount principal axes (NULL without PCA). */
+    double explainedVariance; /**< Fraction of the training variance kept, 0 when loaded from a model. */
+} PreprocessingParams;
+
+/**
+ * @brief Converts a preprocessing name ('normalize', 'standardize', anything else) to its method constant.
+ *
+ * @param name Name given on the command line.
+ * @return The matching PREPROCESS_* constant, PREPROCESS_NONE for unknown names.
+ */
+int parsePreprocessingMethod(const char *name);
+
+/**
+ * @brief Converts a preprocessing method constant back to its name.
+ *
+ * @param method PREPROCESS_NONE, PREPROCESS_NORMALIZE or PREPROCESS_STANDARDIZE.
+ * @return 'none', 'normalize' or 'standardize'.
+ */
+const char *preprocessingMethodName(int method);
+
+/**
+ * @brief Fits preprocessing parameters on a set of samples without modifying them.
+ *
+ * @param data Pointer to the array of ShapeData to fit on (usually the training set).
+ * @param dataSize Number of ShapeData items.
+ * @param featureCount Number of features in each ShapeData item.
+ * @param method One of the PREPROCESS_* constants.
+ * @return The fitted parameters, to be released with freePreprocessingParams.
+ */
+PreprocessingParams fitPreprocessing(ShapeData *data, int dataSize, int featureCount, int method);
+
+/**
+ * @brief Applies fitted preprocessing parameters in place to a set of samples.
+ *
+ * With PCA the first components entries of every feature array receive the projection
+ * and the featureCount of every sample is set to components.
+ *
+ * @param params Parameters returned by fitPreprocessing or loaded from a model file.
+ * @param data Pointer to the array of ShapeData to transform.
+ * @param dataSize Number of ShapeData items.
+ */
+void applyPreprocessing(const PreprocessingParams *params, ShapeData *data, int dataSize);
+
+/**
+ * @brief Returns the number of features of the samples after preprocessing.
+ *
+ * @param params Fitted parameters.
+ * @return The number of principal components with PCA, the fitted feature count otherwise.
+ */
+int preprocessedFeatureCount(const PreprocessingParams *params);
+
+/**
+ * @brief Frees the memory held by preprocessing parameters.
+ *
+ * @param params Pointer to the parameters to be freed.
+ */
+void freePreprocessingParams(PreprocessingParams *params);
+
+#endif // PREPROCESSING_H
@@ -0,0 +1,166 @@
+#include "profiler.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+// Maximum number of trace events kept; later events are counted as dropped
+#define PROFILE_MAX_TRACE_EVENTS 200000
+
+/**
+ * @struct ProfileEvent
+ * @brief One trace event: a finished timer or a k-Means shift sample.
+ */
+typedef struct {
+    int phase;           /**< PROFILE_* phase, -1 for a shift sample. */
+    int thread;          /**< Small id of the recording thread. */
+    uint64_t start;      /**< Start time in nanoseconds. */
+    uint64_t duration;   /**< Duration in nanoseconds. */
+    double value;        /**< Shift of a shift sample. */
+} ProfileEvent;
+
+static const char *phaseNames[PROFILE_PHASE_COUNT] = {
+    "read", "preprocess", "distance", "vote", "kmeans", "metrics"
+};
+static const char *counterNames[PROFILE_COUNTER_COUNT] = {
+    "distance_evaluations", "allocations", "kmeans_iterations", "arena_bytes", "abandoned_distances",
+    "skipped_features"
+};
+
+int profilerEnabled = 0;
+
+static struct timespec origin;
+static uint64_t phaseTime[PROFILE_PHASE_COUNT];
+static uint64_t phaseCalls[PROFILE_PHASE_COUNT];
+static uint64_t counters[PROFILE_PHASE_COUNT][PROFILE_COUNTER_COUNT];
+static double lastShift = -1;
+static ProfileEvent *events = NULL;
+static uint64_t eventCount = 0;
+static int nextThreadId = 0;
+static __thread int threadId = -1;
+
+// Enables the profiler for the rest of the run.
+int profilerEnable(int traceEvents) {
+    clock_gettime(CLOCK_MONOTONIC, &origin);
+    if (traceEvents) {
+        events = malloc(PROFILE_MAX_TRACE_EVENTS * sizeof(ProfileEvent));
+        if (!events) {
+            return PROFILER_ERR_MEMORY;
+        }
+    }
+    profilerEnabled = 1;
+    return PROFILER_SUCCESS;
+}
+
+// Returns the time elapsed since the profiler was enabled, in nanoseconds.
+uint64_t profileNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - origin.tv_sec) * 1000000000ull + now.tv_nsec - origin.tv_nsec;
+}
+
+// Reserves a trace event slot, or returns NULL when tracing is off or the buffer is full.
+static ProfileEvent *reserveEvent(void) {
+    if (!events) {
+        return NULL;
+    }
+    uint64_t slot = __atomic_fetch_add(&eventCount, 1, __ATOMIC_RELAXED);
+    if (slot >= PROFILE_MAX_TRACE_EVENTS) {
+        return NULL;
+    }
+    if (threadId < 0) {
+        threadId = __atomic_fetch_add(&nextThreadId, 1, __ATOMIC_RELAXED);
+    }
+    events[slot].thread = threadId;
+    return &events[slot];
+}
+
+// Records a finished timer.
+void profileRecord(int phase, uint64_t start) {
+    uint64_t duration = profileNow() - start;
+    __atomic_fetch_add(&phaseTime[phase], duration, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&phaseCalls[phase], 1, __ATOMIC_RELAXED);
+
+    ProfileEvent *event = reserveEvent();
+    if (event) {
+        event->phase = phase;
+        event->start = start;
+        event->duration = duration;
+    }
+}
+
+// Adds to a counter of a phase.
+void profileAdd(int phase, int counter, uint64_t amount) {
+    __atomic_fetch_add(&counters[phase][counter], amount, __ATOMIC_RELAXED);
+}
+
+// Records the total centroid shift of one k-Means iteration.
+void profileShift(double shift) {
+    if (!profilerEnabled) {
+        return;
+    }
+    lastShift = shift;
+    ProfileEvent *event = reserveEvent();
+    if (event) {
+        event->phase = -1;
+        event->start = profileNow();
+        event->duration = 0;
+        event->value = shift;
+    }
+}
+
+// Prints the time, call count and counters of every phase.
+void profilerPrintSummary(FILE *output) {
+    fprintf(output, "\nProfile (phases may nest, times are inclusive):\n");
+    fprintf(output, "%-12s %12s %10s", "phase", "time (ms)", "calls");
+    for (int c = 0; c < PROFILE_COUNTER_COUNT; c++) {
+        fprintf(output, " %22s", counterNames[c]);
+    }
+    fprintf(output, "\n");
+
+    for (int phase = 0; phase < PROFILE_PHASE_COUNT; phase++) {
+        fprintf(output, "%-12s %12.3f %10llu", phaseNames[phase], phaseTime[phase] / 1e6,
+                (unsigned long long)phaseCalls[phase]);
+        for (int c = 0; c < PROFILE_COUNTER_COUNT; c++) {
+            fprintf(output, " %22llu", (unsigned long long)counters[phase][c]);
+        }
+        fprintf(output, "\n");
+    }
+    if (lastShift >= 0) {
+        fprintf(output, "Final k-Means convergence shift: %g\n", lastShift);
+    }
+    if (events && eventCount > PROFILE_MAX_TRACE_EVENTS) {
+        fprintf(output, "Trace events dropped: %llu\n", (unsigned long long)(eventCount - PROFILE_MAX_TRACE_EVENTS));
+    }
+}
+
+// Writes the recorded events in the Chrome trace-event JSON format.
+int profilerWriteTrace(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror("Failed to open the trace file");
+        return PROFILER_ERR_WRITE;
+    }
+
+    uint64_t count = eventCount < PROFILE_MAX_TRACE_EVENTS ? eventCount : PROFILE_MAX_TRACE_EVENTS;
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (uint64_t i = 0; events && i < count; i++) {
+        const ProfileEvent *event = &events[i];
+        if (event->phase < 0) {
+            fprintf(file, "{\"name\": \"kmeans_shift\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": 1, \"tid\": %d, "
+                          "\"args\": {\"shift\": %g}}",
+                    event->start / 1e3, event->thread, event->value);
+        } else {
+            fprintf(file, "{\"name\": \"%s\", \"cat\": \"phase\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                          "\"pid\": 1, \"tid\": %d}",
+                    phaseNames[event->phase], event->start / 1e3, event->duration / 1e3, event->thread);
+        }
+        fprintf(file, "%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(file, "]}\n");
+
+    int failed = ferror(file);
+    if (fclose(file) != 0 || failed) {
+        return PROFILER_ERR_WRITE;
+    }
+    return PROFILER_SUCCESS;
+}
@@ -0,0 +1,142 @@
+/**
+ * @file profiler.h
+ * @brief Header file for the phase-level profiler: scoped timers, counters and Chrome trace output.
+ *
+ * Every timer and counter call first checks a global flag, so a disabled profiler costs
+ * one predictable branch per call site. Counters are added in bulk by the caller (for
+ * example once per distance matrix) rather than once per distance. The allocations
+ * counter counts calls to malloc; memory handed out by arenas is counted in bytes.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Phases a run is divided into
+#define PROFILE_READ 0
+#define PROFILE_PREPROCESS 1
+#define PROFILE_DISTANCE 2
+#define PROFILE_VOTE 3
+#define PROFILE_KMEANS 4
+#define PROFILE_METRICS 5
+#define PROFILE_PHASE_COUNT 6
+
+// Counters recorded per phase
+#define PROFILE_DISTANCE_EVALUATIONS 0
+#define PROFILE_ALLOCATIONS 1
+#define PROFILE_KMEANS_ITERATIONS 2
+#define PROFILE_ARENA_BYTES 3
+#define PROFILE_ABANDONED_DISTANCES 4
+#define PROFILE_SKIPPED_FEATURES 5
+#define PROFILE_COUNTER_COUNT 6
+
+// Error codes
+#define PROFILER_SUCCESS 0
+#define PROFILER_ERR_MEMORY -1
+#define PROFILER_ERR_WRITE -2
+
+/** Non-zero once profilerEnable has been called. */
+extern int profilerEnabled;
+
+/**
+ * @struct ProfileScope
+ * @brief Running timer of one phase, opened by profileBegin and closed by profileEnd.
+ */
+typedef struct {
+    int phase;        /**< PROFILE_* phase being timed. */
+    uint64_t start;   /**< Start time in nanoseconds, 0 when the profiler is disabled. */
+} ProfileScope;
+
+/**
+ * @brief Enables the profiler for the rest of the run.
+ *
+ * @param traceEvents Non-zero to also record individual trace events for profilerWriteTrace.
+ * @return PROFILER_SUCCESS or PROFILER_ERR_MEMORY.
+ */
+int profilerEnable(int traceEvents);
+
+/**
+ * @brief Returns the time elapsed since the profiler was enabled, in nanoseconds.
+ */
+uint64_t profileNow(void);
+
+/**
+ * @brief Records a finished timer; called through profileEnd.
+ *
+ * @param phase PROFILE_* phase that was timed.
+ * @param start Start time returned by profileNow.
+ */
+void profileRecord(int phase, uint64_t start);
+
+/**
+ * @brief Adds to a counter; called through profileCount.
+ *
+ * @param phase PROFILE_* phase the work belongs to.
+ * @param counter PROFILE_* counter to increase.
+ * @param amount Amount to add.
+ */
+void profileAdd(int phase, int counter, uint64_t amount);
+
+/**
+ * @brief Records the total centroid shift of one k-Means iteration.
+ *
+ * @param shift Sum of the Euclidean shifts of all centroids.
+ */
+void profileShift(double shift);
+
+/**
+ * @brief Starts timing a phase.
+ *
+ * @param phase PROFILE_* phase to time.
+ * @return Scope to pass to profileEnd.
+ */
+static inline ProfileScope profileBegin(int phase) {
+    ProfileScope scope = {phase, 0};
+    if (profilerEnabled) {
+        scope.start = profileNow();
+    }
+    return scope;
+}
+
+/**
+ * @brief Stops timing a phase.
+ *
+ * @param scope Scope returned by profileBegin.
+ */
+static inline void profileEnd(const ProfileScope *scope) {
+    if (profilerEnabled) {
+        profileRecord(scope->phase, scope->start);
+    }
+}
+
+/**
+ * @brief Adds to a counter of a phase.
+ *
+ * @param phase PROFILE_* phase the work belongs to.
+ * @param counter PROFILE_* counter to increase.
+ * @param amount Amount to add.
+ */
+static inline void profileCount(int phase, int counter, uint64_t amount) {
+    if (profilerEnabled) {
+        profileAdd(phase, counter, amount);
+    }
+}
+
+/**
+ * @brief Prints the time, call count and counters of every phase.
+ *
+ * @param output Stream receiving the summary.
+ */
+void profilerPrintSummary(FILE *output);
+
+/**
+ * @brief Writes the recorded events in the Chrome trace-event JSON format.
+ *
+ * @param path Path of the JSON file, loadable in chrome://tracing or Perfetto.
+ * @return PROFILER_SUCCESS or PROFILER_ERR_WRITE.
+ */
+int profilerWriteTrace(const char *path);
+
+#endif // PROFILER_H
@@ -0,0 +1,77 @@
+/**
+ * @file random.h
+ * @brief Header file for the seeded splitmix64 generator shared by every randomized step.
+ *
+ * splitmix64 adds a constant to its state and scrambles the sum, so its n-th output is a
+ * pure function of the seed and n. Besides the usual sequential use (nextRandom), any
+ * draw can be computed directly from its position (counterRandom): loops drawing one
+ * value per item give the same result in any order and on any number of threads, and a
+ * run is reproduced exactly from its seed.
+ */
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+// Increment of the splitmix64 state (the golden ratio in 64-bit fixed point)
+#define RANDOM_GAMMA 0x9E3779B97F4A7C15ULL
+
+/**
+ * @brief Scrambles a 64-bit word (the splitmix64 finalizer).
+ *
+ * @param x Word to scramble.
+ * @return The scrambled word.
+ */
+static inline uint64_t mixRandom(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * @brief Advances a splitmix64 generator and returns its next output.
+ *
+ * @param state Generator state, initialized with the seed.
+ * @return The next 64 random bits.
+ */
+static inline uint64_t nextRandom(uint64_t *state) {
+    return mixRandom(*state += RANDOM_GAMMA);
+}
+
+/**
+ * @brief Returns the output at a given position of the generator seeded with a seed.
+ *
+ * counterRandom(seed, n) is the (n + 1)-th output of nextRandom from the state seed.
+ *
+ * @param seed Seed of the stream.
+ * @param counter Position of the draw in the stream.
+ * @return 64 random bits.
+ */
+static inline uint64_t counterRandom(uint64_t seed, uint64_t counter) {
+    return mixRandom(seed + (counter + 1) * RANDOM_GAMMA);
+}
+
+/**
+ * @brief Derives the seed of an independent sub-stream, for example one per repetition or per class.
+ *
+ * @param seed Seed of the parent stream.
+ * @param stream Number of the sub-stream.
+ * @return Seed of the sub-stream.
+ */
+static inline uint64_t deriveSeed(uint64_t seed, uint64_t stream) {
+    return mixRandom(counterRandom(seed, stream) ^ 0xD1B54A32D192ED03ULL);
+}
+
+/**
+ * @brief Maps 64 random bits to an integer in [0, bound) without the bias of a modulo.
+ *
+ * @param bits Random bits.
+ * @param bound Exclusive upper bound, positive.
+ * @return Integer in [0, bound).
+ */
+static inline uint64_t randomBelow(uint64_t bits, uint64_t bound) {
+    return (uint64_t)(((unsigned __int128)bits * bound) >> 64);
+}
+
+#endif // RANDOM_H
@@ -0,0 +1,438 @@
+#include "reference_store.h"
+#include "profiler.h"
+#include "arena.h"
+
+#include <float.h>
+#include <math.h>
+
+// Returns the address of the code of a slot.
+static inline uint8_t *slotCode(const ReferenceStore *store, int slot) {
+    return store->codes + (size_t)slot * compressedBytesPerSample(store->index);
+}
+
+// Grows the per-slot arrays to at least the requested number of slots.
+static int growSlots(ReferenceStore *store, int needed) {
+    if (needed <= store->capacity) {
+        return REFERENCE_SUCCESS;
+    }
+    int capacity = store->capacity > 0 ? store->capacity : REFERENCE_INITIAL_CAPACITY;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    size_t rowBytes = (size_t)store->featureCount * sizeof(double);
+
+    double *raw = realloc(store->raw, capacity * rowBytes);
+    if (raw) store->raw = raw;
+    double *features = raw ? realloc(store->features, capacity * rowBytes) : NULL;
+    if (features) store->features = features;
+    ShapeData *samples = features ? realloc(store->samples, capacity * sizeof(ShapeData)) : NULL;
+    if (samples) store->samples = samples;
+    char *alive = samples ? realloc(store->alive, capacity) : NULL;
+    if (alive) store->alive = alive;
+    uint8_t *codes = NULL;
+    if (alive && store->index) {
+        codes = realloc(store->codes, capacity * compressedBytesPerSample(store->index));
+        if (codes) store->codes = codes;
+    }
+    if (!alive || (store->index && !codes)) {
+        fprintf(stderr, "Memory allocation failed for the reference store\n");
+        return REFERENCE_ERR_MEMORY;
+    }
+    profileCount(PROFILE_PREPROCESS, PROFILE_ALLOCATIONS, store->index ? 5 : 4);
+
+    // The feature rows may have moved
+    for (int slot = 0; slot < store->size; slot++) {
+        store->samples[slot].features = store->features + (size_t)slot * store->featureCount;
+    }
+    store->capacity = capacity;
+    return REFERENCE_SUCCESS;
+}
+
+// Grows the id table so that the next id has an entry.
+static int growIds(ReferenceStore *store) {
+    if (store->nextId < store->idCapacity) {
+        return REFERENCE_SUCCESS;
+    }
+    int capacity = store->idCapacity > 0 ? store->idCapacity * 2 : REFERENCE_INITIAL_CAPACITY;
+    int *slotOfId = realloc(store->slotOfId, capacity * sizeof(int));
+    if (!slotOfId) {
+        fprintf(stderr, "Memory allocation failed for the reference store\n");
+        return REFERENCE_ERR_MEMORY;
+    }
+    profileCount(PROFILE_PREPROCESS, PROFILE_ALLOCATIONS, 1);
+    store->slotOfId = slotOfId;
+    store->idCapacity = capacity;
+    return REFERENCE_SUCCESS;
+}
+
+// Transforms raw features with the current scaling.
+void referenceStoreTransform(const ReferenceStore *store, const double *rawFeatures, double *features) {
+    const PreprocessingParams *params = &store->params;
+    for (int j = 0; j < store->featureCount; j++) {
+        features[j] = params->method == PREPROCESS_NONE ? rawFeatures[j]
+                                                         : (rawFeatures[j] - params->offset[j]) / params->scale[j];
+    }
+}
+
+// Adds a sample to the running mean and variance with Welford's update, or removes it with the reverse update.
+static void updateStatistics(ReferenceStore *store, const double *rawFeatures, int adding) {
+    int n = store->liveCount + (adding ? 1 : -1);
+    for (int j = 0; j < store->featureCount; j++) {
+        double x = rawFeatures[j];
+        if (n == 0) {
+            store->mean[j] = 0;
+            store->m2[j] = 0;
+            continue;
+        }
+        double delta = x - store->mean[j];
+        if (adding) {
+            store->mean[j] += delta / n;
+            store->m2[j] += delta * (x - store->mean[j]);
+            store->min[j] = x < store->min[j] ? x : store->min[j];
+            store->max[j] = x > store->max[j] ? x : store->max[j];
+        } else {
+            store->mean[j] -= delta / n;
+            store->m2[j] -= delta * (x - store->mean[j]);
+            // Rounding can leave a tiny negative sum once most samples are gone
+            if (store->m2[j] < 0) {
+                store->m2[j] = 0;
+            }
+        }
+    }
+    store->liveCount = n;
+}
+
+// Sets needsRefit once the statistics drifted past the threshold.
+static void checkDrift(ReferenceStore *store) {
+    if (!store->needsRefit && referenceStoreDrift(store) > store->driftThreshold) {
+        store->needsRefit = 1;
+    }
+}
+
+// Creates a store and inserts the initial samples before fitting the scaling on them.
+int createReferenceStore(ReferenceStore *store, const ShapeData *initial, int initialSize, int featureCount, int p,
+                         int method, double driftThreshold) {
+    memset(store, 0, sizeof(ReferenceStore));
+    if ((!initial && initialSize > 0) || initialSize < 0 || featureCount <= 0 || p <= 0 || driftThreshold < 0 ||
+        (method != PREPROCESS_NONE && method != PREPROCESS_NORMALIZE && method != PREPROCESS_STANDARDIZE)) {
+        fprintf(stderr, "Invalid parameters for the reference store\n");
+        return REFERENCE_ERR_INVALID_INPUT;
+    }
+    store->featureCount = featureCount;
+    store->p = p;
+    store->driftThreshold = driftThreshold > 0 ? driftThreshold : REFERENCE_DEFAULT_DRIFT;
+    store->params = (PreprocessingParams){PREPROCESS_NONE, featureCount, NULL, NULL, 0, NULL, NULL, 0};
+
+    store->mean = calloc(featureCount, sizeof(double));
+    store->m2 = calloc(featureCount, sizeof(double));
+    store->min = malloc(featureCount * sizeof(double));
+    store->max = malloc(featureCount * sizeof(double));
+    if (method != PREPROCESS_NONE) {
+        store->params.offset = calloc(featureCount, sizeof(double));
+        store->params.scale = malloc(featureCount * sizeof(double));
+    }
+    if (!store->mean || !store->m2 || !store->min || !store->max ||
+        (method != PREPROCESS_NONE && (!store->params.offset || !store->params.scale)) ||
+        growSlots(store, initialSize) != REFERENCE_SUCCESS) {
+        fprintf(stderr, "Memory allocation failed for the reference store\n");
+        freeReferenceStore(store);
+        return REFERENCE_ERR_MEMORY;
+    }
+    for (int j = 0; j < featureCount; j++) {
+        store->min[j] = DBL_MAX;
+        store->max[j] = -DBL_MAX;
+        if (method != PREPROCESS_NONE) {
+            store->params.scale[j] = 1.0;
+        }
+    }
+
+    // The samples go in untransformed, then the refit fits the scaling on them and applies it
+    for (int i = 0; i < initialSize; i++) {
+        int id = referenceStoreInsert(store, initial[i].features, initial[i].class);
+        if (id < 0) {
+            freeReferenceStore(store);
+            return id;
+        }
+    }
+    store->params.method = method;
+    referenceStoreRefit(store);
+    return REFERENCE_SUCCESS;
+}
+
+// Appends a sample, growing the arrays by doubling when they are full.
+int referenceStoreInsert(ReferenceStore *store, const double *rawFeatures, int class) {
+    if (!store || !rawFeatures) {
+        fprintf(stderr, "Invalid parameters for the reference store\n");
+        return REFERENCE_ERR_INVALID_INPUT;
+    }
+    int status = growSlots(store, store->size + 1);
+    if (status == REFERENCE_SUCCESS) {
+        status = growIds(store);
+    }
+    if (status != REFERENCE_SUCCESS) {
+        return status;
+    }
+
+    int slot = store->size++, id = store->nextId++, d = store->featureCount;
+    double *raw = store->raw + (size_t)slot * d;
+    double *features = store->features + (size_t)slot * d;
+    memcpy(raw, rawFeatures, d * sizeof(double));
+    referenceStoreTransform(store, raw, features);
+    store->samples[slot] = (ShapeData){class, id, features, d};
+    store->alive[slot] = 1;
+    store->slotOfId[id] = slot;
+    if (store->index) {
+        compressedEncode(store->index, features, slotCode(store, slot));
+    }
+
+    updateStatistics(store, raw, 1);
+    checkDrift(store);
+    return id;
+}
+
+// Marks a sample as dead and compacts once dead slots exceed the ratio.
+int referenceStoreRemove(ReferenceStore *store, int id) {
+    if (!store || id < 0 || id >= store->nextId || store->slotOfId[id] < 0) {
+        return REFERENCE_ERR_NOT_FOUND;
+    }
+    int slot = store->slotOfId[id];
+    store->alive[slot] = 0;
+    store->slotOfId[id] = -1;
+    updateStatistics(store, store->raw + (size_t)slot * store->featureCount, 0);
+    checkDrift(store);
+
+    if (store->size - store->liveCount > REFERENCE_COMPACT_RATIO * store->size) {
+        referenceStoreCompact(store);
+    }
+    return REFERENCE_SUCCESS;
+}
+
+// Moves every live slot down over the dead ones, in order.
+void referenceStoreCompact(ReferenceStore *store) {
+    int d = store->featureCount;
+    size_t codeBytes = store->index ? compressedBytesPerSample(store->index) : 0;
+    int live = 0;
+    for (int slot = 0; slot < store->size; slot++) {
+        if (!store->alive[slot]) {
+            continue;
+        }
+        if (slot != live) {
+            memcpy(store->raw + (size_t)live * d, store->raw + (size_t)slot * d, d * sizeof(double));
+            memcpy(store->features + (size_t)live * d, store->features + (size_t)slot * d, d * sizeof(double));
+            if (codeBytes) {
+                memcpy(slotCode(store, live), slotCode(store, slot), codeBytes);
+            }
+            store->samples[live] = store->samples[slot];
+            store->samples[live].features = store->features + (size_t)live * d;
+            store->alive[live] = 1;
+            store->slotOfId[store->samples[live].sample] = live;
+        }
+        live++;
+    }
+    store->size = live;
+}
+
+// Returns the largest drift of the running statistics from the fitted offset and scale.
+double referenceStoreDrift(const ReferenceStore *store) {
+    const PreprocessingParams *params = &store->params;
+    if (params->method == PREPROCESS_NONE || store->liveCount == 0) {
+        return 0;
+    }
+    double drift = 0;
+    for (int j = 0; j < store->featureCount; j++) {
+        double offset, scale;
+        if (params->method == PREPROCESS_NORMALIZE) {
+            offset = store->min[j];
+            scale = store->max[j] - store->min[j];
+        } else {
+            offset = store->mean[j];
+            scale = sqrt(store->m2[j] / store->liveCount);
+        }
+        // A constant feature is fitted with a scale of 1
+        scale = scale == 0 ? 1.0 : scale;
+        double shift = fabs(offset - params->offset[j]) / params->scale[j];
+        double stretch = fabs(scale / params->scale[j] - 1);
+        drift = shift > drift ? shift : drift;
+        drift = stretch > drift ? stretch : drift;
+    }
+    return drift;
+}
+
+// Refits the offset and scale from the running statistics and transforms every live sample again.
+void referenceStoreRefit(ReferenceStore *store) {
+    PreprocessingParams *params = &store->params;
+    int d = store->featureCount;
+    ProfileScope scope = profileBegin(PROFILE_PREPROCESS);
+
+    if (params->method != PREPROCESS_NONE && store->liveCount > 0) {
+        // The range only widens on insertion, so it is recomputed on the live samples
+        for (int j = 0; j < d; j++) {
+            store->min[j] = DBL_MAX;
+            store->max[j] = -DBL_MAX;
+        }
+        for (int slot = 0; slot < store->size; slot++) {
+            const double *raw = store->raw + (size_t)slot * d;
+            for (int j = 0; store->alive[slot] && j < d; j++) {
+                store->min[j] = raw[j] < store->min[j] ? raw[j] : store->min[j];
+                store->max[j] = raw[j] > store->max[j] ? raw[j] : store->max[j];
+            }
+        }
+        for (int j = 0; j < d; j++) {
+            if (params->method == PREPROCESS_NORMALIZE) {
+                params->offset[j] = store->min[j];
+                params->scale[j] = store->max[j] - store->min[j];
+            } else {
+                params->offset[j] = store->mean[j];
+                params->scale[j] = sqrt(store->m2[j] / store->liveCount);
+            }
+            if (params->scale[j] == 0) {
+                params->scale[j] = 1.0;
+            }
+        }
+
+        for (int slot = 0; slot < store->size; slot++) {
+            if (!store->alive[slot]) {
+                continue;
+            }
+            referenceStoreTransform(store, store->raw + (size_t)slot * d, store->samples[slot].features);
+            if (store->index) {
+                compressedEncode(store->index, store->samples[slot].features, slotCode(store, slot));
+            }
+        }
+    }
+    store->needsRefit = 0;
+    profileEnd(&scope);
+}
+
+// Attaches a compressed index and encodes the samples already stored.
+int referenceStoreAttachIndex(ReferenceStore *store, const CompressedIndex *index, int shortlist) {
+    if (!store || !index || index->featureCount != store->featureCount) {
+        fprintf(stderr, "Invalid parameters for the reference store index\n");
+        return REFERENCE_ERR_INVALID_INPUT;
+    }
+    uint8_t *codes = realloc(store->codes, (store->capacity > 0 ? store->capacity : 1) *
+                                               compressedBytesPerSample(index));
+    if (!codes) {
+        fprintf(stderr, "Memory allocation failed for the reference store\n");
+        return REFERENCE_ERR_MEMORY;
+    }
+    profileCount(PROFILE_PREPROCESS, PROFILE_ALLOCATIONS, 1);
+    store->codes = codes;
+    store->index = index;
+    store->shortlist = shortlist > 0 ? shortlist : COMPRESSED_DEFAULT_SHORTLIST;
+    for (int slot = 0; slot < store->size; slot++) {
+        if (store->alive[slot]) {
+            compressedEncode(index, store->samples[slot].features, slotCode(store, slot));
+        }
+    }
+    return REFERENCE_SUCCESS;
+}
+
+// Fills the candidates with the compressed distances of the live slots and keeps the shortlist.
+static int shortlistCandidates(const ReferenceStore *store, const ShapeData *query, DistanceLabel *candidates,
+                               int shortlist, Arena *scratch) {
+    double *state = arenaAlloc(scratch, compressedQueryStateSize(store->index) * sizeof(double));
+    if (!state) {
+        return REFERENCE_ERR_MEMORY;
+    }
+    compressedPrepareQuery(store->index, query->features, state);
+
+    int count = 0;
+    for (int slot = 0; slot < store->size; slot++) {
+        if (store->alive[slot]) {
+            candidates[count].distance = compressedCodeDistance(store->index, state, slotCode(store, slot));
+            candidates[count++].label = slot;
+        }
+    }
+    knnSelectNearest(candidates, count, shortlist);
+    return REFERENCE_SUCCESS;
+}
+
+// Searches the live slots, through the codes when an index is attached, and re-ranks exactly.
+int referenceStoreSearch(const void *store, const ShapeData *query, int k, DistanceLabel *neighbors) {
+    const ReferenceStore *reference = store;
+    if (!reference || !query || !neighbors || k <= 0 || k > reference->liveCount) {
+        fprintf(stderr, "Invalid parameters for the reference store search\n");
+        return REFERENCE_ERR_INVALID_INPUT;
+    }
+    int live = reference->liveCount;
+    Arena *scratch = scratchArena(PROFILE_DISTANCE);
+    ArenaMark mark = arenaMark(scratch);
+    DistanceLabel *candidates = arenaAlloc(scratch, live * sizeof(DistanceLabel));
+    if (!candidates) {
+        arenaReset(scratch, mark);
+        return REFERENCE_ERR_MEMORY;
+    }
+
+    int count = 0;
+    if (reference->index) {
+        count = reference->shortlist < k ? k : reference->shortlist > live ? live : reference->shortlist;
+        if (shortlistCandidates(reference, query, candidates, count, scratch) != REFERENCE_SUCCESS) {
+            arenaReset(scratch, mark);
+            return REFERENCE_ERR_MEMORY;
+        }
+    } else {
+        for (int slot = 0; slot < reference->size; slot++) {
+            if (reference->alive[slot]) {
+                candidates[count++].label = slot;
+            }
+        }
+    }
+    for (int j = 0; j < count; j++) {
+        candidates[j].distance = minkowskiDistance(*query, reference->samples[candidates[j].label],
+                                                   reference->featureCount, reference->p);
+    }
+    knnSelectNearest(candidates, count, k);
+    memcpy(neighbors, candidates, k * sizeof(DistanceLabel));
+    profileCount(PROFILE_DISTANCE, PROFILE_DISTANCE_EVALUATIONS, count);
+
+    arenaReset(scratch, mark);
+    return REFERENCE_SUCCESS;
+}
+
+// Transforms a raw sample, searches its neighbors and votes on their classes.
+int referenceStoreClassify(const ReferenceStore *store, const double *rawFeatures, int k) {
+    if (!store || !rawFeatures) {
+        fprintf(stderr, "Invalid parameters for the reference store search\n");
+        return REFERENCE_ERR_INVALID_INPUT;
+    }
+    Arena *scratch = scratchArena(PROFILE_DISTANCE);
+    ArenaMark mark = arenaMark(scratch);
+    double *features = arenaAlloc(scratch, store->featureCount * sizeof(double));
+    DistanceLabel *neighbors = arenaAlloc(scratch, (k > 0 ? k : 1) * sizeof(DistanceLabel));
+    if (!features || !neighbors) {
+        arenaReset(scratch, mark);
+        return REFERENCE_ERR_MEMORY;
+    }
+
+    referenceStoreTransform(store, rawFeatures, features);
+    ShapeData query = {0, 0, features, store->featureCount};
+    int result = referenceStoreSearch(store, &query, k, neighbors);
+    if (result == REFERENCE_SUCCESS) {
+        for (int j = 0; j < k; j++) {
+            neighbors[j].label = store->samples[neighbors[j].label].class;
+        }
+        result = knnVote(neighbors, k, k);
+    }
+    arenaReset(scratch, mark);
+    return result;
+}
+
+// Frees every array of the store.
+void freeReferenceStore(ReferenceStore *store) {
+    if (!store) {
+        return;
+    }
+    freePreprocessingParams(&store->params);
+    free(store->raw);
+    free(store->features);
+    free(store->samples);
+    free(store->alive);
+    free(store->slotOfId);
+    free(store->mean);
+    free(store->m2);
+    free(store->min);
+    free(store->max);
+    free(store->codes);
+    memset(store, 0, sizeof(ReferenceStore));
+}
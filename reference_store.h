@@ -0,0 +1,189 @@
+/**
+ * @file reference_store.h
+ * @brief Header file for an updatable k-NN reference set.
+ *
+ * A ReferenceStore keeps the labeled samples a k-NN search compares queries with and
+ * lets samples be added and removed one at a time, without reading the data again or
+ * recomputing a distance matrix:
+ *
+ * - Inserting appends the raw features, transforms them with the current
+ *   preprocessing parameters and, when a compressed index is attached, encodes them.
+ *   The arrays grow by doubling, so an insertion costs O(d) plus the encoding.
+ * - Removing marks the slot as dead. Once dead slots exceed REFERENCE_COMPACT_RATIO
+ *   of the store, the live samples are moved to the front, which is amortized over
+ *   the removals that made it necessary. Ids stay valid across compactions.
+ * - The per-feature mean and variance of the live samples are kept with Welford's
+ *   update (reversed on removal), along with the range seen so far. When they move
+ *   away from the fitted parameters by more than the drift threshold, needsRefit is
+ *   set; referenceStoreRefit then refits the parameters and transforms the samples
+ *   again in O(n·d).
+ *
+ * The store is not synchronized: searches may run concurrently with each other but
+ * not with insertions, removals or refits.
+ */
+
+#ifndef REFERENCE_STORE_H
+#define REFERENCE_STORE_H
+
+#include "knn.h"
+#include "preprocessing.h"
+#include "compressed_search.h"
+
+// Error codes
+#define REFERENCE_SUCCESS 0
+#define REFERENCE_ERR_INVALID_INPUT -1
+#define REFERENCE_ERR_MEMORY -2
+#define REFERENCE_ERR_NOT_FOUND -3
+
+// Slots allocated by an empty store
+#define REFERENCE_INITIAL_CAPACITY 64
+
+// Fraction of dead slots that triggers a compaction
+#define REFERENCE_COMPACT_RATIO 0.5
+
+// Drift of the running statistics, in units of the fitted scale, that asks for a refit
+#define REFERENCE_DEFAULT_DRIFT 0.1
+
+/**
+ * @struct ReferenceStore
+ * @brief Growable set of labeled samples with running preprocessing statistics.
+ */
+typedef struct {
+    int featureCount;             /**< Number of features of every sample. */
+    int p;                        /**< Minkowski exponent of the search. */
+    PreprocessingParams params;   /**< Scaling applied to the stored samples and the queries. */
+    double *raw;                  /**< Row-major capacity x featureCount features as inserted. */
+    double *features;             /**< Row-major capacity x featureCount transformed features. */
+    ShapeData *samples;           /**< Views of the transformed features; sample holds the id. */
+    char *alive;                  /**< Non-zero for slots holding a live sample. */
+    int size;                     /**< Slots in use, live or dead. */
+    int capacity;                 /**< Slots allocated. */
+    int liveCount;                /**< Live samples. */
+    int *slotOfId;                /**< Slot of every id ever returned, -1 once removed. */
+    int idCapacity;               /**< Entries allocated in slotOfId. */
+    int nextId;                   /**< Id given to the next inserted sample. */
+    double *mean;                 /**< Running mean of the raw features of the live samples. */
+    double *m2;                   /**< Running sum of squared deviations from the mean. */
+    double *min;                  /**< Smallest raw value of every feature seen since the last refit. */
+    double *max;                  /**< Largest raw value of every feature seen since the last refit. */
+    double driftThreshold;        /**< Drift above which needsRefit is set. */
+    int needsRefit;               /**< Set when the statistics drifted past driftThreshold. */
+    const CompressedIndex *index; /**< Index encoding the samples, NULL for an exact search. */
+    uint8_t *codes;               /**< capacity codes of compressedBytesPerSample bytes. */
+    int shortlist;                /**< Candidates re-ranked exactly when searching the codes. */
+} ReferenceStore;
+
+/**
+ * @brief Creates a store, fits its preprocessing on the initial samples and inserts them.
+ *
+ * @param store Store to initialize; freeReferenceStore releases it.
+ * @param initial Raw samples to start with, copied into the store.
+ * @param initialSize Number of initial samples; with none the scaling is the identity until the first refit.
+ * @param featureCount Number of features of every sample.
+ * @param p Minkowski exponent.
+ * @param method PREPROCESS_* scaling; PCA is not supported.
+ * @param driftThreshold Drift that sets needsRefit, 0 for REFERENCE_DEFAULT_DRIFT.
+ * @return REFERENCE_SUCCESS or a REFERENCE_ERR_* code.
+ */
+int createReferenceStore(ReferenceStore *store, const ShapeData *initial, int initialSize, int featureCount, int p,
+                         int method, double driftThreshold);
+
+/**
+ * @brief Appends a sample to the store.
+ *
+ * @param store Store to update.
+ * @param rawFeatures featureCount features, not preprocessed.
+ * @param class Class of the sample.
+ * @return The id of the sample (0 or more), or a negative REFERENCE_ERR_* code.
+ */
+int referenceStoreInsert(ReferenceStore *store, const double *rawFeatures, int class);
+
+/**
+ * @brief Removes a sample, compacting the store when too many slots are dead.
+ *
+ * @param store Store to update.
+ * @param id Id returned by referenceStoreInsert.
+ * @return REFERENCE_SUCCESS, or REFERENCE_ERR_NOT_FOUND if the id is unknown or already removed.
+ */
+int referenceStoreRemove(ReferenceStore *store, int id);
+
+/**
+ * @brief Moves the live samples to the first slots and drops the dead ones.
+ *
+ * Slot numbers change, ids do not.
+ *
+ * @param store Store to compact.
+ */
+void referenceStoreCompact(ReferenceStore *store);
+
+/**
+ * @brief Measures how far the running statistics moved from the fitted parameters.
+ *
+ * For standardization this is the largest |mean - offset| / scale or |std / scale - 1|
+ * over the features, for normalization the same with the minimum and the range.
+ *
+ * @param store Store to inspect.
+ * @return The drift, 0 without preprocessing or live samples.
+ */
+double referenceStoreDrift(const ReferenceStore *store);
+
+/**
+ * @brief Refits the preprocessing on the live samples and transforms them again.
+ *
+ * The attached index keeps its projection or codebooks; the samples are only encoded again.
+ *
+ * @param store Store to refit.
+ */
+void referenceStoreRefit(ReferenceStore *store);
+
+/**
+ * @brief Attaches a compressed index used to shortlist candidates, and encodes every slot.
+ *
+ * @param store Store to extend.
+ * @param index Index built on samples with the store's preprocessing; not owned.
+ * @param shortlist Candidates re-ranked exactly per query, 0 for COMPRESSED_DEFAULT_SHORTLIST.
+ * @return REFERENCE_SUCCESS or a REFERENCE_ERR_* code.
+ */
+int referenceStoreAttachIndex(ReferenceStore *store, const CompressedIndex *index, int shortlist);
+
+/**
+ * @brief Transforms raw features with the store's current preprocessing.
+ *
+ * @param store Store whose parameters are used.
+ * @param rawFeatures featureCount features, not preprocessed.
+ * @param features Output of featureCount features; may alias rawFeatures.
+ */
+void referenceStoreTransform(const ReferenceStore *store, const double *rawFeatures, double *features);
+
+/**
+ * @brief Finds the k nearest live samples of a preprocessed query.
+ *
+ * The signature matches KnnIndexSearch, so a store can be attached to a batch
+ * classifier whose training set is store->samples, as long as it is not modified.
+ *
+ * @param store ReferenceStore to search.
+ * @param query Sample transformed with referenceStoreTransform.
+ * @param k Number of neighbors, at most the number of live samples.
+ * @param neighbors Output array of k pairs, nearest first, whose labels are slots.
+ * @return REFERENCE_SUCCESS or a REFERENCE_ERR_* code.
+ */
+int referenceStoreSearch(const void *store, const ShapeData *query, int k, DistanceLabel *neighbors);
+
+/**
+ * @brief Classifies a raw sample by a vote of its k nearest live samples.
+ *
+ * @param store Store to search.
+ * @param rawFeatures featureCount features, not preprocessed.
+ * @param k Number of neighbors voting.
+ * @return The predicted class, or a negative REFERENCE_ERR_* code.
+ */
+int referenceStoreClassify(const ReferenceStore *store, const double *rawFeatures, int k);
+
+/**
+ * @brief Frees the memory held by a store; the attached index is not freed.
+ *
+ * @param store Store to free.
+ */
+void freeReferenceStore(ReferenceStore *store);
+
+#endif // REFERENCE_STORE_H
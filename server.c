@@ -0,0 +1,531 @@
+#include "server.h"
+#include "model_io.h"
+#include "knn.h"
+#include "knn_batch.h"
+#include "laesa.h"
+#include "kmeans.h"
+#include "profiler.h"
+#include "arena.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @struct PendingRequest
+ * @brief A classification request waiting in the batch queue.
+ */
+typedef struct PendingRequest {
+    double *features;             /**< Raw query features owned by the connection thread. */
+    int k;                        /**< Requested number of neighbors, 0 for the model default. */
+    int predictedClass;           /**< Result filled by the batcher. */
+    int done;                     /**< Set by the batcher once the result is available. */
+    struct timespec received;     /**< Time the request was read from the socket. */
+    struct PendingRequest *next;  /**< Next request in the queue. */
+} PendingRequest;
+
+/**
+ * @struct ClassificationServer
+ * @brief Shared state of the server threads.
+ */
+typedef struct {
+    ServerConfig config;
+    int modelType;                       /**< MODEL_TYPE_KNN or MODEL_TYPE_KMEANS. */
+    KnnModel knnModel;
+    KnnBatchClassifier classifier;       /**< Batch classifier over the k-NN training set and its worker pool. */
+    LaesaIndex pivotIndex;               /**< Pivot index stored in the k-NN model, attached to the classifier. */
+    KmeansModel kmeansModel;
+    int featureCount;                    /**< Features expected in every request. */
+    const PreprocessingParams *preprocessing;
+    int listenFd;
+
+    pthread_mutex_t mutex;               /**< Protects everything below. */
+    pthread_cond_t queueCond;            /**< Signaled when requests are queued or on shutdown. */
+    pthread_cond_t doneCond;             /**< Broadcast when a batch has been classified. */
+    PendingRequest *queueHead;
+    PendingRequest *queueTail;
+    int queueSize;
+    int stopping;
+    uint64_t requestCount;
+    uint64_t batchCount;
+    double latencies[SERVER_LATENCY_WINDOW]; /**< Ring buffer of recent latencies in microseconds. */
+    int latencyCount;
+    int latencyNext;
+    double maxLatency;
+} ClassificationServer;
+
+/**
+ * @struct ConnectionArgs
+ * @brief Arguments of a connection thread.
+ */
+typedef struct {
+    ClassificationServer *server;
+    int fd;
+} ConnectionArgs;
+
+static volatile sig_atomic_t signalReceived = 0;
+
+// Records the signal, the accept loop polls the flag.
+static void handleStopSignal(int signal) {
+    (void)signal;
+    signalReceived = 1;
+}
+
+// Blocks the stop signals in the calling thread and every thread it creates afterwards, saving the previous mask.
+static void blockStopSignals(sigset_t *previous) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, previous);
+}
+
+// Writes exactly size bytes to a descriptor.
+int writeFully(int fd, const void *buffer, size_t size) {
+    const char *bytes = buffer;
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return SERVER_ERR_SOCKET;
+        bytes += written;
+        size -= written;
+    }
+    return SERVER_SUCCESS;
+}
+
+// Reads exactly size bytes from a descriptor.
+int readFully(int fd, void *buffer, size_t size) {
+    char *bytes = buffer;
+    while (size > 0) {
+        ssize_t received = read(fd, bytes, size);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return SERVER_ERR_SOCKET;
+        bytes += received;
+        size -= received;
+    }
+    return SERVER_SUCCESS;
+}
+
+// Returns the microseconds elapsed between two timestamps.
+static double elapsedMicros(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+}
+
+// Comparator for sorting latencies.
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Fills the counters of the server. Must be called with the mutex held.
+static void collectStats(ClassificationServer *server, ServerStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->requestCount = server->requestCount;
+    stats->batchCount = server->batchCount;
+    stats->meanBatchSize = server->batchCount ? (double)server->requestCount / server->batchCount : 0;
+    stats->maxMicros = server->maxLatency;
+    if (server->latencyCount == 0) {
+        return;
+    }
+
+    double sorted[SERVER_LATENCY_WINDOW];
+    memcpy(sorted, server->latencies, server->latencyCount * sizeof(double));
+    qsort(sorted, server->latencyCount, sizeof(double), compareDoubles);
+    stats->p50Micros = sorted[(server->latencyCount - 1) / 2];
+    stats->p99Micros = sorted[(int)(0.99 * (server->latencyCount - 1))];
+}
+
+// Classifies a batch of requests with one call to the batch classifier.
+static void classifyBatch(ClassificationServer *server, PendingRequest **batch, int batchSize, ShapeData *queries,
+                          double *queryMatrix, int *predictions) {
+    for (int i = 0; i < batchSize; i++) {
+        queries[i].class = 0;
+        queries[i].sample = i;
+        queries[i].featureCount = server->featureCount;
+        queries[i].features = queryMatrix + (size_t)i * server->featureCount;
+        memcpy(queries[i].features, batch[i]->features, server->featureCount * sizeof(double));
+    }
+    applyPreprocessing(server->preprocessing, queries, batchSize);
+
+    if (server->modelType == MODEL_TYPE_KMEANS) {
+        KmeansModel *model = &server->kmeansModel;
+        int status = nearestCentroidClassify(model->centroids, model->clusterClasses, model->k, queries, batchSize,
+                                             model->featureCount, model->p, predictions);
+        for (int i = 0; i < batchSize; i++) {
+            batch[i]->predictedClass = status == KMEANS_SUCCESS ? predictions[i] : SERVER_ERR_MODEL;
+        }
+        return;
+    }
+
+    // Requests may ask for different k: search the largest once and vote on prefixes of the neighbor lists
+    KnnModel *model = &server->knnModel;
+    int kMax = 0;
+    for (int i = 0; i < batchSize; i++) {
+        int k = batch[i]->k > 0 ? batch[i]->k : model->k;
+        if (k <= model->trainingSize && k > kMax) kMax = k;
+    }
+    if (kMax == 0) {
+        for (int i = 0; i < batchSize; i++) {
+            batch[i]->predictedClass = SERVER_ERR_INVALID_K;
+        }
+        return;
+    }
+
+    Arena *scratch = scratchArena(PROFILE_VOTE);
+    ArenaMark mark = arenaMark(scratch);
+    int *neighbors = arenaAlloc(scratch, (size_t)batchSize * kMax * sizeof(int));
+    DistanceLabel *votes = arenaAlloc(scratch, kMax * sizeof(DistanceLabel));
+    int status = neighbors && votes ? knnBatchClassify(&server->classifier, queryMatrix, batchSize,
+                                                       server->featureCount, kMax, KNN_SEARCH_AUTO, predictions,
+                                                       neighbors, NULL)
+                                    : KNN_BATCH_ERR_MEMORY;
+    for (int i = 0; i < batchSize; i++) {
+        int k = batch[i]->k > 0 ? batch[i]->k : model->k;
+        if (status != KNN_BATCH_SUCCESS) {
+            batch[i]->predictedClass = status == KNN_BATCH_ERR_MEMORY ? SERVER_ERR_MEMORY : SERVER_ERR_MODEL;
+        } else if (k > model->trainingSize) {
+            batch[i]->predictedClass = SERVER_ERR_INVALID_K;
+        } else if (k == kMax) {
+            batch[i]->predictedClass = predictions[i];
+        } else {
+            // The neighbors are sorted, so their rank stands in for the distance
+            for (int j = 0; j < k; j++) {
+                votes[j].distance = j;
+                votes[j].label = model->trainingSet[neighbors[(size_t)i * kMax + j]].class;
+            }
+            batch[i]->predictedClass = knnVote(votes, k, k);
+        }
+    }
+    arenaReset(scratch, mark);
+}
+
+// Batcher thread: gathers queued requests into micro-batches and classifies them.
+static void *batcherThread(void *args) {
+    ClassificationServer *server = args;
+    int maxBatch = server->config.maxBatchSize;
+    PendingRequest **batch = malloc(maxBatch * sizeof(PendingRequest *));
+    ShapeData *queries = malloc(maxBatch * sizeof(ShapeData));
+    double *queryMatrix = malloc((size_t)maxBatch * server->featureCount * sizeof(double));
+    int *predictions = malloc(maxBatch * sizeof(int));
+    if (!batch || !queries || !queryMatrix || !predictions) {
+        fprintf(stderr, "Memory allocation failed for the batch buffers\n");
+        exit(ERR_MEMORY_ALLOCATION_FAILED);
+    }
+
+    pthread_mutex_lock(&server->mutex);
+    for (;;) {
+        while (!server->stopping && server->queueSize == 0) {
+            pthread_cond_wait(&server->queueCond, &server->mutex);
+        }
+        if (server->queueSize == 0) {
+            break; // Stopping and nothing left to answer
+        }
+
+        // Give concurrent clients a short window to join the batch
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long)server->config.batchWindowMicros * 1000;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        while (!server->stopping && server->queueSize < maxBatch) {
+            if (pthread_cond_timedwait(&server->queueCond, &server->mutex, &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
+
+        int batchSize = 0;
+        while (server->queueHead && batchSize < maxBatch) {
+            batch[batchSize++] = server->queueHead;
+            server->queueHead = server->queueHead->next;
+            server->queueSize--;
+        }
+        if (!server->queueHead) {
+            server->queueTail = NULL;
+        }
+        pthread_mutex_unlock(&server->mutex);
+
+        classifyBatch(server, batch, batchSize, queries, queryMatrix, predictions);
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        pthread_mutex_lock(&server->mutex);
+        for (int i = 0; i < batchSize; i++) {
+            double latency = elapsedMicros(batch[i]->received, now);
+            server->latencies[server->latencyNext] = latency;
+            server->latencyNext = (server->latencyNext + 1) % SERVER_LATENCY_WINDOW;
+            if (server->latencyCount < SERVER_LATENCY_WINDOW) server->latencyCount++;
+            if (latency > server->maxLatency) server->maxLatency = latency;
+            batch[i]->done = 1;
+        }
+        server->requestCount += batchSize;
+        server->batchCount++;
+        pthread_cond_broadcast(&server->doneCond);
+    }
+    pthread_mutex_unlock(&server->mutex);
+
+    free(batch);
+    free(queries);
+    free(queryMatrix);
+    free(predictions);
+    return NULL;
+}
+
+// Requests the server to stop accepting connections.
+static void requestStop(ClassificationServer *server) {
+    pthread_mutex_lock(&server->mutex);
+    server->stopping = 1;
+    pthread_cond_broadcast(&server->queueCond);
+    pthread_mutex_unlock(&server->mutex);
+    shutdown(server->listenFd, SHUT_RDWR);
+}
+
+// Answers one classification request: queues it and waits for the batcher.
+static int handleClassify(ClassificationServer *server, int fd, const ServerRequest *request, double *features, ServerResponse *response) {
+    if (request->featureCount > SERVER_MAX_FEATURES) {
+        return SERVER_ERR_PROTOCOL;
+    }
+    if (request->featureCount != (uint32_t)server->featureCount) {
+        // Drain the payload so the connection stays usable
+        double discard;
+        for (uint32_t i = 0; i < request->featureCount; i++) {
+            if (readFully(fd, &discard, sizeof(discard)) != SERVER_SUCCESS) return SERVER_ERR_SOCKET;
+        }
+        response->status = SERVER_ERR_FEATURES;
+        return SERVER_SUCCESS;
+    }
+    if (readFully(fd, features, server->featureCount * sizeof(double)) != SERVER_SUCCESS) {
+        return SERVER_ERR_SOCKET;
+    }
+    // A k-NN model cannot vote with more neighbors than it has training samples
+    if (server->modelType == MODEL_TYPE_KNN && request->k > server->knnModel.trainingSize) {
+        response->status = SERVER_ERR_INVALID_K;
+        return SERVER_SUCCESS;
+    }
+
+    PendingRequest pending = {features, request->k, 0, 0, {0, 0}, NULL};
+    clock_gettime(CLOCK_MONOTONIC, &pending.received);
+
+    pthread_mutex_lock(&server->mutex);
+    if (server->stopping) {
+        // The batcher may already be gone, refuse new work
+        pthread_mutex_unlock(&server->mutex);
+        response->status = SERVER_ERR_SOCKET;
+        return SERVER_SUCCESS;
+    }
+    if (server->queueTail) {
+        server->queueTail->next = &pending;
+    } else {
+        server->queueHead = &pending;
+    }
+    server->queueTail = &pending;
+    server->queueSize++;
+    pthread_cond_signal(&server->queueCond);
+    while (!pending.done) {
+        pthread_cond_wait(&server->doneCond, &server->mutex);
+    }
+    collectStats(server, &response->stats);
+    pthread_mutex_unlock(&server->mutex);
+
+    response->status = pending.predictedClass < 0 ? pending.predictedClass : SERVER_SUCCESS;
+    response->predictedClass = pending.predictedClass;
+    return SERVER_SUCCESS;
+}
+
+// Connection thread: answers the requests of one client until it disconnects.
+static void *connectionThread(void *args) {
+    ConnectionArgs *connection = args;
+    ClassificationServer *server = connection->server;
+    int fd = connection->fd;
+    free(connection);
+
+    double *features = malloc(server->featureCount * sizeof(double));
+    ServerRequest request;
+    while (features && readFully(fd, &request, sizeof(request)) == SERVER_SUCCESS) {
+        ServerResponse response;
+        memset(&response, 0, sizeof(response));
+        response.magic = SERVER_MAGIC;
+
+        if (request.magic != SERVER_MAGIC) {
+            break;
+        }
+        if (request.type == SERVER_REQUEST_CLASSIFY) {
+            if (handleClassify(server, fd, &request, features, &response) != SERVER_SUCCESS) {
+                break;
+            }
+        } else if (request.type == SERVER_REQUEST_STATS || request.type == SERVER_REQUEST_SHUTDOWN) {
+            pthread_mutex_lock(&server->mutex);
+            collectStats(server, &response.stats);
+            pthread_mutex_unlock(&server->mutex);
+        } else {
+            response.status = SERVER_ERR_PROTOCOL;
+        }
+
+        if (writeFully(fd, &response, sizeof(response)) != SERVER_SUCCESS) {
+            break;
+        }
+        if (request.type == SERVER_REQUEST_SHUTDOWN) {
+            requestStop(server);
+            break;
+        }
+    }
+
+    free(features);
+    close(fd);
+    return NULL;
+}
+
+// Loads the served model and records its feature count and preprocessing.
+static int loadServedModel(ClassificationServer *server) {
+    server->modelType = readModelType(server->config.modelPath);
+    int status = server->modelType;
+    if (server->modelType == MODEL_TYPE_KNN) {
+        status = loadKnnModel(server->config.modelPath, &server->knnModel);
+        server->featureCount = server->knnModel.preprocessing.featureCount;
+        server->preprocessing = &server->knnModel.preprocessing;
+        if (status >= 0 && createKnnBatchClassifier(&server->classifier, server->knnModel.trainingSet,
+                                                    server->knnModel.trainingSize, server->knnModel.featureCount,
+                                                    server->knnModel.p, server->config.threads) != KNN_BATCH_SUCCESS) {
+            freeKnnModel(&server->knnModel);
+            return SERVER_ERR_MODEL;
+        }
+        if (status >= 0 && server->knnModel.indexType == MODEL_INDEX_LAESA) {
+            if (restoreLaesaIndex(&server->pivotIndex, &server->knnModel) != LAESA_SUCCESS) {
+                freeKnnBatchClassifier(&server->classifier);
+                freeKnnModel(&server->knnModel);
+                return SERVER_ERR_MODEL;
+            }
+            knnBatchAttachIndex(&server->classifier, &server->pivotIndex, laesaSearch);
+        }
+    } else if (server->modelType == MODEL_TYPE_KMEANS) {
+        status = loadKmeansModel(server->config.modelPath, &server->kmeansModel);
+        server->featureCount = server->kmeansModel.preprocessing.featureCount;
+        server->preprocessing = &server->kmeansModel.preprocessing;
+    }
+    if (status < 0) {
+        fprintf(stderr, "Failed to load model %s: %s\n", server->config.modelPath, modelErrorString(status));
+        return SERVER_ERR_MODEL;
+    }
+    return SERVER_SUCCESS;
+}
+
+// Creates the listening Unix domain socket.
+static int openListeningSocket(const char *path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Unable to create socket");
+        return -1;
+    }
+    unlink(path); // Remove a stale socket left by a previous run
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, 64) != 0) {
+        perror("Unable to listen on socket");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Runs the classification server until shutdown.
+int runClassificationServer(const ServerConfig *config) {
+    static ClassificationServer server;
+    memset(&server, 0, sizeof(server));
+    server.config = *config;
+    if (server.config.maxBatchSize <= 0) server.config.maxBatchSize = SERVER_DEFAULT_BATCH_SIZE;
+    if (server.config.batchWindowMicros < 0) server.config.batchWindowMicros = SERVER_DEFAULT_BATCH_WINDOW_US;
+
+    // Every thread started from here on (pool workers, OpenMP, batcher, connections) inherits the
+    // blocked stop signals, so they are only delivered to the accept loop
+    sigset_t acceptMask;
+    blockStopSignals(&acceptMask);
+    if (loadServedModel(&server) != SERVER_SUCCESS) {
+        pthread_sigmask(SIG_SETMASK, &acceptMask, NULL);
+        return SERVER_ERR_MODEL;
+    }
+    server.listenFd = openListeningSocket(config->socketPath);
+    if (server.listenFd < 0) {
+        pthread_sigmask(SIG_SETMASK, &acceptMask, NULL);
+        freeKnnBatchClassifier(&server.classifier);
+        freeLaesaIndex(&server.pivotIndex);
+        freeKnnModel(&server.knnModel);
+        freeKmeansModel(&server.kmeansModel);
+        return SERVER_ERR_SOCKET;
+    }
+
+    pthread_mutex_init(&server.mutex, NULL);
+    pthread_cond_init(&server.queueCond, NULL);
+    pthread_cond_init(&server.doneCond, NULL);
+
+    // Install handlers without SA_RESTART so accept() is interrupted
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handleStopSignal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_t batcher;
+    pthread_create(&batcher, NULL, batcherThread, &server);
+    printf("Serving %s model %s on %s (%d features, batch size %d, window %d us)\n",
+           server.modelType == MODEL_TYPE_KNN ? "k-NN" : "k-Means", config->modelPath, config->socketPath,
+           server.featureCount, server.config.maxBatchSize, server.config.batchWindowMicros);
+    fflush(stdout);
+
+    pthread_sigmask(SIG_SETMASK, &acceptMask, NULL);
+    while (!signalReceived) {
+        int fd = accept(server.listenFd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            break; // The listening socket was shut down
+        }
+        ConnectionArgs *connection = malloc(sizeof(ConnectionArgs));
+        pthread_t thread;
+        if (!connection) {
+            close(fd);
+            continue;
+        }
+        connection->server = &server;
+        connection->fd = fd;
+        blockStopSignals(NULL);
+        int created = pthread_create(&thread, NULL, connectionThread, connection);
+        pthread_sigmask(SIG_SETMASK, &acceptMask, NULL);
+        if (created != 0) {
+            close(fd);
+            free(connection);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    // Stop accepting; the batcher answers what is already queued before exiting
+    requestStop(&server);
+    pthread_join(batcher, NULL);
+    ServerStats stats;
+    pthread_mutex_lock(&server.mutex);
+    collectStats(&server, &stats);
+    pthread_mutex_unlock(&server.mutex);
+
+    printf("Requests: %llu, Batches: %llu, Mean Batch Size: %.2f\n",
+           (unsigned long long)stats.requestCount, (unsigned long long)stats.batchCount, stats.meanBatchSize);
+    printf("Latency p50: %.1f us, p99: %.1f us, max: %.1f us\n", stats.p50Micros, stats.p99Micros, stats.maxMicros);
+
+    // Idle connection threads may still hold the mutex, so the static state is left in place
+    close(server.listenFd);
+    unlink(config->socketPath);
+    freeKnnBatchClassifier(&server.classifier);
+    freeLaesaIndex(&server.pivotIndex);
+    freeKnnModel(&server.knnModel);
+    freeKmeansModel(&server.kmeansModel);
+    return SERVER_SUCCESS;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file server.h
+ * @brief Header file for the long-running classification server and its wire protocol.
+ *
+ * The server loads a saved model once and answers classification requests received
+ * on a Unix domain socket. Concurrent requests are gathered into micro-batches so that
+ * the distances of a whole batch are computed in one blocked pass.
+ *
+ * Every message is a fixed-size frame in native byte order: a ServerRequest optionally
+ * followed by featureCount raw (not preprocessed) doubles, answered by a ServerResponse.
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Error codes
+#define SERVER_SUCCESS 0
+#define SERVER_ERR_SOCKET -1
+#define SERVER_ERR_MODEL -2
+#define SERVER_ERR_PROTOCOL -3
+#define SERVER_ERR_MEMORY -4
+#define SERVER_ERR_FEATURES -5
+#define SERVER_ERR_INVALID_K -6
+
+// Request types
+#define SERVER_REQUEST_CLASSIFY 1
+#define SERVER_REQUEST_STATS 2
+#define SERVER_REQUEST_SHUTDOWN 3
+
+#define SERVER_MAGIC 0x31514652u        /**< "RFQ1" in little-endian byte order. */
+#define SERVER_MAX_FEATURES 65536        /**< Upper bound accepted for featureCount. */
+#define SERVER_LATENCY_WINDOW 8192       /**< Number of recent latencies kept for percentiles. */
+#define SERVER_DEFAULT_BATCH_SIZE 64
+#define SERVER_DEFAULT_BATCH_WINDOW_US 200
+
+/**
+ * @struct ServerRequest
+ * @brief Request frame sent by clients.
+ */
+typedef struct {
+    uint32_t magic;          /**< SERVER_MAGIC. */
+    uint32_t type;           /**< One of the SERVER_REQUEST_* constants. */
+    uint32_t featureCount;   /**< Number of doubles following the frame (classify requests only). */
+    int32_t k;               /**< Neighbors for k-NN models, 0 for the model default. */
+} ServerRequest;
+
+/**
+ * @struct ServerStats
+ * @brief Counters maintained by the server. Latencies cover the most recent requests.
+ */
+typedef struct {
+    uint64_t requestCount;   /**< Classification requests answered. */
+    uint64_t batchCount;     /**< Batches processed. */
+    double meanBatchSize;    /**< Average number of requests per batch. */
+    double p50Micros;        /**< Median latency from receipt to answer, in microseconds. */
+    double p99Micros;        /**< 99th percentile latency, in microseconds. */
+    double maxMicros;        /**< Maximum latency, in microseconds. */
+} ServerStats;
+
+/**
+ * @struct ServerResponse
+ * @brief Response frame sent by the server for every request.
+ */
+typedef struct {
+    uint32_t magic;          /**< SERVER_MAGIC. */
+    int32_t status;          /**< SERVER_SUCCESS or a SERVER_ERR_* code. */
+    int32_t predictedClass;  /**< Predicted class for classify requests. */
+    int32_t reserved;        /**< Padding, always 0. */
+    ServerStats stats;       /**< Current counters, filled for every response. */
+} ServerResponse;
+
+/**
+ * @struct ServerConfig
+ * @brief Settings of the classification server.
+ */
+typedef struct {
+    const char *socketPath;  /**< Path of the Unix domain socket to listen on. */
+    const char *modelPath;   /**< Path of the saved model to serve. */
+    int maxBatchSize;        /**< Maximum number of requests classified together. */
+    int batchWindowMicros;   /**< Time waited for more requests once a batch is started. */
+    int threads;             /**< Worker threads classifying a batch, 0 for the number of online processors. */
+} ServerConfig;
+
+/**
+ * @brief Runs the classification server until a shutdown request or SIGINT/SIGTERM is received.
+ *
+ * @param config Server settings.
+ * @return SERVER_SUCCESS or a SERVER_ERR_* code.
+ */
+int runClassificationServer(const ServerConfig *config);
+
+/**
+ * @brief Writes exactly size bytes to a descriptor, retrying on partial writes.
+ *
+ * @param fd Descriptor to write to.
+ * @param buffer Bytes to write.
+ * @param size Number of bytes to write.
+ * @return SERVER_SUCCESS or SERVER_ERR_SOCKET.
+ */
+int writeFully(int fd, const void *buffer, size_t size);
+
+/**
+ * @brief Reads exactly size bytes from a descriptor, retrying on partial reads.
+ *
+ * @param fd Descriptor to read from.
+ * @param buffer Destination buffer.
+ * @param size Number of bytes to read.
+ * @return SERVER_SUCCESS, or SERVER_ERR_SOCKET on error or end of stream.
+ */
+int readFully(int fd, void *buffer, size_t size);
+
+#endif // SERVER_H
@@ -1,9 +1,11 @@
 #include "standardization.h"
+#include "profiler.h"
+#include "arena.h"
 #include <math.h>    // For mathematical operations such as sqrt.
 #include <stdlib.h>  // For dynamic memory allocation functions.
 
 // Calculates the mean and standard deviation for each feature across all ShapeData.
-static void calcMeanAndStd(ShapeData *data, int dataSize, int featureCount, double *mean, double *std) {
+void calcMeanAndStd(ShapeData *data, int dataSize, int featureCount, double *mean, double *std) {
     // Initialize mean and standard deviation arrays to zero.
     for (int i = 0; i < featureCount; i++) {
         mean[i] = 0;
@@ -37,9 +39,15 @@ static void calcMeanAndStd(ShapeData *data, int dataSize, int featureCount, doub
 
 // Standardizes the data to have a mean of 0 and standard deviation of 1.
 void standardizeData(ShapeData *data, int dataSize, int featureCount) {
-    // Allocate memory for mean and standard deviation arrays.
-    double *mean = (double *)malloc(featureCount * sizeof(double));
-    double *std = (double *)malloc(featureCount * sizeof(double));
+    // Take the mean and standard deviation arrays from the scratch arena.
+    Arena *scratch = scratchArena(PROFILE_PREPROCESS);
+    ArenaMark mark = arenaMark(scratch);
+    double *mean = arenaAlloc(scratch, 2 * featureCount * sizeof(double));
+    if (!mean) {
+        fprintf(stderr, "Memory allocation failed for standardization\n");
+        exit(EXIT_FAILURE);
+    }
+    double *std = mean + featureCount;
 
     // Calculate mean and standard deviation for each feature.
     calcMeanAndStd(data, dataSize, featureCount, mean, std);
@@ -53,7 +61,6 @@ void standardizeData(ShapeData *data, int dataSize, int featureCount) {
         }
     }
 
-    // Free the allocated memory for mean and standard deviation.
-    free(mean);
-    free(std);
+    // Release the mean and standard deviation arrays.
+    arenaReset(scratch, mark);
 }
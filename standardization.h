@@ -9,6 +9,17 @@
 
 #include "data_reader.h"  // Include to use the ShapeData structure
 
+/**
+ * @brief Calculates the mean and standard deviation of each feature across an array of ShapeData.
+ *
+ * @param data Pointer to the array of ShapeData.
+ * @param dataSize Total number of ShapeData items.
+ * @param featureCount Number of features in each ShapeData item.
+ * @param mean Array receiving the mean of each feature.
+ * @param std Array receiving the standard deviation of each feature.
+ */
+void calcMeanAndStd(ShapeData *data, int dataSize, int featureCount, double *mean, double *std);
+
 /**
  * @brief Standardizes the feature values in an array of ShapeData.
  *
@@ -0,0 +1,153 @@
+#include "thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * @struct QueuedTask
+ * @brief Task waiting in the queue of a pool.
+ */
+typedef struct QueuedTask {
+    ThreadPoolTask task;
+    void *arg;
+    struct QueuedTask *next;
+} QueuedTask;
+
+struct ThreadPool {
+    pthread_t *threads;         /**< Worker thread identifiers. */
+    int threadCount;            /**< Number of worker threads. */
+    pthread_mutex_t mutex;      /**< Protects the queue and the counters. */
+    pthread_cond_t taskReady;   /**< Signaled when a task is queued or the pool stops. */
+    pthread_cond_t allDone;     /**< Broadcast when no task is queued or running. */
+    QueuedTask *head;
+    QueuedTask *tail;
+    int pending;                /**< Tasks queued or running. */
+    int stopping;
+};
+
+// Worker loop: runs queued tasks until the pool stops and the queue is empty.
+static void *workerThread(void *args) {
+    ThreadPool *pool = args;
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        while (!pool->head && !pool->stopping) {
+            pthread_cond_wait(&pool->taskReady, &pool->mutex);
+        }
+        if (!pool->head) {
+            break;
+        }
+
+        QueuedTask *queued = pool->head;
+        pool->head = queued->next;
+        if (!pool->head) {
+            pool->tail = NULL;
+        }
+        pthread_mutex_unlock(&pool->mutex);
+
+        queued->task(queued->arg);
+        free(queued);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->pending == 0) {
+            pthread_cond_broadcast(&pool->allDone);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+// Creates a pool and starts its worker threads.
+ThreadPool *createThreadPool(int threadCount) {
+    if (threadCount <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = online > 0 ? (int)online : 1;
+    }
+
+    ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+    if (!pool) {
+        return NULL;
+    }
+    pool->threads = malloc(threadCount * sizeof(pthread_t));
+    if (!pool->threads) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->taskReady, NULL);
+    pthread_cond_init(&pool->allDone, NULL);
+
+    for (int i = 0; i < threadCount; i++) {
+        if (pthread_create(&pool->threads[i], NULL, workerThread, pool) != 0) {
+            break;
+        }
+        pool->threadCount++;
+    }
+    if (pool->threadCount == 0) {
+        destroyThreadPool(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+// Queues a task for execution by the next idle worker.
+int submitTask(ThreadPool *pool, ThreadPoolTask task, void *arg) {
+    QueuedTask *queued = malloc(sizeof(QueuedTask));
+    if (!queued) {
+        return POOL_ERR_MEMORY;
+    }
+    queued->task = task;
+    queued->arg = arg;
+    queued->next = NULL;
+
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->stopping) {
+        pthread_mutex_unlock(&pool->mutex);
+        free(queued);
+        return POOL_ERR_STOPPED;
+    }
+    if (pool->tail) {
+        pool->tail->next = queued;
+    } else {
+        pool->head = queued;
+    }
+    pool->tail = queued;
+    pool->pending++;
+    pthread_cond_signal(&pool->taskReady);
+    pthread_mutex_unlock(&pool->mutex);
+    return POOL_SUCCESS;
+}
+
+// Blocks until every submitted task has completed.
+void waitThreadPool(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->pending > 0) {
+        pthread_cond_wait(&pool->allDone, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+// Returns the number of worker threads of a pool.
+int threadPoolSize(const ThreadPool *pool) {
+    return pool->threadCount;
+}
+
+// Waits for the queued tasks, stops the workers and frees the pool.
+void destroyThreadPool(ThreadPool *pool) {
+    if (!pool) {
+        return;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->taskReady);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int i = 0; i < pool->threadCount; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->taskReady);
+    pthread_cond_destroy(&pool->allDone);
+    free(pool->threads);
+    free(pool);
+}
@@ -0,0 +1,68 @@
+/**
+ * @file thread_pool.h
+ * @brief Header file for a persistent pool of worker threads executing queued tasks.
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+
+// Error codes
+#define POOL_SUCCESS 0
+#define POOL_ERR_MEMORY -1
+#define POOL_ERR_STOPPED -2
+
+/**
+ * Function executed by a worker thread.
+ * @param arg Argument given when the task was submitted.
+ */
+typedef void (*ThreadPoolTask)(void *arg);
+
+/**
+ * @struct ThreadPool
+ * @brief Opaque pool of worker threads sharing a FIFO task queue.
+ */
+typedef struct ThreadPool ThreadPool;
+
+/**
+ * @brief Creates a pool and starts its worker threads.
+ *
+ * @param threadCount Number of worker threads, 0 for the number of online processors.
+ * @return Pointer to the pool, or NULL on allocation failure.
+ */
+ThreadPool *createThreadPool(int threadCount);
+
+/**
+ * @brief Queues a task for execution by the next idle worker.
+ *
+ * @param pool Pointer to the pool.
+ * @param task Function to execute.
+ * @param arg Argument passed to the function.
+ * @return POOL_SUCCESS, POOL_ERR_MEMORY or POOL_ERR_STOPPED.
+ */
+int submitTask(ThreadPool *pool, ThreadPoolTask task, void *arg);
+
+/**
+ * @brief Blocks until every submitted task has completed.
+ *
+ * @param pool Pointer to the pool.
+ */
+void waitThreadPool(ThreadPool *pool);
+
+/**
+ * @brief Returns the number of worker threads of a pool.
+ *
+ * @param pool Pointer to the pool.
+ * @return Number of worker threads.
+ */
+int threadPoolSize(const ThreadPool *pool);
+
+/**
+ * @brief Waits for the queued tasks, stops the workers and frees the pool.
+ *
+ * @param pool Pointer to the pool to be destroyed.
+ */
+void destroyThreadPool(ThreadPool *pool);
+
+#endif // THREAD_POOL_H